@@ -8,8 +8,8 @@ df = pd.read_csv('benchmark.csv')
 df = df.drop(columns=['error_occurred', 'error_message'])
 df = df.dropna(subset=['cpu_time'])
 
-# Extract the benchmark name for plotting
-df['benchmark'] = df['name'].str.split('/').str[-1]
+# Extract the benchmark name for plotting (strip fixture prefix and timing suffix)
+df['benchmark'] = df['name'].str.split('/', n=1).str[-1].str.replace('/real_time', '', regex=False)
 
 # Set the figure size
 plt.figure(figsize=(10, 6))
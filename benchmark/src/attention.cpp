@@ -0,0 +1,75 @@
+// Copyright Mario "Neo" Sieg 2024. All rights reserved. mario.sieg.64@gmail.com
+// Long sequence attention: fused tiled kernel vs. matmul + softmax + matmul which materializes the seq x seq score matrix
+
+#include <attention.hpp>
+
+#include "fixture.hpp"
+
+static constexpr dim k_head_dim {64};
+
+static auto attention_args(benchmark::internal::Benchmark* const b) -> void {
+    b->ArgNames({"seq", "causal"});
+    for (const std::int64_t seq : {256, 512, 1024, 2048})
+        for (const std::int64_t causal : {0, 1})
+            b->Args({seq, causal});
+}
+
+static auto unfused_args(benchmark::internal::Benchmark* const b) -> void {
+    b->ArgNames({"seq"});
+    for (const std::int64_t seq : {256, 512, 1024, 2048})
+        b->Args({seq});
+}
+
+// Reports the pool memory used by all tensors including the operands and the attention FLOPs (QK^T and PV)
+static auto report_attention(benchmark::State& state, const isolate& ctx, const dim seq, const bool causal) -> void {
+    const double flops {4.0 * static_cast<double>(seq*seq*k_head_dim) * (causal ? 0.5 : 1.0)};
+    state.counters["GFLOP/s"] = benchmark::Counter{flops*1e-9, benchmark::Counter::kIsIterationInvariantRate};
+    state.counters["pool_MiB"] = static_cast<double>(ctx.pool().bytes_allocated()) / static_cast<double>(1_mib);
+}
+
+static auto attention_fused(benchmark::State& state) -> void {
+    const dim seq {state.range(0)};
+    const bool causal {state.range(1) != 0};
+    auto ctx {isolate::create("bench", isolate::compute_device::cpu, 4*seq*k_head_dim*sizeof(float) + 64_kib)};
+    thread_pool threads {};
+    tensor<>* const q {ctx->new_tensor<float>({k_head_dim, seq})};
+    tensor<>* const k {ctx->new_tensor<float>({k_head_dim, seq})};
+    tensor<>* const v {ctx->new_tensor<float>({k_head_dim, seq})};
+    tensor<>* const r {ctx->new_tensor<float>({k_head_dim, seq})};
+    q->splat(0.01f);
+    k->splat(0.02f);
+    v->splat(1.0f);
+    const blas::attention_params params {.scale=0.125f, .causal=causal};
+    for (auto _ : state) {
+        threads.parallel_for([&](const blas::compute_ctx& cctx) {
+            blas::attention(cctx, *r, *q, *k, *v, params);
+        });
+    }
+    report_attention(state, *ctx, seq, causal);
+    const blas::attention_tiles tiles {blas::attention_tile_size(k_head_dim)};
+    state.SetLabel(fmt::format("tile {}x{}", tiles.q_rows, tiles.kv_rows));
+}
+BENCHMARK(attention_fused)->Apply(attention_args)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+// S = Q K^T, P = softmax(S), O = P V with the graph kernels, K is stored transposed for the first matmul
+static auto attention_unfused(benchmark::State& state) -> void {
+    const dim seq {state.range(0)};
+    auto ctx {isolate::create("bench", isolate::compute_device::cpu, (4*seq*k_head_dim + 2*seq*seq)*sizeof(float) + 64_kib)};
+    thread_pool threads {};
+    tensor<>* const q {ctx->new_tensor<float>({k_head_dim, seq})};
+    tensor<>* const kt {ctx->new_tensor<float>({seq, k_head_dim})};
+    tensor<>* const v {ctx->new_tensor<float>({k_head_dim, seq})};
+    tensor<>* const s {ctx->new_tensor<float>({seq, seq})};
+    tensor<>* const p {ctx->new_tensor<float>({seq, seq})};
+    tensor<>* const r {ctx->new_tensor<float>({k_head_dim, seq})};
+    q->splat(0.01f);
+    kt->splat(0.02f);
+    v->splat(1.0f);
+    for (auto _ : state) {
+        threads.parallel_for([&](const blas::compute_ctx& cctx) { blas::matmul(cctx, *s, *q, *kt); });
+        threads.parallel_for([&](const blas::compute_ctx& cctx) { blas::softmax(cctx, *p, *s); });
+        threads.parallel_for([&](const blas::compute_ctx& cctx) { blas::matmul(cctx, *r, *p, *v); });
+    }
+    report_attention(state, *ctx, seq, false);
+}
+BENCHMARK(attention_unfused)->Apply(unfused_args)->UseRealTime()->Unit(benchmark::kMillisecond);
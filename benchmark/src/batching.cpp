@@ -0,0 +1,103 @@
+// Copyright Mario "Neo" Sieg 2024. All rights reserved. mario.sieg.64@gmail.com
+// Load generator for the dynamic batching scheduler: closed loop clients issue single sample requests to a shared MLP
+// max_batch = 1 disables batching and is the baseline, larger batches trade queue time for fewer and wider graph runs
+// Reports latency percentiles and throughput plus the mean queue time, compute time and batch size per request
+
+#include <barrier>
+#include <chrono>
+#include <random>
+#include <thread>
+
+#include <batch_scheduler.hpp>
+
+#include "fixture.hpp"
+
+static constexpr dim k_batch_in {256};
+static constexpr dim k_batch_hidden {512};
+static constexpr dim k_batch_out {64};
+static constexpr std::size_t k_batch_requests_per_round {8}; // Requests per client per iteration
+
+// 3 layer MLP with GeLU, x = [in, batch], W = [out, in]
+static auto build_batch_mlp(isolate& ctx, const dim batch) -> batch_graph {
+    std::mt19937 prng {static_cast<std::mt19937::result_type>(batch)};
+    batch_graph g {};
+    g.input = ctx.new_tensor<float>({k_batch_in, batch});
+    tensor<>* x {g.input};
+    for (const dim out : {k_batch_hidden, k_batch_hidden, k_batch_out}) {
+        tensor<>* const w {ctx.new_tensor<float>({out, x->dims()[0]})};
+        tensor<>* const b {ctx.new_tensor<float>({out, 1})};
+        std::normal_distribution<float> dist {0.0f, 1.0f / std::sqrt(static_cast<float>(x->dims()[0]))};
+        for (float& v : w->data()) v = dist(prng);
+        b->splat(0.01f);
+        tensor<>* const mm {ctx.new_tensor<float>({out, batch})};
+        tensor<>* const add {ctx.new_tensor<float>({out, batch})};
+        tensor<>* const act {ctx.new_tensor<float>({out, batch})};
+        (void)g.exec.push({graph::opcode::matmul, mm, x, w});
+        (void)g.exec.push({graph::opcode::add, add, mm, b});
+        (void)g.exec.push({graph::opcode::gelu, act, add, nullptr});
+        x = act;
+    }
+    g.output = x;
+    return g;
+}
+
+static auto batching_args(benchmark::internal::Benchmark* const b) -> void {
+    b->ArgNames({"max_batch", "clients", "max_wait_us"});
+    for (const std::int64_t max_batch : {1, 8, 32})
+        for (const std::int64_t clients : {4, 16, 64})
+            b->Args({max_batch, clients, 200});
+    b->Args({32, 64, 1000}); // Wider latency window
+}
+
+static auto batching_load(benchmark::State& st) -> void {
+    const batch_config cfg {
+        .max_batch=st.range(0),
+        .max_wait=std::chrono::microseconds{st.range(2)},
+        .num_threads=static_cast<dim>(std::thread::hardware_concurrency())
+    };
+    const auto clients {static_cast<std::size_t>(st.range(1))};
+    std::shared_ptr<isolate> ctx {isolate::create("batching", isolate::compute_device::cpu, 64_mib)};
+    batch_scheduler sched {ctx, &build_batch_mlp, cfg};
+    std::vector<std::vector<double>> latencies (clients);
+    std::vector<std::chrono::nanoseconds> queue_times (clients);
+    std::barrier sync {static_cast<std::ptrdiff_t>(clients+1)};
+    std::atomic_bool stop {};
+    std::vector<std::thread> workers {};
+    for (std::size_t i {}; i < clients; ++i) {
+        workers.emplace_back([&, i] {
+            std::vector<float> x (sched.sample_input_size(), 0.5f);
+            std::vector<float> y (sched.sample_output_size());
+            for (;;) {
+                sync.arrive_and_wait(); // Round start
+                if (stop.load(std::memory_order_relaxed)) return;
+                for (std::size_t r {}; r < k_batch_requests_per_round; ++r) {
+                    const auto t0 {std::chrono::steady_clock::now()};
+                    const request_timing t {sched.run(x, y)};
+                    latencies[i].emplace_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count());
+                    queue_times[i] += t.queue_time;
+                }
+                sync.arrive_and_wait(); // Round end
+            }
+        });
+    }
+    sched.reset_stats();
+    for (auto _ : st) {
+        sync.arrive_and_wait();
+        sync.arrive_and_wait();
+    }
+    stop.store(true, std::memory_order_relaxed);
+    sync.arrive_and_wait();
+    for (std::thread& worker : workers)
+        worker.join();
+    std::vector<double> merged {};
+    for (const std::vector<double>& l : latencies)
+        merged.insert(merged.end(), l.cbegin(), l.cend());
+    report_latency(st, merged, static_cast<double>(clients*k_batch_requests_per_round));
+    const batch_stats stats {sched.stats()};
+    if (stats.requests) {
+        st.counters["queue_us"] = std::chrono::duration<double, std::micro>(stats.queue_time).count() / static_cast<double>(stats.requests);
+        st.counters["compute_us"] = std::chrono::duration<double, std::micro>(stats.compute_time).count() / static_cast<double>(stats.batches); // Per graph run
+        st.counters["batch"] = stats.mean_batch_size();
+    }
+}
+BENCHMARK(batching_load)->Apply(batching_args)->UseRealTime();
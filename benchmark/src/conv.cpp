@@ -0,0 +1,87 @@
+// Copyright Mario "Neo" Sieg 2024. All rights reserved. mario.sieg.64@gmail.com
+// Convolution layers of typical ResNet and Conformer shapes, direct vs. implicit GEMM vs. the heuristic choice of the graph ops
+
+#include <conv.hpp>
+
+#include "fixture.hpp"
+
+struct conv_layer final {
+    const char* name;
+    dim spatial_dims;
+    std::array<dim, 4> x;   // Input shape
+    std::array<dim, 4> w;   // Weight shape
+    blas::conv_params params;
+};
+
+static const std::array k_conv_layers {
+    // ResNet-50 on 224x224 (batch 1)
+    conv_layer{"resnet_stem_7x7s2", 2, {3, 224, 224, 1}, {64, 3, 7, 7}, {.stride={2, 2}, .padding={3, 3}}},
+    conv_layer{"resnet_c2_3x3", 2, {64, 56, 56, 1}, {64, 64, 3, 3}, {.padding={1, 1}}},
+    conv_layer{"resnet_c2_1x1_expand", 2, {64, 56, 56, 1}, {256, 64, 1, 1}, {}},
+    conv_layer{"resnet_c3_3x3s2", 2, {128, 56, 56, 1}, {128, 128, 3, 3}, {.stride={2, 2}, .padding={1, 1}}},
+    conv_layer{"resnet_c4_3x3", 2, {256, 14, 14, 1}, {256, 256, 3, 3}, {.padding={1, 1}}},
+    conv_layer{"resnet_c5_1x1_reduce", 2, {2048, 7, 7, 1}, {512, 2048, 1, 1}, {}},
+    // Conformer conv module (d_model 256, 10 s of audio after 4x subsampling = 250 frames)
+    conv_layer{"conformer_pointwise_1x1", 1, {256, 250, 1, 1}, {512, 256, 1, 1}, {}},
+    conv_layer{"conformer_depthwise_k31", 1, {256, 250, 1, 1}, {256, 1, 31, 1}, {.padding={15, 0}, .groups=256}},
+    conv_layer{"conformer_subsampling_3x3s2", 2, {1, 80, 1000, 1}, {256, 1, 3, 3}, {.stride={2, 2}}},
+};
+
+static auto conv_args(benchmark::internal::Benchmark* const b) -> void {
+    b->ArgNames({"layer", "algo"}); // algo: 0 = direct, 1 = gemm, 2 = heuristic (graph op)
+    for (std::int64_t layer {}; layer < static_cast<std::int64_t>(k_conv_layers.size()); ++layer)
+        for (const std::int64_t algo : {0, 1, 2})
+            b->Args({layer, algo});
+}
+
+static auto conv_layer_bench(benchmark::State& state) -> void {
+    const conv_layer& layer {k_conv_layers[static_cast<std::size_t>(state.range(0))]};
+    auto ctx {isolate::create("bench", isolate::compute_device::cpu, 64_mib)};
+    thread_pool threads {};
+    tensor<>* const x {ctx->new_tensor<float>(layer.x)};
+    tensor<>* const w {ctx->new_tensor<float>(layer.w)};
+    tensor<>* const r {ctx->new_tensor<float>(blas::conv_output_shape(layer.spatial_dims, *x, *w, layer.params))};
+    x->splat(0.5f);
+    w->splat(0.01f);
+    const blas::conv_algorithm algo {
+        state.range(1) == 2
+            ? blas::conv_select_algorithm(layer.spatial_dims, *x, *w, layer.params)
+            : static_cast<blas::conv_algorithm>(state.range(1))
+    };
+    for (auto _ : state) {
+        threads.parallel_for([&](const blas::compute_ctx& cctx) {
+            blas::conv(cctx, layer.spatial_dims, *r, *x, *w, layer.params, algo);
+        });
+    }
+    const double flops {2.0 * static_cast<double>(r->elem_count() * layer.w[1]*layer.w[2]*layer.w[3])};
+    state.counters["GFLOP/s"] = benchmark::Counter{flops*1e-9, benchmark::Counter::kIsIterationInvariantRate};
+    state.SetLabel(fmt::format("{} ({})", layer.name, algo == blas::conv_algorithm::gemm ? "gemm" : "direct"));
+}
+BENCHMARK(conv_layer_bench)->Apply(conv_args)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+// Real time audio: Conformer depthwise k31 conv on 10 ms frames, per chunk cost of the streaming conv1d (mode 0)
+// vs. recomputing the offline conv over the full 250 frame window every time a chunk arrives (mode 1)
+static auto conv1d_stream_bench(benchmark::State& state) -> void {
+    static constexpr dim k_channels {256};
+    static constexpr dim k_window {250};
+    const dim chunk {state.range(0)};
+    const bool recompute {state.range(1) != 0};
+    auto ctx {isolate::create("bench", isolate::compute_device::cpu, 64_mib)};
+    thread_pool threads {};
+    const blas::conv_params params {.groups=k_channels};
+    tensor<>* const w {ctx->new_tensor<float>({k_channels, 1, 31})};
+    w->splat(0.01f);
+    blas::conv1d_stream stream {*ctx, *w, k_channels, 1, params};
+    tensor<>* const x {ctx->new_tensor<float>({k_channels, recompute ? stream.context() + k_window : chunk})};
+    tensor<>* const r {ctx->new_tensor<float>({k_channels, recompute ? k_window : chunk})};
+    x->splat(0.5f);
+    for (auto _ : state) {
+        threads.parallel_for([&](const blas::compute_ctx& cctx) {
+            if (recompute) blas::conv(cctx, 1, *r, *x, *w, params, blas::conv_algorithm::direct);
+            else stream.process(cctx, *r, *x);
+        });
+    }
+    state.counters["frames/s"] = benchmark::Counter{static_cast<double>(chunk), benchmark::Counter::kIsIterationInvariantRate};
+    state.SetLabel(recompute ? "recompute window" : "stream");
+}
+BENCHMARK(conv1d_stream_bench)->ArgNames({"chunk", "recompute"})->ArgsProduct({{1, 4, 16}, {0, 1}})->UseRealTime()->Unit(benchmark::kMicrosecond);
@@ -2,41 +2,203 @@
 
 #pragma once
 
+#include <algorithm>
+#include <vector>
+
 #include <benchmark/benchmark.h>
 
 #include <isolate.hpp>
 #include <tensor.hpp>
 #include <blas.hpp>
+#include <graph.hpp>
+#include <perf_counters.hpp>
+#include <profiler.hpp>
+#include <thread_pool.hpp>
+
+#include "roofline.hpp"
 
 using namespace rtml;
 
+// Operand layout of the second (Y) operand of binary ops
+enum class operand_layout : std::int64_t {
+    contiguous, // Y has the same shape and a dense layout - dense kernel
+    broadcast,  // Y is a single row which is repeated over all rows of X - dense kernel
+    strided,    // Y is a transposed view with non unit innermost stride - sparse kernel
+    $count
+};
+
+static constexpr std::array<const char*, static_cast<std::size_t>(operand_layout::$count)> k_operand_layout_names {
+    "contiguous",
+    "broadcast",
+    "strided"
+};
+
+// Element count exponents (per tensor) from L1 resident to DRAM resident working sets (3 tensors)
+static constexpr std::array<std::int64_t, 5> k_elem_exponents {
+    10, // 3 * 4 KiB
+    14, // 3 * 64 KiB
+    18, // 3 * 1 MiB
+    22, // 3 * 16 MiB
+    24  // 3 * 64 MiB
+};
+
+[[nodiscard]] inline auto bench_thread_counts() -> std::vector<std::int64_t> {
+    std::vector<std::int64_t> counts {};
+    const auto max {std::max<std::int64_t>(1, std::thread::hardware_concurrency())};
+    for (std::int64_t i {1}; i < max; i <<= 1)
+        counts.emplace_back(i);
+    counts.emplace_back(max);
+    return counts;
+}
+
+// Reports per request latency percentiles (sorts latencies_us) and the request throughput
+inline auto report_latency(benchmark::State& state, std::vector<double>& latencies_us, const double requests_per_iter) -> void {
+    if (latencies_us.empty()) return;
+    std::ranges::sort(latencies_us);
+    const auto percentile {[&](const double p) -> double {
+        const auto i {static_cast<std::size_t>(p * static_cast<double>(latencies_us.size()-1) + 0.5)};
+        return latencies_us[i];
+    }};
+    state.counters["p50_us"] = percentile(0.5);
+    state.counters["p90_us"] = percentile(0.9);
+    state.counters["p99_us"] = percentile(0.99);
+    state.counters["max_us"] = latencies_us.back();
+    state.counters["req/s"] = benchmark::Counter{requests_per_iter, benchmark::Counter::kIsIterationInvariantRate};
+}
+
+inline constinit bool g_perf_counters {}; // Set by --rtml_perf_counters
+
+// Hardware counters per iteration (cycles, instructions, cache, dTLB and branch misses) and IPC, enabled with --rtml_perf_counters
+// Must be constructed before the thread pool is spawned, because the inherited counters only include threads spawned afterwards
+class iteration_counters final {
+public:
+    iteration_counters() : m_group{g_perf_counters ? std::make_unique<perf::counter_group>(true) : nullptr} {}
+
+    auto start() -> void {
+        if (m_group) m_begin = m_group->read();
+    }
+
+    auto stop(benchmark::State& state) -> void {
+        if (!m_group || !m_group->is_valid()) return;
+        const perf::counter_values end {m_group->read()};
+        perf::counter_values delta {};
+        for (std::size_t i {}; i < perf::k_num_counters; ++i) {
+            if (!m_group->is_available(static_cast<perf::counter>(i))) continue;
+            delta[i] = end[i] - m_begin[i];
+            state.counters[perf::k_counter_names[i]] = benchmark::Counter{static_cast<double>(delta[i]), benchmark::Counter::kAvgIterations};
+        }
+        const std::uint64_t cycles {delta[static_cast<std::size_t>(perf::counter::cycles)]};
+        if (cycles && m_group->is_available(perf::counter::instructions))
+            state.counters["IPC"] = static_cast<double>(delta[static_cast<std::size_t>(perf::counter::instructions)]) / static_cast<double>(cycles);
+    }
+
+private:
+    std::unique_ptr<perf::counter_group> m_group {};
+    perf::counter_values m_begin {};
+};
+
+// Benchmark fixture parametrized over: state.range(0) = element count exponent, state.range(1) = thread count, state.range(2) = operand layout
 class rtml_fixture : public benchmark::Fixture {
 public:
-    static constexpr dim k_shape {64};
-    static constexpr std::array<dim, tensor<>::k_max_dims> k_shapes {
-        k_shape,
-        k_shape>>1,
-        k_shape,
-        k_shape>>1
-    };
     std::shared_ptr<isolate> ctx {};
+    std::unique_ptr<thread_pool> threads {};
     tensor<>* a {};
     tensor<>* b {};
     tensor<>* c {};
-    blas::compute_ctx cctx {};
+    operand_layout layout {};
+    std::unique_ptr<iteration_counters> counters {};
 
     auto SetUp(benchmark::State& state) -> void override {
         constexpr float x {1.0f};
         constexpr float y {2.0f};
-        ctx = isolate::create("test", isolate::compute_device::cpu, 4_gib);
-        a = ctx->new_tensor<float>(k_shapes);
-        b = ctx->new_tensor<float>(k_shapes);
-        c = ctx->new_tensor<float>(k_shapes);
+        const std::int64_t exp {state.range(0)};
+        const dim side {static_cast<dim>(1) << std::min<std::int64_t>(exp/2, 8)}; // Square planes for the transposed (strided) view
+        const std::array<dim, tensor<>::k_max_dims> shape {side, side, (static_cast<dim>(1)<<exp)/(side*side), 1};
+        layout = static_cast<operand_layout>(state.range(2));
+        const std::size_t bytes {(std::size_t{3} << exp)*sizeof(float)};
+        ctx = isolate::create("bench", isolate::compute_device::cpu, bytes + 64_kib);
+        counters = std::make_unique<iteration_counters>();
+        threads = std::make_unique<thread_pool>(state.range(1));
+        a = ctx->new_tensor<float>(shape);
+        switch (layout) {
+            case operand_layout::contiguous: b = ctx->new_tensor<float>(shape); break;
+            case operand_layout::broadcast: b = ctx->new_tensor<float>({shape[0]}); break;
+            case operand_layout::strided: b = ctx->new_tensor<float>(shape)->transposed_clone(); break;
+            default: std::abort();
+        }
+        c = ctx->new_tensor<float>(shape);
         a->splat(x);
-        b->splat(y);
+        b->slice_base() ? b->slice_base()->splat(y) : b->splat(y);
+        c->splat_zero();
+        const machine_roofline::level lvl {machine_roofs().classify(3*a->size(), threads->num_threads())};
+        state.SetLabel(fmt::format("{}/{}", k_operand_layout_names[static_cast<std::size_t>(layout)], machine_roofline::k_level_names[lvl]));
+        counters->start();
+    }
+
+    auto TearDown(benchmark::State& state) -> void override {
+        counters->stop(state);
+        threads.reset();
+        counters.reset();
+        ctx.reset();
+    }
+
+    // Report GFLOP/s, GB/s and roofline efficiency of one op invocation per iteration
+    static auto report_throughput(
+        benchmark::State& state,
+        const graph::opcode op,
+        const tensor<>& r,
+        const tensor<>& x,
+        const tensor<>& y,
+        const dim threads
+    ) -> void {
+        report_throughput(state, op, r, x, &y, threads);
+    }
+
+    // Report GFLOP/s, GB/s and roofline efficiency of one op invocation per iteration, y is nullptr for unary ops
+    static auto report_throughput(
+        benchmark::State& state,
+        const graph::opcode op,
+        const tensor<>& r,
+        const tensor<>& x,
+        const tensor<>* const y,
+        const dim threads
+    ) -> void {
+        const auto flops {static_cast<double>(profiler::op_flops(op, r, x, y))};
+        const auto bytes {static_cast<double>(profiler::op_bytes(op, r, x, y))};
+        state.counters["GFLOP/s"] = benchmark::Counter{flops*1e-9, benchmark::Counter::kIsIterationInvariantRate};
+        state.counters["GB/s"] = benchmark::Counter{bytes*1e-9, benchmark::Counter::kIsIterationInvariantRate};
+        report_roof_efficiency(state, flops, bytes, threads);
+    }
+};
+
+// Square matrix multiplication fixture: state.range(0) = matrix side, state.range(1) = thread count
+class rtml_matmul_fixture : public benchmark::Fixture {
+public:
+    std::shared_ptr<isolate> ctx {};
+    std::unique_ptr<thread_pool> threads {};
+    tensor<>* a {};
+    tensor<>* b {};
+    tensor<>* c {};
+    std::unique_ptr<iteration_counters> counters {};
+
+    auto SetUp(benchmark::State& state) -> void override {
+        const dim n {state.range(0)};
+        ctx = isolate::create("bench", isolate::compute_device::cpu, 3*n*n*sizeof(float) + 64_kib);
+        counters = std::make_unique<iteration_counters>();
+        threads = std::make_unique<thread_pool>(state.range(1));
+        a = ctx->new_tensor<float>({n, n});
+        b = ctx->new_tensor<float>({n, n});
+        c = ctx->new_tensor<float>({n, n});
+        a->splat(1.0f);
+        b->splat(2.0f);
         c->splat_zero();
+        counters->start();
     }
 
     auto TearDown(benchmark::State& state) -> void override {
+        counters->stop(state);
+        threads.reset();
+        counters.reset();
+        ctx.reset();
     }
 };
@@ -1,6 +1,10 @@
+#include <algorithm>
+#include <cstring>
+
 #include <benchmark/benchmark.h>
 
 #include "blas.hpp"
+#include "fixture.hpp"
 #include "isolate.hpp"
 
 auto main(int argc, char** argv) -> int {
@@ -8,6 +12,9 @@ auto main(int argc, char** argv) -> int {
     char* args_default = arg0_default;
     if (!argv) { argc = 1; argv = &args_default; }
     if (!rtml::isolate::init_rtml_runtime()) return 1;
+    const auto end {std::remove_if(argv+1, argv+argc, [](const char* const arg) { return std::strcmp(arg, "--rtml_perf_counters") == 0; })};
+    g_perf_counters = end != argv+argc; // Hardware counters per benchmark iteration, see iteration_counters
+    argc = static_cast<int>(end - argv);
     benchmark::Initialize(&argc, argv);
     if (benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
     benchmark::RunSpecifiedBenchmarks();
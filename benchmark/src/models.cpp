@@ -0,0 +1,247 @@
+// Copyright Mario "Neo" Sieg 2024. All rights reserved. mario.sieg.64@gmail.com
+// End-to-end model benchmarks: small reference networks (MLP, transformer decoder block, CNN) built from isolate tensors and blas ops
+// Every model is a flat list of ops, each op is dispatched on the thread pool and waited for before the next one starts
+// Reports per request latency percentiles (p50/p90/p99/max) and throughput, for single and concurrent requests
+
+#include <barrier>
+#include <chrono>
+#include <functional>
+#include <random>
+#include <thread>
+
+#include <conv.hpp>
+
+#include "fixture.hpp"
+
+using request_clock = std::chrono::steady_clock;
+
+enum class model_kind : std::int64_t {
+    mlp,            // 4 layer MLP, width 512, ReLU
+    transformer,    // Single transformer decoder block, 32 tokens, 128 model dim, 4 heads, FFN 512, GeLU
+    cnn,            // 3 conv2d layers on a 32x32x3 image, dense classifier
+    $count
+};
+
+static constexpr std::array<const char*, static_cast<std::size_t>(model_kind::$count)> k_model_names {
+    "mlp",
+    "transformer",
+    "cnn"
+};
+
+static constexpr std::size_t k_model_pool_size {16_mib};
+static constexpr std::size_t k_requests_per_round {8}; // Requests per client per iteration in concurrent mode
+
+class model {
+public:
+    using op_function = std::function<void (const blas::compute_ctx&)>;
+    using unary_op = auto (const blas::compute_ctx&, tensor<>&, const tensor<>&) noexcept -> void;
+    using binary_op = auto (const blas::compute_ctx&, tensor<>&, const tensor<>&, const tensor<>&) noexcept -> void;
+
+    explicit model(const model_kind kind) : m_ctx{isolate::create(k_model_names[static_cast<std::size_t>(kind)], isolate::compute_device::cpu, k_model_pool_size)} {
+        switch (kind) {
+            case model_kind::mlp: build_mlp(); break;
+            case model_kind::transformer: build_transformer(); break;
+            case model_kind::cnn: build_cnn(); break;
+            default: std::abort();
+        }
+    }
+    model(const model&) = delete;
+    model(model&&) = delete;
+    auto operator=(const model&) -> model& = delete;
+    auto operator=(model&&) -> model& = delete;
+    ~model() = default;
+
+    auto run(thread_pool& pool) -> void { // Runs one request (forward pass)
+        for (op_function& op : m_ops)
+            pool.parallel_for(op);
+    }
+
+    [[nodiscard]] auto output() const noexcept -> const tensor<>& { return *m_output; }
+
+private:
+    auto weight(const std::initializer_list<const dim> dims, const float scale = 1.0f) -> tensor<>* { // Random uniform (Xavier like) init
+        tensor<>* const w {m_ctx->new_tensor<float>(dims)};
+        const float limit {scale / std::sqrt(static_cast<float>(*(dims.end()-1)))}; // Last dim is the fan in of weight matrices
+        std::uniform_real_distribution<float> dist {-limit, limit};
+        for (float& v : w->data())
+            v = dist(m_rng);
+        return w;
+    }
+
+    auto unary(unary_op* const op, tensor<>* const x) -> tensor<>* {
+        tensor<>* const r {x->isomorphic_clone()};
+        m_ops.emplace_back([=](const blas::compute_ctx& ctx) { (*op)(ctx, *r, *x); });
+        return r;
+    }
+
+    auto binary(binary_op* const op, tensor<>* const x, tensor<>* const y) -> tensor<>* {
+        tensor<>* const r {x->isomorphic_clone()};
+        m_ops.emplace_back([=](const blas::compute_ctx& ctx) { (*op)(ctx, *r, *x, *y); });
+        return r;
+    }
+
+    auto matmul(tensor<>* const x, tensor<>* const y) -> tensor<>* { // X = [K, M], Y = [N, K] -> R = [N, M]
+        tensor<>* const r {m_ctx->new_tensor<float>({y->dims()[0], x->dims()[1]})};
+        m_ops.emplace_back([=](const blas::compute_ctx& ctx) { blas::matmul(ctx, *r, *x, *y); });
+        return r;
+    }
+
+    auto linear(tensor<>* const x, const dim out, const float scale = 1.0f) -> tensor<>* { // x @ W + b, b is broadcasted over all rows
+        tensor<>* const w {weight({out, x->dims()[0]}, scale)};
+        tensor<>* const b {weight({out}, 0.1f)};
+        return binary(&blas::add, matmul(x, w), b);
+    }
+
+    auto build_mlp() -> void {
+        static constexpr dim k_width {512};
+        static constexpr dim k_layers {4};
+        tensor<>* x {weight({k_width, 1})};
+        for (dim i {}; i < k_layers; ++i) {
+            x = linear(x, k_width);
+            if (i < k_layers-1)
+                x = unary(&blas::relu, x);
+        }
+        m_output = x;
+    }
+
+    // Decoder block without normalization (no normalization ops yet):
+    // h = x + attn(x), y = h + ffn(h), attention is causal and multi head
+    // Each head has its own projections, so all per head tensors are dense and the head outputs are summed by the output projection
+    auto build_transformer() -> void {
+        static constexpr dim k_seq {32};
+        static constexpr dim k_model {128};
+        static constexpr dim k_heads {4};
+        static constexpr dim k_head {k_model / k_heads};
+        static constexpr dim k_ffn {512};
+        tensor<>* const x {weight({k_model, k_seq})};
+        tensor<>* const mask {m_ctx->new_tensor<float>({k_seq, k_seq})};
+        for (dim i {}; i < k_seq; ++i) // Causal mask, query i sees keys 0..i
+            for (dim j {}; j < k_seq; ++j)
+                (*mask)({j, i, 0, 0}) = j > i ? -std::numeric_limits<float>::infinity() : 0.0f;
+        tensor<>* attn {};
+        for (dim h {}; h < k_heads; ++h) {
+            const float qk_scale {1.0f / std::sqrt(static_cast<float>(k_head))}; // Folded into the query projection
+            tensor<>* const q {linear(x, k_head, qk_scale)};    // [head, seq]
+            tensor<>* const k {linear(x, k_head)};              // [head, seq]
+            tensor<>* const v {linear(x, k_head)};              // [head, seq]
+            tensor<>* const scores {matmul(q, k->transposed_clone())}; // [seq, seq]
+            tensor<>* const probs {unary(&blas::softmax, binary(&blas::add, scores, mask))};
+            tensor<>* const ctx {matmul(probs, v)};             // [head, seq]
+            tensor<>* const proj {matmul(ctx, weight({k_model, k_head}))}; // [model, seq]
+            attn = attn ? binary(&blas::add, attn, proj) : proj;
+        }
+        tensor<>* const h {binary(&blas::add, x, attn)};
+        tensor<>* const ffn {linear(unary(&blas::gelu, linear(h, k_ffn)), k_model)};
+        m_output = binary(&blas::add, h, ffn);
+    }
+
+    // 2D convolution (padding kernel / 2, square kernel) + bias + ReLU
+    // Activations are channel innermost: [C, W, H]
+    auto conv2d(tensor<>* const x, const dim c_out, const dim kernel, const dim stride) -> tensor<>* {
+        const blas::conv_params params {.stride={stride, stride}, .padding={kernel/2, kernel/2}};
+        tensor<>* const w {weight({c_out, x->dims()[0], kernel, kernel})};
+        tensor<>* const b {weight({c_out}, 0.1f)};
+        tensor<>* const r {m_ctx->new_tensor<float>(blas::conv_output_shape(2, *x, *w, params))};
+        const blas::conv_algorithm algo {blas::conv_select_algorithm(2, *x, *w, params)};
+        m_ops.emplace_back([=](const blas::compute_ctx& ctx) { blas::conv(ctx, 2, *r, *x, *w, params, algo); });
+        return unary(&blas::relu, binary(&blas::add, r, b));
+    }
+
+    auto build_cnn() -> void {
+        static constexpr dim k_classes {10};
+        tensor<>* x {weight({3, 32, 32})};
+        x = conv2d(x, 16, 3, 1);    // [16, 32, 32]
+        x = conv2d(x, 32, 3, 2);    // [32, 16, 16]
+        x = conv2d(x, 64, 3, 2);    // [64, 8, 8]
+        tensor<>* const flat {m_ctx->new_tensor<float>({x->dims()[0]*x->dims()[1]*x->dims()[2], 1}, x)};
+        m_output = unary(&blas::softmax, linear(flat, k_classes));
+    }
+
+    std::shared_ptr<isolate> m_ctx;
+    std::mt19937 m_rng {0x12345};
+    std::vector<op_function> m_ops {};
+    tensor<>* m_output {};
+};
+
+// Reports latency percentiles in microseconds and throughput in requests per second
+static auto model_single_args(benchmark::internal::Benchmark* const b) -> void {
+    b->ArgNames({"model", "threads"});
+    for (std::int64_t kind {}; kind < static_cast<std::int64_t>(model_kind::$count); ++kind)
+        for (const std::int64_t threads : bench_thread_counts())
+            b->Args({kind, threads});
+}
+
+static auto model_concurrent_args(benchmark::internal::Benchmark* const b) -> void {
+    b->ArgNames({"model", "clients"});
+    const auto max {std::max<std::int64_t>(4, std::thread::hardware_concurrency())};
+    for (std::int64_t kind {}; kind < static_cast<std::int64_t>(model_kind::$count); ++kind)
+        for (std::int64_t clients {2}; clients <= max; clients <<= 1)
+            b->Args({kind, clients});
+}
+
+// Single request mode: one model instance uses all threads, one request per iteration
+static auto model_single(benchmark::State& st) -> void {
+    const auto kind {static_cast<model_kind>(st.range(0))};
+    iteration_counters counters {};
+    thread_pool pool {st.range(1)};
+    model net {kind};
+    std::vector<double> latencies {};
+    counters.start();
+    for (auto _ : st) {
+        const request_clock::time_point t0 {request_clock::now()};
+        net.run(pool);
+        latencies.emplace_back(std::chrono::duration<double, std::micro>(request_clock::now() - t0).count());
+    }
+    counters.stop(st);
+    benchmark::DoNotOptimize(net.output().data().data());
+    report_latency(st, latencies, 1.0);
+    st.SetLabel(k_model_names[static_cast<std::size_t>(kind)]);
+}
+BENCHMARK(model_single)->Apply(model_single_args)->UseRealTime();
+
+// Concurrent request mode: each client thread owns a model instance (own isolate) and a thread pool with an equal share of the hardware threads
+// Clients issue k_requests_per_round back to back requests per iteration, all clients start each round together
+static auto model_concurrent(benchmark::State& st) -> void {
+    const auto kind {static_cast<model_kind>(st.range(0))};
+    const auto clients {static_cast<std::size_t>(st.range(1))};
+    const dim threads_per_client {std::max<dim>(1, std::thread::hardware_concurrency() / static_cast<dim>(clients))};
+    std::vector<std::unique_ptr<model>> nets {};
+    std::vector<std::vector<double>> latencies (clients);
+    for (std::size_t i {}; i < clients; ++i)
+        nets.emplace_back(std::make_unique<model>(kind));
+    std::barrier sync {static_cast<std::ptrdiff_t>(clients+1)};
+    std::atomic_bool stop {};
+    iteration_counters counters {}; // Includes all clients and their thread pools
+    std::vector<std::thread> workers {};
+    for (std::size_t i {}; i < clients; ++i) {
+        workers.emplace_back([&, i] {
+            thread_pool pool {threads_per_client};
+            for (;;) {
+                sync.arrive_and_wait(); // Round start
+                if (stop.load(std::memory_order_relaxed)) return;
+                for (std::size_t r {}; r < k_requests_per_round; ++r) {
+                    const request_clock::time_point t0 {request_clock::now()};
+                    nets[i]->run(pool);
+                    latencies[i].emplace_back(std::chrono::duration<double, std::micro>(request_clock::now() - t0).count());
+                }
+                sync.arrive_and_wait(); // Round end
+            }
+        });
+    }
+    counters.start();
+    for (auto _ : st) {
+        sync.arrive_and_wait();
+        sync.arrive_and_wait();
+    }
+    counters.stop(st);
+    stop.store(true, std::memory_order_relaxed);
+    sync.arrive_and_wait();
+    for (std::thread& worker : workers)
+        worker.join();
+    std::vector<double> merged {};
+    for (const std::vector<double>& l : latencies)
+        merged.insert(merged.end(), l.cbegin(), l.cend());
+    report_latency(st, merged, static_cast<double>(clients*k_requests_per_round));
+    st.SetLabel(fmt::format("{}/{}x{}", k_model_names[static_cast<std::size_t>(kind)], clients, threads_per_client));
+}
+BENCHMARK(model_concurrent)->Apply(model_concurrent_args)->UseRealTime();
@@ -0,0 +1,56 @@
+// Copyright Mario "Neo" Sieg 2024. All rights reserved. mario.sieg.64@gmail.com
+// Run latency distribution of a small MLP graph with the plain executor on a default thread pool (mode 0)
+// vs. the realtime executor with pinned SCHED_FIFO threads (mode 1), deadline misses are counted against a 1 ms deadline
+
+#include <numeric>
+#include <optional>
+
+#include <executor.hpp>
+#include <realtime.hpp>
+
+#include "fixture.hpp"
+
+static auto realtime_run(benchmark::State& state) -> void {
+    static constexpr dim k_width {256};
+    static constexpr std::chrono::milliseconds k_deadline {1};
+    const bool realtime {state.range(0) != 0};
+    auto ctx {isolate::create("bench", isolate::compute_device::cpu, 16_mib)};
+    graph::executor g {};
+    tensor<>* x {ctx->new_tensor<float>({k_width, 16})};
+    x->splat(0.1f);
+    for (int layer {}; layer < 3; ++layer) {
+        tensor<>* const w {ctx->new_tensor<float>({k_width, k_width})};
+        tensor<>* const h {ctx->new_tensor<float>({k_width, 16})};
+        tensor<>* const a {ctx->new_tensor<float>({k_width, 16})};
+        w->splat(0.01f);
+        (void)g.push({.op=graph::opcode::matmul, .r=h, .x=x, .y=w});
+        (void)g.push({.op=graph::opcode::gelu, .r=a, .x=h});
+        x = a;
+    }
+    std::vector<int> cores(std::thread::hardware_concurrency());
+    std::iota(cores.begin(), cores.end(), 0);
+    std::optional<realtime_executor> rt {}; // Changes the policy of this thread, so only constructed in realtime mode
+    std::optional<thread_pool> pool {};
+    if (realtime) rt.emplace(realtime_config{.deadline=k_deadline, .cores=cores});
+    else pool.emplace();
+    std::vector<double> latencies {};
+    latencies.reserve(1<<20);
+    std::uint64_t misses {};
+    for (auto _ : state) {
+        if (realtime) {
+            const run_result res {rt->run(g)};
+            latencies.emplace_back(std::chrono::duration<double, std::micro>(res.latency).count());
+            misses += res.missed;
+        } else {
+            const auto t0 {std::chrono::steady_clock::now()};
+            g.run(*pool);
+            const auto latency {std::chrono::steady_clock::now() - t0};
+            latencies.emplace_back(std::chrono::duration<double, std::micro>(latency).count());
+            misses += latency > k_deadline;
+        }
+    }
+    report_latency(state, latencies, 1.0);
+    state.counters["misses"] = static_cast<double>(misses);
+    state.SetLabel(realtime ? fmt::format("realtime ({})", rt->scheduling() == thread_priority::realtime ? "SCHED_FIFO" : "fallback") : "default pool");
+}
+BENCHMARK(realtime_run)->ArgNames({"realtime"})->Arg(0)->Arg(1)->UseRealTime()->Unit(benchmark::kMicrosecond);
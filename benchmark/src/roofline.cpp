@@ -0,0 +1,170 @@
+// Copyright Mario "Neo" Sieg 2024. All rights reserved. mario.sieg.64@gmail.com
+// Machine peak calibration (FMA throughput and L1/L2/L3/DRAM bandwidth) for roofline efficiency reporting
+// The calibration kernels are built on the same vector kernels (blas::vec) as the runtime ops
+
+#include "roofline.hpp"
+
+#include <chrono>
+
+#include <blas_vec.hpp>
+
+static constexpr std::size_t k_fma_chains {128};        // Independent accumulators, enough to hide FMA latency on AVX-512
+static constexpr std::size_t k_fma_iters {1<<14};       // Iterations per kernel invocation
+static constexpr double k_calibration_seconds {0.05};   // Minimum measurement time per roof
+static constexpr std::size_t k_min_pass_bytes {4_mib};  // Small working sets are repeated to amortize the dispatch overhead
+
+auto machine_roofline::classify(const std::size_t working_set, const dim threads) const noexcept -> level {
+    if (working_set <= capacity[l1]*threads) return l1; // L1 and L2 are private per core
+    if (working_set <= capacity[l2]*threads) return l2;
+    if (working_set <= capacity[l3]) return l3;
+    return dram;
+}
+
+auto machine_roofline::peak_gflops(const dim threads) const noexcept -> double {
+    return threads >= max_threads ? peak_gflops_total : std::min(peak_gflops_core*static_cast<double>(threads), peak_gflops_total);
+}
+
+auto machine_roofline::bandwidth_gbs(const level lvl, const dim threads) const noexcept -> double {
+    if (threads <= 1) return gbs_core[lvl];
+    return std::min(gbs_core[lvl]*static_cast<double>(threads), gbs_total[lvl]);
+}
+
+auto machine_roofline::attainable_gflops(const double flops, const double bytes, const dim threads) const noexcept -> double {
+    const double intensity {bytes > 0.0 ? flops / bytes : 0.0}; // Arithmetic intensity in FLOP/byte
+    const level lvl {classify(static_cast<std::size_t>(bytes), threads)};
+    return std::min(peak_gflops(threads), intensity*bandwidth_gbs(lvl, threads));
+}
+
+auto level_capacity(const machine_roofline::level lvl) -> std::size_t {
+    std::array<std::size_t, machine_roofline::$count> sizes {32_kib, 1_mib, 32_mib, std::numeric_limits<std::size_t>::max()}; // Fallback if the CPU info is incomplete
+    for (const benchmark::CPUInfo::CacheInfo& cache : benchmark::CPUInfo::Get().caches) {
+        if (cache.type == "Instruction" || cache.level < 1 || cache.level > 3) continue;
+        sizes[cache.level-1] = static_cast<std::size_t>(cache.size);
+    }
+    return sizes[lvl];
+}
+
+auto level_working_set(const machine_roofline::level lvl) -> std::size_t {
+    switch (lvl) {
+        case machine_roofline::l1: return level_capacity(machine_roofline::l1) / 2;
+        case machine_roofline::l2: return level_capacity(machine_roofline::l2) / 2;
+        case machine_roofline::l3: return std::min(level_capacity(machine_roofline::l3) / 2, level_capacity(machine_roofline::l2) * 4); // Stay clear of the L3 capacity, some VMs report huge L3s
+        default: return std::clamp<std::size_t>(level_capacity(machine_roofline::l3) * 4, 256_mib, 1_gib);
+    }
+}
+
+auto run_peak_fma(thread_pool& pool) -> double {
+    pool.parallel_for([](const blas::compute_ctx&) {
+        std::array<float, k_fma_chains> acc {};
+        blas::vec::fma_chains<k_fma_chains, float>(k_fma_iters, acc.data(), 0.999999f, 1e-6f);
+        benchmark::DoNotOptimize(acc);
+    });
+    return 2.0 * static_cast<double>(k_fma_chains*k_fma_iters) * static_cast<double>(pool.num_threads());
+}
+
+stream_kernel::stream_kernel(thread_pool& pool, const std::size_t working_set_per_thread) : m_pool{pool} {
+    m_elems_per_thread = std::max<std::size_t>(working_set_per_thread / (3*sizeof(float)), 16) & ~std::size_t{15};
+    m_reps = std::max<std::size_t>(1, k_min_pass_bytes / (3*sizeof(float)*m_elems_per_thread));
+    const auto n {static_cast<dim>(m_elems_per_thread*pool.num_threads())};
+    m_ctx = isolate::create("roofline", isolate::compute_device::cpu, 3*n*sizeof(float) + 64_kib);
+    m_a = m_ctx->new_tensor<float>({n});
+    m_b = m_ctx->new_tensor<float>({n});
+    m_c = m_ctx->new_tensor<float>({n});
+    m_a->splat(1.0f);
+    m_b->splat(2.0f);
+    m_c->splat_zero();
+}
+
+auto stream_kernel::run() -> double {
+    m_pool.parallel_for([this](const blas::compute_ctx& ctx) {
+        const std::size_t offs {m_elems_per_thread*static_cast<std::size_t>(ctx.thread_idx)};
+        for (std::size_t i {}; i < m_reps; ++i) {
+            blas::vec::add(m_elems_per_thread, m_c->data().data()+offs, m_a->data().data()+offs, m_b->data().data()+offs);
+            benchmark::ClobberMemory();
+        }
+    });
+    return 3.0 * static_cast<double>(m_elems_per_thread*sizeof(float)*m_reps) * static_cast<double>(m_pool.num_threads());
+}
+
+template <typename F>
+static auto measure_best_rate(F&& pass) -> double { // Best rate (work per second) of repeated passes
+    using clock = std::chrono::steady_clock;
+    double best {};
+    pass(); // Warmup
+    const clock::time_point begin {clock::now()};
+    while (std::chrono::duration<double>(clock::now() - begin).count() < k_calibration_seconds) {
+        const clock::time_point t0 {clock::now()};
+        const double work {pass()};
+        const double secs {std::chrono::duration<double>(clock::now() - t0).count()};
+        if (secs > 0.0) best = std::max(best, work / secs);
+    }
+    return best;
+}
+
+auto machine_roofs() -> const machine_roofline& {
+    static const machine_roofline s_roofs {[] {
+        machine_roofline roofs {};
+        roofs.max_threads = std::max<dim>(1, std::thread::hardware_concurrency());
+        thread_pool single {1};
+        thread_pool all {roofs.max_threads};
+        roofs.peak_gflops_core = measure_best_rate([&] { return run_peak_fma(single); }) * 1e-9;
+        roofs.peak_gflops_total = measure_best_rate([&] { return run_peak_fma(all); }) * 1e-9;
+        for (std::size_t lvl {}; lvl < machine_roofline::$count; ++lvl) {
+            const std::size_t ws {level_working_set(static_cast<machine_roofline::level>(lvl))};
+            roofs.capacity[lvl] = level_capacity(static_cast<machine_roofline::level>(lvl));
+            stream_kernel core {single, ws};
+            roofs.gbs_core[lvl] = measure_best_rate([&] { return core.run(); }) * 1e-9;
+            stream_kernel total {all, lvl == machine_roofline::l3 || lvl == machine_roofline::dram ? ws / roofs.max_threads : ws};
+            roofs.gbs_total[lvl] = measure_best_rate([&] { return total.run(); }) * 1e-9;
+        }
+        return roofs;
+    }()};
+    return s_roofs;
+}
+
+auto report_roof_efficiency(benchmark::State& state, const double flops, const double bytes, const dim threads) -> void {
+    const machine_roofline& roofs {machine_roofs()};
+    const double attainable {roofs.attainable_gflops(flops, bytes, threads) * 1e9};
+    if (attainable <= 0.0) return;
+    state.counters["roof%"] = benchmark::Counter{100.0 * flops / attainable, benchmark::Counter::kIsIterationInvariantRate};
+}
+
+static auto roofline_thread_args(benchmark::internal::Benchmark* const b) -> void {
+    b->ArgNames({"threads"});
+    const auto max {std::max<std::int64_t>(1, std::thread::hardware_concurrency())};
+    for (std::int64_t i {1}; i < max; i <<= 1)
+        b->Arg(i);
+    b->Arg(max);
+}
+
+static auto roofline_level_args(benchmark::internal::Benchmark* const b) -> void {
+    b->ArgNames({"level", "threads"});
+    const auto max {std::max<std::int64_t>(1, std::thread::hardware_concurrency())};
+    for (std::int64_t lvl {}; lvl < machine_roofline::$count; ++lvl) {
+        b->Args({lvl, 1});
+        if (max > 1) b->Args({lvl, max});
+    }
+}
+
+static auto roofline_peak_fma(benchmark::State& st) -> void {
+    thread_pool pool {st.range(0)};
+    double flops {};
+    for (auto _ : st)
+        flops = run_peak_fma(pool);
+    st.counters["GFLOP/s"] = benchmark::Counter{flops*1e-9, benchmark::Counter::kIsIterationInvariantRate};
+}
+BENCHMARK(roofline_peak_fma)->Apply(roofline_thread_args)->UseRealTime();
+
+static auto roofline_bandwidth(benchmark::State& st) -> void {
+    const auto lvl {static_cast<machine_roofline::level>(st.range(0))};
+    thread_pool pool {st.range(1)};
+    const std::size_t ws {level_working_set(lvl)};
+    const bool shared {lvl == machine_roofline::l3 || lvl == machine_roofline::dram};
+    stream_kernel kernel {pool, shared ? ws / static_cast<std::size_t>(pool.num_threads()) : ws};
+    double bytes {};
+    for (auto _ : st)
+        bytes = kernel.run();
+    st.counters["GB/s"] = benchmark::Counter{bytes*1e-9, benchmark::Counter::kIsIterationInvariantRate};
+    st.SetLabel(machine_roofline::k_level_names[lvl]);
+}
+BENCHMARK(roofline_bandwidth)->Apply(roofline_level_args)->UseRealTime();
@@ -0,0 +1,76 @@
+// Copyright Mario "Neo" Sieg 2024. All rights reserved. mario.sieg.64@gmail.com
+// Machine peak calibration (FMA throughput and L1/L2/L3/DRAM bandwidth) for roofline efficiency reporting
+// The calibration kernels are built on the same vector kernels (blas::vec) as the runtime ops
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+
+#include <benchmark/benchmark.h>
+
+#include <isolate.hpp>
+#include <tensor.hpp>
+#include <thread_pool.hpp>
+
+using namespace rtml;
+
+struct machine_roofline final {
+    enum level : std::size_t {
+        l1,
+        l2,
+        l3,
+        dram,
+        $count
+    };
+    static constexpr std::array<const char*, $count> k_level_names {"L1", "L2", "L3", "DRAM"};
+
+    dim max_threads {};                         // Thread count used for the total roofs
+    double peak_gflops_core {};                 // Peak FMA throughput of a single thread
+    double peak_gflops_total {};                // Peak FMA throughput of all threads
+    std::array<std::size_t, $count> capacity {}; // Bytes per core (L1, L2) or shared (L3) which fit into each level, DRAM is unbounded
+    std::array<double, $count> gbs_core {};     // Bandwidth of a single thread per level
+    std::array<double, $count> gbs_total {};    // Bandwidth of all threads per level
+
+    [[nodiscard]] auto classify(std::size_t working_set, dim threads) const noexcept -> level; // Memory level a working set lives in
+    [[nodiscard]] auto peak_gflops(dim threads) const noexcept -> double;
+    [[nodiscard]] auto bandwidth_gbs(level lvl, dim threads) const noexcept -> double;
+    [[nodiscard]] auto attainable_gflops(double flops, double bytes, dim threads) const noexcept -> double; // min(peak, intensity * bandwidth)
+};
+
+// Capacity of each cache level as reported by the CPU info (DRAM is unbounded)
+[[nodiscard]] extern auto level_capacity(machine_roofline::level lvl) -> std::size_t;
+
+// Per thread working set used to measure the bandwidth of each level, well inside the level capacity
+[[nodiscard]] extern auto level_working_set(machine_roofline::level lvl) -> std::size_t;
+
+// Runs the peak FMA kernel once on every thread of the pool, returns the performed FLOPs
+extern auto run_peak_fma(thread_pool& pool) -> double;
+
+// STREAM-like add kernel (c = a + b) over a per thread working set
+class stream_kernel final {
+public:
+    stream_kernel(thread_pool& pool, std::size_t working_set_per_thread);
+    stream_kernel(const stream_kernel&) = delete;
+    stream_kernel(stream_kernel&&) = delete;
+    auto operator=(const stream_kernel&) -> stream_kernel& = delete;
+    auto operator=(stream_kernel&&) -> stream_kernel& = delete;
+    ~stream_kernel() = default;
+
+    auto run() -> double; // Runs one pass on all threads, returns the moved bytes
+
+private:
+    thread_pool& m_pool;
+    std::shared_ptr<isolate> m_ctx {};
+    tensor<>* m_a {};
+    tensor<>* m_b {};
+    tensor<>* m_c {};
+    std::size_t m_elems_per_thread {};
+    std::size_t m_reps {}; // Kernel repetitions per pass
+};
+
+// Machine roofs, calibrated lazily on first use
+[[nodiscard]] extern auto machine_roofs() -> const machine_roofline&;
+
+// Reports the achieved percentage of the attainable roofline performance ("roof%") for one op invocation per iteration
+extern auto report_roof_efficiency(benchmark::State& state, double flops, double bytes, dim threads) -> void;
@@ -0,0 +1,78 @@
+// Copyright Mario "Neo" Sieg 2024. All rights reserved. mario.sieg.64@gmail.com
+// Static vs. dynamic row partitioning (blas::row_schedule) of element wise ops under synthetic interference
+// Straggler: one thread of the pool is delayed at the start of every dispatch, like a thread preempted by a noisy neighbor
+// Antagonists: background threads spinning on half of the hardware threads, like other tenants of a shared host
+// The shape has an uneven row count and broadcasts Y over the rows
+
+#include <chrono>
+#include <thread>
+
+#include "fixture.hpp"
+
+enum class interference : std::int64_t {
+    none,
+    straggler,
+    antagonists,
+    $count
+};
+
+static constexpr std::array<const char*, static_cast<std::size_t>(interference::$count)> k_interference_names {
+    "none",
+    "straggler",
+    "antagonists"
+};
+
+static constexpr std::array<const char*, 3> k_schedule_names {
+    "static",
+    "guided",
+    "adaptive"
+};
+
+static constexpr std::chrono::microseconds k_straggler_delay {100};
+
+static auto scheduling_args(benchmark::internal::Benchmark* const b) -> void {
+    b->ArgNames({"schedule", "interference", "threads"});
+    for (std::int64_t schedule {}; schedule < static_cast<std::int64_t>(k_schedule_names.size()); ++schedule)
+        for (std::int64_t noise {}; noise < static_cast<std::int64_t>(interference::$count); ++noise)
+            for (const std::int64_t threads : bench_thread_counts())
+                b->Args({schedule, noise, threads});
+}
+
+static auto busy_wait(const std::chrono::microseconds duration) noexcept -> void { // Burns CPU instead of sleeping, like a competing process
+    const auto end {std::chrono::steady_clock::now() + duration};
+    while (std::chrono::steady_clock::now() < end);
+}
+
+static auto row_scheduling(benchmark::State& state) -> void {
+    static constexpr dim k_cols {1000};
+    static constexpr dim k_rows {4099}; // Prime, not divisible by any thread count
+    const auto noise {static_cast<interference>(state.range(1))};
+    auto ctx {isolate::create("bench", isolate::compute_device::cpu, 64_mib)};
+    thread_pool pool {state.range(2)};
+    pool.set_schedule(static_cast<blas::row_schedule>(state.range(0)));
+    tensor<>* const x {ctx->new_tensor<float>({k_cols, k_rows})};
+    tensor<>* const y {ctx->new_tensor<float>({k_cols})};
+    tensor<>* const r {ctx->new_tensor<float>({k_cols, k_rows})};
+    x->splat(0.5f);
+    y->splat(0.25f);
+    std::atomic_bool stop {};
+    std::vector<std::thread> antagonists {};
+    if (noise == interference::antagonists) {
+        const unsigned count {std::max(1u, std::thread::hardware_concurrency() / 2)};
+        for (unsigned i {}; i < count; ++i)
+            antagonists.emplace_back([&stop] { while (!stop.load(std::memory_order_relaxed)); });
+    }
+    const dim straggler {pool.num_threads()-1}; // Thread 0 is the benchmark thread
+    for (auto _ : state) {
+        pool.parallel_for([&](const blas::compute_ctx& cctx) {
+            if (noise == interference::straggler && cctx.thread_idx == straggler) busy_wait(k_straggler_delay);
+            blas::add(cctx, *r, *x, *y);
+        });
+    }
+    stop.store(true, std::memory_order_relaxed);
+    for (std::thread& t : antagonists)
+        t.join();
+    state.counters["GB/s"] = benchmark::Counter{3.0*sizeof(float)*k_cols*k_rows*1e-9, benchmark::Counter::kIsIterationInvariantRate};
+    state.SetLabel(fmt::format("{} / {}", k_schedule_names[static_cast<std::size_t>(state.range(0))], k_interference_names[static_cast<std::size_t>(noise)]));
+}
+BENCHMARK(row_scheduling)->Apply(scheduling_args)->UseRealTime()->Unit(benchmark::kMicrosecond);
@@ -0,0 +1,63 @@
+// Copyright Mario "Neo" Sieg 2024. All rights reserved. mario.sieg.64@gmail.com
+// Per op overhead of tiny tensors (control models): generic kernels vs. the small op fast path, in nanoseconds per op
+// Modes: 0 = generic kernel dispatched to the pool, 1 = generic kernel on the calling thread, 2 = fast path kernel on the calling thread,
+// 3 = graph::run which applies the cost model (inline fast path for small ops)
+
+#include <executor.hpp>
+
+#include "fixture.hpp"
+
+struct small_shape final {
+    const char* name;
+    std::array<dim, 4> x;
+    std::array<dim, 4> y;
+};
+
+static const std::array k_small_shapes {
+    small_shape{"4", {4, 1, 1, 1}, {4, 1, 1, 1}},
+    small_shape{"64", {64, 1, 1, 1}, {64, 1, 1, 1}},
+    small_shape{"16x16+row", {16, 16, 1, 1}, {16, 1, 1, 1}},
+    small_shape{"8x8x4+bias", {8, 8, 4, 1}, {8, 1, 1, 1}},
+    small_shape{"32x32", {32, 32, 1, 1}, {32, 32, 1, 1}},
+};
+
+static constexpr std::array<const char*, 4> k_small_mode_names {
+    "pool",
+    "generic",
+    "fast path",
+    "graph::run"
+};
+
+static auto small_op_bench(benchmark::State& state) -> void {
+    const small_shape& shape {k_small_shapes[static_cast<std::size_t>(state.range(0))]};
+    const std::int64_t mode {state.range(1)};
+    const auto op {static_cast<graph::opcode>(state.range(2))};
+    auto ctx {isolate::create("bench", isolate::compute_device::cpu, 1_mib)};
+    thread_pool pool {};
+    tensor<>* const x {ctx->new_tensor<float>(shape.x)};
+    tensor<>* const y {ctx->new_tensor<float>(shape.y)};
+    tensor<>* const r {ctx->new_tensor<float>(shape.x)};
+    x->splat(0.5f);
+    y->splat(0.25f);
+    const graph::node n {.op=op, .r=r, .x=x, .y=y};
+    blas::set_small_op_limit(mode < 2 ? 0 : blas::k_small_op_limit);
+    for (auto _ : state) {
+        switch (mode) {
+            case 0: pool.parallel_for([&](const blas::compute_ctx& cctx) { blas::eval(cctx, n.op, *n.r, *n.x, n.y); }); break;
+            case 1:
+            case 2: blas::eval(blas::compute_ctx{}, n.op, *n.r, *n.x, n.y); break;
+            default: graph::run(pool, n); break;
+        }
+        benchmark::ClobberMemory();
+    }
+    blas::set_small_op_limit(blas::k_small_op_limit);
+    state.SetLabel(fmt::format("{} {} ({})", graph::k_names[static_cast<std::size_t>(op)], shape.name, k_small_mode_names[static_cast<std::size_t>(mode)]));
+}
+BENCHMARK(small_op_bench)
+    ->ArgNames({"shape", "mode", "op"})
+    ->ArgsProduct({
+        benchmark::CreateDenseRange(0, static_cast<std::int64_t>(k_small_shapes.size())-1, 1),
+        {0, 1, 2, 3},
+        {static_cast<std::int64_t>(graph::opcode::add), static_cast<std::int64_t>(graph::opcode::mul), static_cast<std::int64_t>(graph::opcode::gelu)}
+    })
+    ->Unit(benchmark::kNanosecond);
@@ -0,0 +1,80 @@
+// Copyright Mario "Neo" Sieg 2024. All rights reserved. mario.sieg.64@gmail.com
+// Fixed shape control model ops: dynamic tensor kernels (graph::run, which takes the small op fast path) vs. static_tensor
+// kernels with compile time shapes, both on the same pool allocated tensors, in nanoseconds per op
+
+#include <executor.hpp>
+#include <static_tensor.hpp>
+
+#include "fixture.hpp"
+
+template <typename R, typename Y>
+static auto static_binary_bench(benchmark::State& state) -> void {
+    const bool is_static {state.range(0) != 0};
+    auto ctx {isolate::create("bench", isolate::compute_device::cpu, 1_mib)};
+    thread_pool pool {};
+    tensor<>* const x {R::new_tensor(*ctx)};
+    tensor<>* const y {Y::new_tensor(*ctx)};
+    tensor<>* const r {R::new_tensor(*ctx)};
+    x->splat(0.5f);
+    y->splat(0.25f);
+    const graph::node n {.op=graph::opcode::add, .r=r, .x=x, .y=y};
+    const R sr {*r}, sx {*x};
+    const Y sy {*y};
+    for (auto _ : state) {
+        if (is_static) blas::add(sr, sx, sy);
+        else graph::run(pool, n);
+        benchmark::ClobberMemory();
+    }
+    state.SetLabel(is_static ? "static" : "dynamic");
+}
+BENCHMARK(static_binary_bench<static_tensor<float, 16>, static_tensor<float, 16>>)->Arg(0)->Arg(1)->Unit(benchmark::kNanosecond);
+BENCHMARK(static_binary_bench<static_tensor<float, 16, 16>, static_tensor<float, 16>>)->Arg(0)->Arg(1)->Unit(benchmark::kNanosecond);
+BENCHMARK(static_binary_bench<static_tensor<float, 8, 8, 4>, static_tensor<float, 8>>)->Arg(0)->Arg(1)->Unit(benchmark::kNanosecond);
+BENCHMARK(static_binary_bench<static_tensor<float, 32, 32>, static_tensor<float, 32, 32>>)->Arg(0)->Arg(1)->Unit(benchmark::kNanosecond);
+
+template <typename R>
+static auto static_gelu_bench(benchmark::State& state) -> void {
+    const bool is_static {state.range(0) != 0};
+    auto ctx {isolate::create("bench", isolate::compute_device::cpu, 1_mib)};
+    thread_pool pool {};
+    tensor<>* const x {R::new_tensor(*ctx)};
+    tensor<>* const r {R::new_tensor(*ctx)};
+    x->splat(0.5f);
+    const graph::node n {.op=graph::opcode::gelu, .r=r, .x=x};
+    const R sr {*r}, sx {*x};
+    for (auto _ : state) {
+        if (is_static) blas::gelu(sr, sx);
+        else graph::run(pool, n);
+        benchmark::ClobberMemory();
+    }
+    state.SetLabel(is_static ? "static" : "dynamic");
+}
+BENCHMARK(static_gelu_bench<static_tensor<float, 16>>)->Arg(0)->Arg(1)->Unit(benchmark::kNanosecond);
+BENCHMARK(static_gelu_bench<static_tensor<float, 64, 4>>)->Arg(0)->Arg(1)->Unit(benchmark::kNanosecond);
+
+// Dense layer of a control model: r = [N, M] = x [K, M] @ w [N, K]
+template <const dim M, const dim N, const dim K>
+static auto static_matmul_bench(benchmark::State& state) -> void {
+    const bool is_static {state.range(0) != 0};
+    auto ctx {isolate::create("bench", isolate::compute_device::cpu, 1_mib)};
+    thread_pool pool {};
+    tensor<>* const x {static_tensor<float, K, M>::new_tensor(*ctx)};
+    tensor<>* const w {static_tensor<float, N, K>::new_tensor(*ctx)};
+    tensor<>* const r {static_tensor<float, N, M>::new_tensor(*ctx)};
+    x->splat(0.5f);
+    w->splat(0.25f);
+    const graph::node n {.op=graph::opcode::matmul, .r=r, .x=x, .y=w};
+    const static_tensor<float, N, M> sr {*r};
+    const static_tensor<float, K, M> sx {*x};
+    const static_tensor<float, N, K> sw {*w};
+    for (auto _ : state) {
+        if (is_static) blas::matmul(sr, sx, sw);
+        else graph::run(pool, n);
+        benchmark::ClobberMemory();
+    }
+    state.counters["GFLOP/s"] = benchmark::Counter{2.0*M*N*K*1e-9, benchmark::Counter::kIsIterationInvariantRate};
+    state.SetLabel(is_static ? "static" : "dynamic");
+}
+BENCHMARK(static_matmul_bench<1, 16, 16>)->Arg(0)->Arg(1)->Unit(benchmark::kNanosecond);
+BENCHMARK(static_matmul_bench<8, 32, 32>)->Arg(0)->Arg(1)->Unit(benchmark::kNanosecond);
+BENCHMARK(static_matmul_bench<16, 64, 64>)->Arg(0)->Arg(1)->Unit(benchmark::kNanosecond);
@@ -0,0 +1,45 @@
+// Copyright Mario "Neo" Sieg 2024. All rights reserved. mario.sieg.64@gmail.com
+// r = gelu(a * b + c) with a bias row c: fused expression template assignment vs. one blas op per node with a temporary
+
+#include <tensor_expr.hpp>
+
+#include "fixture.hpp"
+
+static auto tensor_expr_args(benchmark::internal::Benchmark* const b) -> void {
+    b->ArgNames({"rows", "fused", "threads"});
+    for (const std::int64_t rows : {16, 1024, 8192})
+        for (const std::int64_t fused : {0, 1})
+            for (const std::int64_t threads : bench_thread_counts())
+                b->Args({rows, fused, threads});
+}
+
+static auto tensor_expr_bench(benchmark::State& state) -> void {
+    static constexpr dim k_cols {256};
+    const dim rows {state.range(0)};
+    const bool fused {state.range(1) != 0};
+    auto ctx {isolate::create("bench", isolate::compute_device::cpu, 64_mib)};
+    thread_pool pool {state.range(2)};
+    tensor<>* const a {ctx->new_tensor<float>({k_cols, rows})};
+    tensor<>* const b {ctx->new_tensor<float>({k_cols, rows})};
+    tensor<>* const c {ctx->new_tensor<float>({k_cols})};
+    tensor<>* const r {ctx->new_tensor<float>({k_cols, rows})};
+    tensor<>* const tmp {ctx->new_tensor<float>({k_cols, rows})};
+    a->splat(0.5f);
+    b->splat(0.25f);
+    c->splat(0.1f);
+    const expr::pool_scope scope {pool};
+    for (auto _ : state) {
+        if (fused) {
+            *r = gelu(*a * *b + *c);
+        } else {
+            pool.parallel_for([&](const blas::compute_ctx& cctx) { blas::mul(cctx, *tmp, *a, *b); });
+            pool.parallel_for([&](const blas::compute_ctx& cctx) { blas::add(cctx, *tmp, *tmp, *c); });
+            pool.parallel_for([&](const blas::compute_ctx& cctx) { blas::gelu(cctx, *r, *tmp); });
+        }
+        benchmark::ClobberMemory();
+    }
+    const auto bytes {static_cast<double>(3*r->size())}; // a, b and r, the bias row stays in cache
+    state.counters["GB/s"] = benchmark::Counter{bytes*1e-9, benchmark::Counter::kIsIterationInvariantRate};
+    state.SetLabel(fused ? "fused" : "per op");
+}
+BENCHMARK(tensor_expr_bench)->Apply(tensor_expr_args)->UseRealTime()->Unit(benchmark::kMicrosecond);
@@ -2,32 +2,69 @@
 
 #include "fixture.hpp"
 
-BENCHMARK_F(rtml_fixture, tensor_add)(benchmark::State& st) {
-    for (auto _ : st) {
-        blas::add(cctx, *c, *a, *b);
-     }
+static auto binary_op_args(benchmark::internal::Benchmark* const b) -> void {
+    b->ArgNames({"log2_elems", "threads", "layout"});
+    for (const std::int64_t exp : k_elem_exponents)
+        for (const std::int64_t threads : bench_thread_counts())
+            for (std::int64_t layout {}; layout < static_cast<std::int64_t>(operand_layout::$count); ++layout)
+                b->Args({exp, threads, layout});
 }
 
-BENCHMARK_F(rtml_fixture, tensor_sub)(benchmark::State& st) {
-    for (auto _ : st) {
-        blas::sub(cctx, *c, *a, *b);
-    }
+// Unary kernels require X dense in dim 0, so only the contiguous layout is swept
+static auto unary_op_args(benchmark::internal::Benchmark* const b) -> void {
+    b->ArgNames({"log2_elems", "threads", "layout"});
+    for (const std::int64_t exp : k_elem_exponents)
+        for (const std::int64_t threads : bench_thread_counts())
+            b->Args({exp, threads, static_cast<std::int64_t>(operand_layout::contiguous)});
 }
 
-BENCHMARK_F(rtml_fixture, tensor_mul)(benchmark::State& st) {
-    for (auto _ : st) {
-        blas::mul(cctx, *c, *a, *b);
-    }
+static auto matmul_args(benchmark::internal::Benchmark* const b) -> void {
+    b->ArgNames({"n", "threads"});
+    for (const std::int64_t n : {32, 64, 128, 256})
+        for (const std::int64_t threads : bench_thread_counts())
+            b->Args({n, threads});
 }
 
-BENCHMARK_F(rtml_fixture, tensor_div)(benchmark::State& st) {
-    for (auto _ : st) {
-        blas::div(cctx, *c, *a, *b);
-    }
-}
+#define impl_binary_op_bench(name) \
+    BENCHMARK_DEFINE_F(rtml_fixture, tensor_##name)(benchmark::State& st) { \
+        for (auto _ : st) { \
+            threads->parallel_for([this](const blas::compute_ctx& cctx) { \
+                blas::name(cctx, *c, *a, *b); \
+            }); \
+        } \
+        report_throughput(st, graph::opcode::name, *c, *a, *b, threads->num_threads()); \
+    } \
+    BENCHMARK_REGISTER_F(rtml_fixture, tensor_##name)->Apply(binary_op_args)->UseRealTime()
+
+impl_binary_op_bench(add);
+impl_binary_op_bench(sub);
+impl_binary_op_bench(mul);
+impl_binary_op_bench(div);
+
+#define impl_unary_op_bench(name) \
+    BENCHMARK_DEFINE_F(rtml_fixture, tensor_##name)(benchmark::State& st) { \
+        for (auto _ : st) { \
+            threads->parallel_for([this](const blas::compute_ctx& cctx) { \
+                blas::name(cctx, *c, *a); \
+            }); \
+        } \
+        report_throughput(st, graph::opcode::name, *c, *a, nullptr, threads->num_threads()); \
+    } \
+    BENCHMARK_REGISTER_F(rtml_fixture, tensor_##name)->Apply(unary_op_args)->UseRealTime()
+
+impl_unary_op_bench(softmax);
+impl_unary_op_bench(sigmoid);
+impl_unary_op_bench(tanh);
+impl_unary_op_bench(relu);
+impl_unary_op_bench(gelu);
+impl_unary_op_bench(silu);
 
-BENCHMARK_F(rtml_fixture, tensor_matmul)(benchmark::State& st) {
+BENCHMARK_DEFINE_F(rtml_matmul_fixture, tensor_matmul)(benchmark::State& st) {
     for (auto _ : st) {
-        blas::matmul(cctx, *c, *a, *b);
+        threads->parallel_for([this](const blas::compute_ctx& cctx) {
+            blas::matmul(cctx, *c, *a, *b);
+        });
     }
+    rtml_fixture::report_throughput(st, graph::opcode::matmul, *c, *a, *b, threads->num_threads());
 }
+BENCHMARK_REGISTER_F(rtml_matmul_fixture, tensor_matmul)->Apply(matmul_args)->UseRealTime();
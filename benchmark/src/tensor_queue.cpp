@@ -0,0 +1,110 @@
+// Copyright Mario "Neo" Sieg 2024. All rights reserved. mario.sieg.64@gmail.com
+// Handoff latency of input tensors from a producer thread to the consumer (inference) thread
+// The lock free tensor_queue (SPSC and MPSC mode) vs. the mutex protected std::queue with a condition variable it replaces
+// Latency is measured from publish to pop, the producer fills a 1 KiB tensor in place for every handoff
+// Producer and consumer ping-pong with one tensor in flight, so the queue is empty on every publish and the latency
+// does not include time spent waiting behind earlier tensors
+
+#include <condition_variable>
+#include <mutex>
+#include <queue>
+#include <thread>
+
+#include <tensor_queue.hpp>
+
+#include "fixture.hpp"
+
+enum class handoff_kind : std::int64_t {
+    spsc,
+    mpsc,
+    locked,
+    $count
+};
+
+static constexpr std::array<const char*, static_cast<std::size_t>(handoff_kind::$count)> k_handoff_names {
+    "tensor_queue spsc",
+    "tensor_queue mpsc",
+    "mutex std::queue"
+};
+
+// Baseline: both directions through mutex protected queues, the consumer sleeps on a condition variable
+// Producers poll for free slots like with the tensor_queue, so only the consumer side differs in waiting
+class locked_handoff final {
+public:
+    explicit locked_handoff(const std::span<tensor_queue::slot> slots) {
+        for (tensor_queue::slot& s : slots) m_free.push(&s);
+    }
+
+    auto try_acquire() -> tensor_queue::slot* {
+        const std::lock_guard lock {m_mtx};
+        if (m_free.empty()) return nullptr;
+        tensor_queue::slot* const s {m_free.front()};
+        m_free.pop();
+        return s;
+    }
+
+    auto publish(tensor_queue::slot* const s) -> void {
+        s->published = std::chrono::steady_clock::now();
+        {
+            const std::lock_guard lock {m_mtx};
+            m_ready.push(s);
+        }
+        m_ready_cv.notify_one();
+    }
+
+    auto pop() -> tensor_queue::slot* {
+        std::unique_lock lock {m_mtx};
+        m_ready_cv.wait(lock, [this] { return !m_ready.empty(); });
+        tensor_queue::slot* const s {m_ready.front()};
+        m_ready.pop();
+        return s;
+    }
+
+    auto recycle(tensor_queue::slot* const s) -> void {
+        const std::lock_guard lock {m_mtx};
+        m_free.push(s);
+    }
+
+private:
+    std::mutex m_mtx {};
+    std::condition_variable m_ready_cv {};
+    std::queue<tensor_queue::slot*> m_free {};
+    std::queue<tensor_queue::slot*> m_ready {};
+};
+
+// Each iteration hands off one tensor, the producer publishes the next one after the consumer has popped the previous one
+static auto tensor_handoff(benchmark::State& state) -> void {
+    static constexpr std::uint32_t num_slots {2}; // The next slot is filled while the previous one is recycled
+    const auto kind {static_cast<handoff_kind>(state.range(0))};
+    auto ctx {isolate::create("bench", isolate::compute_device::cpu, 1_mib)};
+    tensor_queue q {*ctx, std::array<dim, 1>{256}, num_slots, kind == handoff_kind::mpsc ? tensor_queue::producers::multi : tensor_queue::producers::single};
+    locked_handoff locked {q.slots()};
+    std::atomic_bool stop {};
+    std::atomic_uint64_t popped {}; // Number of tensors popped by the consumer
+    std::thread producer {[&] {
+        for (std::uint64_t i {}; !stop.load(std::memory_order_relaxed);) {
+            if (popped.load(std::memory_order_acquire) < i) { std::this_thread::yield(); continue; } // Previous tensor still in flight
+            tensor_queue::slot* const s {kind == handoff_kind::locked ? locked.try_acquire() : q.try_acquire()};
+            if (!s) { std::this_thread::yield(); continue; } // Lets the benchmark stop even when the consumer is gone
+            s->input->splat(static_cast<float>(i));
+            s->tag = i++;
+            if (kind == handoff_kind::locked) locked.publish(s);
+            else q.publish(s);
+        }
+    }};
+    std::vector<double> latencies {};
+    latencies.reserve(1<<20);
+    for (auto _ : state) {
+        tensor_queue::slot* const s {kind == handoff_kind::locked ? locked.pop() : q.pop()};
+        latencies.emplace_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - s->published).count());
+        popped.store(s->tag+1, std::memory_order_release);
+        benchmark::DoNotOptimize(s->input->data()[0]);
+        if (kind == handoff_kind::locked) locked.recycle(s);
+        else q.recycle(s);
+    }
+    stop.store(true, std::memory_order_relaxed);
+    producer.join();
+    report_latency(state, latencies, 1.0);
+    state.SetLabel(k_handoff_names[static_cast<std::size_t>(kind)]);
+}
+BENCHMARK(tensor_handoff)->ArgName("queue")->DenseRange(0, static_cast<std::int64_t>(handoff_kind::$count)-1)->UseRealTime();
@@ -0,0 +1,70 @@
+// Copyright Mario "Neo" Sieg 2024. All rights reserved. mario.sieg.64@gmail.com
+// Thread scaling per pinning policy: compute bound packed SGEMM (B panels shared per L3 domain) and memory bound add
+// Multi socket machines show the effect of scatter (bandwidth of all sockets) vs. compact (shared L3) placement
+
+#include "fixture.hpp"
+
+#include <topology.hpp>
+
+static constexpr std::array<const char*, 4> k_pin_policy_names {
+    "none",
+    "compact",
+    "scatter",
+    "physical"
+};
+
+static auto topology_args(benchmark::internal::Benchmark* const b) -> void {
+    b->ArgNames({"policy", "threads"});
+    for (std::int64_t policy {}; policy < static_cast<std::int64_t>(k_pin_policy_names.size()); ++policy)
+        for (const std::int64_t threads : bench_thread_counts())
+            b->Args({policy, threads});
+}
+
+[[nodiscard]] static auto topology_label(const std::int64_t policy, const thread_pool& pool) -> std::string {
+    const cpu_topology& topo {cpu_topology::system()};
+    return fmt::format(
+        "{} ({} pkg, {} cores, {} cpus, {} L3) {} domains",
+        k_pin_policy_names[static_cast<std::size_t>(policy)],
+        topo.num_packages(),
+        topo.num_cores(),
+        topo.cpus().size(),
+        topo.num_l3_domains(),
+        pool.domain(0).count
+    );
+}
+
+static auto topology_sgemm(benchmark::State& state) -> void {
+    static constexpr dim k_n {1024};
+    auto ctx {isolate::create("bench", isolate::compute_device::cpu, 64_mib)};
+    thread_pool pool {state.range(1)};
+    (void)pool.pin(static_cast<pin_policy>(state.range(0)));
+    tensor<>* const x {ctx->new_tensor<float>({k_n, k_n})};
+    tensor<>* const y {ctx->new_tensor<float>({k_n, k_n})};
+    tensor<>* const r {ctx->new_tensor<float>({k_n, k_n})};
+    x->splat(0.5f);
+    y->splat(0.25f);
+    for (auto _ : state)
+        pool.parallel_for([&](const blas::compute_ctx& cctx) { blas::matmul(cctx, *r, *x, *y); });
+    state.counters["GFLOP/s"] = benchmark::Counter{2.0*k_n*k_n*k_n*1e-9, benchmark::Counter::kIsIterationInvariantRate};
+    state.SetLabel(topology_label(state.range(0), pool));
+    pool.unpin(); // The benchmark thread is thread 0 of the pool
+}
+BENCHMARK(topology_sgemm)->Apply(topology_args)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+static auto topology_add(benchmark::State& state) -> void {
+    static constexpr dim k_elems {1<<24}; // 3 * 64 MiB, DRAM resident
+    auto ctx {isolate::create("bench", isolate::compute_device::cpu, 256_mib)};
+    thread_pool pool {state.range(1)};
+    (void)pool.pin(static_cast<pin_policy>(state.range(0)));
+    tensor<>* const x {ctx->new_tensor<float>({k_elems})};
+    tensor<>* const y {ctx->new_tensor<float>({k_elems})};
+    tensor<>* const r {ctx->new_tensor<float>({k_elems})};
+    x->splat(0.5f);
+    y->splat(0.25f);
+    for (auto _ : state)
+        pool.parallel_for([&](const blas::compute_ctx& cctx) { blas::add(cctx, *r, *x, *y); });
+    state.counters["GB/s"] = benchmark::Counter{3.0*sizeof(float)*k_elems*1e-9, benchmark::Counter::kIsIterationInvariantRate};
+    state.SetLabel(topology_label(state.range(0), pool));
+    pool.unpin(); // The benchmark thread is thread 0 of the pool
+}
+BENCHMARK(topology_add)->Apply(topology_args)->UseRealTime()->Unit(benchmark::kMillisecond);
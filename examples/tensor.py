@@ -1,7 +1,18 @@
 import rtml
 
-a = rtml.Tensor('a', [2, 2, 1])
-b = rtml.Tensor('b', [2, 2, 1])
+iso = rtml.Isolate('Example', rtml.ComputeDevice.CPU)
+
+a = rtml.Tensor(iso, [2, 2]).fill(1.0)
+b = rtml.Tensor(iso, [2, 2]).fill(2.0)
 r = a.matmul(b)
 
 print(r)
+
+# Graphs are validated once and executed with a single call
+g = rtml.Graph(iso)
+mm = g.op(rtml.Opcode.MATMUL, a, b)
+g.op(rtml.Opcode.RELU, g.op(rtml.Opcode.ADD, mm, a))
+g.execute()
+print(g.result(2))
+
+rtml.global_shutdown()
@@ -1,5 +1,6 @@
 # Copyright Mario "Neo" Sieg 2024. All rights reserved. mario.sieg.64@gmail.com
 
+import asyncio
 from enum import Enum
 from ctypes import *
 
@@ -10,6 +11,41 @@ from rtml_runtime import *
 assert rtml_global_init is not None, "Failed to load the RTML dynamic library"
 
 
+class RtmlError(Exception):
+    pass
+
+
+def _check(ok):
+    if not ok:
+        raise RtmlError(rtml_last_error().decode('utf-8'))
+    return ok
+
+
+# DLPack capsules (PyCapsule named 'dltensor' holding a DLManagedTensor*)
+_DLTENSOR = b'dltensor'
+_USED_DLTENSOR = create_string_buffer(b'used_dltensor')  # Must outlive renamed capsules
+_PyCapsule_Destructor = CFUNCTYPE(None, c_void_p)
+pythonapi.PyCapsule_New.argtypes = [c_void_p, c_char_p, _PyCapsule_Destructor]
+pythonapi.PyCapsule_New.restype = py_object
+pythonapi.PyCapsule_GetPointer.argtypes = [py_object, c_char_p]
+pythonapi.PyCapsule_GetPointer.restype = c_void_p
+_PyCapsule_IsValid_raw = pythonapi['PyCapsule_IsValid']  # Destructors receive the dying capsule as raw pointer
+_PyCapsule_IsValid_raw.argtypes = [c_void_p, c_char_p]
+_PyCapsule_IsValid_raw.restype = c_int
+_PyCapsule_GetPointer_raw = pythonapi['PyCapsule_GetPointer']
+_PyCapsule_GetPointer_raw.argtypes = [c_void_p, c_char_p]
+_PyCapsule_GetPointer_raw.restype = c_void_p
+pythonapi.PyCapsule_SetName.argtypes = [py_object, c_char_p]
+pythonapi.PyCapsule_SetName.restype = c_int
+
+
+@_PyCapsule_Destructor
+def _dlpack_capsule_destructor(capsule):
+    # Only release capsules which were never consumed, consumers rename them to 'used_dltensor'
+    if _PyCapsule_IsValid_raw(capsule, _DLTENSOR):
+        rtml_dlpack_release(cast(_PyCapsule_GetPointer_raw(capsule, _DLTENSOR), POINTER(DLManagedTensor)))
+
+
 def global_init() -> bool:
     return rtml_global_init()
 
@@ -19,10 +55,33 @@ def global_shutdown():
 
 
 class ComputeDevice(Enum):
-    AUTO = 0
-    CPU = 1
-    GPU = 2
-    TPU = 3
+    AUTO = RTML_DEVICE_AUTO
+    CPU = RTML_DEVICE_CPU
+    GPU = RTML_DEVICE_GPU
+    TPU = RTML_DEVICE_TPU
+
+
+class Opcode(Enum):
+    SOFTMAX = RTML_OP_SOFTMAX
+    SIGMOID = RTML_OP_SIGMOID
+    TANH = RTML_OP_TANH
+    RELU = RTML_OP_RELU
+    GELU = RTML_OP_GELU
+    SILU = RTML_OP_SILU
+    ADD = RTML_OP_ADD
+    SUB = RTML_OP_SUB
+    MUL = RTML_OP_MUL
+    DIV = RTML_OP_DIV
+    MATMUL = RTML_OP_MATMUL
+    SUM = RTML_OP_SUM
+    MEAN = RTML_OP_MEAN
+    MAX = RTML_OP_MAX
+    MIN = RTML_OP_MIN
+    ARGMAX = RTML_OP_ARGMAX
+    LAYERNORM = RTML_OP_LAYERNORM
+    RMSNORM = RTML_OP_RMSNORM
+    CONV1D = RTML_OP_CONV1D
+    CONV2D = RTML_OP_CONV2D
 
 
 class Isolate:
@@ -33,50 +92,349 @@ class Isolate:
     def __init__(self, name: str, device: ComputeDevice = ComputeDevice.AUTO, mem_budget: int = DEFAULT_POOL_SIZE):
         self._lazy_init()
         mem_budget = max(mem_budget, self.DEFAULT_POOL_SIZE)
-        rtml_isolate_create(name, device.value, mem_budget)
+        self._handle = _check(rtml_isolate_create(name, device.value, mem_budget))
         self.name = name
         self.device = device
         self.mem_budget = mem_budget
-        if self.ACTIVE is None:
-            self.ACTIVE = self
+        if Isolate.ACTIVE is None:
+            Isolate.ACTIVE = self
 
-    def _lazy_init(self):
-        if not self._INITIALIZED:
+    @classmethod
+    def _lazy_init(cls):
+        if not cls._INITIALIZED:
             rtml_global_init()
-            self._INITIALIZED = True
+            cls._INITIALIZED = True
 
+    @staticmethod
     def exists(name: str) -> bool:
-        return rtml_isolate_exists(name)
+        return rtml_isolate_find(name) != RTML_INVALID_HANDLE
+
+    def is_alive(self) -> bool:
+        return rtml_isolate_exists(self._handle)
+
+    def set_num_threads(self, num_threads: int):
+        _check(rtml_isolate_set_num_threads(self._handle, num_threads))
+
+    def destroy(self):
+        _check(rtml_isolate_destroy(self._handle))
+        if Isolate.ACTIVE is self:
+            Isolate.ACTIVE = None
+
+    def handle(self) -> int:
+        return self._handle
 
-    def active(self) -> 'Isolate':
-        return self.ACTIVE
+    @staticmethod
+    def active() -> 'Isolate':
+        return Isolate.ACTIVE
 
 
 class Tensor:
-    MAX_DIMS = 4
+    MAX_DIMS = RTML_MAX_DIMS
 
     class DType(Enum):
-        F32 = 0
+        F32 = RTML_DTYPE_F32
 
-    def __init__(self, ctx: Isolate, shape: list[int], dtype: DType = DType.F32):
+    def __init__(self, ctx: Isolate, shape: list[int], dtype: DType = DType.F32, _handle: int = RTML_INVALID_HANDLE):
         assert ctx is not None, 'Invalid context'
         assert len(shape) <= self.MAX_DIMS, 'Invalid tensor shape'
         assert all([0 < x for x in shape]), 'Invalid tensor shape'
-        d1 = shape[0]
-        d2 = shape[1] if len(shape) > 1 else 1
-        d3 = shape[2] if len(shape) > 2 else 1
-        d4 = shape[3] if len(shape) > 3 else 1
         self._ctx = ctx
-        self._handle = rtml_isolate_create_tensor(ctx.name, dtype.value, d1, d2, d3, d4, len(shape),
-                                                  rtml_tensor_id_t(0), c_size_t(0))
         self._shape = shape
         self._dtype = dtype
+        self._owner = None  # External memory viewed by this tensor
+        if _handle == RTML_INVALID_HANDLE:
+            dims = shape + [1] * (self.MAX_DIMS - len(shape))
+            _handle = _check(rtml_isolate_create_tensor(ctx.handle(), dtype.value, *dims, len(shape),
+                                                        rtml_tensor_id_t(0), c_size_t(0)))
+        self._handle = _handle
+
+    @staticmethod
+    def _from_handle(ctx: Isolate, handle: int) -> 'Tensor':
+        dims = (int64_t * RTML_MAX_DIMS)()
+        num_dims = uint32_t(0)
+        _check(rtml_tensor_shape(ctx.handle(), handle, dims, byref(num_dims)))
+        return Tensor(ctx, list(dims[:num_dims.value]), _handle=handle)
+
+    @staticmethod
+    def from_numpy(ctx: Isolate, array, copy: bool = False) -> 'Tensor':
+        # Wraps the memory of a float32 NumPy array without copying if it is aligned and has positive strides,
+        # the tensor keeps the array alive. Otherwise, or if copy is True, the data is copied into the isolate pool
+        import numpy as np
+        array = np.asarray(array)
+        if array.ndim == 0:
+            array = array.reshape(1)
+        assert array.ndim <= Tensor.MAX_DIMS, 'Invalid tensor shape'
+        shape = list(reversed(array.shape))  # RTML dim 0 is the innermost dimension
+        if (not copy and array.dtype == np.float32 and array.ctypes.data % array.dtype.alignment == 0
+                and all(st > 0 and st % array.itemsize == 0 for st in array.strides)):
+            dims = (int64_t * Tensor.MAX_DIMS)(*shape)
+            strides = (int64_t * Tensor.MAX_DIMS)(*reversed(array.strides))
+            handle = rtml_isolate_wrap_tensor(ctx.handle(), Tensor.DType.F32.value, dims, strides, array.ndim,
+                                              c_void_p(array.ctypes.data))
+            if handle != RTML_INVALID_HANDLE:
+                tensor = Tensor(ctx, shape, _handle=handle)
+                tensor._owner = array
+                return tensor
+        array = np.ascontiguousarray(array, dtype=np.float32)
+        tensor = Tensor(ctx, shape)
+        memmove(rtml_tensor_data(ctx.handle(), tensor.handle()), array.ctypes.data, array.nbytes)
+        return tensor
+
+    @property
+    def __array_interface__(self) -> dict:
+        # Zero-copy view for NumPy (numpy.asarray(tensor)) with the real strides, the array keeps this tensor alive
+        strides = (int64_t * Tensor.MAX_DIMS)()
+        _check(rtml_tensor_strides(self._ctx.handle(), self._handle, strides))
+        return {
+            'version': 3,
+            'shape': tuple(reversed(self._shape)),
+            'strides': tuple(reversed(strides[:len(self._shape)])),
+            'typestr': '<f4',
+            'data': (rtml_tensor_data(self._ctx.handle(), self._handle), False),
+        }
+
+    @staticmethod
+    def from_dlpack(ctx: Isolate, obj) -> 'Tensor':
+        # Zero-copy import of any object implementing __dlpack__ (NumPy, PyTorch, JAX, ...)
+        # The isolate takes ownership of the exchanged memory and releases it when it is destroyed
+        capsule = obj.__dlpack__() if hasattr(obj, '__dlpack__') else obj
+        managed = pythonapi.PyCapsule_GetPointer(capsule, _DLTENSOR)
+        handle = _check(rtml_isolate_from_dlpack(ctx.handle(), cast(managed, POINTER(DLManagedTensor))))
+        pythonapi.PyCapsule_SetName(capsule, cast(_USED_DLTENSOR, c_char_p))
+        return Tensor._from_handle(ctx, handle)
+
+    def __dlpack__(self, stream=None, max_version=None, dl_device=None, copy=None):
+        # Zero-copy export, the capsule keeps the isolate alive until it is consumed and released
+        if copy:
+            raise BufferError('RTML tensors are only exported without copies')
+        managed = _check(rtml_tensor_to_dlpack(self._ctx.handle(), self._handle))
+        return pythonapi.PyCapsule_New(cast(managed, c_void_p), _DLTENSOR, _dlpack_capsule_destructor)
+
+    def __dlpack_device__(self) -> tuple[int, int]:
+        return 1, 0  # kDLCPU
+
+    def numpy(self):
+        import numpy as np
+        return np.asarray(self)
 
     def __str__(self) -> str:
-        return rtml_tensor_print(self._ctx.name, self._handle).decode('utf-8')
+        return _check(rtml_tensor_print(self._ctx.handle(), self._handle)).decode('utf-8')
+
+    def handle(self) -> int:
+        return self._handle
 
     def shape(self) -> list[int]:
         return self._shape
 
     def dtype(self) -> DType:
         return self._dtype
+
+    def fill(self, value: float) -> 'Tensor':
+        _check(rtml_tensor_fill(self._ctx.handle(), self._handle, value))
+        return self
+
+    def _op(self, op: Opcode, y: 'Tensor' = None, axis: int = 0, params: list[int] = None) -> 'Tensor':
+        # Eager execution of a single op, use Graph to execute many ops with a single call
+        if op == Opcode.MATMUL:
+            shape = [y.shape()[0], self._shape[1] if len(self._shape) > 1 else 1] + self._shape[2:]
+        elif op in (Opcode.SUM, Opcode.MEAN, Opcode.MAX, Opcode.MIN, Opcode.ARGMAX):
+            shape = self._shape + [1] * (axis + 1 - len(self._shape))
+            shape[axis] = 1
+        elif op in (Opcode.CONV1D, Opcode.CONV2D):
+            shape = _conv_output_shape(self._shape, y.shape(), params, 2 if op == Opcode.CONV2D else 1)
+        else:
+            shape = self._shape
+        r = Tensor(self._ctx, shape, self._dtype)
+        _check(rtml_tensor_op_params(self._ctx.handle(), op.value, r.handle(), self._handle,
+                                     y.handle() if y is not None else RTML_INVALID_HANDLE, _op_params(params)))
+        return r
+
+    def __add__(self, y: 'Tensor') -> 'Tensor':
+        return self._op(Opcode.ADD, y)
+
+    def __sub__(self, y: 'Tensor') -> 'Tensor':
+        return self._op(Opcode.SUB, y)
+
+    def __mul__(self, y: 'Tensor') -> 'Tensor':
+        return self._op(Opcode.MUL, y)
+
+    def __truediv__(self, y: 'Tensor') -> 'Tensor':
+        return self._op(Opcode.DIV, y)
+
+    def matmul(self, y: 'Tensor') -> 'Tensor':
+        return self._op(Opcode.MATMUL, y)
+
+    def softmax(self) -> 'Tensor':
+        return self._op(Opcode.SOFTMAX)
+
+    def sigmoid(self) -> 'Tensor':
+        return self._op(Opcode.SIGMOID)
+
+    def tanh(self) -> 'Tensor':
+        return self._op(Opcode.TANH)
+
+    def relu(self) -> 'Tensor':
+        return self._op(Opcode.RELU)
+
+    def gelu(self) -> 'Tensor':
+        return self._op(Opcode.GELU)
+
+    def silu(self) -> 'Tensor':
+        return self._op(Opcode.SILU)
+
+    # Normalization of each row, params = [d0, 2] (gamma, beta) for layer_norm and [d0] (gamma) for rms_norm
+    def layer_norm(self, params: 'Tensor') -> 'Tensor':
+        return self._op(Opcode.LAYERNORM, params)
+
+    def rms_norm(self, gamma: 'Tensor') -> 'Tensor':
+        return self._op(Opcode.RMSNORM, gamma)
+
+    # Convolutions, channels are innermost: conv1d x = [C_in, T, B], w = [C_out, C_in / groups, K]
+    # conv2d x = [C_in, W, H, B], w = [C_out, C_in / groups, KW, KH], stride, padding and dilation are ints or (W, H) pairs
+    def conv1d(self, w: 'Tensor', stride: int = 1, padding: int = 0, dilation: int = 1, groups: int = 1) -> 'Tensor':
+        return self._op(Opcode.CONV1D, w, params=conv_params(stride, padding, dilation, groups))
+
+    def conv2d(self, w: 'Tensor', stride=1, padding=0, dilation=1, groups: int = 1) -> 'Tensor':
+        return self._op(Opcode.CONV2D, w, params=conv_params(stride, padding, dilation, groups))
+
+    # Reductions along one dim (0 = innermost), the reduced dim is kept with size 1
+    def sum(self, axis: int = 0) -> 'Tensor':
+        return self._op(Opcode.SUM, axis=axis)
+
+    def mean(self, axis: int = 0) -> 'Tensor':
+        return self._op(Opcode.MEAN, axis=axis)
+
+    def max(self, axis: int = 0) -> 'Tensor':
+        return self._op(Opcode.MAX, axis=axis)
+
+    def min(self, axis: int = 0) -> 'Tensor':
+        return self._op(Opcode.MIN, axis=axis)
+
+    def argmax(self, axis: int = 0) -> 'Tensor':
+        return self._op(Opcode.ARGMAX, axis=axis)
+
+
+def conv_params(stride=1, padding=0, dilation=1, groups: int = 1) -> list[int]:
+    # Op params of convolutions: stride W, stride H, padding W, padding H, dilation W, dilation H, groups
+    def pair(v):
+        return list(v) if isinstance(v, (tuple, list)) else [v, v]
+    return pair(stride) + pair(padding) + pair(dilation) + [groups]
+
+
+def _op_params(params: list[int] = None):
+    values = (int64_t * RTML_MAX_OP_PARAMS)()
+    for i, v in enumerate(params or []):
+        values[i] = v
+    return values
+
+
+def _conv_output_shape(x: list[int], w: list[int], params: list[int], spatial_dims: int) -> list[int]:
+    x = x + [1] * (4 - len(x))
+    w = w + [1] * (4 - len(w))
+    out = [w[0]]
+    for i in range(spatial_dims):
+        stride, padding, dilation = params[i], params[2 + i], params[4 + i]
+        out.append((x[1 + i] + 2 * padding - dilation * (w[2 + i] - 1) - 1) // stride + 1)
+    return out + x[1 + spatial_dims:1 + spatial_dims + 1]
+
+
+class Job:
+    """Handle of an asynchronous graph execution.
+
+    All calls into the runtime release the GIL (ctypes does not hold it during foreign calls), so other Python threads
+    keep running while a job executes or is waited for. Jobs can be awaited from asyncio, which waits on the eventfd of
+    the job without blocking the event loop."""
+
+    def __init__(self, ctx: Isolate, handle: int):
+        self._ctx = ctx
+        self._handle = handle
+
+    def __del__(self):
+        if self._handle != RTML_INVALID_HANDLE and self._ctx.is_alive():
+            rtml_job_release(self._ctx.handle(), self._handle)
+
+    def done(self) -> bool:
+        state = rtml_job_poll(self._ctx.handle(), self._handle)
+        if state < 0:
+            raise RtmlError(rtml_last_error().decode('utf-8'))
+        return state == 1
+
+    def wait(self, timeout: float = None) -> bool:
+        # Returns True if the job completed, timeout is in seconds, None waits forever
+        timeout_us = -1 if timeout is None else int(timeout * 1e6)
+        return rtml_job_wait(self._ctx.handle(), self._handle, timeout_us)
+
+    def fileno(self) -> int:
+        # eventfd which becomes readable once the job completed, usable with select, poll or event loops
+        fd = rtml_job_eventfd(self._ctx.handle(), self._handle)
+        if fd < 0:
+            raise RtmlError(rtml_last_error().decode('utf-8'))
+        return fd
+
+    def __await__(self):
+        if self.done():
+            return None
+        loop = asyncio.get_running_loop()
+        try:
+            fd = self.fileno()
+        except RtmlError:  # No eventfd on this platform, wait on a worker thread instead
+            yield from loop.run_in_executor(None, self.wait).__await__()
+            return None
+        future = loop.create_future()
+
+        def on_ready():
+            loop.remove_reader(fd)
+            if not future.done():
+                future.set_result(None)
+
+        loop.add_reader(fd, on_ready)
+        try:
+            yield from future.__await__()
+        finally:
+            loop.remove_reader(fd)
+        return None
+
+
+class Graph:
+    """Records ops and builds them into a graph which is validated once and executed with a single call."""
+
+    def __init__(self, ctx: Isolate):
+        self._ctx = ctx
+        self._nodes = []
+        self._handle = RTML_INVALID_HANDLE
+
+    def op(self, op: Opcode, x, y=None, params: list[int] = None) -> int:
+        # x and y are tensors or node indices returned by earlier calls, returns the index of the new node
+        # params are op specific, e.g. conv_params() of convolutions
+        def operand(t):
+            if t is None:
+                return RTML_INVALID_HANDLE
+            return RTML_NODE_RESULT(t) if isinstance(t, int) else t.handle()
+        assert self._handle == RTML_INVALID_HANDLE, 'Graph is already built'
+        self._nodes.append(rtml_graph_node_t(op.value, RTML_INVALID_HANDLE, operand(x), operand(y), _op_params(params)))
+        return len(self._nodes) - 1
+
+    def build(self):
+        nodes = (rtml_graph_node_t * len(self._nodes))(*self._nodes)
+        self._handle = _check(rtml_graph_build(self._ctx.handle(), nodes, len(self._nodes)))
+        self._nodes = list(nodes)
+
+    def execute(self):
+        if self._handle == RTML_INVALID_HANDLE:
+            self.build()
+        _check(rtml_graph_execute(self._ctx.handle(), self._handle))
+
+    def submit(self) -> Job:
+        # Queues an asynchronous execution, jobs of one isolate run in submission order, different isolates run concurrently
+        if self._handle == RTML_INVALID_HANDLE:
+            self.build()
+        return Job(self._ctx, _check(rtml_graph_submit(self._ctx.handle(), self._handle)))
+
+    def result(self, node: int) -> Tensor:
+        assert self._handle != RTML_INVALID_HANDLE, 'Graph is not built'
+        return Tensor._from_handle(self._ctx, self._nodes[node].r)
+
+    def destroy(self):
+        if self._handle != RTML_INVALID_HANDLE:
+            _check(rtml_graph_destroy(self._ctx.handle(), self._handle))
+            self._handle = RTML_INVALID_HANDLE
@@ -868,8 +868,87 @@ _libs["rtml_runtime"] = load_library("rtml_runtime")
 # No modules
 
 uint32_t = c_uint# /Applications/Xcode.app/Contents/Developer/Platforms/MacOSX.platform/Developer/SDKs/MacOSX.sdk/usr/include/_types/_uint32_t.h: 31
-
-# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 20
+int64_t = c_longlong# /Applications/Xcode.app/Contents/Developer/Platforms/MacOSX.platform/Developer/SDKs/MacOSX.sdk/usr/include/sys/_types/_int64_t.h: 30
+rtml_isolate_id_t = uint32_t# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 33
+rtml_tensor_id_t = uint32_t# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 34
+rtml_graph_id_t = uint32_t# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 35
+uint64_t = c_ulonglong# /Applications/Xcode.app/Contents/Developer/Platforms/MacOSX.platform/Developer/SDKs/MacOSX.sdk/usr/include/_types/_uint64_t.h: 31
+rtml_job_id_t = uint64_t# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 36
+enum_rtml_compute_device_t = c_int# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 39
+RTML_DEVICE_AUTO = 0# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 40
+RTML_DEVICE_CPU = 1# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 41
+RTML_DEVICE_GPU = 2# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 42
+RTML_DEVICE_TPU = 3# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 43
+rtml_compute_device_t = enum_rtml_compute_device_t# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 44
+enum_rtml_dtype_t = c_int# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 46
+RTML_DTYPE_F32 = 0# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 47
+rtml_dtype_t = enum_rtml_dtype_t# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 48
+enum_rtml_opcode_t = c_int# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 51
+RTML_OP_SOFTMAX = 0# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 52
+RTML_OP_SIGMOID = 1# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 53
+RTML_OP_TANH = 2# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 54
+RTML_OP_RELU = 3# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 55
+RTML_OP_GELU = 4# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 56
+RTML_OP_SILU = 5# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 57
+RTML_OP_ADD = 6# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 58
+RTML_OP_SUB = 7# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 59
+RTML_OP_MUL = 8# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 60
+RTML_OP_DIV = 9# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 61
+RTML_OP_MATMUL = 10# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 62
+RTML_OP_SUM = 11# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 63
+RTML_OP_MEAN = 12# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 64
+RTML_OP_MAX = 13# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 65
+RTML_OP_MIN = 14# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 66
+RTML_OP_ARGMAX = 15# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 67
+RTML_OP_LAYERNORM = 16# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 68
+RTML_OP_RMSNORM = 17# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 69
+RTML_OP_CONV1D = 18# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 70
+RTML_OP_CONV2D = 19# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 71
+RTML_OP_COUNT = 20# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 72
+rtml_opcode_t = enum_rtml_opcode_t# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 73
+# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 76
+class struct_rtml_tensor_desc_t(Structure):
+    pass
+
+struct_rtml_tensor_desc_t.__slots__ = [
+    'dtype',
+    'num_dims',
+    'dims',
+    'slice',
+    'slice_offset',
+]
+struct_rtml_tensor_desc_t._fields_ = [
+    ('dtype', uint32_t),
+    ('num_dims', uint32_t),
+    ('dims', int64_t * int(4)),
+    ('slice', rtml_tensor_id_t),
+    ('slice_offset', c_size_t),
+]
+
+
+rtml_tensor_desc_t = struct_rtml_tensor_desc_t# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 82
+# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 88
+class struct_rtml_graph_node_t(Structure):
+    pass
+
+struct_rtml_graph_node_t.__slots__ = [
+    'opcode',
+    'r',
+    'x',
+    'y',
+    'params',
+]
+struct_rtml_graph_node_t._fields_ = [
+    ('opcode', uint32_t),
+    ('r', rtml_tensor_id_t),
+    ('x', rtml_tensor_id_t),
+    ('y', rtml_tensor_id_t),
+    ('params', int64_t * int(8)),
+]
+
+rtml_graph_node_t = struct_rtml_graph_node_t# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 94
+
+# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 96
 for _lib in _libs.values():
     if not _lib.has("rtml_global_init", "cdecl"):
         continue
@@ -878,7 +957,7 @@ for _lib in _libs.values():
     rtml_global_init.restype = c_bool
     break
 
-# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 21
+# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 97
 for _lib in _libs.values():
     if not _lib.has("rtml_global_shutdown", "cdecl"):
         continue
@@ -887,44 +966,314 @@ for _lib in _libs.values():
     rtml_global_shutdown.restype = None
     break
 
-rtml_tensor_id_t = uint32_t# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 23
+# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 98
+for _lib in _libs.values():
+    if not _lib.has("rtml_last_error", "cdecl"):
+        continue
+    rtml_last_error = _lib.get("rtml_last_error", "cdecl")
+    rtml_last_error.argtypes = []
+    rtml_last_error.restype = c_char_p
+    break
 
-# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 24
+# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 100
 for _lib in _libs.values():
     if not _lib.has("rtml_isolate_create", "cdecl"):
         continue
     rtml_isolate_create = _lib.get("rtml_isolate_create", "cdecl")
     rtml_isolate_create.argtypes = [String, uint32_t, c_size_t]
-    rtml_isolate_create.restype = None
+    rtml_isolate_create.restype = rtml_isolate_id_t
     break
 
-# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 29
+# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 101
+for _lib in _libs.values():
+    if not _lib.has("rtml_isolate_destroy", "cdecl"):
+        continue
+    rtml_isolate_destroy = _lib.get("rtml_isolate_destroy", "cdecl")
+    rtml_isolate_destroy.argtypes = [rtml_isolate_id_t]
+    rtml_isolate_destroy.restype = c_bool
+    break
+
+# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 102
 for _lib in _libs.values():
     if not _lib.has("rtml_isolate_exists", "cdecl"):
         continue
     rtml_isolate_exists = _lib.get("rtml_isolate_exists", "cdecl")
-    rtml_isolate_exists.argtypes = [String]
+    rtml_isolate_exists.argtypes = [rtml_isolate_id_t]
     rtml_isolate_exists.restype = c_bool
     break
 
-# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 30
+# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 103
+for _lib in _libs.values():
+    if not _lib.has("rtml_isolate_find", "cdecl"):
+        continue
+    rtml_isolate_find = _lib.get("rtml_isolate_find", "cdecl")
+    rtml_isolate_find.argtypes = [String]
+    rtml_isolate_find.restype = rtml_isolate_id_t
+    break
+
+# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 104
+for _lib in _libs.values():
+    if not _lib.has("rtml_isolate_set_num_threads", "cdecl"):
+        continue
+    rtml_isolate_set_num_threads = _lib.get("rtml_isolate_set_num_threads", "cdecl")
+    rtml_isolate_set_num_threads.argtypes = [rtml_isolate_id_t, uint32_t]
+    rtml_isolate_set_num_threads.restype = c_bool
+    break
+
+# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 106
 for _lib in _libs.values():
     if not _lib.has("rtml_isolate_create_tensor", "cdecl"):
         continue
     rtml_isolate_create_tensor = _lib.get("rtml_isolate_create_tensor", "cdecl")
-    rtml_isolate_create_tensor.argtypes = [String, uint32_t, c_int64, c_int64, c_int64, c_int64, uint32_t, rtml_tensor_id_t, c_size_t]
+    rtml_isolate_create_tensor.argtypes = [rtml_isolate_id_t, uint32_t, int64_t, int64_t, int64_t, int64_t, uint32_t, rtml_tensor_id_t, c_size_t]
     rtml_isolate_create_tensor.restype = rtml_tensor_id_t
     break
 
-# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 39
+# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 119
+for _lib in _libs.values():
+    if not _lib.has("rtml_isolate_wrap_tensor", "cdecl"):
+        continue
+    rtml_isolate_wrap_tensor = _lib.get("rtml_isolate_wrap_tensor", "cdecl")
+    rtml_isolate_wrap_tensor.argtypes = [rtml_isolate_id_t, uint32_t, POINTER(int64_t), POINTER(int64_t), uint32_t, POINTER(None)]
+    rtml_isolate_wrap_tensor.restype = rtml_tensor_id_t
+    break
+
+# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 127
+for _lib in _libs.values():
+    if not _lib.has("rtml_isolate_create_tensors", "cdecl"):
+        continue
+    rtml_isolate_create_tensors = _lib.get("rtml_isolate_create_tensors", "cdecl")
+    rtml_isolate_create_tensors.argtypes = [rtml_isolate_id_t, POINTER(rtml_tensor_desc_t), uint32_t, POINTER(rtml_tensor_id_t)]
+    rtml_isolate_create_tensors.restype = c_bool
+    break
+
+# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 129
+for _lib in _libs.values():
+    if not _lib.has("rtml_tensor_shape", "cdecl"):
+        continue
+    rtml_tensor_shape = _lib.get("rtml_tensor_shape", "cdecl")
+    rtml_tensor_shape.argtypes = [rtml_isolate_id_t, rtml_tensor_id_t, POINTER(int64_t), POINTER(uint32_t)]
+    rtml_tensor_shape.restype = c_bool
+    break
+
+# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 130
+for _lib in _libs.values():
+    if not _lib.has("rtml_tensor_strides", "cdecl"):
+        continue
+    rtml_tensor_strides = _lib.get("rtml_tensor_strides", "cdecl")
+    rtml_tensor_strides.argtypes = [rtml_isolate_id_t, rtml_tensor_id_t, POINTER(int64_t)]
+    rtml_tensor_strides.restype = c_bool
+    break
+
+# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 131
+for _lib in _libs.values():
+    if not _lib.has("rtml_tensor_data", "cdecl"):
+        continue
+    rtml_tensor_data = _lib.get("rtml_tensor_data", "cdecl")
+    rtml_tensor_data.argtypes = [rtml_isolate_id_t, rtml_tensor_id_t]
+    rtml_tensor_data.restype = POINTER(None)
+    break
+
+# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 132
+for _lib in _libs.values():
+    if not _lib.has("rtml_tensor_data_size", "cdecl"):
+        continue
+    rtml_tensor_data_size = _lib.get("rtml_tensor_data_size", "cdecl")
+    rtml_tensor_data_size.argtypes = [rtml_isolate_id_t, rtml_tensor_id_t]
+    rtml_tensor_data_size.restype = c_size_t
+    break
+
+# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 133
+for _lib in _libs.values():
+    if not _lib.has("rtml_tensor_fill", "cdecl"):
+        continue
+    rtml_tensor_fill = _lib.get("rtml_tensor_fill", "cdecl")
+    rtml_tensor_fill.argtypes = [rtml_isolate_id_t, rtml_tensor_id_t, c_float]
+    rtml_tensor_fill.restype = c_bool
+    break
+
+# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 134
+for _lib in _libs.values():
+    if not _lib.has("rtml_tensor_set_name", "cdecl"):
+        continue
+    rtml_tensor_set_name = _lib.get("rtml_tensor_set_name", "cdecl")
+    rtml_tensor_set_name.argtypes = [rtml_isolate_id_t, rtml_tensor_id_t, String]
+    rtml_tensor_set_name.restype = c_bool
+    break
+
+# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 135
 for _lib in _libs.values():
     if not _lib.has("rtml_tensor_print", "cdecl"):
         continue
     rtml_tensor_print = _lib.get("rtml_tensor_print", "cdecl")
-    rtml_tensor_print.argtypes = [String, rtml_tensor_id_t]
+    rtml_tensor_print.argtypes = [rtml_isolate_id_t, rtml_tensor_id_t]
     rtml_tensor_print.restype = c_char_p
     break
 
+# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 138
+class struct_DLManagedTensor(Structure):
+    pass
+
+# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 140
+for _lib in _libs.values():
+    if not _lib.has("rtml_tensor_to_dlpack", "cdecl"):
+        continue
+    rtml_tensor_to_dlpack = _lib.get("rtml_tensor_to_dlpack", "cdecl")
+    rtml_tensor_to_dlpack.argtypes = [rtml_isolate_id_t, rtml_tensor_id_t]
+    rtml_tensor_to_dlpack.restype = POINTER(struct_DLManagedTensor)
+    break
+
+# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 142
+for _lib in _libs.values():
+    if not _lib.has("rtml_isolate_from_dlpack", "cdecl"):
+        continue
+    rtml_isolate_from_dlpack = _lib.get("rtml_isolate_from_dlpack", "cdecl")
+    rtml_isolate_from_dlpack.argtypes = [rtml_isolate_id_t, POINTER(struct_DLManagedTensor)]
+    rtml_isolate_from_dlpack.restype = rtml_tensor_id_t
+    break
+
+# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 143
+for _lib in _libs.values():
+    if not _lib.has("rtml_dlpack_release", "cdecl"):
+        continue
+    rtml_dlpack_release = _lib.get("rtml_dlpack_release", "cdecl")
+    rtml_dlpack_release.argtypes = [POINTER(struct_DLManagedTensor)]
+    rtml_dlpack_release.restype = None
+    break
+
+# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 145
+for _lib in _libs.values():
+    if not _lib.has("rtml_tensor_op", "cdecl"):
+        continue
+    rtml_tensor_op = _lib.get("rtml_tensor_op", "cdecl")
+    rtml_tensor_op.argtypes = [rtml_isolate_id_t, uint32_t, rtml_tensor_id_t, rtml_tensor_id_t, rtml_tensor_id_t]
+    rtml_tensor_op.restype = c_bool
+    break
+
+# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 146
+for _lib in _libs.values():
+    if not _lib.has("rtml_tensor_op_params", "cdecl"):
+        continue
+    rtml_tensor_op_params = _lib.get("rtml_tensor_op_params", "cdecl")
+    rtml_tensor_op_params.argtypes = [rtml_isolate_id_t, uint32_t, rtml_tensor_id_t, rtml_tensor_id_t, rtml_tensor_id_t, POINTER(int64_t)]
+    rtml_tensor_op_params.restype = c_bool
+    break
+
+# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 148
+for _lib in _libs.values():
+    if not _lib.has("rtml_graph_build", "cdecl"):
+        continue
+    rtml_graph_build = _lib.get("rtml_graph_build", "cdecl")
+    rtml_graph_build.argtypes = [rtml_isolate_id_t, POINTER(rtml_graph_node_t), uint32_t]
+    rtml_graph_build.restype = rtml_graph_id_t
+    break
+
+# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 149
+for _lib in _libs.values():
+    if not _lib.has("rtml_graph_execute", "cdecl"):
+        continue
+    rtml_graph_execute = _lib.get("rtml_graph_execute", "cdecl")
+    rtml_graph_execute.argtypes = [rtml_isolate_id_t, rtml_graph_id_t]
+    rtml_graph_execute.restype = c_bool
+    break
+
+# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 150
+for _lib in _libs.values():
+    if not _lib.has("rtml_graph_destroy", "cdecl"):
+        continue
+    rtml_graph_destroy = _lib.get("rtml_graph_destroy", "cdecl")
+    rtml_graph_destroy.argtypes = [rtml_isolate_id_t, rtml_graph_id_t]
+    rtml_graph_destroy.restype = c_bool
+    break
+
+# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 151
+for _lib in _libs.values():
+    if not _lib.has("rtml_graph_run", "cdecl"):
+        continue
+    rtml_graph_run = _lib.get("rtml_graph_run", "cdecl")
+    rtml_graph_run.argtypes = [rtml_isolate_id_t, POINTER(rtml_graph_node_t), uint32_t]
+    rtml_graph_run.restype = c_bool
+    break
+
+# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 155
+for _lib in _libs.values():
+    if not _lib.has("rtml_graph_submit", "cdecl"):
+        continue
+    rtml_graph_submit = _lib.get("rtml_graph_submit", "cdecl")
+    rtml_graph_submit.argtypes = [rtml_isolate_id_t, rtml_graph_id_t]
+    rtml_graph_submit.restype = rtml_job_id_t
+    break
+
+# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 156
+for _lib in _libs.values():
+    if not _lib.has("rtml_job_poll", "cdecl"):
+        continue
+    rtml_job_poll = _lib.get("rtml_job_poll", "cdecl")
+    rtml_job_poll.argtypes = [rtml_isolate_id_t, rtml_job_id_t]
+    rtml_job_poll.restype = c_int
+    break
+
+# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 157
+for _lib in _libs.values():
+    if not _lib.has("rtml_job_wait", "cdecl"):
+        continue
+    rtml_job_wait = _lib.get("rtml_job_wait", "cdecl")
+    rtml_job_wait.argtypes = [rtml_isolate_id_t, rtml_job_id_t, int64_t]
+    rtml_job_wait.restype = c_bool
+    break
+
+# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 158
+for _lib in _libs.values():
+    if not _lib.has("rtml_job_eventfd", "cdecl"):
+        continue
+    rtml_job_eventfd = _lib.get("rtml_job_eventfd", "cdecl")
+    rtml_job_eventfd.argtypes = [rtml_isolate_id_t, rtml_job_id_t]
+    rtml_job_eventfd.restype = c_int
+    break
+
+# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 159
+for _lib in _libs.values():
+    if not _lib.has("rtml_job_release", "cdecl"):
+        continue
+    rtml_job_release = _lib.get("rtml_job_release", "cdecl")
+    rtml_job_release.argtypes = [rtml_isolate_id_t, rtml_job_id_t]
+    rtml_job_release.restype = c_bool
+    break
+
+# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 27
+try:
+    RTML_MAX_DIMS = 4
+except:
+    pass
+
+# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 28
+try:
+    RTML_MAX_OP_PARAMS = 8
+except:
+    pass
+
+# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 29
+try:
+    RTML_INVALID_HANDLE = 0
+except:
+    pass
+
+# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 30
+try:
+    RTML_NODE_RESULT_BIT = 0x80000000
+except:
+    pass
+
+# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 31
+def RTML_NODE_RESULT(i):
+    return (RTML_NODE_RESULT_BIT | (uint32_t (ord_if_char(i))).value)
+
+rtml_tensor_desc_t = struct_rtml_tensor_desc_t# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 82
+
+rtml_graph_node_t = struct_rtml_graph_node_t# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 94
+
+DLManagedTensor = struct_DLManagedTensor# /Users/mario/Documents/projects/rtml/runtime/rtml_capi.h: 138
+
 # No inserted files
 
 # No prefix-stripping
@@ -2,6 +2,9 @@ cmake -S . -B bin
 cmake --build bin --config Release -j12
 bench=bin/benchmark/rtml_benchmark # Difference build than from the IDE
 plot=benchmark/plot.py
-rm benchmark.csv
-$bench --benchmark_format=csv > benchmark.csv
-python3 $plot -f benchmark.csv
\ No newline at end of file
+rm -f benchmark.csv roofline.csv models.csv batching.csv
+$bench --benchmark_filter=roofline --benchmark_format=csv > roofline.csv # Machine peak calibration data
+$bench --benchmark_filter=model_ --benchmark_format=csv > models.csv # End-to-end model latency percentiles
+$bench --benchmark_filter=batching_ --benchmark_format=csv > batching.csv # Dynamic batching load generator
+$bench '--benchmark_filter=-roofline|model_|batching_' --benchmark_format=csv > benchmark.csv
+python3 $plot -f benchmark.csv
@@ -0,0 +1,167 @@
+// Copyright Mario "Neo" Sieg 2024. All rights reserved. mario.sieg.64@gmail.com
+// CPU backend only!
+// Fused, tiled scaled dot product attention (flash attention style)
+// Q/K/V are processed in tiles which fit into L2 and softmax is computed online with running row maxima and sums,
+// so the seq_q x seq_kv score matrix is never materialized - memory is O(seq) instead of O(seq^2)
+
+#include "attention.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+#include <unistd.h>
+
+#include "blas_vec.hpp"
+#include "tensor.hpp"
+
+namespace rtml::blas {
+    static constexpr dim k_max_tile {64}; // Upper bound of tile rows, bounds the score tile on the stack to 16 KiB
+
+    [[nodiscard]] static auto l2_cache_size() noexcept -> std::size_t {
+        static const std::size_t size {[]() noexcept -> std::size_t {
+#ifdef _SC_LEVEL2_CACHE_SIZE
+            if (const long bytes {sysconf(_SC_LEVEL2_CACHE_SIZE)}; bytes > 0)
+                return static_cast<std::size_t>(bytes);
+#endif
+            return 1_mib; // Common L2 size of current desktop and server cores
+        }()};
+        return size;
+    }
+
+    auto attention_tile_size(const dim head_dim) noexcept -> attention_tiles {
+        const std::size_t budget {l2_cache_size() / 2}; // Leave room for the other hyperthread and the output rows
+        attention_tiles tiles {.q_rows=k_max_tile, .kv_rows=k_max_tile};
+        const auto bytes {[&]() noexcept -> std::size_t { // Q + O tiles, K + V tiles and the score tile
+            return static_cast<std::size_t>((2*tiles.q_rows + 2*tiles.kv_rows)*head_dim + tiles.q_rows*tiles.kv_rows)*sizeof(float);
+        }};
+        while (bytes() > budget && tiles.kv_rows > 8) {
+            tiles.q_rows >>= 1;
+            tiles.kv_rows >>= 1;
+        }
+        return tiles;
+    }
+
+    auto validate_attention(
+        const tensor<>& r,
+        const tensor<>& q,
+        const tensor<>& k,
+        const tensor<>& v
+    ) noexcept -> const char* {
+        if (!r.is_shape_eq(&q)) [[unlikely]]
+            return "result shape mismatch";
+        if (!k.is_shape_eq(&v)) [[unlikely]]
+            return "key and value shape mismatch";
+        if (q.dims()[0] != k.dims()[0]) [[unlikely]]
+            return "query and key head dim mismatch";
+        if (q.dims()[3] != k.dims()[3]) [[unlikely]]
+            return "batch size mismatch";
+        if (q.dims()[2] % k.dims()[2] != 0) [[unlikely]]
+            return "query heads must be a multiple of key/value heads";
+        for (const tensor<>* const t : {&r, &q, &k, &v})
+            if (t->strides()[0] != dtype_traits<dtypes::f32>::k_size) [[unlikely]]
+                return "operands must be dense in dim 0";
+        return nullptr;
+    }
+
+    // One query tile of one head: o[i] = softmax(q[i] @ k^T * scale) @ v for nq rows
+    // Key/value tiles are streamed through while the query tile, running maxima and sums stay resident
+    static auto RTML_HOT attention_tile(
+        const dim head_dim,
+        const dim nq,            // Query rows of this tile
+        const dim kv_len,        // Keys visible to the last query row of this tile
+        const dim kv_rows,       // Rows per key/value tile
+        const dim visible,       // Keys visible to the first query row, grows by one per row if causal, else kv_len
+        const bool causal,
+        const float scale,
+        const std::uint8_t* const q, const dim q_stride,
+        const std::uint8_t* const k, const dim k_stride,
+        const std::uint8_t* const v, const dim v_stride,
+        std::uint8_t* const o, const dim o_stride
+    ) noexcept -> void {
+        std::array<float, k_max_tile*k_max_tile> scores;
+        std::array<float, k_max_tile> max;
+        std::array<float, k_max_tile> sum;
+        max.fill(vec::k_online_softmax_max<float>);
+        sum.fill(0.0f);
+        for (dim i {}; i < nq; ++i)
+            std::fill_n(reinterpret_cast<float*>(o + i*o_stride), head_dim, 0.0f);
+        for (dim kv0 {}; kv0 < kv_len; kv0 += kv_rows) {
+            const dim nk {std::min(kv_rows, kv_len - kv0)};
+            for (dim i {}; i < nq; ++i) { // S = Q K^T * scale for the visible part of the tile
+                const dim n {std::clamp<dim>((causal ? visible + i : visible) - kv0, 0, nk)};
+                const auto* const qi {reinterpret_cast<const float*>(q + i*q_stride)};
+                float* const si {scores.data() + i*k_max_tile};
+                for (dim j {}; j < n; ++j) {
+                    vec::hdot(static_cast<std::size_t>(head_dim), si + j, qi, reinterpret_cast<const float*>(k + (kv0+j)*k_stride));
+                    si[j] *= scale;
+                }
+            }
+            for (dim i {}; i < nq; ++i) { // Online softmax and O += P V
+                const dim n {std::clamp<dim>((causal ? visible + i : visible) - kv0, 0, nk)};
+                if (!n) continue; // Fully masked
+                const float* const si {scores.data() + i*k_max_tile};
+                float tile_max {max[i]};
+                for (dim j {}; j < n; ++j)
+                    tile_max = std::max(tile_max, si[j]);
+                const float correction {std::exp(max[i] - tile_max)};
+                auto* const oi {reinterpret_cast<float*>(o + i*o_stride)};
+                float row_sum {sum[i]*correction};
+                for (dim d {}; d < head_dim; ++d)
+                    oi[d] *= correction;
+                for (dim j {}; j < n; ++j) {
+                    const float p {std::exp(si[j] - tile_max)};
+                    row_sum += p;
+                    const auto* const vj {reinterpret_cast<const float*>(v + (kv0+j)*v_stride)};
+                    for (dim d {}; d < head_dim; ++d)
+                        oi[d] += p*vj[d];
+                }
+                max[i] = tile_max;
+                sum[i] = row_sum;
+            }
+        }
+        for (dim i {}; i < nq; ++i) {
+            if (sum[i] <= 0.0f) continue; // No visible keys, output stays zero
+            const float inv {1.0f / sum[i]};
+            auto* const oi {reinterpret_cast<float*>(o + i*o_stride)};
+            for (dim d {}; d < head_dim; ++d)
+                oi[d] *= inv;
+        }
+    }
+
+    auto attention(
+        const compute_ctx& ctx,
+        tensor<>& r,
+        const tensor<>& q,
+        const tensor<>& k,
+        const tensor<>& v,
+        const attention_params& params
+    ) noexcept -> void {
+        assert(!validate_attention(r, q, k, v)); // Debug only verification - ! must be checked by the caller
+        const auto [head_dim, seq_q, heads, batch] {q.dims()};
+        const dim seq_kv {k.dims()[1]};
+        const dim group {heads / k.dims()[2]};
+        const attention_tiles tiles {attention_tile_size(head_dim)};
+        const dim q_tiles {(seq_q + tiles.q_rows - 1) / tiles.q_rows};
+        const dim items {batch*heads*q_tiles};
+        const dim causal_offset {seq_kv - seq_q}; // Query i sees keys [0, i + causal_offset]
+        // Items are assigned round robin, with a causal mask later query tiles see more keys, so contiguous ranges would be unbalanced
+        for (dim item {ctx.thread_idx}; item < items; item += ctx.num_threads) {
+            const dim qt {item % q_tiles};
+            const dim h {item / q_tiles % heads};
+            const dim b {item / (q_tiles*heads)};
+            const dim q0 {qt*tiles.q_rows};
+            const dim nq {std::min(tiles.q_rows, seq_q - q0)};
+            const dim visible {params.causal ? q0 + causal_offset + 1 : seq_kv}; // Can be <= 0 if seq_q > seq_kv
+            const dim kv_len {params.causal ? std::clamp<dim>(q0 + nq + causal_offset, 0, seq_kv) : seq_kv};
+            const dim kvh {h / group};
+            attention_tile(
+                head_dim, nq, kv_len, tiles.kv_rows, visible, params.causal, params.scale,
+                q.ptr() + b*q.strides()[3] + h*q.strides()[2] + q0*q.strides()[1], q.strides()[1],
+                k.ptr() + b*k.strides()[3] + kvh*k.strides()[2], k.strides()[1],
+                v.ptr() + b*v.strides()[3] + kvh*v.strides()[2], v.strides()[1],
+                r.ptr() + b*r.strides()[3] + h*r.strides()[2] + q0*r.strides()[1], r.strides()[1]
+            );
+        }
+    }
+}
@@ -0,0 +1,46 @@
+// Copyright Mario "Neo" Sieg 2024. All rights reserved. mario.sieg.64@gmail.com
+// CPU backend only!
+// Fused, tiled scaled dot product attention (flash attention style)
+// Q/K/V are processed in tiles which fit into L2 and softmax is computed online with running row maxima and sums,
+// so the seq_q x seq_kv score matrix is never materialized - memory is O(seq) instead of O(seq^2)
+
+#pragma once
+
+#include "base.hpp"
+#include "blas.hpp"
+#include "tensor_base.hpp"
+
+namespace rtml::blas {
+    struct attention_params final {
+        float scale {};      // Score scale, usually 1 / sqrt(head_dim)
+        bool causal {};      // Query i attends to keys j <= i + seq_kv - seq_q (aligned to the end of the keys)
+    };
+
+    // Tile sizes (rows of Q and K/V per tile) for a head dimension, chosen so that the Q, K, V, O tiles and the score tile fit into half of L2
+    struct attention_tiles final {
+        dim q_rows {};
+        dim kv_rows {};
+    };
+    [[nodiscard]] extern auto attention_tile_size(dim head_dim) noexcept -> attention_tiles;
+
+    // r = softmax(q @ k^T * scale + mask) @ v
+    // q, r = [head_dim, seq_q, heads, batch], k, v = [head_dim, seq_kv, kv_heads, batch], rows (dim 0) must be dense
+    // heads must be a multiple of kv_heads (grouped query attention)
+    // Work is split into (batch, head, query tile) items, which are partitioned across threads
+    extern auto attention(
+        const compute_ctx& ctx,
+        tensor<dtypes::f32>& r,
+        const tensor<dtypes::f32>& q,
+        const tensor<dtypes::f32>& k,
+        const tensor<dtypes::f32>& v,
+        const attention_params& params
+    ) noexcept -> void;
+
+    // Checks shapes and layouts of attention operands, returns an error message or nullptr
+    [[nodiscard]] extern auto validate_attention(
+        const tensor<dtypes::f32>& r,
+        const tensor<dtypes::f32>& q,
+        const tensor<dtypes::f32>& k,
+        const tensor<dtypes::f32>& v
+    ) noexcept -> const char*;
+}
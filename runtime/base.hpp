@@ -2,6 +2,7 @@
 
 #pragma once
 
+#include <atomic>
 #include <span>
 #include <string>
 #include <cassert>
@@ -10,11 +11,13 @@
 
 #ifdef _MSC_VER
 #    define RTML_AINLINE __forceinline
+#    define RTML_NOINLINE __declspec(noinline)
 #    define RTML_COLD
 #    define RTML_HOT
 #    define RTML_EXPORT __declspec(dllexport)
 #else
 #    define RTML_AINLINE __attribute__((always_inline))
+#    define RTML_NOINLINE __attribute__((noinline))
 #    define RTML_COLD __attribute__((cold))
 #    define RTML_HOT __attribute__((hot))
 #    define RTML_EXPORT __attribute__((visibility("default")))
@@ -22,14 +25,14 @@
 
 #define RTML_LOG_ENABLE false
 
-#if RTML_LOG_ENABLE
-#    define rtml_log_info SPDLOG_INFO
-#    define rtml_log_warn SPDLOG_WARN
-#    define rtml_log_error SPDLOG_ERROR
+#if RTML_LOG_ENABLE // Log messages allocate, so they are dropped in locked mode
+#    define rtml_log_info(...) do { if (!::rtml::is_runtime_locked()) SPDLOG_INFO(__VA_ARGS__); } while (false)
+#    define rtml_log_warn(...) do { if (!::rtml::is_runtime_locked()) SPDLOG_WARN(__VA_ARGS__); } while (false)
+#    define rtml_log_error(...) do { if (!::rtml::is_runtime_locked()) SPDLOG_ERROR(__VA_ARGS__); } while (false)
 #else
-#    define rtml_log_info(...)
-#    define rtml_log_warn(...)
-#    define rtml_log_error(...)
+#    define rtml_log_info(...) ((void)0)
+#    define rtml_log_warn(...) ((void)0)
+#    define rtml_log_error(...) ((void)0)
 #endif
 
 #define RTML_CCRED "\x1b[31m"
@@ -43,6 +46,17 @@
 namespace rtml {
     [[noreturn]] extern auto RTML_COLD panic(std::string_view msg) -> void;
 
+    // Locked mode: after warm-up (every graph ran once on every thread pool it uses) the runtime is locked and all execution
+    // paths run out of isolate pools and preallocated structures without touching the heap
+    // While locked, log messages and profiler events of threads which never recorded before are dropped and calls which
+    // would allocate (e.g. graph::executor::push) fail, tensors can still be created from isolate pools
+    namespace detail {
+        inline constinit std::atomic_bool g_runtime_locked {};
+    }
+    inline auto lock_runtime() noexcept -> void { detail::g_runtime_locked.store(true, std::memory_order_release); }
+    inline auto unlock_runtime() noexcept -> void { detail::g_runtime_locked.store(false, std::memory_order_release); }
+    [[nodiscard]] inline auto is_runtime_locked() noexcept -> bool { return detail::g_runtime_locked.load(std::memory_order_relaxed); }
+
     constexpr auto operator ""_kib(const unsigned long long int x) noexcept -> unsigned long long int  {
         return x << 10;
     }
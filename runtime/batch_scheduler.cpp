@@ -0,0 +1,117 @@
+// Copyright Mario "Neo" Sieg 2024. All rights reserved. mario.sieg.64@gmail.com
+// CPU backend only!
+// Dynamic request batching for serving: single sample requests from many threads are gathered along the outermost
+// dimension of the model input, executed as one graph run and scattered back to their callers
+// A batch is dispatched once max_batch requests are queued or the oldest request waited max_wait
+
+#include "batch_scheduler.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include "isolate.hpp"
+#include "tensor.hpp"
+#include "thread_pool.hpp"
+
+namespace rtml {
+    [[nodiscard]] static auto batch_dim(const tensor<>& t) noexcept -> dim {
+        return t.dims()[t.dim_count()-1];
+    }
+
+    batch_scheduler::batch_scheduler(std::shared_ptr<isolate> ctx, const batch_graph_builder& build, const batch_config& cfg)
+        : m_ctx{std::move(ctx)}, m_cfg{cfg} {
+        rtml_assert(m_cfg.max_batch > 0, "Max batch size must be positive");
+        m_pool = m_cfg.num_threads ? std::make_unique<thread_pool>(m_cfg.num_threads) : std::make_unique<thread_pool>();
+        for (dim batch {1};; batch = std::min(batch<<1, m_cfg.max_batch)) {
+            batch_graph& g {m_buckets.emplace_back(build(*m_ctx, batch))};
+            rtml_assert(g.input && g.output, "Batch graph must have an input and output");
+            rtml_assert(g.input->is_dense() && g.output->is_dense(), "Batch graph input and output must be dense");
+            rtml_assert(batch_dim(*g.input) == batch && batch_dim(*g.output) == batch, "Outermost dimension must be the batch size {}", batch);
+            const auto sample_in {static_cast<std::size_t>(g.input->elem_count() / batch)};
+            const auto sample_out {static_cast<std::size_t>(g.output->elem_count() / batch)};
+            rtml_assert(m_buckets.size() == 1 || (sample_in == m_sample_in && sample_out == m_sample_out), "Sample shape differs between batch sizes");
+            m_sample_in = sample_in;
+            m_sample_out = sample_out;
+            if (batch == m_cfg.max_batch) break;
+        }
+        m_worker = std::thread{&batch_scheduler::worker_entry, this};
+    }
+
+    batch_scheduler::~batch_scheduler() {
+        {
+            const std::lock_guard lock {m_mtx};
+            m_stop = true;
+        }
+        m_cv.notify_one();
+        m_worker.join();
+    }
+
+    auto batch_scheduler::run(const std::span<const float> input, const std::span<float> output) -> request_timing {
+        rtml_assert(input.size() == m_sample_in && output.size() == m_sample_out, "Request size mismatch");
+        request req {.input=input, .output=output, .submitted=std::chrono::steady_clock::now()};
+        std::unique_lock lock {m_mtx};
+        m_queue.emplace_back(&req);
+        if (m_queue.size() == 1 || m_queue.size() >= static_cast<std::size_t>(m_cfg.max_batch)) // Batch window opens or is full
+            m_cv.notify_one();
+        m_done_cv.wait(lock, [&req] { return req.done; }); // The condition variable outlives the request, unlike an atomic in the request
+        return req.timing;
+    }
+
+    auto batch_scheduler::stats() const -> batch_stats {
+        const std::lock_guard lock {m_mtx};
+        return m_stats;
+    }
+
+    auto batch_scheduler::reset_stats() -> void {
+        const std::lock_guard lock {m_mtx};
+        m_stats = {};
+    }
+
+    auto batch_scheduler::worker_entry() -> void {
+        const auto max_batch {static_cast<std::size_t>(m_cfg.max_batch)};
+        std::vector<request*> batch {};
+        batch.reserve(max_batch);
+        for (;;) {
+            {
+                std::unique_lock lock {m_mtx};
+                m_cv.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+                if (m_queue.empty()) return; // Stop requested and all requests completed
+                const auto deadline {m_queue.front()->submitted + m_cfg.max_wait};
+                m_cv.wait_until(lock, deadline, [&] { return m_stop || m_queue.size() >= max_batch; }); // Collect more requests
+                const std::size_t n {std::min(m_queue.size(), max_batch)};
+                batch.assign(m_queue.begin(), m_queue.begin()+static_cast<std::ptrdiff_t>(n));
+                m_queue.erase(m_queue.begin(), m_queue.begin()+static_cast<std::ptrdiff_t>(n));
+            }
+            execute(batch);
+        }
+    }
+
+    auto batch_scheduler::execute(const std::span<request* const> batch) -> void {
+        const auto start {std::chrono::steady_clock::now()};
+        const auto n {static_cast<dim>(batch.size())};
+        const batch_graph& g {*std::ranges::find_if(m_buckets, [n](const batch_graph& b) { return batch_dim(*b.input) >= n; })};
+        auto* const in {reinterpret_cast<float*>(g.input->ptr())};
+        for (std::size_t i {}; i < batch.size(); ++i) // Gather, unused entries of a larger bucket keep stale data
+            std::memcpy(in + i*m_sample_in, batch[i]->input.data(), m_sample_in*sizeof(float));
+        g.exec.run(*m_pool);
+        const auto* const out {reinterpret_cast<const float*>(g.output->ptr())};
+        for (std::size_t i {}; i < batch.size(); ++i) // Scatter
+            std::memcpy(batch[i]->output.data(), out + i*m_sample_out, m_sample_out*sizeof(float));
+        const auto end {std::chrono::steady_clock::now()};
+        std::chrono::nanoseconds queue_time {};
+        for (request* const req : batch)
+            queue_time += start - req->submitted;
+        {
+            const std::lock_guard lock {m_mtx};
+            m_stats.requests += batch.size();
+            ++m_stats.batches;
+            m_stats.queue_time += queue_time;
+            m_stats.compute_time += end - start;
+            for (request* const req : batch) {
+                req->timing = {.queue_time=start - req->submitted, .compute_time=end - start, .batch_size=n};
+                req->done = true;
+            }
+        }
+        m_done_cv.notify_all();
+    }
+}
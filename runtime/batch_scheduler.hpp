@@ -0,0 +1,104 @@
+// Copyright Mario "Neo" Sieg 2024. All rights reserved. mario.sieg.64@gmail.com
+// CPU backend only!
+// Dynamic request batching for serving: single sample requests from many threads are gathered along the outermost
+// dimension of the model input, executed as one graph run and scattered back to their callers
+// A batch is dispatched once max_batch requests are queued or the oldest request waited max_wait
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <vector>
+
+#include "base.hpp"
+#include "executor.hpp"
+#include "tensor_base.hpp"
+
+namespace rtml {
+    class isolate;
+    class thread_pool;
+
+    // Graph of the served model for a fixed batch size, the batch is the outermost used dimension of input and output
+    // Batch entries must be computed independently of each other (no reductions across the batch dimension)
+    struct batch_graph final {
+        graph::executor exec {};
+        tensor<dtypes::f32>* input {};
+        tensor<dtypes::f32>* output {};
+    };
+
+    // Builds the model graph for the given batch size in the isolate, called once per batch size bucket
+    using batch_graph_builder = std::function<auto (isolate& ctx, dim batch) -> batch_graph>;
+
+    struct batch_config final {
+        dim max_batch {32};                             // Upper bound of requests per graph run
+        std::chrono::microseconds max_wait {500};       // Upper bound of the time the oldest request waits for more requests
+        dim num_threads {0};                            // Threads of the compute pool, 0 = all hardware threads
+    };
+
+    struct request_timing final {
+        std::chrono::nanoseconds queue_time {};   // Submission until its batch started
+        std::chrono::nanoseconds compute_time {}; // Gather, graph run and scatter of its batch
+        dim batch_size {};                        // Requests in its batch
+    };
+
+    struct batch_stats final {
+        std::uint64_t requests {};
+        std::uint64_t batches {};
+        std::chrono::nanoseconds queue_time {};   // Sum over all requests
+        std::chrono::nanoseconds compute_time {}; // Sum over all batches
+        [[nodiscard]] auto mean_batch_size() const noexcept -> double { return batches ? static_cast<double>(requests)/static_cast<double>(batches) : 0.0; }
+    };
+
+    class batch_scheduler final {
+    public:
+        // Graphs are built for power of two batch sizes up to max_batch, partial batches run in the smallest fitting bucket
+        batch_scheduler(std::shared_ptr<isolate> ctx, const batch_graph_builder& build, const batch_config& cfg);
+        batch_scheduler(const batch_scheduler&) = delete;
+        batch_scheduler(batch_scheduler&&) = delete;
+        auto operator=(const batch_scheduler&) -> batch_scheduler& = delete;
+        auto operator=(batch_scheduler&&) -> batch_scheduler& = delete;
+        ~batch_scheduler(); // Completes all queued requests
+
+        // Thread safe, blocks until the request was executed
+        // input and output hold one batch entry: the elements of the model input and output without the batch dimension
+        auto run(std::span<const float> input, std::span<float> output) -> request_timing;
+
+        [[nodiscard]] auto sample_input_size() const noexcept -> std::size_t { return m_sample_in; }
+        [[nodiscard]] auto sample_output_size() const noexcept -> std::size_t { return m_sample_out; }
+        [[nodiscard]] auto config() const noexcept -> const batch_config& { return m_cfg; }
+        [[nodiscard]] auto stats() const -> batch_stats;
+        auto reset_stats() -> void;
+
+    private:
+        struct request final {
+            std::span<const float> input {};
+            std::span<float> output {};
+            std::chrono::steady_clock::time_point submitted {};
+            request_timing timing {};
+            bool done {}; // Guarded by m_mtx
+        };
+
+        auto worker_entry() -> void;
+        auto execute(std::span<request* const> batch) -> void;
+
+        const std::shared_ptr<isolate> m_ctx;
+        const batch_config m_cfg;
+        std::unique_ptr<thread_pool> m_pool;
+        std::vector<batch_graph> m_buckets {}; // Ascending batch sizes, the last one is max_batch
+        std::size_t m_sample_in {};            // Elements of one batch entry of the input
+        std::size_t m_sample_out {};           // Elements of one batch entry of the output
+        mutable std::mutex m_mtx {};
+        std::condition_variable m_cv {};      // Wakes the worker
+        std::condition_variable m_done_cv {}; // Wakes callers whose requests completed
+        std::deque<request*> m_queue {};
+        batch_stats m_stats {};
+        bool m_stop {};
+        std::thread m_worker;
+    };
+}
@@ -6,89 +6,17 @@
 
 #include <algorithm>
 #include <cmath>
+#include <limits>
 
 #include "blas.hpp"
+#include "blas_vec.hpp"
+#include "gemm.hpp"
+#include "graph.hpp"
 #include "isolate.hpp"
+#include "profiler.hpp"
 #include "tensor.hpp"
 
 namespace rtml::blas {
-    namespace scalar { // These are needed to implement the generic tensor operations with vector (for dense) and scalar (for sparse) kernels
-        // TODO: optimize with SIMD and dynamic CPU detection for x86-64: AVX512, AVX2, FMA, SSE and ARM: NEON (SVE in the future?)
-        template <typename S> requires is_dtype<S>
-        [[nodiscard]] static constexpr auto RTML_AINLINE RTML_HOT add(const S x, const S y) noexcept -> S { return x + y; }
-        template <typename S> requires is_dtype<S>
-        [[nodiscard]] static constexpr auto RTML_AINLINE RTML_HOT sub(const S x, const S y) noexcept -> S { return x - y; }
-        template <typename S> requires is_dtype<S>
-        [[nodiscard]] static constexpr auto RTML_AINLINE RTML_HOT mul(const S x, const S y) noexcept -> S { return x * y; }
-        template <typename S> requires is_dtype<S>
-        [[nodiscard]] static constexpr auto RTML_AINLINE RTML_HOT div(const S x, const S y) noexcept -> S { return x / y; }
-    }
-
-    namespace vec {
-        // TODO: optimize with SIMD and dynamic CPU detection for x86-64: AVX512, AVX2, FMA, SSE and ARM: NEON (SVE in the future?)
-        // TODO: optimize with polynomial approximation for tanh, sigmoid, relu, gelu, silu
-        static constexpr float k_rtml_sqrt2pi {0.79788456080286535587989211986876f}; // sqrt(2/PI)
-        static constexpr float k_rtml_gelu_coeff {0.044715f}; // GeLU coefficient
-
-        template <typename S> requires is_dtype<S>
-        static auto RTML_HOT softmax(const std::size_t n, S* const ov, const S* const x) noexcept -> void {
-            for (std::size_t i = 0; i < n; ++i)
-                ov[i] = std::expf(x[i]);
-        }
-        template <typename S> requires is_dtype<S>
-        static auto RTML_HOT sigmoid(const std::size_t n, S* const ov, const S* const x) noexcept -> void {
-            for (std::size_t i = 0; i < n; ++i)
-                ov[i] = 1.0f / (1.0f + std::expf(-x[i]));
-        }
-        template <typename S> requires is_dtype<S>
-        static auto RTML_HOT tanh(const std::size_t n, S* const ov, const S* const x) noexcept -> void {
-            for (std::size_t i = 0; i < n; ++i)
-                ov[i] = std::tanh(x[i]);
-        }
-        template <typename S> requires is_dtype<S>
-        static auto RTML_HOT relu(const std::size_t n, S* const ov, const S* const x) noexcept -> void {
-            for (std::size_t i = 0; i < n; ++i)
-                ov[i] = std::max(x[i], 0.0f);
-        }
-        template <typename S> requires is_dtype<S>
-        static auto RTML_HOT gelu(const std::size_t n, S* const ov, const S* const x) noexcept -> void {
-            for (std::size_t i = 0; i < n; ++i)
-                ov[i] = 0.5f * x[i] * (1.0f + std::tanh(k_rtml_sqrt2pi * x[i] * (1.0f + k_rtml_gelu_coeff * x[i] * x[i])));
-        }
-        template <typename S> requires is_dtype<S>
-        static auto RTML_HOT silu(const std::size_t n, S* const ov, const S* const x) noexcept -> void {
-            for (std::size_t i = 0; i < n; ++i)
-                ov[i] = x[i] / (1.0f + std::exp(-x[i]));
-        }
-        template <typename S> requires is_dtype<S>
-        static auto RTML_HOT add(const std::size_t n, S* const ov, const S* const x, const S* const y) noexcept -> void {
-            for (std::size_t i = 0; i < n; ++i)
-                ov[i] = scalar::add(x[i], y[i]);
-        }
-        template <typename S> requires is_dtype<S>
-        static auto RTML_HOT sub(const std::size_t n, S* const ov, const S* const x, const S* const y) noexcept -> void {
-            for (std::size_t i = 0; i < n; ++i)
-                ov[i] = scalar::sub(x[i], y[i]);
-        }
-        template <typename S> requires is_dtype<S>
-        static auto RTML_HOT mul(const std::size_t n, S* const ov, const S* const x, const S* const y) noexcept -> void {
-            for (std::size_t i = 0; i < n; ++i)
-                ov[i] = scalar::mul(x[i], y[i]);
-        }
-        template <typename S> requires is_dtype<S>
-        static auto RTML_HOT div(const std::size_t n, S* const ov, const S* const x, const S* const y) noexcept -> void {
-            for (std::size_t i = 0; i < n; ++i)
-                ov[i] = scalar::div(x[i], y[i]);
-        }
-        template <typename S> requires is_dtype<S>
-        static auto RTML_HOT dot(const std::size_t n, S* const os, const S* const x, const S* const y) noexcept -> void {
-            double sum = 0.0;
-            for (std::size_t i = 0; i < n; ++i)
-                sum += static_cast<double>(x[i] * y[i]);
-            *os = static_cast<float>(sum);
-        }
-    }
-
     template <typename F, typename S>
     concept is_vector_op = requires {
         is_dtype<S>;
@@ -106,6 +34,42 @@ namespace rtml::blas {
         sparse
     };
 
+    static constexpr dim k_cost_arith {1};            // Small op cost model: cost of an element of +, -, *, /, relu
+    static constexpr dim k_cost_transcendental {8};   // Cost of an element of exp or tanh based ops
+    static constexpr dim k_cost_norm {4};             // Cost of an element of the normalizations (statistics and affine pass)
+
+    static constexpr dim k_min_chunk_bytes {4096};   // Smallest dynamic chunk, amortizes the atomic claim
+    static constexpr dim k_adaptive_chunks {8};       // Dynamic chunks per thread of the adaptive schedule
+
+    // Splits the rows [0, rc) of a dispatch across threads with the row schedule of the pool and calls f(begin, end) for every claimed chunk
+    // Every row is passed to exactly one f call of one thread, the order of rows within a thread is not specified for dynamic schedules
+    template <typename F>
+    static auto for_each_row_chunk(const compute_ctx& ctx, const dim rc, const dim row_bytes, F&& f) noexcept -> void {
+        const dim tc {ctx.num_threads};
+        const row_schedule schedule {ctx.shared ? ctx.shared->schedule : row_schedule::static_even};
+        if (schedule == row_schedule::static_even || tc == 1) {
+            const dim rpt {(rc + tc - 1)/tc};                           // Rows per thread
+            const dim row_start {std::min(rpt * ctx.thread_idx, rc)};   // Current thread row interval start
+            f(row_start, std::min(row_start + rpt, rc));
+            return;
+        }
+        const dim min_chunk {std::max<dim>(1, k_min_chunk_bytes / std::max<dim>(1, row_bytes))};
+        compute_shared& shared {*ctx.shared}; // Rows are independent, the dispatch join orders the results
+        const std::uint64_t seq {shared.next_call(ctx.thread_idx)};
+        dim begin {}, end {};
+        if (schedule == row_schedule::guided) {
+            while (shared.claim_rows(seq, rc, [=](const dim pos) noexcept { return std::max(min_chunk, (rc - pos)/(2*tc)); }, begin, end))
+                f(begin, end);
+            return;
+        }
+        const dim home {rc/(2*tc)};                                     // Static rows per thread, no contention and locality across dispatches
+        if (home) f(home*ctx.thread_idx, home*(ctx.thread_idx+1));
+        const dim base {home*tc};
+        const dim chunk {std::max(min_chunk, (rc - base + k_adaptive_chunks*tc - 1)/(k_adaptive_chunks*tc))};
+        while (shared.claim_rows(seq, rc - base, [=](dim) noexcept { return chunk; }, begin, end))
+            f(base + begin, base + end);
+    }
+
     // Generic tensor binary operation like +, -, *, /
     template <const kernel_density density, typename S, typename V_OP, typename S_OP>
         requires is_dtype<S> && is_vector_op<V_OP, S> && is_scalar_op<S_OP, S>
@@ -129,39 +93,114 @@ namespace rtml::blas {
         const auto [r_d0, r_d1, r_d2, r_d3] {r.dims()};                 // Dimensions of r
         const auto [r_s0, r_s1, r_s2, r_s3] {r.strides()};              // Strides of r
         const dim rc {r.row_count()};                                   // Row count (number of columns in first dim): r.dims()[0]
-        const dim tidx {ctx.thread_idx};                                // Current thread index
-        const dim tc {ctx.num_threads};                                 // Current thread count
-        const dim rpt {(rc + tc - 1)/tc};                               // Rows per thread
-        const dim row_start {rpt * tidx};                               // Current thread row interval start
-        const dim row_end {std::min(row_start + rpt, rc)};          // Current thread row interval end
-        for (dim row_i {row_start}; row_i < row_end; ++row_i) {         // For each row
-            const dim x_i3 {row_i / (x_d2*x_d1)};                       // Dimension 3 - Linear index to 3D index
-            const dim x_i2 {(row_i - x_i3*x_d2*x_d1) / x_d1};           // Dimension 2 - Linear index to 3D index
-            const dim x_i1 {row_i - x_i3*x_d2*x_d1 - x_i2*x_d1};        // Dimension 1 - Linear index to 3D index
-            const dim y_i3 {x_i3 % y_d3};                               // Dimension 3 Broadcast x -> y
-            const dim y_i2 {x_i2 % y_d2};                               // Dimension 2 Broadcast x -> y
-            const dim y_i1 {x_i1 % y_d1};                               // Dimension 1 Broadcast x -> y
-            auto* const p_r {reinterpret_cast<S*>(                      // Result destination ptr
-                b_r + x_i3*r_s3 + x_i2*r_s2 + x_i1*r_s1
-            )};
-            const auto* const p_x {reinterpret_cast<const S*>(          // X Source ptr
-                b_x + x_i3*x_s3 + x_i2*x_s2 + x_i1*x_s1
-            )};
-            if constexpr (density == kernel_density::dense) {           // Dense kernel for contiguous layout
-                const auto* const p_y {reinterpret_cast<const S*>(      // Y Source ptr
-                    b_y + y_i3*y_s3 + y_i2*y_s2 + y_i1*y_s1
+        const dim row_bytes {x_d0*static_cast<dim>(sizeof(S))};         // Cost estimate of a row for chunking
+        for_each_row_chunk(ctx, rc, row_bytes, [&](const dim row_start, const dim row_end) {
+            for (dim row_i {row_start}; row_i < row_end; ++row_i) {     // For each row
+                const dim x_i3 {row_i / (x_d2*x_d1)};                   // Dimension 3 - Linear index to 3D index
+                const dim x_i2 {(row_i - x_i3*x_d2*x_d1) / x_d1};       // Dimension 2 - Linear index to 3D index
+                const dim x_i1 {row_i - x_i3*x_d2*x_d1 - x_i2*x_d1};    // Dimension 1 - Linear index to 3D index
+                const dim y_i3 {x_i3 % y_d3};                           // Dimension 3 Broadcast x -> y
+                const dim y_i2 {x_i2 % y_d2};                           // Dimension 2 Broadcast x -> y
+                const dim y_i1 {x_i1 % y_d1};                           // Dimension 1 Broadcast x -> y
+                auto* const p_r {reinterpret_cast<S*>(                  // Result destination ptr
+                    b_r + x_i3*r_s3 + x_i2*r_s2 + x_i1*r_s1
                 )};
-                for (dim i {}; i < x_d0 / y_d0; ++i) {                  // Macro Kernel
-                    v_op(y_d0, p_r + i*y_d0, p_x + i*y_d0, p_y);        // Micro Kernel - Apply vector operation
-                }
-            } else {                                                    // Sparse kernel
-                for (dim i {}; i < r_d0; ++i) {                         // Micro Kernel
+                const auto* const p_x {reinterpret_cast<const S*>(      // X Source ptr
+                    b_x + x_i3*x_s3 + x_i2*x_s2 + x_i1*x_s1
+                )};
+                if constexpr (density == kernel_density::dense) {       // Dense kernel for contiguous layout
                     const auto* const p_y {reinterpret_cast<const S*>(  // Y Source ptr
-                        b_y + y_i3*y_s3 + y_i2*y_s2 + y_i1*y_s1 + i%y_d0*y_s0
+                        b_y + y_i3*y_s3 + y_i2*y_s2 + y_i1*y_s1
                     )};
-                    p_r[i] = s_op(p_x[i], *p_y);                        // Apply scalar operation
+                    for (dim i {}; i < x_d0 / y_d0; ++i) {              // Macro Kernel
+                        v_op(y_d0, p_r + i*y_d0, p_x + i*y_d0, p_y);    // Micro Kernel - Apply vector operation
+                    }
+                } else {                                                // Sparse kernel
+                    for (dim i {}; i < r_d0; ++i) {                     // Micro Kernel
+                        const auto* const p_y {reinterpret_cast<const S*>( // Y Source ptr
+                            b_y + y_i3*y_s3 + y_i2*y_s2 + y_i1*y_s1 + i%y_d0*y_s0
+                        )};
+                        p_r[i] = s_op(p_x[i], *p_y);                    // Apply scalar operation
+                    }
                 }
             }
+        });
+    }
+
+    using shape = std::array<dim, tensor<>::k_max_dims>;
+
+    // Loop nest of the small op fast path for dense tensors of compile time rank, the innermost dim is fully unrolled for short rows
+    // Dims of Y are either equal to the dims of X or 1 (broadcast), y_strides are element strides which are 0 for broadcast dims
+    template <const dim rank, typename S, typename S_OP>
+    static auto RTML_HOT small_binary_nest(
+        S* const p_r,
+        const S* const p_x,
+        const S* const p_y,
+        const shape& x_strides,
+        const shape& y_strides,
+        const shape& dims,
+        S_OP&& s_op
+    ) noexcept -> void {
+        if constexpr (rank == 1) {
+            if (y_strides[0]) {
+                for (dim i {}; i < dims[0]; ++i)
+                    p_r[i] = s_op(p_x[i], p_y[i]);
+            } else {
+                const S y {*p_y};
+                for (dim i {}; i < dims[0]; ++i)
+                    p_r[i] = s_op(p_x[i], y);
+            }
+        } else {
+            for (dim i {}; i < dims[rank-1]; ++i)
+                small_binary_nest<rank-1>(p_r + i*x_strides[rank-1], p_x + i*x_strides[rank-1], p_y + i*y_strides[rank-1], x_strides, y_strides, dims, s_op);
+        }
+    }
+
+    // Small op fast path of the binary ops on a single thread: no row index decomposition, no thread split
+    // Falls back to the generic kernel (on one thread) for non dense operands and repeated (tiled) broadcasts
+    template <typename S, typename V_OP, typename S_OP>
+        requires is_dtype<S> && is_vector_op<V_OP, S> && is_scalar_op<S_OP, S>
+    static auto RTML_HOT small_binary(
+        tensor<S>& r,
+        const tensor<S>& x,
+        const tensor<S>& y,
+        V_OP&& v_op,
+        S_OP&& s_op
+    ) noexcept -> void {
+        auto* const p_r {reinterpret_cast<S*>(r.ptr())};
+        const auto* const p_x {reinterpret_cast<const S*>(x.ptr())};
+        const auto* const p_y {reinterpret_cast<const S*>(y.ptr())};
+        const dim n {x.elem_count()};
+        const bool dense {r.is_dense() && x.is_dense() && y.is_dense()};
+        if (dense && y.elem_count() == n) { // Same shape: one row loop of the vector kernel on this thread
+            blas_tensor_gen_op_binary_kernel<kernel_density::dense, S>(compute_ctx{}, r, x, y, v_op, s_op);
+            return;
+        }
+        const shape& dims {x.dims()};
+        shape x_strides {}, y_strides {};
+        dim rank {1};
+        bool broadcast {dense};
+        for (dim i {}, xs {1}, ys {1}; i < tensor<S>::k_max_dims; ++i) {
+            broadcast &= y.dims()[i] == 1 || y.dims()[i] == dims[i];
+            x_strides[i] = xs;
+            y_strides[i] = y.dims()[i] == 1 ? 0 : ys;
+            xs *= dims[i];
+            ys *= y.dims()[i];
+            if (dims[i] > 1) rank = i+1;
+        }
+        if (!broadcast) [[unlikely]] {
+            const compute_ctx single {};
+            if (y.strides()[0] == dtype_traits<S>::k_size)
+                blas_tensor_gen_op_binary_kernel<kernel_density::dense, S>(single, r, x, y, v_op, s_op);
+            else
+                blas_tensor_gen_op_binary_kernel<kernel_density::sparse, S>(single, r, x, y, v_op, s_op);
+            return;
+        }
+        switch (rank) {
+            case 1: small_binary_nest<1>(p_r, p_x, p_y, x_strides, y_strides, dims, s_op); return;
+            case 2: small_binary_nest<2>(p_r, p_x, p_y, x_strides, y_strides, dims, s_op); return;
+            case 3: small_binary_nest<3>(p_r, p_x, p_y, x_strides, y_strides, dims, s_op); return;
+            default: small_binary_nest<4>(p_r, p_x, p_y, x_strides, y_strides, dims, s_op); return;
         }
     }
 
@@ -176,8 +215,12 @@ namespace rtml::blas {
         V_OP&& v_op,        // Vector OP
         S_OP&& s_op         // Scalar OP
     ) noexcept -> void {
+        if (r.elem_count()*k_cost_arith <= small_op_limit()) { // Small op fast path on thread 0, the other threads have nothing to do
+            if (ctx.thread_idx == 0) small_binary(r, x, y, v_op, s_op);
+            return;
+        }
         if (y.strides()[0] == dtype_traits<S>::k_size) { // Dense or sparse kernel? Sparse means non-contiguous memory layout
-            blas_tensor_gen_op_binary_kernel<kernel_density::dense, S, V_OP, S_OP>(
+            blas_tensor_gen_op_binary_kernel<kernel_density::dense, S>(
                 ctx,
                 r,
                 x,
@@ -186,7 +229,7 @@ namespace rtml::blas {
                 s_op
             );
         } else {
-            blas_tensor_gen_op_binary_kernel<kernel_density::sparse, S, V_OP, S_OP>(
+            blas_tensor_gen_op_binary_kernel<kernel_density::sparse, S>(
                 ctx,
                 r,
                 x,
@@ -197,11 +240,54 @@ namespace rtml::blas {
         }
     }
 
+    // Generic tensor unary operation like relu, gelu, softmax - applied to each row (dim 0) of X
+    // X and R must be dense in dim 0, rows are partitioned across threads by the row schedule of the pool
+    template <typename S, typename V_OP>
+        requires is_dtype<S> && std::is_nothrow_invocable_r_v<void, V_OP, std::size_t, S*, const S*>
+    static auto RTML_HOT blas_tensor_gen_op_unary(
+        const compute_ctx& ctx,
+        tensor<S>& r,       // result
+        const tensor<S>& x, // X = src 0
+        V_OP&& v_op,        // Vector OP
+        const dim elem_cost // Cost of one element for the small op cost model
+    ) noexcept -> void {
+        assert(x.is_shape_eq(&r));                                      // Debug only verification - ! must be checked by validation function
+        assert(x.strides()[0] == dtype_traits<S>::k_size);              // Debug only verification - ! must be checked by validation function
+        assert(r.strides()[0] == dtype_traits<S>::k_size);              // Debug only verification - ! must be checked by validation function
+        if (r.elem_count()*elem_cost <= small_op_limit() && r.is_dense() && x.is_dense()) { // Small op fast path on thread 0
+            if (ctx.thread_idx != 0) return;
+            const dim d0 {x.dims()[0]};
+            auto* p_r {reinterpret_cast<S*>(r.ptr())};
+            const auto* p_x {reinterpret_cast<const S*>(x.ptr())};
+            for (dim row_i {}; row_i < x.row_count(); ++row_i, p_r += d0, p_x += d0)
+                v_op(static_cast<std::size_t>(d0), p_r, p_x);
+            return;
+        }
+        std::uint8_t* const b_r {r.ptr()};                              // Data base ptr
+        const std::uint8_t* const b_x {x.ptr()};                        // Data base ptr
+        const auto [x_d0, x_d1, x_d2, x_d3] {x.dims()};                 // Dimensions of x
+        const auto [x_s0, x_s1, x_s2, x_s3] {x.strides()};              // Strides of x
+        const auto [r_s0, r_s1, r_s2, r_s3] {r.strides()};              // Strides of r
+        const dim rc {x.row_count()};                                   // Row count
+        for_each_row_chunk(ctx, rc, x_d0*static_cast<dim>(sizeof(S)), [&](const dim row_start, const dim row_end) {
+            for (dim row_i {row_start}; row_i < row_end; ++row_i) {     // For each row
+                const dim i3 {row_i / (x_d2*x_d1)};                     // Dimension 3 - Linear index to 3D index
+                const dim i2 {(row_i - i3*x_d2*x_d1) / x_d1};           // Dimension 2 - Linear index to 3D index
+                const dim i1 {row_i - i3*x_d2*x_d1 - i2*x_d1};          // Dimension 1 - Linear index to 3D index
+                v_op(                                                   // Apply vector operation to row
+                    static_cast<std::size_t>(x_d0),
+                    reinterpret_cast<S*>(b_r + i3*r_s3 + i2*r_s2 + i1*r_s1),
+                    reinterpret_cast<const S*>(b_x + i3*x_s3 + i2*x_s2 + i1*x_s1)
+                );
+            }
+        });
+    }
+
     /*
      * BLAS SGEMM (Single precision General Matrix Multiply)
      * Compute the matrix product of two matrices X and Y: R = X @ Y
+     * Rows of R are partitioned evenly across threads.
      * TODO: This is a naive implementation and not optimized.
-     * TODO: Thread partitioning
      * TODO: optimize for cache efficiency and SIMD (use vec::dot)
      * TODO: Handle broadcasting
      */
@@ -212,8 +298,8 @@ namespace rtml::blas {
         const tensor<>& y  // Y = src 1
     ) noexcept -> void {
         static_assert(std::is_same_v<std::decay_t<decltype(r)>::dtype, dtypes::f32>);
-        assert(x.is_matmul_compatible(&y));
-        assert(!x.is_transposed());
+        assert(x.dims()[0] == y.dims()[1]); // X = [K, M], Y = [N, K], R = [N, M] (dim 0 first)
+        assert(r.dims()[0] == y.dims()[0] && r.dims()[1] == x.dims()[1]);
         static constexpr dim block_x {16};
         static constexpr dim block_y {16};
         static_assert(block_x == block_y);
@@ -226,10 +312,15 @@ namespace rtml::blas {
         const auto [y_s0, y_s1, y_s2, y_s3] {y.strides()};              // Strides of y
         const auto [r_d0, r_d1, r_d2, r_d3] {r.dims()};                 // Dimensions of r
         const auto [r_s0, r_s1, r_s2, r_s3] {r.strides()};              // Strides of r
+        const dim tidx {ctx.thread_idx};                                // Current thread index
+        const dim tc {ctx.num_threads};                                 // Current thread count
+        const dim rpt {(r_d1 + tc - 1)/tc};                             // Rows per thread
+        const dim row_start {rpt * tidx};                               // Current thread row interval start
+        const dim row_end {std::min(row_start + rpt, r_d1)};            // Current thread row interval end
         for (dim i3 {}; i3 < r_d3; ++i3) {
             for (dim i2 {}; i2 < r_d2; ++i2) {
-                for (dim i1 {}; i1 < r_d1; ++i1) {
-                    for (dim i0 {}; i0 < r_d1; ++i0) {
+                for (dim i0 {row_start}; i0 < row_end; ++i0) {          // For each row of R
+                    for (dim i1 {}; i1 < r_d0; ++i1) {                  // For each column of R
                         double sum = 0.0f; // TODO: optimize and use vec::dot
                         for (dim k {}; k < x_d0; ++k) {
                             const auto* p_x {reinterpret_cast<const dtypes::f32*>(
@@ -250,6 +341,31 @@ namespace rtml::blas {
         }
     }
 
+    // Matmul of operands which are dense in dim 0 with the packed SGEMM, one GEMM per batch (dims 2 and 3)
+    static auto RTML_HOT blas_tensor_sgemm_packed(
+        const compute_ctx& ctx,
+        tensor<>& r,       // result
+        const tensor<>& x, // X = src 0
+        const tensor<>& y  // Y = src 1
+    ) noexcept -> void {
+        static constexpr auto k_size {static_cast<dim>(dtype_traits<dtypes::f32>::k_size)};
+        const auto [x_d0, x_d1, x_d2, x_d3] {x.dims()};                 // Dimensions of x
+        const auto [x_s0, x_s1, x_s2, x_s3] {x.strides()};              // Strides of x
+        const auto [y_s0, y_s1, y_s2, y_s3] {y.strides()};              // Strides of y
+        const auto [r_d0, r_d1, r_d2, r_d3] {r.dims()};                 // Dimensions of r
+        const auto [r_s0, r_s1, r_s2, r_s3] {r.strides()};              // Strides of r
+        for (dim i3 {}; i3 < r_d3; ++i3) {
+            for (dim i2 {}; i2 < r_d2; ++i2) {
+                sgemm( // R[M, N] = X[M, K] @ Y[K, N] in row major terms
+                    ctx, r_d1, r_d0, x_d0,
+                    reinterpret_cast<const dtypes::f32*>(x.ptr() + i2*x_s2 + i3*x_s3), x_s1/k_size,
+                    reinterpret_cast<const dtypes::f32*>(y.ptr() + i2*y_s2 + i3*y_s3), y_s1/k_size,
+                    reinterpret_cast<dtypes::f32*>(r.ptr() + i2*r_s2 + i3*r_s3), r_s1/k_size
+                );
+            }
+        }
+    }
+
     /*
      * BLAS SGEMM (Single precision General Matrix Multiply), but a modified version.
      * Compute the matrix product of two matrices X and Y: R_T = X @ Y_T
@@ -346,45 +462,542 @@ namespace rtml::blas {
         }
     }
 
-    auto blas::add(const compute_ctx& ctx, tensor<dtypes::f32>& r, const tensor<dtypes::f32>& x, const tensor<dtypes::f32>& y) noexcept -> void {
-        blas_tensor_gen_op_binary
-        <
-            std::decay_t<decltype(r)>::dtype,
-            decltype(vec::add<std::decay_t<decltype(r)>::dtype>),
-            decltype(scalar::add<std::decay_t<decltype(r)>::dtype>)
-        >(ctx, r, x, y, vec::add, scalar::add);
+    enum class reduce_op {
+        sum,
+        mean,
+        max,
+        min,
+        argmax
+    };
+
+    auto reduction_axis(const tensor<>& r, const tensor<>& x) noexcept -> dim {
+        dim axis {-1};
+        for (dim i {}; i < static_cast<dim>(tensor<>::k_max_dims); ++i) {
+            if (r.dims()[i] == x.dims()[i]) continue;
+            if (r.dims()[i] != 1 || axis != -1) return -1; // Reduced dim must have size 1 in r and at most one dim is reduced
+            axis = i;
+        }
+        if (axis != -1) return axis;
+        for (dim i {}; i < static_cast<dim>(tensor<>::k_max_dims); ++i) // Same shape: reduction of a dim with size 1
+            if (x.dims()[i] == 1) return i;
+        return -1;
     }
 
-    auto blas::sub(const compute_ctx& ctx, tensor<dtypes::f32>& r, const tensor<dtypes::f32>& x, const tensor<dtypes::f32>& y) noexcept -> void {
-        blas_tensor_gen_op_binary
-        <
-            std::decay_t<decltype(r)>::dtype,
-            decltype(vec::sub<std::decay_t<decltype(r)>::dtype>),
-            decltype(scalar::sub<std::decay_t<decltype(r)>::dtype>)
-        >(ctx, r, x, y, vec::sub, scalar::sub);
+    // Reduction of a contiguous range of a row into a partial: value and index (argmax only) relative to the range start
+    template <const reduce_op op>
+    [[nodiscard]] static auto RTML_HOT reduce_row(const dim n, const dtypes::f32* const x) noexcept -> compute_shared::partial {
+        dtypes::f32 v {};
+        std::size_t i {};
+        if constexpr (op == reduce_op::sum || op == reduce_op::mean) vec::hsum(n, &v, x);
+        else if constexpr (op == reduce_op::max) vec::hmax(n, &v, x);
+        else if constexpr (op == reduce_op::min) vec::hmin(n, &v, x);
+        else vec::hargmax(n, &v, &i, x);
+        return {.value=v, .index=static_cast<dim>(i)};
     }
 
-    auto blas::mul(const compute_ctx& ctx, tensor<dtypes::f32>& r, const tensor<dtypes::f32>& x, const tensor<dtypes::f32>& y) noexcept -> void {
-        blas_tensor_gen_op_binary
-        <
-            std::decay_t<decltype(r)>::dtype,
-            decltype(vec::mul<std::decay_t<decltype(r)>::dtype>),
-            decltype(scalar::mul<std::decay_t<decltype(r)>::dtype>)
-        >(ctx, r, x, y, vec::mul, scalar::mul);
+    template <const reduce_op op>
+    [[nodiscard]] static constexpr auto RTML_AINLINE combine(const compute_shared::partial& acc, const compute_shared::partial& x) noexcept -> compute_shared::partial {
+        if constexpr (op == reduce_op::sum || op == reduce_op::mean) return {acc.value + x.value, 0};
+        else if constexpr (op == reduce_op::min) return x.value < acc.value ? x : acc;
+        else return x.value > acc.value ? x : acc; // Strictly greater keeps the first occurrence for argmax
     }
 
-    auto blas::div(const compute_ctx& ctx, tensor<dtypes::f32>& r, const tensor<dtypes::f32>& x, const tensor<dtypes::f32>& y) noexcept -> void {
-        blas_tensor_gen_op_binary
-        <
-            std::decay_t<decltype(r)>::dtype,
-            decltype(vec::div<std::decay_t<decltype(r)>::dtype>),
-            decltype(scalar::div<std::decay_t<decltype(r)>::dtype>)
-        >(ctx, r, x, y, vec::div, scalar::div);
+    template <const reduce_op op>
+    [[nodiscard]] static constexpr auto RTML_AINLINE finalize(const compute_shared::partial& p, const dim n) noexcept -> dtypes::f32 {
+        if constexpr (op == reduce_op::mean) return static_cast<dtypes::f32>(p.value / static_cast<double>(n));
+        else if constexpr (op == reduce_op::argmax) return static_cast<dtypes::f32>(p.index);
+        else return static_cast<dtypes::f32>(p.value);
+    }
+
+    /*
+     * Reduction of dim 0 (horizontal): every row of X is reduced to one element of R with a SIMD horizontal reduction.
+     * Rows are partitioned across threads. If there are fewer rows than threads and the rows are long, every row is split
+     * into one chunk per thread instead, each thread stores its partials in the shared dispatch state and the last thread
+     * to finish combines them in thread order, which keeps the result deterministic for a given thread count.
+     */
+    template <const reduce_op op>
+    static auto RTML_HOT blas_tensor_reduce_horizontal(
+        const compute_ctx& ctx,
+        tensor<>& r,       // result
+        const tensor<>& x  // X = src 0
+    ) noexcept -> void {
+        static constexpr dim k_min_split {1<<14}; // Minimum row length to split rows across threads
+        static constexpr auto k_lanes {static_cast<dim>(vec::k_lanes)};
+        const auto [x_d0, x_d1, x_d2, x_d3] {x.dims()};                 // Dimensions of x
+        const auto [x_s0, x_s1, x_s2, x_s3] {x.strides()};              // Strides of x
+        const auto [r_s0, r_s1, r_s2, r_s3] {r.strides()};              // Strides of r
+        const dim rc {x.row_count()};                                   // Row count
+        const dim tidx {ctx.thread_idx};                                // Current thread index
+        const dim tc {ctx.num_threads};                                 // Current thread count
+        const auto row {[&](const dim row_i) noexcept -> std::pair<const dtypes::f32*, dtypes::f32*> {
+            const dim i3 {row_i / (x_d2*x_d1)};                         // Dimension 3 - Linear index to 3D index
+            const dim i2 {(row_i - i3*x_d2*x_d1) / x_d1};               // Dimension 2 - Linear index to 3D index
+            const dim i1 {row_i - i3*x_d2*x_d1 - i2*x_d1};              // Dimension 1 - Linear index to 3D index
+            return {
+                reinterpret_cast<const dtypes::f32*>(x.ptr() + i3*x_s3 + i2*x_s2 + i1*x_s1),
+                reinterpret_cast<dtypes::f32*>(r.ptr() + i3*r_s3 + i2*r_s2 + i1*r_s1)
+            };
+        }};
+        if (ctx.shared && tc > 1 && rc < tc && rc <= compute_shared::k_max_split_rows && x_d0 >= k_min_split) { // Split rows
+            const dim chunk {((x_d0 + tc - 1)/tc + k_lanes - 1) & ~(k_lanes - 1)}; // Multiple of the vector width
+            const dim start {std::min(chunk*tidx, x_d0)};
+            const dim end {std::min(start + chunk, x_d0)};
+            const std::uint32_t seq {ctx.shared->enter_combine(tidx)}; // The slots of the previous split call are combined
+            for (dim row_i {}; row_i < rc; ++row_i) {
+                compute_shared::partial& p {ctx.shared->slot(tidx, row_i)};
+                if (start < end) {
+                    p = reduce_row<op>(end - start, row(row_i).first + start);
+                    p.index += start;
+                } else { // Identity
+                    p = {.value=op == reduce_op::min ? std::numeric_limits<double>::max() : op == reduce_op::sum || op == reduce_op::mean ? 0.0 : std::numeric_limits<double>::lowest(), .index=0};
+                }
+            }
+            if (!ctx.shared->arrive(tc)) return;
+            for (dim row_i {}; row_i < rc; ++row_i) { // Last thread combines
+                compute_shared::partial acc {ctx.shared->slot(0, row_i)};
+                for (dim t {1}; t < tc; ++t)
+                    acc = combine<op>(acc, ctx.shared->slot(t, row_i));
+                *row(row_i).second = finalize<op>(acc, x_d0);
+            }
+            ctx.shared->complete(seq);
+            return;
+        }
+        const dim rpt {(rc + tc - 1)/tc};                               // Rows per thread
+        const dim row_start {rpt * tidx};                               // Current thread row interval start
+        const dim row_end {std::min(row_start + rpt, rc)};              // Current thread row interval end
+        for (dim row_i {row_start}; row_i < row_end; ++row_i) {
+            const auto [p_x, p_r] {row(row_i)};
+            *p_r = finalize<op>(reduce_row<op>(x_d0, p_x), x_d0);
+        }
+    }
+
+    /*
+     * Reduction of dim 1, 2 or 3 (vertical): the rows of X along the reduced dim are accumulated elementwise into one row of R.
+     * Work items are column blocks of the rows of R, so long rows are split across threads without any combining step.
+     * Each block is accumulated on the stack and stays in L1 while the rows along the reduced dim are streamed through.
+     */
+    template <const reduce_op op>
+    static auto RTML_HOT blas_tensor_reduce_vertical(
+        const compute_ctx& ctx,
+        tensor<>& r,       // result
+        const tensor<>& x, // X = src 0
+        const dim axis     // Reduced dim
+    ) noexcept -> void {
+        static constexpr dim k_block {256};                             // Columns per work item
+        const auto [r_d0, r_d1, r_d2, r_d3] {r.dims()};                 // Dimensions of r
+        const auto [r_s0, r_s1, r_s2, r_s3] {r.strides()};              // Strides of r
+        const auto [x_s0, x_s1, x_s2, x_s3] {x.strides()};              // Strides of x
+        const dim n {x.dims()[axis]};                                   // Length of the reduced dim
+        const dim x_sa {x.strides()[axis]};                             // Stride of the reduced dim
+        const dim blocks {(r_d0 + k_block - 1)/k_block};                // Column blocks per row
+        const dim items {r.row_count()*blocks};                         // Work items
+        const dim tidx {ctx.thread_idx};                                // Current thread index
+        const dim tc {ctx.num_threads};                                 // Current thread count
+        const dim ipt {(items + tc - 1)/tc};                            // Items per thread
+        const dim item_start {ipt * tidx};                              // Current thread item interval start
+        const dim item_end {std::min(item_start + ipt, items)};         // Current thread item interval end
+        alignas(64) std::array<dtypes::f32, k_block> acc;
+        alignas(64) std::array<dtypes::f32, k_block> idx;
+        for (dim item {item_start}; item < item_end; ++item) {
+            const dim row_i {item / blocks};
+            const dim c0 {item % blocks * k_block};
+            const auto nc {static_cast<std::size_t>(std::min(k_block, r_d0 - c0))};
+            const dim i3 {row_i / (r_d2*r_d1)};                         // Dimension 3 - Linear index to 3D index
+            const dim i2 {(row_i - i3*r_d2*r_d1) / r_d1};               // Dimension 2 - Linear index to 3D index
+            const dim i1 {row_i - i3*r_d2*r_d1 - i2*r_d1};              // Dimension 1 - Linear index to 3D index, index of the reduced dim is 0
+            const std::uint8_t* const p_x {x.ptr() + i3*x_s3 + i2*x_s2 + i1*x_s1 + c0*x_s0};
+            auto* const p_r {reinterpret_cast<dtypes::f32*>(r.ptr() + i3*r_s3 + i2*r_s2 + i1*r_s1 + c0*r_s0)};
+            vec::copy(nc, acc.data(), reinterpret_cast<const dtypes::f32*>(p_x));
+            if constexpr (op == reduce_op::argmax) std::fill_n(idx.data(), nc, 0.0f);
+            for (dim k {1}; k < n; ++k) {
+                const auto* const p_xk {reinterpret_cast<const dtypes::f32*>(p_x + k*x_sa)};
+                if constexpr (op == reduce_op::sum || op == reduce_op::mean) vec::add(nc, acc.data(), acc.data(), p_xk);
+                else if constexpr (op == reduce_op::max) vec::vmax(nc, acc.data(), acc.data(), p_xk);
+                else if constexpr (op == reduce_op::min) vec::vmin(nc, acc.data(), acc.data(), p_xk);
+                else vec::vargmax(nc, acc.data(), idx.data(), p_xk, static_cast<dtypes::f32>(k));
+            }
+            if constexpr (op == reduce_op::mean) {
+                const dtypes::f32 inv {1.0f / static_cast<dtypes::f32>(n)};
+                for (std::size_t i {}; i < nc; ++i) p_r[i] = acc[i]*inv;
+            } else if constexpr (op == reduce_op::argmax) {
+                vec::copy(nc, p_r, idx.data());
+            } else {
+                vec::copy(nc, p_r, acc.data());
+            }
+        }
+    }
+
+    template <const reduce_op op>
+    static auto blas_tensor_reduce(const compute_ctx& ctx, tensor<>& r, const tensor<>& x) noexcept -> void {
+        assert(x.strides()[0] == dtype_traits<dtypes::f32>::k_size);   // Debug only verification - ! must be checked by validation function
+        assert(r.strides()[0] == dtype_traits<dtypes::f32>::k_size);   // Debug only verification - ! must be checked by validation function
+        const dim axis {reduction_axis(r, x)};
+        assert(axis >= 0);                                              // Debug only verification - ! must be checked by validation function
+        if (axis == 0) blas_tensor_reduce_horizontal<op>(ctx, r, x);
+        else blas_tensor_reduce_vertical<op>(ctx, r, x, axis);
+    }
+
+    struct norm_stats final {
+        dtypes::f32 mean;   // 0 for rmsnorm
+        dtypes::f32 rstd;   // 1/std for layernorm, 1/rms for rmsnorm
+    };
+
+    /*
+     * Statistics of one row for layernorm or rmsnorm.
+     * Small rows stay in L1 after the first read, so the variance is computed exactly from the centered row in a second pass
+     * and the row is streamed from memory once. Large rows compute sum and sum of squares in a single streaming pass,
+     * shifted by the first element to avoid cancellation, and the normalization is the second streaming pass.
+     */
+    template <const bool rms>
+    [[nodiscard]] static auto RTML_HOT row_norm_stats(const dim n, const dtypes::f32* const x) noexcept -> norm_stats {
+        static constexpr dim k_small_row {1024}; // 4 KiB rows
+        const auto nf {static_cast<dtypes::f32>(n)};
+        dtypes::f32 sum {}, sum_sq {};
+        if constexpr (rms) {
+            vec::hdot(n, &sum_sq, x, x);
+            return {.mean=0.0f, .rstd=1.0f / std::sqrt(sum_sq/nf + k_norm_eps)};
+        } else if (n <= k_small_row) {
+            vec::hsum(n, &sum, x);
+            const dtypes::f32 mean {sum/nf};
+            vec::hmoments(n, &sum, &sum_sq, x, mean);
+            return {.mean=mean, .rstd=1.0f / std::sqrt(sum_sq/nf + k_norm_eps)};
+        } else {
+            vec::hmoments(n, &sum, &sum_sq, x, x[0]);
+            const dtypes::f32 shifted_mean {sum/nf};
+            return {.mean=x[0] + shifted_mean, .rstd=1.0f / std::sqrt(std::max(sum_sq/nf - shifted_mean*shifted_mean, 0.0f) + k_norm_eps)};
+        }
+    }
+
+    // Layernorm or rmsnorm of each row (dim 0) of X, rows are partitioned evenly across threads
+    template <const bool rms>
+    static auto RTML_HOT blas_tensor_norm(
+        const compute_ctx& ctx,
+        tensor<>& r,       // result
+        const tensor<>& x, // X = src 0
+        const tensor<>& y  // Y = src 1 = gamma (and beta)
+    ) noexcept -> void {
+        assert(x.is_shape_eq(&r) && y.is_dense());                     // Debug only verification - ! must be checked by validation function
+        assert(x.strides()[0] == dtype_traits<dtypes::f32>::k_size);   // Debug only verification - ! must be checked by validation function
+        const auto [x_d0, x_d1, x_d2, x_d3] {x.dims()};                 // Dimensions of x
+        const auto [x_s0, x_s1, x_s2, x_s3] {x.strides()};              // Strides of x
+        const auto [r_s0, r_s1, r_s2, r_s3] {r.strides()};              // Strides of r
+        const auto* const gamma {reinterpret_cast<const dtypes::f32*>(y.ptr())};
+        const dtypes::f32* const beta {rms ? nullptr : gamma + x_d0};
+        const dim rc {x.row_count()};                                   // Row count
+        const dim tidx {ctx.thread_idx};                                // Current thread index
+        const dim tc {ctx.num_threads};                                 // Current thread count
+        const dim rpt {(rc + tc - 1)/tc};                               // Rows per thread
+        const dim row_start {rpt * tidx};                               // Current thread row interval start
+        const dim row_end {std::min(row_start + rpt, rc)};              // Current thread row interval end
+        for (dim row_i {row_start}; row_i < row_end; ++row_i) {         // For each row
+            const dim i3 {row_i / (x_d2*x_d1)};                         // Dimension 3 - Linear index to 3D index
+            const dim i2 {(row_i - i3*x_d2*x_d1) / x_d1};               // Dimension 2 - Linear index to 3D index
+            const dim i1 {row_i - i3*x_d2*x_d1 - i2*x_d1};              // Dimension 1 - Linear index to 3D index
+            const auto* const p_x {reinterpret_cast<const dtypes::f32*>(x.ptr() + i3*x_s3 + i2*x_s2 + i1*x_s1)};
+            auto* const p_r {reinterpret_cast<dtypes::f32*>(r.ptr() + i3*r_s3 + i2*r_s2 + i1*r_s1)};
+            const auto [mean, rstd] {row_norm_stats<rms>(x_d0, p_x)};
+            if constexpr (rms) {
+                for (dim i {}; i < x_d0; ++i)
+                    p_r[i] = p_x[i]*rstd*gamma[i];
+            } else {
+                for (dim i {}; i < x_d0; ++i)
+                    p_r[i] = (p_x[i] - mean)*rstd*gamma[i] + beta[i];
+            }
+        }
+    }
+
+    template <const bool rms>
+    static auto RTML_HOT blas_tensor_norm_stats(const compute_ctx& ctx, tensor<>& stats, const tensor<>& x) noexcept -> void {
+        static constexpr dim k_stats {rms ? 1 : 2};                     // Statistics per row
+        assert(x.is_dense() && stats.is_dense() && stats.elem_count() == k_stats*x.row_count());
+        const dim d0 {x.dims()[0]};
+        const dim rc {x.row_count()};                                   // Row count
+        const dim rpt {(rc + ctx.num_threads - 1)/ctx.num_threads};     // Rows per thread
+        const dim row_start {rpt * ctx.thread_idx};                     // Current thread row interval start
+        const dim row_end {std::min(row_start + rpt, rc)};              // Current thread row interval end
+        const auto* const b_x {reinterpret_cast<const dtypes::f32*>(x.ptr())};
+        auto* const b_s {reinterpret_cast<dtypes::f32*>(stats.ptr())};
+        for (dim row_i {row_start}; row_i < row_end; ++row_i) {
+            const norm_stats st {row_norm_stats<rms>(d0, b_x + row_i*d0)};
+            if constexpr (rms) {
+                b_s[row_i] = st.rstd;
+            } else {
+                b_s[k_stats*row_i] = st.mean;
+                b_s[k_stats*row_i+1] = st.rstd;
+            }
+        }
+    }
+
+    /*
+     * Backward pass of layernorm or rmsnorm with xhat = (x - mean) * rstd and g = dr * gamma:
+     * dx = rstd * (g - mean(g) - xhat * mean(g * xhat)), the mean(g) term is dropped for rmsnorm,
+     * dgamma = sum over rows of dr * xhat, dbeta = sum over rows of dr.
+     * Rows of dx are partitioned across threads, columns of the parameter gradients too, so every thread owns its outputs
+     * and the parameter gradients are accumulated in row order without combining partials across threads.
+     */
+    template <const bool rms>
+    static auto RTML_HOT blas_tensor_norm_backward(
+        const compute_ctx& ctx,
+        tensor<>& dx,
+        tensor<>& dparams,
+        const tensor<>& dr,
+        const tensor<>& x,
+        const tensor<>& params,
+        const tensor<>& stats
+    ) noexcept -> void {
+        static constexpr dim k_stats {rms ? 1 : 2};                     // Statistics per row
+        assert(x.is_dense() && dx.is_dense() && dr.is_dense() && params.is_dense() && dparams.is_dense() && stats.is_dense());
+        assert(x.is_shape_eq(&dx) && x.is_shape_eq(&dr) && params.is_shape_eq(&dparams));
+        const dim n {x.dims()[0]};
+        const auto nf {static_cast<dtypes::f32>(n)};
+        const dim rc {x.row_count()};
+        const auto* const b_x {reinterpret_cast<const dtypes::f32*>(x.ptr())};
+        const auto* const b_dr {reinterpret_cast<const dtypes::f32*>(dr.ptr())};
+        const auto* const b_s {reinterpret_cast<const dtypes::f32*>(stats.ptr())};
+        auto* const b_dx {reinterpret_cast<dtypes::f32*>(dx.ptr())};
+        const auto* const gamma {reinterpret_cast<const dtypes::f32*>(params.ptr())};
+        auto* const dgamma {reinterpret_cast<dtypes::f32*>(dparams.ptr())};
+        dtypes::f32* const dbeta {rms ? nullptr : dgamma + n};
+        const auto row_stats {[&](const dim row_i) noexcept -> norm_stats {
+            if constexpr (rms) return {.mean=0.0f, .rstd=b_s[row_i]};
+            else return {.mean=b_s[k_stats*row_i], .rstd=b_s[k_stats*row_i+1]};
+        }};
+        const dim rpt {(rc + ctx.num_threads - 1)/ctx.num_threads};     // Rows per thread
+        const dim row_start {rpt * ctx.thread_idx};
+        const dim row_end {std::min(row_start + rpt, rc)};
+        for (dim row_i {row_start}; row_i < row_end; ++row_i) {         // dx
+            const auto [mean, rstd] {row_stats(row_i)};
+            const dtypes::f32* const p_x {b_x + row_i*n};
+            const dtypes::f32* const p_dr {b_dr + row_i*n};
+            dtypes::f32* const p_dx {b_dx + row_i*n};
+            dtypes::f32 sum_g {}, sum_gx {};
+            for (dim i {}; i < n; ++i) {
+                const dtypes::f32 g {p_dr[i]*gamma[i]};
+                sum_g += g;
+                sum_gx += g*(p_x[i] - mean)*rstd;
+            }
+            const dtypes::f32 mean_g {rms ? 0.0f : sum_g/nf};
+            const dtypes::f32 mean_gx {sum_gx/nf};
+            for (dim i {}; i < n; ++i)
+                p_dx[i] = rstd*(p_dr[i]*gamma[i] - mean_g - (p_x[i] - mean)*rstd*mean_gx);
+        }
+        const dim cpt {(n + ctx.num_threads - 1)/ctx.num_threads};      // Columns per thread
+        const dim col_start {std::min(cpt * ctx.thread_idx, n)};
+        const dim col_end {std::min(col_start + cpt, n)};
+        std::fill(dgamma + col_start, dgamma + col_end, 0.0f);
+        if constexpr (!rms) std::fill(dbeta + col_start, dbeta + col_end, 0.0f);
+        for (dim row_i {}; row_i < rc; ++row_i) {                       // dgamma, dbeta
+            const auto [mean, rstd] {row_stats(row_i)};
+            const dtypes::f32* const p_x {b_x + row_i*n};
+            const dtypes::f32* const p_dr {b_dr + row_i*n};
+            for (dim i {col_start}; i < col_end; ++i)
+                dgamma[i] += p_dr[i]*(p_x[i] - mean)*rstd;
+            if constexpr (!rms)
+                for (dim i {col_start}; i < col_end; ++i)
+                    dbeta[i] += p_dr[i];
+        }
+    }
+
+    auto softmax(const compute_ctx& ctx, tensor<dtypes::f32>& r, const tensor<dtypes::f32>& x) noexcept -> void {
+        rtml_profile_op(graph::opcode::softmax, ctx.thread_idx, r, x);
+        blas_tensor_gen_op_unary(ctx, r, x, vec::softmax<std::decay_t<decltype(r)>::dtype>, k_cost_transcendental);
+    }
+
+    auto sigmoid(const compute_ctx& ctx, tensor<dtypes::f32>& r, const tensor<dtypes::f32>& x) noexcept -> void {
+        rtml_profile_op(graph::opcode::sigmoid, ctx.thread_idx, r, x);
+        blas_tensor_gen_op_unary(ctx, r, x, vec::sigmoid<std::decay_t<decltype(r)>::dtype>, k_cost_transcendental);
+    }
+
+    auto tanh(const compute_ctx& ctx, tensor<dtypes::f32>& r, const tensor<dtypes::f32>& x) noexcept -> void {
+        rtml_profile_op(graph::opcode::tanh, ctx.thread_idx, r, x);
+        blas_tensor_gen_op_unary(ctx, r, x, vec::tanh<std::decay_t<decltype(r)>::dtype>, k_cost_transcendental);
+    }
+
+    auto relu(const compute_ctx& ctx, tensor<dtypes::f32>& r, const tensor<dtypes::f32>& x) noexcept -> void {
+        rtml_profile_op(graph::opcode::relu, ctx.thread_idx, r, x);
+        blas_tensor_gen_op_unary(ctx, r, x, vec::relu<std::decay_t<decltype(r)>::dtype>, k_cost_arith);
+    }
+
+    auto gelu(const compute_ctx& ctx, tensor<dtypes::f32>& r, const tensor<dtypes::f32>& x) noexcept -> void {
+        rtml_profile_op(graph::opcode::gelu, ctx.thread_idx, r, x);
+        blas_tensor_gen_op_unary(ctx, r, x, vec::gelu<std::decay_t<decltype(r)>::dtype>, k_cost_transcendental);
+    }
+
+    auto silu(const compute_ctx& ctx, tensor<dtypes::f32>& r, const tensor<dtypes::f32>& x) noexcept -> void {
+        rtml_profile_op(graph::opcode::silu, ctx.thread_idx, r, x);
+        blas_tensor_gen_op_unary(ctx, r, x, vec::silu<std::decay_t<decltype(r)>::dtype>, k_cost_transcendental);
+    }
+
+    auto add(const compute_ctx& ctx, tensor<dtypes::f32>& r, const tensor<dtypes::f32>& x, const tensor<dtypes::f32>& y) noexcept -> void {
+        rtml_profile_op(graph::opcode::add, ctx.thread_idx, r, x, y);
+        using S = std::decay_t<decltype(r)>::dtype;
+        blas_tensor_gen_op_binary<S>(ctx, r, x, y, vec::add<S>, [](const S a, const S b) noexcept -> S { return scalar::add(a, b); }); // Lambda: inlined into the scalar loops
+    }
+
+    auto sub(const compute_ctx& ctx, tensor<dtypes::f32>& r, const tensor<dtypes::f32>& x, const tensor<dtypes::f32>& y) noexcept -> void {
+        rtml_profile_op(graph::opcode::sub, ctx.thread_idx, r, x, y);
+        using S = std::decay_t<decltype(r)>::dtype;
+        blas_tensor_gen_op_binary<S>(ctx, r, x, y, vec::sub<S>, [](const S a, const S b) noexcept -> S { return scalar::sub(a, b); }); // Lambda: inlined into the scalar loops
+    }
+
+    auto mul(const compute_ctx& ctx, tensor<dtypes::f32>& r, const tensor<dtypes::f32>& x, const tensor<dtypes::f32>& y) noexcept -> void {
+        rtml_profile_op(graph::opcode::mul, ctx.thread_idx, r, x, y);
+        using S = std::decay_t<decltype(r)>::dtype;
+        blas_tensor_gen_op_binary<S>(ctx, r, x, y, vec::mul<S>, [](const S a, const S b) noexcept -> S { return scalar::mul(a, b); }); // Lambda: inlined into the scalar loops
+    }
+
+    auto div(const compute_ctx& ctx, tensor<dtypes::f32>& r, const tensor<dtypes::f32>& x, const tensor<dtypes::f32>& y) noexcept -> void {
+        rtml_profile_op(graph::opcode::div, ctx.thread_idx, r, x, y);
+        using S = std::decay_t<decltype(r)>::dtype;
+        blas_tensor_gen_op_binary<S>(ctx, r, x, y, vec::div<S>, [](const S a, const S b) noexcept -> S { return scalar::div(a, b); }); // Lambda: inlined into the scalar loops
     }
 
     auto matmul(const compute_ctx& ctx, tensor<>& r, const tensor<>& x, const tensor<>& y) noexcept -> void {
-        blas_tensor_sgemm_naive(ctx, r, x, y);
+        rtml_profile_op(graph::opcode::matmul, ctx.thread_idx, r, x, y);
+        static constexpr auto k_size {static_cast<dim>(dtype_traits<dtypes::f32>::k_size)};
+        if (x.strides()[0] == k_size && y.strides()[0] == k_size && r.strides()[0] == k_size) [[likely]] {
+            blas_tensor_sgemm_packed(ctx, r, x, y);
+        } else {
+            blas_tensor_sgemm_naive(ctx, r, x, y);
+        }
         // TODO - Use this version if it makes sense
         //blas_tensor_sgemm_tranposed(ctx, r, x, y);
     }
+
+    auto layernorm(const compute_ctx& ctx, tensor<>& r, const tensor<>& x, const tensor<>& y) noexcept -> void {
+        rtml_profile_op(graph::opcode::layernorm, ctx.thread_idx, r, x, y);
+        blas_tensor_norm<false>(ctx, r, x, y);
+    }
+
+    auto rmsnorm(const compute_ctx& ctx, tensor<>& r, const tensor<>& x, const tensor<>& y) noexcept -> void {
+        rtml_profile_op(graph::opcode::rmsnorm, ctx.thread_idx, r, x, y);
+        blas_tensor_norm<true>(ctx, r, x, y);
+    }
+
+    auto layernorm_stats(const compute_ctx& ctx, tensor<>& stats, const tensor<>& x) noexcept -> void {
+        blas_tensor_norm_stats<false>(ctx, stats, x);
+    }
+
+    auto rmsnorm_stats(const compute_ctx& ctx, tensor<>& stats, const tensor<>& x) noexcept -> void {
+        blas_tensor_norm_stats<true>(ctx, stats, x);
+    }
+
+    auto layernorm_backward(
+        const compute_ctx& ctx,
+        tensor<>& dx,
+        tensor<>& dparams,
+        const tensor<>& dr,
+        const tensor<>& x,
+        const tensor<>& params,
+        const tensor<>& stats
+    ) noexcept -> void {
+        blas_tensor_norm_backward<false>(ctx, dx, dparams, dr, x, params, stats);
+    }
+
+    auto rmsnorm_backward(
+        const compute_ctx& ctx,
+        tensor<>& dx,
+        tensor<>& dparams,
+        const tensor<>& dr,
+        const tensor<>& x,
+        const tensor<>& params,
+        const tensor<>& stats
+    ) noexcept -> void {
+        blas_tensor_norm_backward<true>(ctx, dx, dparams, dr, x, params, stats);
+    }
+
+    auto sum(const compute_ctx& ctx, tensor<>& r, const tensor<>& x) noexcept -> void {
+        rtml_profile_op(graph::opcode::sum, ctx.thread_idx, r, x);
+        blas_tensor_reduce<reduce_op::sum>(ctx, r, x);
+    }
+
+    auto mean(const compute_ctx& ctx, tensor<>& r, const tensor<>& x) noexcept -> void {
+        rtml_profile_op(graph::opcode::mean, ctx.thread_idx, r, x);
+        blas_tensor_reduce<reduce_op::mean>(ctx, r, x);
+    }
+
+    auto max(const compute_ctx& ctx, tensor<>& r, const tensor<>& x) noexcept -> void {
+        rtml_profile_op(graph::opcode::max, ctx.thread_idx, r, x);
+        blas_tensor_reduce<reduce_op::max>(ctx, r, x);
+    }
+
+    auto min(const compute_ctx& ctx, tensor<>& r, const tensor<>& x) noexcept -> void {
+        rtml_profile_op(graph::opcode::min, ctx.thread_idx, r, x);
+        blas_tensor_reduce<reduce_op::min>(ctx, r, x);
+    }
+
+    auto argmax(const compute_ctx& ctx, tensor<>& r, const tensor<>& x) noexcept -> void {
+        rtml_profile_op(graph::opcode::argmax, ctx.thread_idx, r, x);
+        blas_tensor_reduce<reduce_op::argmax>(ctx, r, x);
+    }
+
+    static auto eval_op(
+        auto (* const op)(const compute_ctx&, tensor<>&, const tensor<>&) noexcept -> void,
+        const compute_ctx& ctx,
+        tensor<>& r,
+        const tensor<>& x,
+        const tensor<>*,
+        const op_params&
+    ) noexcept -> void {
+        (*op)(ctx, r, x);
+    }
+
+    static auto eval_op(
+        auto (* const op)(const compute_ctx&, tensor<>&, const tensor<>&, const tensor<>&) noexcept -> void,
+        const compute_ctx& ctx,
+        tensor<>& r,
+        const tensor<>& x,
+        const tensor<>* const y,
+        const op_params&
+    ) noexcept -> void {
+        assert(y);
+        (*op)(ctx, r, x, *y);
+    }
+
+    static auto eval_op(
+        auto (* const op)(const compute_ctx&, tensor<>&, const tensor<>&, const tensor<>&, const op_params&) noexcept -> void,
+        const compute_ctx& ctx,
+        tensor<>& r,
+        const tensor<>& x,
+        const tensor<>* const y,
+        const op_params& params
+    ) noexcept -> void {
+        assert(y);
+        (*op)(ctx, r, x, *y, params);
+    }
+
+    auto op_cost(const graph::opcode op, const tensor<>& r, const tensor<>& x, const tensor<>* const y) noexcept -> dim {
+        switch (op) {
+            case graph::opcode::add:
+            case graph::opcode::sub:
+            case graph::opcode::mul:
+            case graph::opcode::div:
+            case graph::opcode::relu: return r.elem_count()*k_cost_arith;
+            case graph::opcode::softmax:
+            case graph::opcode::sigmoid:
+            case graph::opcode::tanh:
+            case graph::opcode::gelu:
+            case graph::opcode::silu: return r.elem_count()*k_cost_transcendental;
+            case graph::opcode::matmul: return r.elem_count()*x.dims()[0]; // M * N * K multiply adds
+            case graph::opcode::sum:
+            case graph::opcode::mean:
+            case graph::opcode::max:
+            case graph::opcode::min:
+            case graph::opcode::argmax: return x.elem_count()*k_cost_arith;
+            case graph::opcode::layernorm:
+            case graph::opcode::rmsnorm: return x.elem_count()*k_cost_norm;
+            case graph::opcode::conv1d:
+            case graph::opcode::conv2d: return y ? r.elem_count()*(y->elem_count()/std::max<dim>(1, y->dims()[0])) : r.elem_count(); // Multiply adds
+            default: return std::numeric_limits<dim>::max();
+        }
+    }
+
+    auto eval(const compute_ctx& ctx, const graph::opcode op, tensor<>& r, const tensor<>& x, const tensor<>* const y, const op_params& params) noexcept -> void {
+        switch (op) { // Op kernels have the same names as the opcodes
+            #define _(mnemonic, operands, name) case graph::opcode::mnemonic: eval_op(&blas::mnemonic, ctx, r, x, y, params); return;
+                rtml_opcode_def(_, )
+            #undef _
+            default: std::abort();
+        }
+    }
 }
@@ -5,22 +5,251 @@
 
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
 #include "tensor_base.hpp"
 
+namespace rtml::graph {
+    enum class opcode : std::uint32_t;
+}
+
 namespace rtml::blas {
+    // How row partitioned kernels (element wise binary and unary ops) split the rows of a dispatch across threads
+    // The dynamic schedules balance uneven row costs and threads which are slowed down by other processes (shared hosts)
+    enum class row_schedule {
+        static_even,    // ceil(rows / threads) contiguous rows per thread, no synchronization (default)
+        guided,         // Threads claim remaining / (2 * threads) rows from a shared counter, chunks shrink towards the end
+        adaptive        // Half of the even share is claimed statically, the rest in small fixed chunks from a shared counter
+    };
+
+    // State shared by all threads of one dispatch, owned by the thread pool and reused for every dispatch
+    // Kernels which split a single output across threads write one partial per thread, the last thread to arrive combines
+    // all partials in thread order, so results are deterministic for a given thread count
+    // Such combining calls are numbered per dispatch like the row claims below (all threads make the same calls in the same
+    // order): a thread entering call n first waits until the last thread completed call n-1, so a thread which moved on
+    // never overwrites partials or counts an arrival of a call which is still being combined
+    struct compute_shared final {
+        static constexpr dim k_max_split_rows {8}; // Partial slots per thread
+
+        struct partial final {
+            double value;
+            dim index;
+        };
+
+        explicit compute_shared(const dim num_threads) : partials(num_threads*k_max_split_rows), m_calls{std::make_unique<call_state[]>(num_threads)} {}
+
+        [[nodiscard]] auto slot(const dim thread_idx, const dim row) noexcept -> partial& { return partials[thread_idx*k_max_split_rows + row]; }
+        [[nodiscard]] auto enter_combine(const dim thread_idx) noexcept -> std::uint32_t { // Returns the sequence of the call
+            const std::uint32_t seq {++m_calls[thread_idx].combine_seq};
+            for (std::uint32_t i {}, done; (done = m_combined.load(std::memory_order_acquire)) < seq-1; ++i) {
+                if (i < 1<<10) std::this_thread::yield();
+                else m_combined.wait(done, std::memory_order_acquire);
+            }
+            return seq;
+        }
+        [[nodiscard]] auto arrive(const dim num_threads) noexcept -> bool { // Returns true for the last arriving thread, which resets the counter
+            if (m_arrived.fetch_add(1, std::memory_order_acq_rel) != num_threads-1) return false;
+            m_arrived.store(0, std::memory_order_relaxed); // Published by complete, later calls arrive only after it
+            return true;
+        }
+        auto complete(const std::uint32_t seq) noexcept -> void { // Called by the last arriving thread when the call is combined
+            m_combined.store(seq, std::memory_order_release);
+            m_combined.notify_all();
+        }
+
+        // Threads of one cache domain (see cache_domain) share a barrier and a scratch buffer, e.g. for packed GEMM panels
+        // Without scratch (default, pools which are not pinned) domain_scratch is nullptr and kernels use private buffers
+        auto set_domains(const dim count, const std::size_t scratch_floats) -> void {
+            m_num_domains = count;
+            m_domains = std::make_unique<domain_state[]>(count);
+            for (dim i {}; i < count; ++i)
+                m_domains[i].scratch.reset(scratch_floats ? new(std::align_val_t{64}) float[scratch_floats] : nullptr);
+        }
+        [[nodiscard]] auto domain_scratch(const dim domain) const noexcept -> float* {
+            return domain < m_num_domains ? m_domains[domain].scratch.get() : nullptr;
+        }
+        auto domain_sync(const dim domain, const dim num_threads) noexcept -> void { // Barrier of the num_threads threads of a domain
+            domain_state& d {m_domains[domain]};
+            const std::uint32_t gen {d.generation.load(std::memory_order_acquire)};
+            if (d.arrived.fetch_add(1, std::memory_order_acq_rel) == num_threads-1) {
+                d.arrived.store(0, std::memory_order_relaxed);
+                d.generation.fetch_add(1, std::memory_order_release);
+                d.generation.notify_all();
+                return;
+            }
+            for (std::uint32_t i {}; d.generation.load(std::memory_order_acquire) == gen; ++i) {
+                if (i < 1<<10) std::this_thread::yield();
+                else d.generation.wait(gen, std::memory_order_acquire);
+            }
+        }
+
+        // Dynamic row schedules: every row partitioned call of a dispatch has a sequence number (the per thread count of calls,
+        // all threads of a dispatch make the same calls in the same order), the claim counter holds the sequence of the call
+        // it belongs to in its upper bits. The first claim of a call restarts at row 0, a thread which finds a later sequence
+        // knows that all rows of its call are claimed, so several row partitioned ops can run in one dispatch without a barrier
+        static constexpr std::uint32_t k_claim_row_bits {40};
+
+        auto reset_calls(const dim thread_idx) noexcept -> void { // Called by every thread before a dispatch
+            m_calls[thread_idx].seq = 0;
+            m_calls[thread_idx].combine_seq = 0;
+            if (!thread_idx) { // Before the dispatch is published
+                m_row_claim.store(0, std::memory_order_relaxed);
+                m_combined.store(0, std::memory_order_relaxed);
+            }
+        }
+        [[nodiscard]] auto next_call(const dim thread_idx) noexcept -> std::uint64_t { return ++m_calls[thread_idx].seq; }
+        // Claims rows [begin, begin + chunk(begin)) of [0, rc) for call seq, returns false if all rows of the call are claimed
+        template <typename C>
+        [[nodiscard]] auto claim_rows(const std::uint64_t seq, const dim rc, C&& chunk, dim& begin, dim& end) noexcept -> bool {
+            static constexpr std::uint64_t k_row_mask {(std::uint64_t{1}<<k_claim_row_bits) - 1};
+            std::uint64_t cur {m_row_claim.load(std::memory_order_relaxed)};
+            for (;;) {
+                const std::uint64_t tag {cur>>k_claim_row_bits};
+                if (tag > seq) return false;
+                const dim pos {tag == seq ? static_cast<dim>(cur & k_row_mask) : 0};
+                if (pos >= rc) return false;
+                const dim next {std::min(rc, pos + chunk(pos))};
+                if (m_row_claim.compare_exchange_weak(cur, (seq<<k_claim_row_bits) | static_cast<std::uint64_t>(next), std::memory_order_relaxed)) {
+                    begin = pos;
+                    end = next;
+                    return true;
+                }
+            }
+        }
+
+        std::vector<partial> partials;
+        row_schedule schedule {row_schedule::static_even}; // Set by thread_pool::set_schedule
+
+    private:
+        struct call_state final {
+            alignas(64) std::uint64_t seq; // Row partitioned calls of the thread in the current dispatch
+            std::uint32_t combine_seq;     // Combining calls of the thread in the current dispatch
+        };
+        std::unique_ptr<call_state[]> m_calls;
+        alignas(64) std::atomic_uint64_t m_row_claim {}; // Sequence << k_claim_row_bits | next unclaimed row
+        alignas(64) std::atomic<dim> m_arrived {};       // Threads which arrived at the current combining call
+        alignas(64) std::atomic_uint32_t m_combined {};  // Sequence of the last completed combining call
+
+        struct aligned_delete final {
+            auto operator()(float* const p) const noexcept -> void { ::operator delete[](p, std::align_val_t{64}); }
+        };
+        struct domain_state final {
+            alignas(64) std::atomic<dim> arrived {};
+            std::atomic_uint32_t generation {};
+            std::unique_ptr<float[], aligned_delete> scratch {};
+        };
+        std::unique_ptr<domain_state[]> m_domains {};
+        dim m_num_domains {};
+    };
+
+    // Position of a thread among the last level cache (L3) domains of its thread pool, threads of one domain share the L3
+    // Pools which are not pinned form a single domain
+    struct cache_domain final {
+        dim idx {0};            // Domain of the thread
+        dim count {1};          // Domains of the pool
+        dim thread_idx {0};     // Index of the thread within its domain
+        dim num_threads {1};    // Threads of the domain
+        dim rank {0};           // Domain major thread index: threads of domain 0 first, kernels split work by rank for locality
+    };
+
     // Context for compute operations
     struct compute_ctx {
         const dim thread_idx;     // Current thread index - Must be >= 0
         const dim num_threads;    // Total number of threads Must be > 0
+        compute_shared* const shared; // Shared state of the dispatch, nullptr if called outside of a thread pool
+        const cache_domain domain;    // Cache domain of the thread
 
-        constexpr explicit compute_ctx(const dim thread_idx = 0, const dim num_threads = 1) noexcept
+        constexpr explicit compute_ctx(const dim thread_idx = 0, const dim num_threads = 1, compute_shared* const shared = nullptr) noexcept
             : thread_idx{std::max<dim>(0, thread_idx)},
-                num_threads{std::max<dim>(1, num_threads)} {}
+                num_threads{std::max<dim>(1, num_threads)},
+                shared{shared},
+                domain{.thread_idx=this->thread_idx, .num_threads=this->num_threads, .rank=this->thread_idx} {}
+        constexpr compute_ctx(const dim thread_idx, const dim num_threads, compute_shared* const shared, const cache_domain& domain) noexcept
+            : thread_idx{thread_idx}, num_threads{num_threads}, shared{shared}, domain{domain} {}
     };
 
+    // Integer parameters of ops which need more than their operands, e.g. stride, padding, dilation and groups of convolutions
+    // The layout is defined by the op, zero selects the default of a parameter
+    static constexpr std::size_t k_max_op_params {8};
+    using op_params = std::array<dim, k_max_op_params>;
+
+    // Small op fast path: every stage of the generic kernels (density check, row index decomposition, thread split and the
+    // dispatch itself) costs more than the arithmetic of tiny tensors. Ops with an estimated cost (op_cost) of at most the limit
+    // run on a single thread through rank specialized kernels, graph::run executes them inline on the calling thread
+    // A limit of 0 disables the fast path
+    static constexpr dim k_small_op_limit {4096};
+    namespace detail {
+        inline constinit std::atomic<dim> g_small_op_limit {k_small_op_limit};
+    }
+    inline auto set_small_op_limit(const dim limit) noexcept -> void { detail::g_small_op_limit.store(limit, std::memory_order_relaxed); }
+    [[nodiscard]] inline auto small_op_limit() noexcept -> dim { return detail::g_small_op_limit.load(std::memory_order_relaxed); }
+
+    extern auto softmax(const compute_ctx& ctx, tensor<dtypes::f32>& r, const tensor<dtypes::f32>& x) noexcept -> void;                                // r = softmax(x) per row
+    extern auto sigmoid(const compute_ctx& ctx, tensor<dtypes::f32>& r, const tensor<dtypes::f32>& x) noexcept -> void;                                // r = 1 / (1 + exp(-x))
+    extern auto tanh(const compute_ctx& ctx, tensor<dtypes::f32>& r, const tensor<dtypes::f32>& x) noexcept -> void;                                   // r = tanh(x)
+    extern auto relu(const compute_ctx& ctx, tensor<dtypes::f32>& r, const tensor<dtypes::f32>& x) noexcept -> void;                                   // r = max(x, 0)
+    extern auto gelu(const compute_ctx& ctx, tensor<dtypes::f32>& r, const tensor<dtypes::f32>& x) noexcept -> void;                                   // r = gelu(x) (tanh approximation)
+    extern auto silu(const compute_ctx& ctx, tensor<dtypes::f32>& r, const tensor<dtypes::f32>& x) noexcept -> void;                                   // r = x * sigmoid(x)
     extern auto add(const compute_ctx& ctx, tensor<dtypes::f32>& r, const tensor<dtypes::f32>& x, const tensor<dtypes::f32>& y) noexcept -> void;       // r = x + y
     extern auto sub(const compute_ctx& ctx, tensor<dtypes::f32>& r, const tensor<dtypes::f32>& x, const tensor<dtypes::f32>& y) noexcept -> void;       // r = x - y
     extern auto mul(const compute_ctx& ctx, tensor<dtypes::f32>& r, const tensor<dtypes::f32>& x, const tensor<dtypes::f32>& y) noexcept -> void;       // r = x * y
     extern auto div(const compute_ctx& ctx, tensor<dtypes::f32>& r, const tensor<dtypes::f32>& x, const tensor<dtypes::f32>& y) noexcept -> void;       // r = x / y
+    // Every thread of a dispatch must call matmul (and conv) with the same operands: in pinned pools (thread_pool::pin) the
+    // threads of a cache domain pack B together and wait for each other, a thread which skips the call deadlocks the others
     extern auto matmul(const compute_ctx& ctx, tensor<dtypes::f32>& r, const tensor<dtypes::f32>& x, const tensor<dtypes::f32>& y) noexcept -> void;    // r = x @ y
+
+    // Row normalization over dim 0 with affine parameters: y = [d0, 2] holds gamma (row 0) and beta (row 1) for layernorm, y = [d0] holds gamma for rmsnorm
+    static constexpr float k_norm_eps {1e-5f}; // Added to the variance (layernorm) or mean square (rmsnorm)
+    extern auto layernorm(const compute_ctx& ctx, tensor<dtypes::f32>& r, const tensor<dtypes::f32>& x, const tensor<dtypes::f32>& y) noexcept -> void;    // r = (x - mean) / sqrt(var + eps) * gamma + beta
+    extern auto rmsnorm(const compute_ctx& ctx, tensor<dtypes::f32>& r, const tensor<dtypes::f32>& x, const tensor<dtypes::f32>& y) noexcept -> void;      // r = x / sqrt(mean(x^2) + eps) * gamma
+
+    // Backward pass of the normalizations for training, rows are partitioned across threads for dx and columns for the parameter gradients
+    // stats holds the per row statistics of the forward input: [2, rows of x] = (mean, 1/std) for layernorm, [1, rows of x] = 1/rms for rmsnorm
+    // dparams has the shape of the forward parameters y, all tensors must be dense
+    extern auto layernorm_stats(const compute_ctx& ctx, tensor<dtypes::f32>& stats, const tensor<dtypes::f32>& x) noexcept -> void;
+    extern auto rmsnorm_stats(const compute_ctx& ctx, tensor<dtypes::f32>& stats, const tensor<dtypes::f32>& x) noexcept -> void;
+    extern auto layernorm_backward(
+        const compute_ctx& ctx,
+        tensor<dtypes::f32>& dx,
+        tensor<dtypes::f32>& dparams,
+        const tensor<dtypes::f32>& dr,
+        const tensor<dtypes::f32>& x,
+        const tensor<dtypes::f32>& params,
+        const tensor<dtypes::f32>& stats
+    ) noexcept -> void;
+    extern auto rmsnorm_backward(
+        const compute_ctx& ctx,
+        tensor<dtypes::f32>& dx,
+        tensor<dtypes::f32>& dparams,
+        const tensor<dtypes::f32>& dr,
+        const tensor<dtypes::f32>& x,
+        const tensor<dtypes::f32>& params,
+        const tensor<dtypes::f32>& stats
+    ) noexcept -> void;
+
+    // Reductions along a single dim: r has the shape of x with size 1 in the reduced dim, which is inferred from the shapes
+    // Reductions of dim 0 are horizontal SIMD reductions of each row, reductions of outer dims accumulate whole rows vertically
+    extern auto sum(const compute_ctx& ctx, tensor<dtypes::f32>& r, const tensor<dtypes::f32>& x) noexcept -> void;                                    // r = sum(x)
+    extern auto mean(const compute_ctx& ctx, tensor<dtypes::f32>& r, const tensor<dtypes::f32>& x) noexcept -> void;                                   // r = sum(x) / n
+    extern auto max(const compute_ctx& ctx, tensor<dtypes::f32>& r, const tensor<dtypes::f32>& x) noexcept -> void;                                    // r = max(x)
+    extern auto min(const compute_ctx& ctx, tensor<dtypes::f32>& r, const tensor<dtypes::f32>& x) noexcept -> void;                                    // r = min(x)
+    extern auto argmax(const compute_ctx& ctx, tensor<dtypes::f32>& r, const tensor<dtypes::f32>& x) noexcept -> void;                                 // r = index of first max(x), stored as float
+    [[nodiscard]] extern auto reduction_axis(const tensor<dtypes::f32>& r, const tensor<dtypes::f32>& x) noexcept -> dim;                              // Reduced dim or -1 if the shapes do not describe a reduction
+
+    // Convolutions, see conv.hpp for layouts and the params layout, x = input, y = weights
+    extern auto conv1d(const compute_ctx& ctx, tensor<dtypes::f32>& r, const tensor<dtypes::f32>& x, const tensor<dtypes::f32>& y, const op_params& params) noexcept -> void;
+    extern auto conv2d(const compute_ctx& ctx, tensor<dtypes::f32>& r, const tensor<dtypes::f32>& x, const tensor<dtypes::f32>& y, const op_params& params) noexcept -> void;
+
+    // Estimated cost of an op in element operations (multiply adds for matmul and convolutions), for the small op cost model
+    [[nodiscard]] extern auto op_cost(graph::opcode op, const tensor<dtypes::f32>& r, const tensor<dtypes::f32>& x, const tensor<dtypes::f32>* y) noexcept -> dim;
+    [[nodiscard]] inline auto is_small_op(const graph::opcode op, const tensor<dtypes::f32>& r, const tensor<dtypes::f32>& x, const tensor<dtypes::f32>* const y) noexcept -> bool {
+        return op_cost(op, r, x, y) <= small_op_limit();
+    }
+
+    // Dispatches to the op kernel of the opcode, y is ignored by unary ops and params by ops without parameters - operands must be validated before
+    extern auto eval(const compute_ctx& ctx, graph::opcode op, tensor<dtypes::f32>& r, const tensor<dtypes::f32>& x, const tensor<dtypes::f32>* y, const op_params& params = {}) noexcept -> void;
 }
@@ -0,0 +1,241 @@
+// Copyright Mario "Neo" Sieg 2024. All rights reserved. mario.sieg.64@gmail.com
+// CPU backend only!
+// Scalar and vector (SIMD) micro kernels which are shared by the BLAS routines, the benchmarks and other CPU kernels
+// The vector kernels are written as plain loops over contiguous memory, which the compiler vectorizes for the target ISA
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+
+#include "base.hpp"
+#include "tensor_base.hpp"
+
+namespace rtml::blas {
+    namespace scalar { // These are needed to implement the generic tensor operations with vector (for dense) and scalar (for sparse) kernels
+        // TODO: optimize with SIMD and dynamic CPU detection for x86-64: AVX512, AVX2, FMA, SSE and ARM: NEON (SVE in the future?)
+        template <typename S> requires is_dtype<S>
+        [[nodiscard]] constexpr auto RTML_AINLINE RTML_HOT add(const S x, const S y) noexcept -> S { return x + y; }
+        template <typename S> requires is_dtype<S>
+        [[nodiscard]] constexpr auto RTML_AINLINE RTML_HOT sub(const S x, const S y) noexcept -> S { return x - y; }
+        template <typename S> requires is_dtype<S>
+        [[nodiscard]] constexpr auto RTML_AINLINE RTML_HOT mul(const S x, const S y) noexcept -> S { return x * y; }
+        template <typename S> requires is_dtype<S>
+        [[nodiscard]] constexpr auto RTML_AINLINE RTML_HOT div(const S x, const S y) noexcept -> S { return x / y; }
+    }
+
+    namespace vec {
+        // TODO: optimize with SIMD and dynamic CPU detection for x86-64: AVX512, AVX2, FMA, SSE and ARM: NEON (SVE in the future?)
+        // TODO: optimize with polynomial approximation for tanh, sigmoid, relu, gelu, silu
+        static constexpr float k_rtml_sqrt2pi {0.79788456080286535587989211986876f}; // sqrt(2/PI)
+        static constexpr float k_rtml_gelu_coeff {0.044715f}; // GeLU coefficient
+
+        template <typename S> requires is_dtype<S>
+        auto RTML_HOT softmax(const std::size_t n, S* const ov, const S* const x) noexcept -> void {
+            S max {-std::numeric_limits<S>::infinity()};
+            for (std::size_t i = 0; i < n; ++i) // Subtract max for numerical stability
+                max = std::max(max, x[i]);
+            S sum {};
+            for (std::size_t i = 0; i < n; ++i) {
+                ov[i] = std::exp(x[i] - max);
+                sum += ov[i];
+            }
+            const S inv {static_cast<S>(1.0f) / sum};
+            for (std::size_t i = 0; i < n; ++i)
+                ov[i] *= inv;
+        }
+        template <typename S> requires is_dtype<S>
+        auto RTML_HOT sigmoid(const std::size_t n, S* const ov, const S* const x) noexcept -> void {
+            for (std::size_t i = 0; i < n; ++i)
+                ov[i] = 1.0f / (1.0f + std::exp(-x[i]));
+        }
+        template <typename S> requires is_dtype<S>
+        auto RTML_HOT tanh(const std::size_t n, S* const ov, const S* const x) noexcept -> void {
+            for (std::size_t i = 0; i < n; ++i)
+                ov[i] = std::tanh(x[i]);
+        }
+        template <typename S> requires is_dtype<S>
+        auto RTML_HOT relu(const std::size_t n, S* const ov, const S* const x) noexcept -> void {
+            for (std::size_t i = 0; i < n; ++i)
+                ov[i] = std::max(x[i], 0.0f);
+        }
+        template <typename S> requires is_dtype<S>
+        auto RTML_HOT gelu(const std::size_t n, S* const ov, const S* const x) noexcept -> void {
+            for (std::size_t i = 0; i < n; ++i)
+                ov[i] = 0.5f * x[i] * (1.0f + std::tanh(k_rtml_sqrt2pi * x[i] * (1.0f + k_rtml_gelu_coeff * x[i] * x[i])));
+        }
+        template <typename S> requires is_dtype<S>
+        auto RTML_HOT silu(const std::size_t n, S* const ov, const S* const x) noexcept -> void {
+            for (std::size_t i = 0; i < n; ++i)
+                ov[i] = x[i] / (1.0f + std::exp(-x[i]));
+        }
+        template <typename S> requires is_dtype<S>
+        auto RTML_HOT add(const std::size_t n, S* const ov, const S* const x, const S* const y) noexcept -> void {
+            for (std::size_t i = 0; i < n; ++i)
+                ov[i] = scalar::add(x[i], y[i]);
+        }
+        template <typename S> requires is_dtype<S>
+        auto RTML_HOT sub(const std::size_t n, S* const ov, const S* const x, const S* const y) noexcept -> void {
+            for (std::size_t i = 0; i < n; ++i)
+                ov[i] = scalar::sub(x[i], y[i]);
+        }
+        template <typename S> requires is_dtype<S>
+        auto RTML_HOT mul(const std::size_t n, S* const ov, const S* const x, const S* const y) noexcept -> void {
+            for (std::size_t i = 0; i < n; ++i)
+                ov[i] = scalar::mul(x[i], y[i]);
+        }
+        template <typename S> requires is_dtype<S>
+        auto RTML_HOT div(const std::size_t n, S* const ov, const S* const x, const S* const y) noexcept -> void {
+            for (std::size_t i = 0; i < n; ++i)
+                ov[i] = scalar::div(x[i], y[i]);
+        }
+        template <typename S> requires is_dtype<S>
+        auto RTML_HOT dot(const std::size_t n, S* const os, const S* const x, const S* const y) noexcept -> void {
+            double sum = 0.0;
+            for (std::size_t i = 0; i < n; ++i)
+                sum += static_cast<double>(x[i] * y[i]);
+            *os = static_cast<float>(sum);
+        }
+        template <typename S> requires is_dtype<S>
+        auto RTML_HOT copy(const std::size_t n, S* const ov, const S* const x) noexcept -> void {
+            for (std::size_t i = 0; i < n; ++i)
+                ov[i] = x[i];
+        }
+        template <typename S> requires is_dtype<S>
+        auto RTML_HOT axpy(const std::size_t n, S* const ov, const S a, const S* const x, const S* const y) noexcept -> void {
+            for (std::size_t i = 0; i < n; ++i)
+                ov[i] = a*x[i] + y[i];
+        }
+        // Horizontal reductions use k_lanes independent accumulators, which the compiler maps to one vector register
+        // The reduction order only depends on n, so results are reproducible for the same input
+        static constexpr std::size_t k_lanes {16};
+        template <typename S> requires is_dtype<S>
+        auto RTML_HOT hsum(const std::size_t n, S* const os, const S* const x) noexcept -> void {
+            S acc[k_lanes] {};
+            std::size_t i {};
+            for (; i + k_lanes <= n; i += k_lanes)
+                for (std::size_t j = 0; j < k_lanes; ++j)
+                    acc[j] += x[i+j];
+            for (; i < n; ++i)
+                acc[0] += x[i];
+            S sum {};
+            for (std::size_t j = 0; j < k_lanes; ++j)
+                sum += acc[j];
+            *os = sum;
+        }
+        template <typename S> requires is_dtype<S>
+        auto RTML_HOT hmax(const std::size_t n, S* const os, const S* const x) noexcept -> void {
+            S acc[k_lanes];
+            for (std::size_t j = 0; j < k_lanes; ++j)
+                acc[j] = std::numeric_limits<S>::lowest();
+            std::size_t i {};
+            for (; i + k_lanes <= n; i += k_lanes)
+                for (std::size_t j = 0; j < k_lanes; ++j)
+                    acc[j] = std::max(acc[j], x[i+j]);
+            for (; i < n; ++i)
+                acc[0] = std::max(acc[0], x[i]);
+            *os = *std::max_element(acc, acc+k_lanes);
+        }
+        template <typename S> requires is_dtype<S>
+        auto RTML_HOT hmin(const std::size_t n, S* const os, const S* const x) noexcept -> void {
+            S acc[k_lanes];
+            for (std::size_t j = 0; j < k_lanes; ++j)
+                acc[j] = std::numeric_limits<S>::max();
+            std::size_t i {};
+            for (; i + k_lanes <= n; i += k_lanes)
+                for (std::size_t j = 0; j < k_lanes; ++j)
+                    acc[j] = std::min(acc[j], x[i+j]);
+            for (; i < n; ++i)
+                acc[0] = std::min(acc[0], x[i]);
+            *os = *std::min_element(acc, acc+k_lanes);
+        }
+        // Maximum and index of its first occurrence, two vectorizable passes instead of one branchy pass, n must be > 0
+        template <typename S> requires is_dtype<S>
+        auto RTML_HOT hargmax(const std::size_t n, S* const os, std::size_t* const oi, const S* const x) noexcept -> void {
+            hmax(n, os, x);
+            std::size_t i {};
+            while (x[i] != *os) ++i;
+            *oi = i;
+        }
+        // Sum and sum of squares of x - shift in one pass, shifting by a sample of x avoids the cancellation of E[x^2] - E[x]^2
+        template <typename S> requires is_dtype<S>
+        auto RTML_HOT hmoments(const std::size_t n, S* const os, S* const osq, const S* const x, const S shift) noexcept -> void {
+            S acc[k_lanes] {};
+            S acc_sq[k_lanes] {};
+            std::size_t i {};
+            for (; i + k_lanes <= n; i += k_lanes)
+                for (std::size_t j = 0; j < k_lanes; ++j) {
+                    const S d {x[i+j] - shift};
+                    acc[j] += d;
+                    acc_sq[j] += d*d;
+                }
+            for (; i < n; ++i) {
+                const S d {x[i] - shift};
+                acc[0] += d;
+                acc_sq[0] += d*d;
+            }
+            S sum {}, sum_sq {};
+            for (std::size_t j = 0; j < k_lanes; ++j) {
+                sum += acc[j];
+                sum_sq += acc_sq[j];
+            }
+            *os = sum;
+            *osq = sum_sq;
+        }
+        // Initial running maximum of online (streaming) softmax, e.g. attention over key tiles
+        // Lowest finite value instead of -infinity, infinities are not honored under -ffast-math
+        template <typename S> requires is_dtype<S>
+        inline constexpr S k_online_softmax_max {std::numeric_limits<S>::lowest()};
+        // Dot product with float accumulation in k_lanes lanes, unlike dot which accumulates sequentially in double
+        // Used for the attention scores, q @ k for every key row
+        template <typename S> requires is_dtype<S>
+        auto RTML_HOT hdot(const std::size_t n, S* const os, const S* const x, const S* const y) noexcept -> void {
+            S acc[k_lanes] {};
+            std::size_t i {};
+            for (; i + k_lanes <= n; i += k_lanes)
+                for (std::size_t j = 0; j < k_lanes; ++j)
+                    acc[j] += x[i+j]*y[i+j];
+            for (; i < n; ++i)
+                acc[0] += x[i]*y[i];
+            S sum {};
+            for (std::size_t j = 0; j < k_lanes; ++j)
+                sum += acc[j];
+            *os = sum;
+        }
+        // Vertical (elementwise) reductions which accumulate whole rows
+        template <typename S> requires is_dtype<S>
+        auto RTML_HOT vmax(const std::size_t n, S* const ov, const S* const x, const S* const y) noexcept -> void {
+            for (std::size_t i = 0; i < n; ++i)
+                ov[i] = std::max(x[i], y[i]);
+        }
+        template <typename S> requires is_dtype<S>
+        auto RTML_HOT vmin(const std::size_t n, S* const ov, const S* const x, const S* const y) noexcept -> void {
+            for (std::size_t i = 0; i < n; ++i)
+                ov[i] = std::min(x[i], y[i]);
+        }
+        // Running maximum ov and its index oi, the index is updated to idx where x is strictly greater (first occurrence wins)
+        template <typename S> requires is_dtype<S>
+        auto RTML_HOT vargmax(const std::size_t n, S* const ov, S* const oi, const S* const x, const S idx) noexcept -> void {
+            for (std::size_t i = 0; i < n; ++i) {
+                const bool gt {x[i] > ov[i]};
+                ov[i] = gt ? x[i] : ov[i];
+                oi[i] = gt ? idx : oi[i];
+            }
+        }
+        // N independent register resident FMA dependency chains: acc = acc*a + b, repeated iters times
+        // Used to calibrate the peak FMA throughput - N must be large enough to hide the FMA latency
+        template <const std::size_t N, typename S> requires is_dtype<S>
+        auto RTML_HOT fma_chains(const std::size_t iters, S* const acc, const S a, const S b) noexcept -> void {
+            S r[N];
+            for (std::size_t i = 0; i < N; ++i)
+                r[i] = acc[i];
+            for (std::size_t it = 0; it < iters; ++it)
+                for (std::size_t i = 0; i < N; ++i)
+                    r[i] = r[i]*a + b;
+            for (std::size_t i = 0; i < N; ++i)
+                acc[i] = r[i];
+        }
+    }
+}
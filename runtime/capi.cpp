@@ -0,0 +1,728 @@
+// Copyright Mario "Neo" Sieg 2024. All rights reserved. mario.sieg.64@gmail.com
+// Stable C ABI of the RTML runtime, see rtml_capi.h
+// Isolate handles encode a slot index and the slot generation: generation << k_slot_bits | index
+// Tensor and graph handles are indices + 1 into per isolate tables, so every lookup is a bounds and generation check
+// Job handles are generation << 32 | index + 1, job slots are reused because jobs are submitted at a high rate
+// Asynchronous jobs run on one worker thread per isolate, synchronous calls first wait for all pending jobs of the isolate
+
+#include "rtml_capi.h"
+#include "dlpack.h"
+
+#include <algorithm>
+#include <mutex>
+
+#include "conv.hpp"
+#include "executor.hpp"
+#include "graph.hpp"
+#include "isolate.hpp"
+#include "job_queue.hpp"
+#include "tensor.hpp"
+#include "thread_pool.hpp"
+
+using namespace rtml;
+
+static_assert(RTML_MAX_DIMS == tensor<>::k_max_dims);
+static_assert(RTML_OP_COUNT == static_cast<int>(graph::opcode::$count));
+static_assert(RTML_OP_MATMUL == static_cast<int>(graph::opcode::matmul));
+static_assert(RTML_OP_ARGMAX == static_cast<int>(graph::opcode::argmax));
+static_assert(RTML_OP_RMSNORM == static_cast<int>(graph::opcode::rmsnorm));
+static_assert(RTML_OP_CONV2D == static_cast<int>(graph::opcode::conv2d));
+static_assert(RTML_MAX_OP_PARAMS == blas::k_max_op_params);
+static_assert(RTML_DEVICE_TPU+1 == static_cast<int>(isolate::compute_device::$count));
+
+namespace {
+    constexpr std::uint32_t k_slot_bits {10};
+    constexpr std::uint32_t k_max_isolates {1u<<k_slot_bits};
+
+    struct job_slot final {
+        std::shared_ptr<completion> done {};
+        std::uint32_t generation {1};
+    };
+
+    struct isolate_slot final {
+        std::shared_ptr<isolate> ctx {};
+        std::vector<tensor<>*> tensors {};                  // Tensor handle - 1 -> tensor
+        std::vector<std::unique_ptr<graph::executor>> graphs {}; // Graph handle - 1 -> graph, nullptr if destroyed
+        std::unique_ptr<thread_pool> threads {};            // Created on first execution
+        dim num_threads {};                                 // 0 = all hardware threads
+        std::mutex jobs_mtx {};                             // Guards jobs and free_jobs, jobs may be polled from other threads while submitting
+        std::vector<job_slot> jobs {};                      // Job index -> job, done is nullptr if released
+        std::vector<std::uint32_t> free_jobs {};            // Released job indices
+        std::uint32_t generation {1};                       // Incremented when the isolate is destroyed, never 0
+        std::unique_ptr<job_queue> queue {};                // Created on first submission
+    };
+
+    struct registry final {
+        std::mutex mtx {}; // Guards creation and destruction of isolates
+        std::array<isolate_slot, k_max_isolates> slots {};
+    };
+
+    [[nodiscard]] auto get_registry() -> registry& {
+        static registry s_registry {};
+        return s_registry;
+    }
+
+    thread_local std::string t_last_error {};
+    thread_local std::string t_print_buf {};
+
+    template <typename... Args>
+    auto RTML_COLD set_error(const fmt::format_string<Args...>& fmt, Args&&... args) -> void {
+        t_last_error = fmt::format(fmt, std::forward<Args>(args)...);
+        rtml_log_error("C API: {}", t_last_error);
+    }
+
+    [[nodiscard]] auto next_generation(const std::uint32_t generation) noexcept -> std::uint32_t {
+        const std::uint32_t next {(generation+1) & ((1u<<(32-k_slot_bits))-1)}; // Must fit into the handle
+        return next ? next : 1;
+    }
+
+    [[nodiscard]] auto make_handle(const std::uint32_t idx, const std::uint32_t generation) noexcept -> rtml_isolate_id_t {
+        return (generation<<k_slot_bits) | idx;
+    }
+
+    [[nodiscard]] auto resolve(const rtml_isolate_id_t iso) noexcept -> isolate_slot* {
+        isolate_slot& slot {get_registry().slots[iso & (k_max_isolates-1)]};
+        if (!slot.ctx || slot.generation != iso>>k_slot_bits) [[unlikely]] {
+            set_error("invalid isolate handle {:#x}", iso);
+            return nullptr;
+        }
+        return &slot;
+    }
+
+    [[nodiscard]] auto resolve(const isolate_slot& slot, const rtml_tensor_id_t t) noexcept -> tensor<>* {
+        if (!t || t > slot.tensors.size()) [[unlikely]] {
+            set_error("invalid tensor handle {} in isolate '{}'", t, slot.ctx->name());
+            return nullptr;
+        }
+        return slot.tensors[t-1];
+    }
+
+    [[nodiscard]] auto resolve(const rtml_isolate_id_t iso, const rtml_tensor_id_t t) noexcept -> tensor<>* {
+        const isolate_slot* const slot {resolve(iso)};
+        return slot ? resolve(*slot, t) : nullptr;
+    }
+
+    auto drain_jobs(isolate_slot& slot) -> void { // Synchronous calls must not race with asynchronous jobs
+        if (slot.queue && slot.queue->pending()) [[unlikely]]
+            slot.queue->drain();
+    }
+
+    auto reset_slot(isolate_slot& slot) -> void {
+        slot.queue.reset(); // Completes pending jobs before the graphs and threads they use are destroyed
+        slot.graphs.clear();
+        slot.threads.reset();
+        slot.num_threads = 0;
+        slot.tensors.clear();
+        {
+            const std::lock_guard lock {slot.jobs_mtx};
+            slot.jobs.clear();
+            slot.free_jobs.clear();
+        }
+        slot.ctx.reset();
+        slot.generation = next_generation(slot.generation); // Invalidates all outstanding handles
+    }
+
+    [[nodiscard]] auto resolve_job_locked(isolate_slot& slot, const rtml_job_id_t job) -> job_slot* { // jobs_mtx must be held
+        const std::uint64_t idx {(job & 0xffffffff) - 1};
+        if (idx >= slot.jobs.size() || !slot.jobs[idx].done || slot.jobs[idx].generation != job>>32) [[unlikely]] {
+            set_error("invalid job handle {:#x}", job);
+            return nullptr;
+        }
+        return &slot.jobs[idx];
+    }
+
+    // Returns a reference to the completion, so it stays valid if the job is released or the job table grows concurrently
+    [[nodiscard]] auto resolve_job(isolate_slot& slot, const rtml_job_id_t job) -> std::shared_ptr<completion> {
+        const std::lock_guard lock {slot.jobs_mtx};
+        const job_slot* const j {resolve_job_locked(slot, job)};
+        return j ? j->done : nullptr;
+    }
+
+    [[nodiscard]] auto slot_threads(isolate_slot& slot) -> thread_pool& {
+        if (!slot.threads) [[unlikely]]
+            slot.threads = slot.num_threads ? std::make_unique<thread_pool>(slot.num_threads) : std::make_unique<thread_pool>();
+        return *slot.threads;
+    }
+
+    [[nodiscard]] auto create_tensor(isolate_slot& slot, const rtml_tensor_desc_t& desc) -> rtml_tensor_id_t {
+        if (desc.dtype != RTML_DTYPE_F32) [[unlikely]] {
+            set_error("unsupported dtype {}", desc.dtype);
+            return RTML_INVALID_HANDLE;
+        }
+        if (!desc.num_dims || desc.num_dims > RTML_MAX_DIMS) [[unlikely]] {
+            set_error("invalid dimension count {}", desc.num_dims);
+            return RTML_INVALID_HANDLE;
+        }
+        std::size_t size {sizeof(dtypes::f32)};
+        for (std::uint32_t i {}; i < desc.num_dims; ++i) {
+            if (desc.dims[i] <= 0) [[unlikely]] {
+                set_error("invalid dimension {} = {}", i, desc.dims[i]);
+                return RTML_INVALID_HANDLE;
+            }
+            size *= static_cast<std::size_t>(desc.dims[i]);
+        }
+        tensor<>* slice {};
+        if (desc.slice != RTML_INVALID_HANDLE) {
+            slice = resolve(slot, desc.slice);
+            if (!slice) [[unlikely]] return RTML_INVALID_HANDLE;
+            if (size + desc.slice_offset > slice->size()) [[unlikely]] {
+                set_error("slice of {}B at offset {} exceeds sliced tensor of {}B", size, desc.slice_offset, slice->size());
+                return RTML_INVALID_HANDLE;
+            }
+        } else if (size + sizeof(tensor<>) + 2*pool::k_natural_align > static_cast<std::size_t>(slot.ctx->pool().needle() - slot.ctx->pool().data())) [[unlikely]] {
+            set_error("isolate '{}' is out of memory, {}B requested", slot.ctx->name(), size);
+            return RTML_INVALID_HANDLE;
+        }
+        slot.tensors.emplace_back(slot.ctx->new_tensor<dtypes::f32>(std::span<const dim>{desc.dims, desc.num_dims}, slice, desc.slice_offset));
+        return static_cast<rtml_tensor_id_t>(slot.tensors.size());
+    }
+
+    [[nodiscard]] auto wrap_tensor(
+        isolate_slot& slot,
+        const std::uint32_t dtype,
+        const std::span<const dim> dims,
+        const std::int64_t* const strides,
+        void* const data
+    ) -> rtml_tensor_id_t {
+        if (dtype != RTML_DTYPE_F32) [[unlikely]] {
+            set_error("unsupported dtype {}", dtype);
+            return RTML_INVALID_HANDLE;
+        }
+        if (dims.empty() || dims.size() > RTML_MAX_DIMS) [[unlikely]] {
+            set_error("invalid dimension count {}", dims.size());
+            return RTML_INVALID_HANDLE;
+        }
+        if (!data || reinterpret_cast<std::uintptr_t>(data) % dtype_traits<dtypes::f32>::k_align) [[unlikely]] {
+            set_error("external data {} is null or not aligned to {}B", data, dtype_traits<dtypes::f32>::k_align);
+            return RTML_INVALID_HANDLE;
+        }
+        std::array<dim, RTML_MAX_DIMS> dense {};
+        for (std::size_t i {}; i < dims.size(); ++i) {
+            if (dims[i] <= 0) [[unlikely]] {
+                set_error("invalid dimension {} = {}", i, dims[i]);
+                return RTML_INVALID_HANDLE;
+            }
+            dense[i] = i ? dense[i-1]*dims[i-1] : static_cast<dim>(sizeof(dtypes::f32));
+            if (strides && (strides[i] <= 0 || strides[i] % static_cast<dim>(sizeof(dtypes::f32)))) [[unlikely]] {
+                set_error("invalid stride {} = {}B", i, strides[i]);
+                return RTML_INVALID_HANDLE;
+            }
+        }
+        if (sizeof(tensor<>) + 2*pool::k_natural_align > static_cast<std::size_t>(slot.ctx->pool().needle() - slot.ctx->pool().data())) [[unlikely]] {
+            set_error("isolate '{}' is out of memory", slot.ctx->name());
+            return RTML_INVALID_HANDLE;
+        }
+        slot.tensors.emplace_back(slot.ctx->new_external_tensor<dtypes::f32>(dims, data, strides ? std::span<const dim>{strides, dims.size()} : std::span<const dim>{dense.data(), dims.size()}));
+        return static_cast<rtml_tensor_id_t>(slot.tensors.size());
+    }
+
+    // DLPack tensor exported from an isolate, owns a reference to the isolate
+    struct dlpack_export final {
+        DLManagedTensor managed {};
+        std::shared_ptr<isolate> ctx {};
+        std::array<std::int64_t, RTML_MAX_DIMS> shape {};   // Outermost dimension first
+        std::array<std::int64_t, RTML_MAX_DIMS> strides {}; // In elements
+    };
+
+    template <typename T> requires is_dtype<T>
+    constexpr DLDataType k_dlpack_dtype {
+        .code=static_cast<std::uint8_t>(kDLFloat),
+        .bits=static_cast<std::uint8_t>(dtype_traits<T>::k_size*8),
+        .lanes=1
+    };
+
+    // Resolves a node, allocates the result tensor if requested and writes its handle back
+    [[nodiscard]] auto resolve_node(isolate_slot& slot, rtml_graph_node_t& n, graph::node& out) -> bool {
+        if (n.opcode >= RTML_OP_COUNT) [[unlikely]] {
+            set_error("invalid opcode {}", n.opcode);
+            return false;
+        }
+        out.op = static_cast<graph::opcode>(n.opcode);
+        std::ranges::copy(n.params, out.params.begin());
+        out.x = resolve(slot, n.x);
+        if (!out.x) [[unlikely]] return false;
+        if (n.y != RTML_INVALID_HANDLE) {
+            out.y = resolve(slot, n.y);
+            if (!out.y) [[unlikely]] return false;
+        }
+        if (n.r == RTML_INVALID_HANDLE) {
+            rtml_tensor_desc_t desc {.dtype=RTML_DTYPE_F32, .num_dims=out.x->dim_count(), .dims={}, .slice=RTML_INVALID_HANDLE, .slice_offset=0};
+            std::ranges::copy(out.x->dims(), desc.dims);
+            if (out.op == graph::opcode::matmul) {
+                if (!out.y) [[unlikely]] {
+                    set_error("matmul requires two operands");
+                    return false;
+                }
+                desc.dims[0] = out.y->dims()[0]; // X = [K, M], Y = [N, K] -> R = [N, M]
+                desc.num_dims = std::max(desc.num_dims, 2u);
+            } else if (graph::is_reduction(out.op)) {
+                desc.dims[0] = 1; // Allocated results of reductions reduce dim 0
+            } else if (out.op == graph::opcode::conv1d || out.op == graph::opcode::conv2d) {
+                if (!out.y) [[unlikely]] {
+                    set_error("convolutions require weights");
+                    return false;
+                }
+                const dim spatial_dims {out.op == graph::opcode::conv2d ? 2 : 1};
+                const std::array<dim, tensor<>::k_max_dims> shape {blas::conv_output_shape(spatial_dims, *out.x, *out.y, blas::conv_params_from(out.params))};
+                if (std::ranges::any_of(shape, [](const dim d) { return d <= 0; })) [[unlikely]] {
+                    set_error("kernel does not fit into the padded input");
+                    return false;
+                }
+                std::ranges::copy(shape, desc.dims);
+                desc.num_dims = std::max(desc.num_dims, static_cast<std::uint32_t>(spatial_dims + 1));
+            }
+            n.r = create_tensor(slot, desc);
+            if (n.r == RTML_INVALID_HANDLE) [[unlikely]] return false;
+        }
+        out.r = resolve(slot, n.r);
+        if (!out.r) [[unlikely]] return false;
+        if (const char* const error {graph::validate(out)}; error) [[unlikely]] {
+            set_error("invalid node {}: {}", graph::k_names[n.opcode], error);
+            return false;
+        }
+        return true;
+    }
+
+    [[nodiscard]] auto build_graph(isolate_slot& slot, rtml_graph_node_t* const nodes, const std::uint32_t num_nodes, graph::executor& out) -> bool {
+        if (!nodes && num_nodes) [[unlikely]] {
+            set_error("nodes must not be null");
+            return false;
+        }
+        out.reserve(num_nodes); // Pushing fails in locked mode if it would grow the node list
+        for (std::uint32_t i {}; i < num_nodes; ++i) {
+            for (rtml_tensor_id_t* const operand : {&nodes[i].x, &nodes[i].y}) { // Resolve references to earlier node results
+                if (!(*operand & RTML_NODE_RESULT_BIT)) continue;
+                const std::uint32_t ref {*operand & ~RTML_NODE_RESULT_BIT};
+                if (ref >= i) [[unlikely]] {
+                    set_error("node {} refers to the result of node {}, which is not an earlier node", i, ref);
+                    return false;
+                }
+                *operand = nodes[ref].r;
+            }
+            graph::node n {};
+            if (!resolve_node(slot, nodes[i], n)) [[unlikely]] return false;
+            if (const char* const error {out.push(n)}; error) [[unlikely]] {
+                set_error("node {}: {}", i, error);
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+extern "C" {
+    auto rtml_global_init() -> bool {
+        t_last_error.clear();
+        return isolate::init_rtml_runtime();
+    }
+
+    auto rtml_global_shutdown() -> void {
+        registry& reg {get_registry()};
+        {
+            const std::lock_guard lock {reg.mtx};
+            for (isolate_slot& slot : reg.slots) {
+                if (!slot.ctx) continue;
+                reset_slot(slot);
+            }
+        }
+        isolate::shutdown_rtml_runtime();
+    }
+
+    auto rtml_last_error() -> const char* {
+        return t_last_error.c_str();
+    }
+
+    auto rtml_isolate_create(const char* const name, const std::uint32_t device, const std::size_t pool_mem) -> rtml_isolate_id_t {
+        if (!name) [[unlikely]] {
+            set_error("isolate name must not be null");
+            return RTML_INVALID_HANDLE;
+        }
+        if (device >= static_cast<std::uint32_t>(isolate::compute_device::$count) || !pool_mem) [[unlikely]] {
+            set_error("invalid device {} or pool size {}", device, pool_mem);
+            return RTML_INVALID_HANDLE;
+        }
+        registry& reg {get_registry()};
+        const std::lock_guard lock {reg.mtx};
+        for (std::uint32_t i {}; i < k_max_isolates; ++i) {
+            isolate_slot& slot {reg.slots[i]};
+            if (slot.ctx) continue;
+            slot.ctx = isolate::create(name, static_cast<isolate::compute_device>(device), pool_mem);
+            return make_handle(i, slot.generation);
+        }
+        set_error("too many isolates, max: {}", k_max_isolates);
+        return RTML_INVALID_HANDLE;
+    }
+
+    auto rtml_isolate_destroy(const rtml_isolate_id_t iso) -> bool {
+        registry& reg {get_registry()};
+        const std::lock_guard lock {reg.mtx};
+        isolate_slot* const slot {resolve(iso)};
+        if (!slot) [[unlikely]] return false;
+        reset_slot(*slot);
+        return true;
+    }
+
+    auto rtml_isolate_exists(const rtml_isolate_id_t iso) -> bool {
+        const isolate_slot& slot {get_registry().slots[iso & (k_max_isolates-1)]};
+        return slot.ctx && slot.generation == iso>>k_slot_bits;
+    }
+
+    auto rtml_isolate_find(const char* const name) -> rtml_isolate_id_t {
+        if (!name) [[unlikely]] return RTML_INVALID_HANDLE;
+        registry& reg {get_registry()};
+        const std::lock_guard lock {reg.mtx};
+        for (std::uint32_t i {}; i < k_max_isolates; ++i)
+            if (reg.slots[i].ctx && reg.slots[i].ctx->name() == name)
+                return make_handle(i, reg.slots[i].generation);
+        set_error("no isolate named '{}'", name);
+        return RTML_INVALID_HANDLE;
+    }
+
+    auto rtml_isolate_set_num_threads(const rtml_isolate_id_t iso, const std::uint32_t num_threads) -> bool {
+        isolate_slot* const slot {resolve(iso)};
+        if (!slot) [[unlikely]] return false;
+        if (num_threads > RTML_MAX_THREADS) [[unlikely]] {
+            set_error("invalid thread count {}, max: {}", num_threads, RTML_MAX_THREADS);
+            return false;
+        }
+        if (slot->num_threads != num_threads) {
+            drain_jobs(*slot);
+            slot->num_threads = num_threads;
+            slot->threads.reset(); // Recreated with the new size on next execution
+        }
+        return true;
+    }
+
+    auto rtml_isolate_create_tensor(
+        const rtml_isolate_id_t iso,
+        const std::uint32_t dtype,
+        const std::int64_t d0,
+        const std::int64_t d1,
+        const std::int64_t d2,
+        const std::int64_t d3,
+        const std::uint32_t num_dims,
+        const rtml_tensor_id_t slice,
+        const std::size_t slice_offset
+    ) -> rtml_tensor_id_t {
+        isolate_slot* const slot {resolve(iso)};
+        if (!slot) [[unlikely]] return RTML_INVALID_HANDLE;
+        const rtml_tensor_desc_t desc {
+            .dtype=dtype,
+            .num_dims=num_dims,
+            .dims={d0, d1, d2, d3},
+            .slice=slice,
+            .slice_offset=slice_offset
+        };
+        return create_tensor(*slot, desc);
+    }
+
+    auto rtml_isolate_wrap_tensor(
+        const rtml_isolate_id_t iso,
+        const std::uint32_t dtype,
+        const std::int64_t* const dims,
+        const std::int64_t* const strides,
+        const std::uint32_t num_dims,
+        void* const data
+    ) -> rtml_tensor_id_t {
+        isolate_slot* const slot {resolve(iso)};
+        if (!slot) [[unlikely]] return RTML_INVALID_HANDLE;
+        if (!dims) [[unlikely]] {
+            set_error("dims must not be null");
+            return RTML_INVALID_HANDLE;
+        }
+        return wrap_tensor(*slot, dtype, std::span<const dim>{dims, num_dims}, strides, data);
+    }
+
+    auto rtml_isolate_create_tensors(
+        const rtml_isolate_id_t iso,
+        const rtml_tensor_desc_t* const descs,
+        const std::uint32_t num,
+        rtml_tensor_id_t* const out_ids
+    ) -> bool {
+        isolate_slot* const slot {resolve(iso)};
+        if (!slot) [[unlikely]] return false;
+        if ((!descs || !out_ids) && num) [[unlikely]] {
+            set_error("descs and out_ids must not be null");
+            return false;
+        }
+        for (std::uint32_t i {}; i < num; ++i) {
+            out_ids[i] = create_tensor(*slot, descs[i]);
+            if (out_ids[i] == RTML_INVALID_HANDLE) [[unlikely]] return false;
+        }
+        return true;
+    }
+
+    auto rtml_tensor_shape(const rtml_isolate_id_t iso, const rtml_tensor_id_t t, std::int64_t* const out_dims, std::uint32_t* const out_num_dims) -> bool {
+        const tensor<>* const ts {resolve(iso, t)};
+        if (!ts) [[unlikely]] return false;
+        if (out_dims) std::ranges::copy(ts->dims(), out_dims);
+        if (out_num_dims) *out_num_dims = ts->dim_count();
+        return true;
+    }
+
+    auto rtml_tensor_strides(const rtml_isolate_id_t iso, const rtml_tensor_id_t t, std::int64_t* const out_strides) -> bool {
+        const tensor<>* const ts {resolve(iso, t)};
+        if (!ts) [[unlikely]] return false;
+        if (out_strides) std::ranges::copy(ts->strides(), out_strides);
+        return true;
+    }
+
+    auto rtml_tensor_data(const rtml_isolate_id_t iso, const rtml_tensor_id_t t) -> void* {
+        isolate_slot* const slot {resolve(iso)};
+        const tensor<>* const ts {slot ? resolve(*slot, t) : nullptr};
+        if (!ts) [[unlikely]] return nullptr;
+        drain_jobs(*slot); // The caller reads or writes the data after this call
+        return ts->ptr();
+    }
+
+    auto rtml_tensor_data_size(const rtml_isolate_id_t iso, const rtml_tensor_id_t t) -> std::size_t {
+        const tensor<>* const ts {resolve(iso, t)};
+        return ts ? ts->size() : 0;
+    }
+
+    auto rtml_tensor_fill(const rtml_isolate_id_t iso, const rtml_tensor_id_t t, const float value) -> bool {
+        isolate_slot* const slot {resolve(iso)};
+        const tensor<>* const ts {slot ? resolve(*slot, t) : nullptr};
+        if (!ts) [[unlikely]] return false;
+        drain_jobs(*slot);
+        if (ts->is_dense()) [[likely]] {
+            ts->splat(value);
+            return true;
+        }
+        for (dim i {}; i < ts->elem_count(); ++i) // Strided views must not touch the gaps between elements
+            (*ts)(ts->unroll_index(i)) = value;
+        return true;
+    }
+
+    auto rtml_tensor_set_name(const rtml_isolate_id_t iso, const rtml_tensor_id_t t, const char* const name) -> bool {
+        tensor<>* const ts {resolve(iso, t)};
+        if (!ts || !name) [[unlikely]] return false;
+        ts->set_name(name);
+        return true;
+    }
+
+    auto rtml_tensor_print(const rtml_isolate_id_t iso, const rtml_tensor_id_t t) -> const char* {
+        isolate_slot* const slot {resolve(iso)};
+        const tensor<>* const ts {slot ? resolve(*slot, t) : nullptr};
+        if (!ts) [[unlikely]] return nullptr;
+        drain_jobs(*slot);
+        t_print_buf.clear(); // Keeps the capacity, repeated prints do not allocate
+        ts->format_to(std::back_inserter(t_print_buf));
+        return t_print_buf.c_str();
+    }
+
+    auto rtml_tensor_to_dlpack(const rtml_isolate_id_t iso, const rtml_tensor_id_t t) -> DLManagedTensor* {
+        isolate_slot* const slot {resolve(iso)};
+        if (!slot) [[unlikely]] return nullptr;
+        const tensor<>* const ts {resolve(*slot, t)};
+        if (!ts) [[unlikely]] return nullptr;
+        drain_jobs(*slot); // The consumer reads the data after this call
+        auto* const exp {new dlpack_export{.ctx=slot->ctx}};
+        const std::uint32_t n {ts->dim_count()};
+        for (std::uint32_t i {}; i < n; ++i) { // RTML dim 0 is the innermost dimension, DLPack lists the outermost first
+            exp->shape[n-1-i] = ts->dims()[i];
+            exp->strides[n-1-i] = ts->strides()[i] / static_cast<dim>(dtype_traits<dtypes::f32>::k_size); // Byte to element strides
+        }
+        exp->managed.dl_tensor = {
+            .data=ts->ptr(),
+            .device={.device_type=kDLCPU, .device_id=0},
+            .ndim=static_cast<std::int32_t>(n),
+            .dtype=k_dlpack_dtype<dtypes::f32>,
+            .shape=exp->shape.data(),
+            .strides=exp->strides.data(),
+            .byte_offset=0
+        };
+        exp->managed.manager_ctx = exp;
+        exp->managed.deleter = [](DLManagedTensor* const self) {
+            delete static_cast<dlpack_export*>(self->manager_ctx); // Releases the isolate if this was the last reference
+        };
+        return &exp->managed;
+    }
+
+    auto rtml_isolate_from_dlpack(const rtml_isolate_id_t iso, DLManagedTensor* const managed) -> rtml_tensor_id_t {
+        isolate_slot* const slot {resolve(iso)};
+        if (!slot) [[unlikely]] return RTML_INVALID_HANDLE;
+        if (!managed) [[unlikely]] {
+            set_error("managed tensor must not be null");
+            return RTML_INVALID_HANDLE;
+        }
+        const DLTensor& dl {managed->dl_tensor};
+        if (dl.device.device_type != kDLCPU && dl.device.device_type != kDLCUDAHost) [[unlikely]] {
+            set_error("DLPack device type {} is not host accessible", static_cast<int>(dl.device.device_type));
+            return RTML_INVALID_HANDLE;
+        }
+        constexpr DLDataType k_f32 {k_dlpack_dtype<dtypes::f32>};
+        if (dl.dtype.code != k_f32.code || dl.dtype.bits != k_f32.bits || dl.dtype.lanes != k_f32.lanes) [[unlikely]] {
+            set_error("unsupported DLPack dtype code {} bits {} lanes {}", dl.dtype.code, dl.dtype.bits, dl.dtype.lanes);
+            return RTML_INVALID_HANDLE;
+        }
+        if (dl.ndim < 0 || dl.ndim > RTML_MAX_DIMS) [[unlikely]] {
+            set_error("invalid DLPack dimension count {}", dl.ndim);
+            return RTML_INVALID_HANDLE;
+        }
+        const std::uint32_t n {std::max(static_cast<std::uint32_t>(dl.ndim), 1u)}; // Scalars become 1D tensors
+        std::array<dim, RTML_MAX_DIMS> dims {1, 1, 1, 1};
+        std::array<dim, RTML_MAX_DIMS> strides {static_cast<dim>(sizeof(dtypes::f32))};
+        for (std::uint32_t i {}; i < static_cast<std::uint32_t>(dl.ndim); ++i) {
+            const std::uint32_t src {n-1-i}; // DLPack lists the outermost dimension first
+            dims[i] = dl.shape[src];
+            strides[i] = dl.strides
+                ? dl.strides[src] * static_cast<dim>(sizeof(dtypes::f32)) // Element to byte strides
+                : i ? strides[i-1]*dims[i-1] : static_cast<dim>(sizeof(dtypes::f32)); // Compact row-major
+        }
+        void* const data {static_cast<std::uint8_t*>(dl.data) + dl.byte_offset};
+        const rtml_tensor_id_t t {wrap_tensor(*slot, RTML_DTYPE_F32, std::span<const dim>{dims.data(), n}, strides.data(), data)};
+        if (t == RTML_INVALID_HANDLE) [[unlikely]] return RTML_INVALID_HANDLE;
+        slot->ctx->on_destroy([managed] {
+            if (managed->deleter) managed->deleter(managed);
+        });
+        return t;
+    }
+
+    auto rtml_dlpack_release(DLManagedTensor* const managed) -> void {
+        if (managed && managed->deleter)
+            managed->deleter(managed);
+    }
+
+    auto rtml_tensor_op(
+        const rtml_isolate_id_t iso,
+        const std::uint32_t opcode,
+        const rtml_tensor_id_t r,
+        const rtml_tensor_id_t x,
+        const rtml_tensor_id_t y
+    ) -> bool {
+        return rtml_tensor_op_params(iso, opcode, r, x, y, nullptr);
+    }
+
+    auto rtml_tensor_op_params(
+        const rtml_isolate_id_t iso,
+        const std::uint32_t opcode,
+        const rtml_tensor_id_t r,
+        const rtml_tensor_id_t x,
+        const rtml_tensor_id_t y,
+        const std::int64_t* const params
+    ) -> bool {
+        isolate_slot* const slot {resolve(iso)};
+        if (!slot) [[unlikely]] return false;
+        if (r == RTML_INVALID_HANDLE) [[unlikely]] {
+            set_error("result tensor must be given");
+            return false;
+        }
+        rtml_graph_node_t node {.opcode=opcode, .r=r, .x=x, .y=y, .params={}};
+        if (params) std::copy_n(params, RTML_MAX_OP_PARAMS, node.params);
+        graph::node n {};
+        if (!resolve_node(*slot, node, n)) [[unlikely]] return false;
+        drain_jobs(*slot);
+        graph::run(slot_threads(*slot), n);
+        return true;
+    }
+
+    auto rtml_graph_build(const rtml_isolate_id_t iso, rtml_graph_node_t* const nodes, const std::uint32_t num_nodes) -> rtml_graph_id_t {
+        isolate_slot* const slot {resolve(iso)};
+        if (!slot) [[unlikely]] return RTML_INVALID_HANDLE;
+        auto graph {std::make_unique<graph::executor>()};
+        if (!build_graph(*slot, nodes, num_nodes, *graph)) [[unlikely]] return RTML_INVALID_HANDLE;
+        slot->graphs.emplace_back(std::move(graph));
+        return static_cast<rtml_graph_id_t>(slot->graphs.size());
+    }
+
+    auto rtml_graph_execute(const rtml_isolate_id_t iso, const rtml_graph_id_t graph) -> bool {
+        isolate_slot* const slot {resolve(iso)};
+        if (!slot) [[unlikely]] return false;
+        if (!graph || graph > slot->graphs.size() || !slot->graphs[graph-1]) [[unlikely]] {
+            set_error("invalid graph handle {}", graph);
+            return false;
+        }
+        drain_jobs(*slot);
+        slot->graphs[graph-1]->run(slot_threads(*slot));
+        return true;
+    }
+
+    auto rtml_graph_destroy(const rtml_isolate_id_t iso, const rtml_graph_id_t graph) -> bool {
+        isolate_slot* const slot {resolve(iso)};
+        if (!slot) [[unlikely]] return false;
+        if (!graph || graph > slot->graphs.size() || !slot->graphs[graph-1]) [[unlikely]] {
+            set_error("invalid graph handle {}", graph);
+            return false;
+        }
+        drain_jobs(*slot);
+        slot->graphs[graph-1].reset(); // Handle is not reused
+        return true;
+    }
+
+    auto rtml_graph_run(const rtml_isolate_id_t iso, rtml_graph_node_t* const nodes, const std::uint32_t num_nodes) -> bool {
+        isolate_slot* const slot {resolve(iso)};
+        if (!slot) [[unlikely]] return false;
+        graph::executor graph {};
+        if (!build_graph(*slot, nodes, num_nodes, graph)) [[unlikely]] return false;
+        drain_jobs(*slot);
+        graph.run(slot_threads(*slot));
+        return true;
+    }
+
+    auto rtml_graph_submit(const rtml_isolate_id_t iso, const rtml_graph_id_t graph) -> rtml_job_id_t {
+        isolate_slot* const slot {resolve(iso)};
+        if (!slot) [[unlikely]] return RTML_INVALID_HANDLE;
+        if (!graph || graph > slot->graphs.size() || !slot->graphs[graph-1]) [[unlikely]] {
+            set_error("invalid graph handle {}", graph);
+            return RTML_INVALID_HANDLE;
+        }
+        if (!slot->queue) [[unlikely]]
+            slot->queue = std::make_unique<job_queue>();
+        const graph::executor* const exec {slot->graphs[graph-1].get()};
+        thread_pool* const pool {&slot_threads(*slot)}; // Created here, not on the worker
+        std::shared_ptr<completion> done {slot->queue->submit([exec, pool] { exec->run(*pool); })};
+        const std::lock_guard lock {slot->jobs_mtx};
+        std::uint32_t idx {};
+        if (slot->free_jobs.empty()) {
+            idx = static_cast<std::uint32_t>(slot->jobs.size());
+            slot->jobs.emplace_back();
+        } else {
+            idx = slot->free_jobs.back();
+            slot->free_jobs.pop_back();
+        }
+        job_slot& job {slot->jobs[idx]};
+        job.done = std::move(done);
+        return (static_cast<rtml_job_id_t>(job.generation)<<32) | (idx+1);
+    }
+
+    auto rtml_job_poll(const rtml_isolate_id_t iso, const rtml_job_id_t job) -> int {
+        isolate_slot* const slot {resolve(iso)};
+        const std::shared_ptr<completion> done {slot ? resolve_job(*slot, job) : nullptr};
+        if (!done) [[unlikely]] return -1;
+        return done->is_done() ? 1 : 0;
+    }
+
+    auto rtml_job_wait(const rtml_isolate_id_t iso, const rtml_job_id_t job, const std::int64_t timeout_us) -> bool {
+        isolate_slot* const slot {resolve(iso)};
+        const std::shared_ptr<completion> done {slot ? resolve_job(*slot, job) : nullptr};
+        if (!done) [[unlikely]] return false;
+        if (timeout_us < 0) {
+            done->wait();
+            return true;
+        }
+        return done->wait_for(std::chrono::microseconds{timeout_us});
+    }
+
+    auto rtml_job_eventfd(const rtml_isolate_id_t iso, const rtml_job_id_t job) -> int {
+        isolate_slot* const slot {resolve(iso)};
+        const std::shared_ptr<completion> done {slot ? resolve_job(*slot, job) : nullptr};
+        if (!done) [[unlikely]] return -1;
+        const int fd {done->event_fd()};
+        if (fd < 0) [[unlikely]]
+            set_error("eventfd is not supported on this platform");
+        return fd;
+    }
+
+    auto rtml_job_release(const rtml_isolate_id_t iso, const rtml_job_id_t job) -> bool {
+        isolate_slot* const slot {resolve(iso)};
+        if (!slot) [[unlikely]] return false;
+        const std::lock_guard lock {slot->jobs_mtx};
+        job_slot* const j {resolve_job_locked(*slot, job)};
+        if (!j) [[unlikely]] return false;
+        j->done.reset(); // The queue keeps its own reference if the job is still pending
+        j->generation = next_generation(j->generation);
+        slot->free_jobs.emplace_back(static_cast<std::uint32_t>((job & 0xffffffff) - 1));
+        return true;
+    }
+}
@@ -0,0 +1,337 @@
+// Copyright Mario "Neo" Sieg 2024. All rights reserved. mario.sieg.64@gmail.com
+// CPU backend only!
+// 1D and 2D convolutions with stride, zero padding, dilation and groups
+// conv1d is a conv2d with H = KH = 1, both share the kernels below
+
+#include "conv.hpp"
+
+#include <algorithm>
+
+#include "gemm.hpp"
+#include "graph.hpp"
+#include "isolate.hpp"
+#include "profiler.hpp"
+#include "tensor.hpp"
+
+namespace rtml::blas {
+    auto conv_params_from(const op_params& p) noexcept -> conv_params {
+        const auto or_default {[](const dim v, const dim def) noexcept -> dim { return v ? v : def; }};
+        return {
+            .stride={or_default(p[0], 1), or_default(p[1], 1)},
+            .padding={p[2], p[3]},
+            .dilation={or_default(p[4], 1), or_default(p[5], 1)},
+            .groups=or_default(p[6], 1)
+        };
+    }
+
+    auto to_op_params(const conv_params& p) noexcept -> op_params {
+        return {p.stride[0], p.stride[1], p.padding[0], p.padding[1], p.dilation[0], p.dilation[1], p.groups, 0};
+    }
+
+    // Geometry of a convolution in conv2d terms, strides are in elements
+    struct conv_geometry final {
+        dim c_in, w_in, h_in, batch;
+        dim xs_w, xs_h, xs_b;
+        dim c_out, w_out, h_out;
+        dim kw, kh;
+        dim groups, cin_g, cout_g;
+        dim sw, sh;
+        dim pw, ph;
+        dim dw, dh;
+
+        [[nodiscard]] auto taps() const noexcept -> dim { return kw*kh; }
+        [[nodiscard]] auto pixels() const noexcept -> dim { return w_out*h_out; }
+    };
+
+    [[nodiscard]] static auto conv_make_geometry(const dim spatial_dims, const tensor<>& x, const tensor<>& w, const conv_params& params) noexcept -> conv_geometry {
+        static constexpr auto k_size {static_cast<dim>(dtype_traits<dtypes::f32>::k_size)};
+        const auto [x_d0, x_d1, x_d2, x_d3] {x.dims()};
+        const auto [x_s0, x_s1, x_s2, x_s3] {x.strides()};
+        const auto [w_d0, w_d1, w_d2, w_d3] {w.dims()};
+        const bool is_2d {spatial_dims == 2};
+        conv_geometry g {
+            .c_in=x_d0, .w_in=x_d1, .h_in=is_2d ? x_d2 : 1, .batch=is_2d ? x_d3 : x_d2,
+            .xs_w=x_s1/k_size, .xs_h=x_s2/k_size, .xs_b=(is_2d ? x_s3 : x_s2)/k_size,
+            .c_out=w_d0, .w_out=0, .h_out=0,
+            .kw=w_d2, .kh=is_2d ? w_d3 : 1,
+            .groups=std::max<dim>(params.groups, 1), .cin_g=w_d1, .cout_g=0,
+            .sw=params.stride[0], .sh=is_2d ? params.stride[1] : 1,
+            .pw=params.padding[0], .ph=is_2d ? params.padding[1] : 0,
+            .dw=params.dilation[0], .dh=is_2d ? params.dilation[1] : 1
+        };
+        g.cout_g = g.c_out / g.groups;
+        if (g.sw > 0 && g.sh > 0) {
+            g.w_out = (g.w_in + 2*g.pw - g.dw*(g.kw - 1) - 1) / g.sw + 1;
+            g.h_out = (g.h_in + 2*g.ph - g.dh*(g.kh - 1) - 1) / g.sh + 1;
+        }
+        return g;
+    }
+
+    auto conv_output_shape(const dim spatial_dims, const tensor<>& x, const tensor<>& w, const conv_params& params) noexcept -> std::array<dim, 4> {
+        const conv_geometry g {conv_make_geometry(spatial_dims, x, w, params)};
+        if (spatial_dims == 2) return {g.c_out, g.w_out, g.h_out, g.batch};
+        return {g.c_out, g.w_out, g.batch, 1};
+    }
+
+    auto validate_conv(
+        const dim spatial_dims,
+        const tensor<>& r,
+        const tensor<>& x,
+        const tensor<>& w,
+        const conv_params& params
+    ) noexcept -> const char* {
+        if (spatial_dims != 1 && spatial_dims != 2) [[unlikely]]
+            return "convolutions must have 1 or 2 spatial dims";
+        if (spatial_dims == 1 && (x.dims()[3] != 1 || w.dims()[3] != 1)) [[unlikely]]
+            return "conv1d operands must have at most 3 dims";
+        for (dim i {}; i < 2; ++i)
+            if (params.stride[i] < 1 || params.dilation[i] < 1 || params.padding[i] < 0) [[unlikely]]
+                return "stride and dilation must be >= 1, padding >= 0";
+        if (params.groups < 1 || x.dims()[0] % params.groups || w.dims()[0] % params.groups) [[unlikely]]
+            return "input and output channels must be divisible by groups";
+        if (w.dims()[1] != x.dims()[0] / params.groups) [[unlikely]]
+            return "weight input channels must be input channels / groups";
+        const std::array<dim, 4> shape {conv_output_shape(spatial_dims, x, w, params)};
+        if (shape[1] <= 0 || (spatial_dims == 2 && shape[2] <= 0)) [[unlikely]]
+            return "kernel does not fit into the padded input";
+        if (!std::ranges::equal(r.dims(), shape)) [[unlikely]]
+            return "result shape mismatch";
+        if (x.strides()[0] != dtype_traits<dtypes::f32>::k_size || !r.is_dense() || !w.is_dense()) [[unlikely]]
+            return "x must be dense in dim 0, result and weights must be dense";
+        return nullptr;
+    }
+
+    [[nodiscard]] static auto conv_select_geometry(const conv_geometry& g) noexcept -> conv_algorithm {
+        static constexpr dim k_min_gemm_k {32};     // Minimum reduction length (taps * input channels per group) of the GEMM path
+        static constexpr dim k_min_gemm_n {16};     // Minimum output channels per group of the GEMM path, one vector
+        if (g.cin_g == 1) return conv_algorithm::direct; // Depthwise: no reduction over channels, the GEMM would be memory bound on packing
+        if (g.taps()*g.cin_g < k_min_gemm_k || g.cout_g < k_min_gemm_n || g.pixels() < k_gemm_mr) return conv_algorithm::direct;
+        return conv_algorithm::gemm;
+    }
+
+    auto conv_select_algorithm(const dim spatial_dims, const tensor<>& x, const tensor<>& w, const conv_params& params) noexcept -> conv_algorithm {
+        return conv_select_geometry(conv_make_geometry(spatial_dims, x, w, params));
+    }
+
+    // Input pixels are resolved by a callable: src(b, iy, ix) -> pointer to channel 0 of the in bounds input pixel,
+    // so the kernels run on strided tensors and on the ring buffered context of conv1d_stream alike
+    template <typename F>
+    concept conv_source = std::is_nothrow_invocable_r_v<const dtypes::f32*, F, dim, dim, dim>;
+
+    // Gathers kernel taps of output pixels [i0, i0+mc) and reduction indices [p0, p0+kc) into MR row panels (like sgemm_pack_a)
+    // Reduction index k = (ky*KW + kx)*cin_g + ci, so every tap is a contiguous run of input channels
+    template <typename F> requires conv_source<F>
+    static auto RTML_HOT conv_pack_a(
+        const conv_geometry& g,
+        const F& src_pixel,
+        const dim b,
+        const dim ci0,              // First input channel of the group
+        float* const dst,
+        const dim i0,
+        const dim mc,
+        const dim p0,
+        const dim kc
+    ) noexcept -> void {
+        for (dim ir {}; ir < mc; ir += k_gemm_mr) {
+            float* const panel {dst + ir*kc};
+            for (dim i {}; i < k_gemm_mr; ++i) {
+                if (ir + i >= mc) {
+                    for (dim p {}; p < kc; ++p) panel[p*k_gemm_mr + i] = 0.0f;
+                    continue;
+                }
+                const dim pixel {i0 + ir + i};
+                const dim ox {pixel % g.w_out};
+                const dim oy {pixel / g.w_out};
+                for (dim p {}, k {p0}; p < kc;) {
+                    const dim tap {k / g.cin_g};
+                    const dim ci {k - tap*g.cin_g};
+                    const dim n {std::min(g.cin_g - ci, kc - p)};
+                    const dim ix {ox*g.sw - g.pw + tap%g.kw*g.dw};
+                    const dim iy {oy*g.sh - g.ph + tap/g.kw*g.dh};
+                    float* const out {panel + p*k_gemm_mr + i};
+                    if (ix < 0 || iy < 0 || ix >= g.w_in || iy >= g.h_in) {
+                        for (dim j {}; j < n; ++j) out[j*k_gemm_mr] = 0.0f;
+                    } else {
+                        const dtypes::f32* const src {src_pixel(b, iy, ix) + ci0 + ci};
+                        for (dim j {}; j < n; ++j) out[j*k_gemm_mr] = src[j];
+                    }
+                    p += n;
+                    k += n;
+                }
+            }
+        }
+    }
+
+    // One GEMM per batch and group: R[pixels, cout_g] = im2col(X)[pixels, taps*cin_g] @ W[taps*cin_g, cout_g]
+    template <typename F> requires conv_source<F>
+    static auto RTML_HOT conv_gemm(const compute_ctx& ctx, const conv_geometry& g, dtypes::f32* const r, const F& src_pixel, const dtypes::f32* const w) noexcept -> void {
+        for (dim b {}; b < g.batch; ++b) {
+            for (dim grp {}; grp < g.groups; ++grp) {
+                sgemm_packed(
+                    ctx, g.pixels(), g.cout_g, g.taps()*g.cin_g,
+                    [&g, &src_pixel, b, ci0=grp*g.cin_g](float* const dst, const dim i0, const dim mc, const dim p0, const dim kc) noexcept {
+                        conv_pack_a(g, src_pixel, b, ci0, dst, i0, mc, p0, kc);
+                    },
+                    w + grp*g.cout_g, g.c_out,
+                    r + b*g.pixels()*g.c_out + grp*g.cout_g, g.c_out,
+                    false
+                );
+            }
+        }
+    }
+
+    /*
+     * Direct convolution, output pixels of all batches are partitioned across threads.
+     * Every output pixel is a dense row of C_out channels which is accumulated over all kernel taps, with SIMD over the channels:
+     * depthwise convolutions multiply the input pixel row with the weight row of the tap, grouped and dense convolutions
+     * broadcast every input channel and accumulate its weight row.
+     */
+    template <typename F> requires conv_source<F>
+    static auto RTML_HOT conv_direct(const compute_ctx& ctx, const conv_geometry& g, dtypes::f32* const r, const F& src_pixel, const dtypes::f32* const w) noexcept -> void {
+        const dim total {g.batch*g.pixels()};
+        const dim ppt {(total + ctx.num_threads - 1) / ctx.num_threads};   // Pixels per thread
+        const dim start {std::min(ppt*ctx.thread_idx, total)};
+        const dim end {std::min(start + ppt, total)};
+        const bool depthwise {g.cin_g == 1 && g.cout_g == 1};
+        for (dim i {start}; i < end; ++i) {
+            const dim b {i / g.pixels()};
+            const dim pixel {i - b*g.pixels()};
+            const dim ox {pixel % g.w_out};
+            const dim oy {pixel / g.w_out};
+            dtypes::f32* const out {r + i*g.c_out};
+            std::fill_n(out, g.c_out, 0.0f);
+            for (dim ky {}; ky < g.kh; ++ky) {
+                const dim iy {oy*g.sh - g.ph + ky*g.dh};
+                if (iy < 0 || iy >= g.h_in) continue;
+                for (dim kx {}; kx < g.kw; ++kx) {
+                    const dim ix {ox*g.sw - g.pw + kx*g.dw};
+                    if (ix < 0 || ix >= g.w_in) continue;
+                    const dtypes::f32* const src {src_pixel(b, iy, ix)};
+                    const dtypes::f32* const w_tap {w + (ky*g.kw + kx)*g.cin_g*g.c_out};
+                    if (depthwise) {
+                        for (dim c {}; c < g.c_out; ++c)
+                            out[c] += src[c]*w_tap[c];
+                        continue;
+                    }
+                    for (dim grp {}; grp < g.groups; ++grp) {
+                        dtypes::f32* const out_g {out + grp*g.cout_g};
+                        for (dim ci {}; ci < g.cin_g; ++ci) {
+                            const dtypes::f32 v {src[grp*g.cin_g + ci]};
+                            const dtypes::f32* const w_row {w_tap + ci*g.c_out + grp*g.cout_g};
+                            for (dim co {}; co < g.cout_g; ++co)
+                                out_g[co] += v*w_row[co];
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    auto conv(
+        const compute_ctx& ctx,
+        const dim spatial_dims,
+        tensor<>& r,
+        const tensor<>& x,
+        const tensor<>& w,
+        const conv_params& params,
+        const conv_algorithm algorithm
+    ) noexcept -> void {
+        assert(!validate_conv(spatial_dims, r, x, w, params)); // Debug only verification - ! must be checked by the caller
+        const conv_geometry g {conv_make_geometry(spatial_dims, x, w, params)};
+        auto* const p_r {reinterpret_cast<dtypes::f32*>(r.ptr())};
+        const auto* const p_x {reinterpret_cast<const dtypes::f32*>(x.ptr())};
+        const auto* const p_w {reinterpret_cast<const dtypes::f32*>(w.ptr())};
+        const auto src_pixel {[&g, p_x](const dim b, const dim iy, const dim ix) noexcept -> const dtypes::f32* {
+            return p_x + b*g.xs_b + iy*g.xs_h + ix*g.xs_w;
+        }};
+        if (algorithm == conv_algorithm::gemm) conv_gemm(ctx, g, p_r, src_pixel, p_w);
+        else conv_direct(ctx, g, p_r, src_pixel, p_w);
+    }
+
+    auto conv1d(const compute_ctx& ctx, tensor<>& r, const tensor<>& x, const tensor<>& y, const op_params& params) noexcept -> void {
+        rtml_profile_op(graph::opcode::conv1d, ctx.thread_idx, r, x, y);
+        const conv_params p {conv_params_from(params)};
+        conv(ctx, 1, r, x, y, p, conv_select_algorithm(1, x, y, p));
+    }
+
+    auto conv2d(const compute_ctx& ctx, tensor<>& r, const tensor<>& x, const tensor<>& y, const op_params& params) noexcept -> void {
+        rtml_profile_op(graph::opcode::conv2d, ctx.thread_idx, r, x, y);
+        const conv_params p {conv_params_from(params)};
+        conv(ctx, 2, r, x, y, p, conv_select_algorithm(2, x, y, p));
+    }
+
+    conv1d_stream::conv1d_stream(isolate& ctx, const tensor<>& w, const dim channels, const dim batch, const conv_params& params)
+        : m_w{&w}, m_params{params}, m_channels{channels}, m_batch{batch}, m_context{(w.dims()[2] - 1)*params.dilation[0]} {
+        rtml_assert(params.stride[0] == 1 && params.padding[0] == 0, "Streaming conv1d requires stride 1 and no padding");
+        rtml_assert(params.dilation[0] >= 1 && params.groups >= 1 && channels % params.groups == 0 && w.dims()[1] == channels / params.groups, "Invalid streaming conv1d weights or params");
+        rtml_assert(w.is_dense() && batch > 0, "Invalid streaming conv1d config");
+        if (m_context) {
+            m_history = ctx.new_tensor<dtypes::f32>({channels, m_context, batch});
+            m_history->splat(0.0f);
+        }
+    }
+
+    auto conv1d_stream::validate(const tensor<>& r, const tensor<>& x) const noexcept -> const char* {
+        const auto [x_d0, x_d1, x_d2, x_d3] {x.dims()};
+        if (x_d0 != m_channels || x_d2 != m_batch || x_d3 != 1) [[unlikely]]
+            return "input must be [channels, frames, batch]";
+        if (!std::ranges::equal(r.dims(), std::array<dim, 4>{m_w->dims()[0], x_d1, m_batch, 1})) [[unlikely]]
+            return "result shape mismatch";
+        if (x.strides()[0] != dtype_traits<dtypes::f32>::k_size || !r.is_dense()) [[unlikely]]
+            return "x must be dense in dim 0 and the result dense";
+        return nullptr;
+    }
+
+    auto conv1d_stream::process(const compute_ctx& ctx, tensor<>& r, const tensor<>& x) noexcept -> void {
+        static constexpr auto k_size {static_cast<dim>(dtype_traits<dtypes::f32>::k_size)};
+        assert(!validate(r, x)); // Debug only verification - ! must be checked by the caller
+        assert(ctx.num_threads == 1 || ctx.shared);
+        // Waits until earlier combining calls of the dispatch are completed, e.g. the advance of a previous chunk of this stream
+        const std::uint32_t seq {ctx.num_threads == 1 ? 0 : ctx.shared->enter_combine(ctx.thread_idx)};
+        const conv_params params {.dilation=m_params.dilation, .groups=m_params.groups};
+        conv_geometry g {conv_make_geometry(1, x, *m_w, params)};
+        g.w_in += m_context; // Input frames [0, context) come from the ring buffer, the new frames follow
+        g.w_out = x.dims()[1];
+        const auto* const p_x {reinterpret_cast<const dtypes::f32*>(x.ptr())};
+        const auto* const p_h {m_history ? reinterpret_cast<const dtypes::f32*>(m_history->ptr()) : nullptr};
+        const dim hs_b {m_history ? m_history->strides()[2]/k_size : 0};
+        const auto src_pixel {[&, p_x, p_h, hs_b](const dim b, dim, const dim ix) noexcept -> const dtypes::f32* {
+            if (ix >= m_context) return p_x + b*g.xs_b + (ix - m_context)*g.xs_w;
+            dim slot {m_head + ix};
+            if (slot >= m_context) slot -= m_context;
+            return p_h + b*hs_b + slot*m_channels;
+        }};
+        auto* const p_r {reinterpret_cast<dtypes::f32*>(r.ptr())};
+        const auto* const p_w {reinterpret_cast<const dtypes::f32*>(m_w->ptr())};
+        if (conv_select_geometry(g) == conv_algorithm::gemm) conv_gemm(ctx, g, p_r, src_pixel, p_w);
+        else conv_direct(ctx, g, p_r, src_pixel, p_w);
+        if (ctx.num_threads == 1) {
+            advance(x);
+        } else if (ctx.shared->arrive(ctx.num_threads)) { // All threads are done reading the context
+            advance(x);
+            ctx.shared->complete(seq);
+        }
+    }
+
+    auto conv1d_stream::advance(const tensor<>& x) noexcept -> void {
+        const dim t {x.dims()[1]};
+        m_frames += t;
+        if (!m_context) return;
+        const dim n {std::min(t, m_context)}; // The n newest frames replace the n oldest context frames
+        for (dim b {}; b < m_batch; ++b) {
+            for (dim i {}; i < n; ++i) {
+                dim slot {m_head + i};
+                if (slot >= m_context) slot -= m_context;
+                const auto* const src {reinterpret_cast<const dtypes::f32*>(x.ptr() + (t - n + i)*x.strides()[1] + b*x.strides()[2])};
+                std::copy_n(src, m_channels, &(*m_history)({0, slot, b, 0}));
+            }
+        }
+        m_head = (m_head + n) % m_context;
+    }
+
+    auto conv1d_stream::reset() noexcept -> void {
+        if (m_history) m_history->splat(0.0f);
+        m_head = 0;
+        m_frames = 0;
+    }
+}
@@ -0,0 +1,104 @@
+// Copyright Mario "Neo" Sieg 2024. All rights reserved. mario.sieg.64@gmail.com
+// CPU backend only!
+// 1D and 2D convolutions with stride, zero padding, dilation and groups
+// Activations are channel innermost: conv2d x = [C_in, W, H, B], r = [C_out, W_out, H_out, B], conv1d x = [C_in, T, B], r = [C_out, T_out, B]
+// Weights are [C_out, C_in / groups, KW, KH] (conv2d) or [C_out, C_in / groups, K] (conv1d), so a weight tensor is the
+// [KH * KW * C_in / groups, C_out] row major B matrix of the convolution as a GEMM of output pixels x kernel taps
+
+#pragma once
+
+#include <array>
+
+#include "base.hpp"
+#include "blas.hpp"
+#include "tensor_base.hpp"
+
+namespace rtml {
+    class isolate;
+}
+
+namespace rtml::blas {
+    // Index 0 is the W (conv1d: time) axis, index 1 the H axis which is unused by conv1d
+    struct conv_params final {
+        std::array<dim, 2> stride {1, 1};
+        std::array<dim, 2> padding {0, 0};  // Zero padding on both sides
+        std::array<dim, 2> dilation {1, 1};
+        dim groups {1};
+    };
+
+    // Graph op parameter layout: stride W, stride H, padding W, padding H, dilation W, dilation H, groups - zero selects the default
+    [[nodiscard]] extern auto conv_params_from(const op_params& p) noexcept -> conv_params;
+    [[nodiscard]] extern auto to_op_params(const conv_params& p) noexcept -> op_params;
+
+    enum class conv_algorithm {
+        direct,     // Per output pixel SIMD loops over channels, for depthwise convolutions and small channel counts
+        gemm        // Implicit GEMM: kernel taps are gathered into the packed A panels of the SGEMM (no im2col buffer)
+    };
+
+    // Heuristic choice of the convolution algorithm from the operand shapes
+    [[nodiscard]] extern auto conv_select_algorithm(dim spatial_dims, const tensor<dtypes::f32>& x, const tensor<dtypes::f32>& w, const conv_params& params) noexcept -> conv_algorithm;
+
+    // Result shape of a convolution, dims are <= 0 if the kernel does not fit into the padded input
+    [[nodiscard]] extern auto conv_output_shape(dim spatial_dims, const tensor<dtypes::f32>& x, const tensor<dtypes::f32>& w, const conv_params& params) noexcept -> std::array<dim, 4>;
+
+    // Checks shapes, layouts and parameters of convolution operands, returns an error message or nullptr
+    // x must be dense in dim 0, r and w must be dense
+    [[nodiscard]] extern auto validate_conv(
+        dim spatial_dims,
+        const tensor<dtypes::f32>& r,
+        const tensor<dtypes::f32>& x,
+        const tensor<dtypes::f32>& w,
+        const conv_params& params
+    ) noexcept -> const char*;
+
+    // r = conv(x, w) with an explicit algorithm, conv1d and conv2d (graph ops) use conv_select_algorithm
+    // Like matmul, every thread of a dispatch must call this with the same operands (the GEMM paths synchronize in pinned pools)
+    extern auto conv(
+        const compute_ctx& ctx,
+        dim spatial_dims,
+        tensor<dtypes::f32>& r,
+        const tensor<dtypes::f32>& x,
+        const tensor<dtypes::f32>& w,
+        const conv_params& params,
+        conv_algorithm algorithm
+    ) noexcept -> void;
+
+    /*
+     * Stateful streaming conv1d for real time input which arrives in chunks of frames.
+     * The last (K - 1) * dilation input frames of every batch are kept in a ring buffer tensor allocated from the isolate pool,
+     * so every call only computes the outputs of its new frames and the context update copies at most min(new frames, context) frames.
+     * The stream starts with zero context: the concatenated outputs of all calls are identical to the offline conv1d of the
+     * concatenated input with (K - 1) * dilation zero frames prepended (causal convolution).
+     * Groups and dilation are supported, stride must be 1 and padding 0 because the context replaces the padding.
+     */
+    class conv1d_stream final {
+    public:
+        // w = [C_out, C_in / groups, K], must outlive the stream
+        conv1d_stream(isolate& ctx, const tensor<dtypes::f32>& w, dim channels, dim batch, const conv_params& params);
+        conv1d_stream(const conv1d_stream&) = delete;
+        conv1d_stream(conv1d_stream&&) = delete;
+        auto operator=(const conv1d_stream&) -> conv1d_stream& = delete;
+        auto operator=(conv1d_stream&&) -> conv1d_stream& = delete;
+        ~conv1d_stream() = default;
+
+        // x = [C_in, T, B] new frames, r = [C_out, T, B] their outputs
+        // Called on all threads of a dispatch like an op kernel, the last thread to finish advances the context
+        auto process(const compute_ctx& ctx, tensor<dtypes::f32>& r, const tensor<dtypes::f32>& x) noexcept -> void;
+        [[nodiscard]] auto validate(const tensor<dtypes::f32>& r, const tensor<dtypes::f32>& x) const noexcept -> const char*;
+        auto reset() noexcept -> void; // Zero context, starts a new stream
+        [[nodiscard]] auto context() const noexcept -> dim { return m_context; }
+        [[nodiscard]] auto frames() const noexcept -> dim { return m_frames; } // Frames processed since the last reset
+
+    private:
+        auto advance(const tensor<dtypes::f32>& x) noexcept -> void;
+
+        const tensor<dtypes::f32>* m_w;
+        conv_params m_params;
+        dim m_channels;
+        dim m_batch;
+        dim m_context;                          // (K - 1) * dilation
+        tensor<dtypes::f32>* m_history {};      // [C_in, context, B] ring buffer, nullptr if the context is empty
+        dim m_head {};                          // Ring slot of the oldest context frame
+        dim m_frames {};
+    };
+}
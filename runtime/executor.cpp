@@ -0,0 +1,91 @@
+// Copyright Mario "Neo" Sieg 2024. All rights reserved. mario.sieg.64@gmail.com
+// CPU backend only!
+// Linear graph executor: a validated, topologically ordered list of ops which runs on a thread pool
+// Every op is dispatched to all threads of the pool and completes before the next op starts
+
+#include "executor.hpp"
+
+#include "blas.hpp"
+#include "conv.hpp"
+#include "graph.hpp"
+#include "tensor.hpp"
+#include "thread_pool.hpp"
+
+namespace rtml::graph {
+    auto validate(const node& n) noexcept -> const char* {
+        if (static_cast<std::size_t>(n.op) >= static_cast<std::size_t>(opcode::$count)) [[unlikely]]
+            return "invalid opcode";
+        if (!n.r || !n.x) [[unlikely]]
+            return "missing operand";
+        const bool unary {k_operands[static_cast<std::size_t>(n.op)] == 1};
+        if (unary == (n.y != nullptr)) [[unlikely]]
+            return "operand count mismatch";
+        if (n.r == n.x || n.r == n.y) [[unlikely]]
+            return "result must not alias an operand";
+        const tensor<>& r {*n.r};
+        const tensor<>& x {*n.x};
+        if (n.op == opcode::matmul) { // X = [K, M], Y = [N, K] -> R = [N, M]
+            const tensor<>& y {*n.y};
+            if (x.dims()[0] != y.dims()[1]) [[unlikely]]
+                return "matmul inner dimension mismatch";
+            if (r.dims()[0] != y.dims()[0] || r.dims()[1] != x.dims()[1]) [[unlikely]]
+                return "matmul result shape mismatch";
+            for (std::size_t i {2}; i < tensor<>::k_max_dims; ++i)
+                if (x.dims()[i] != r.dims()[i] || y.dims()[i] != r.dims()[i]) [[unlikely]]
+                    return "matmul batch dimension mismatch";
+            return nullptr;
+        }
+        if (n.op == opcode::layernorm || n.op == opcode::rmsnorm) { // Y = [d0, 2] = gamma, beta for layernorm, [d0] = gamma for rmsnorm
+            const tensor<>& y {*n.y};
+            if (!r.is_shape_eq(&x)) [[unlikely]]
+                return "result shape mismatch";
+            if (x.strides()[0] != dtype_traits<dtypes::f32>::k_size || r.strides()[0] != dtype_traits<dtypes::f32>::k_size || !y.is_dense()) [[unlikely]]
+                return "operands must be dense in dim 0 and parameters dense";
+            if (y.dims()[0] != x.dims()[0] || y.elem_count() != x.dims()[0]*(n.op == opcode::layernorm ? 2 : 1)) [[unlikely]]
+                return "normalization parameters must be [d0, 2] (layernorm) or [d0] (rmsnorm)";
+            return nullptr;
+        }
+        if (n.op == opcode::conv1d || n.op == opcode::conv2d) // Y = weights
+            return blas::validate_conv(n.op == opcode::conv2d ? 2 : 1, r, x, *n.y, blas::conv_params_from(n.params));
+        if (is_reduction(n.op)) { // R = X with size 1 in the reduced dim
+            if (blas::reduction_axis(r, x) < 0) [[unlikely]]
+                return "reduction result must match x except for size 1 in the reduced dim";
+            if (x.strides()[0] != dtype_traits<dtypes::f32>::k_size || r.strides()[0] != dtype_traits<dtypes::f32>::k_size) [[unlikely]]
+                return "operands must be dense in dim 0";
+            return nullptr;
+        }
+        if (!r.is_shape_eq(&x)) [[unlikely]]
+            return "result shape mismatch";
+        if (x.strides()[0] != dtype_traits<dtypes::f32>::k_size || r.strides()[0] != dtype_traits<dtypes::f32>::k_size) [[unlikely]]
+            return "operands must be dense in dim 0";
+        if (!unary && !n.y->can_repeat(&x)) [[unlikely]]
+            return "y can not be broadcasted to x";
+        return nullptr;
+    }
+
+    auto executor::push(const node& n) -> const char* {
+        if (is_runtime_locked() && m_nodes.size() == m_nodes.capacity()) [[unlikely]]
+            return "runtime is locked, pushing the node would allocate";
+        if (const char* const error {validate(n)}; error) [[unlikely]] {
+            rtml_log_error("Invalid graph node: {}", error);
+            return error;
+        }
+        m_nodes.emplace_back(n);
+        return nullptr;
+    }
+
+    auto run(thread_pool& pool, const node& n) -> void {
+        if (blas::is_small_op(n.op, *n.r, *n.x, n.y)) {
+            blas::eval(blas::compute_ctx{}, n.op, *n.r, *n.x, n.y, n.params);
+            return;
+        }
+        pool.parallel_for([&n](const blas::compute_ctx& ctx) {
+            blas::eval(ctx, n.op, *n.r, *n.x, n.y, n.params);
+        });
+    }
+
+    auto executor::run(thread_pool& pool) const -> void {
+        for (const node& n : m_nodes)
+            graph::run(pool, n);
+    }
+}
@@ -0,0 +1,56 @@
+// Copyright Mario "Neo" Sieg 2024. All rights reserved. mario.sieg.64@gmail.com
+// CPU backend only!
+// Linear graph executor: a validated, topologically ordered list of ops which runs on a thread pool
+// Every op is dispatched to all threads of the pool (small ops run inline on the calling thread) and completes before the next op starts
+
+#pragma once
+
+#include <span>
+#include <vector>
+
+#include "base.hpp"
+#include "blas.hpp"
+#include "tensor_base.hpp"
+
+namespace rtml {
+    class thread_pool;
+}
+
+namespace rtml::graph {
+    enum class opcode : std::uint32_t;
+
+    // Single op of a graph: r = op(x, y)
+    struct node final {
+        opcode op {};
+        tensor<dtypes::f32>* r {};
+        const tensor<dtypes::f32>* x {};
+        const tensor<dtypes::f32>* y {}; // nullptr for unary ops
+        blas::op_params params {};       // Op specific parameters, all zero for ops without parameters
+    };
+
+    // Checks opcode, operand count and operand shapes and layouts against the requirements of the op kernel
+    // Returns an error message or nullptr if the node is valid
+    [[nodiscard]] extern auto validate(const node& n) noexcept -> const char*;
+
+    // Runs a single node on the pool, small ops (blas::is_small_op) run inline on the calling thread without a dispatch
+    extern auto run(thread_pool& pool, const node& n) -> void;
+
+    class executor final {
+    public:
+        executor() = default;
+        executor(const executor&) = delete;
+        executor(executor&&) = default;
+        auto operator=(const executor&) -> executor& = delete;
+        auto operator=(executor&&) -> executor& = default;
+        ~executor() = default;
+
+        [[nodiscard]] auto push(const node& n) -> const char*; // Validates and appends a node, returns an error message or nullptr
+        auto clear() noexcept -> void { m_nodes.clear(); }
+        auto reserve(const std::size_t n) -> void { m_nodes.reserve(n); } // Lets push succeed in locked mode
+        auto run(thread_pool& pool) const -> void; // Runs all nodes in order
+        [[nodiscard]] auto nodes() const noexcept -> std::span<const node> { return m_nodes; }
+
+    private:
+        std::vector<node> m_nodes {};
+    };
+}
@@ -0,0 +1,144 @@
+// Copyright Mario "Neo" Sieg 2024. All rights reserved. mario.sieg.64@gmail.com
+// CPU backend only!
+// Packed SGEMM (Goto/BLIS style): C = A @ B with row major operands
+
+#include "gemm.hpp"
+
+#include <new>
+
+namespace rtml::blas {
+    static constexpr std::align_val_t k_gemm_align {64};
+
+    auto gemm_thread_workspace(const bool with_b) noexcept -> const gemm_workspace* {
+        struct owner final {
+            gemm_workspace ws {.a=nullptr, .b=nullptr, .mc=k_gemm_mc, .nc=k_gemm_nc};
+            owner() = default;
+            owner(const owner&) = delete;
+            owner(owner&&) = delete;
+            auto operator=(const owner&) -> owner& = delete;
+            auto operator=(owner&&) -> owner& = delete;
+            ~owner() {
+                ::operator delete(ws.a, k_gemm_align);
+                ::operator delete(ws.b, k_gemm_align);
+            }
+        };
+        static thread_local owner t_owner {};
+        gemm_workspace& ws {t_owner.ws};
+        if (!ws.a) [[unlikely]]
+            ws.a = static_cast<float*>(::operator new(k_gemm_mc*k_gemm_kc*sizeof(float), k_gemm_align, std::nothrow));
+        if (with_b && !ws.b) [[unlikely]]
+            ws.b = static_cast<float*>(::operator new(k_gemm_kc*k_gemm_nc*sizeof(float), k_gemm_align, std::nothrow));
+        return ws.a && (ws.b || !with_b) ? &ws : nullptr;
+    }
+
+    auto sgemm_pack_a(float* dst, const float* const a, const dim lda, const dim mc, const dim kc) noexcept -> void {
+        for (dim ir {}; ir < mc; ir += k_gemm_mr) {
+            const dim mr {std::min(k_gemm_mr, mc - ir)};
+            for (dim p {}; p < kc; ++p) {
+                dim i {};
+                for (; i < mr; ++i) dst[i] = a[(ir + i)*lda + p];
+                for (; i < k_gemm_mr; ++i) dst[i] = 0.0f;
+                dst += k_gemm_mr;
+            }
+        }
+    }
+
+    auto sgemm_pack_b(float* dst, const float* const b, const dim ldb, const dim kc, const dim nc) noexcept -> void {
+        for (dim jr {}; jr < nc; jr += k_gemm_nr) {
+            const dim nr {std::min(k_gemm_nr, nc - jr)};
+            for (dim p {}; p < kc; ++p) {
+                const float* const src {b + p*ldb + jr};
+                if (nr == k_gemm_nr) [[likely]] {
+                    for (dim j {}; j < k_gemm_nr; ++j) dst[j] = src[j];
+                } else {
+                    dim j {};
+                    for (; j < nr; ++j) dst[j] = src[j];
+                    for (; j < k_gemm_nr; ++j) dst[j] = 0.0f;
+                }
+                dst += k_gemm_nr;
+            }
+        }
+    }
+
+    // MR x NR tile of C from one packed A panel and one packed B panel
+    // The fixed trip count loops are fully unrolled and the accumulators stay in vector registers
+    static auto RTML_HOT sgemm_micro_kernel(
+        const dim kc,
+        const float* __restrict__ pa,
+        const float* __restrict__ pb,
+        float* const c,
+        const dim ldc,
+        const dim mr,
+        const dim nr,
+        const bool accumulate
+    ) noexcept -> void {
+        alignas(64) float acc[k_gemm_mr][k_gemm_nr] {};
+        for (dim p {}; p < kc; ++p) {
+            #pragma GCC unroll 6
+            for (dim i {}; i < k_gemm_mr; ++i) {
+                const float a {pa[i]};
+                #pragma GCC unroll 32
+                for (dim j {}; j < k_gemm_nr; ++j)
+                    acc[i][j] += a*pb[j];
+            }
+            pa += k_gemm_mr;
+            pb += k_gemm_nr;
+        }
+        for (dim i {}; i < mr; ++i) {
+            float* const ci {c + i*ldc};
+            if (accumulate) for (dim j {}; j < nr; ++j) ci[j] += acc[i][j];
+            else for (dim j {}; j < nr; ++j) ci[j] = acc[i][j];
+        }
+    }
+
+    auto sgemm_macro_kernel(
+        const dim kc,
+        const dim mc,
+        const dim nc,
+        const float* const pa,
+        const float* const pb,
+        float* const c,
+        const dim ldc,
+        const bool accumulate
+    ) noexcept -> void {
+        for (dim jr {}; jr < nc; jr += k_gemm_nr) { // The B panel stays in L1 while all A panels of the block stream from L2
+            const float* const pb_panel {pb + jr*kc};
+            const dim nr {std::min(k_gemm_nr, nc - jr)};
+            for (dim ir {}; ir < mc; ir += k_gemm_mr) {
+                const dim mr {std::min(k_gemm_mr, mc - ir)};
+                sgemm_micro_kernel(kc, pa + ir*kc, pb_panel, c + ir*ldc + jr, ldc, mr, nr, accumulate);
+            }
+        }
+    }
+
+    auto gemm_partition(const compute_ctx& ctx, const dim m, const dim n) noexcept -> gemm_range {
+        const dim tc {ctx.num_threads};
+        const dim tidx {ctx.domain.rank};
+        const dim m_tiles {(m + k_gemm_mr - 1) / k_gemm_mr};
+        const dim n_tiles {(n + k_gemm_nr - 1) / k_gemm_nr};
+        if (m_tiles >= tc || m_tiles >= n_tiles) { // Split rows, B is packed per cache domain
+            const dim tpt {(m_tiles + tc - 1) / tc};
+            return {.i0=std::min(tpt*tidx*k_gemm_mr, m), .i1=std::min(tpt*(tidx+1)*k_gemm_mr, m), .j0=0, .j1=n, .split_rows=true};
+        }
+        const dim tpt {(n_tiles + tc - 1) / tc}; // Split columns, few rows of A are packed by every thread
+        return {.i0=0, .i1=m, .j0=std::min(tpt*tidx*k_gemm_nr, n), .j1=std::min(tpt*(tidx+1)*k_gemm_nr, n), .split_rows=false};
+    }
+
+    auto sgemm(
+        const compute_ctx& ctx,
+        const dim m,
+        const dim n,
+        const dim k,
+        const float* const a,
+        const dim lda,
+        const float* const b,
+        const dim ldb,
+        float* const c,
+        const dim ldc,
+        const bool accumulate
+    ) noexcept -> void {
+        sgemm_packed(ctx, m, n, k, [=](float* const dst, const dim i0, const dim mc, const dim p0, const dim kc) noexcept {
+            sgemm_pack_a(dst, a + i0*lda + p0, lda, mc, kc);
+        }, b, ldb, c, ldc, accumulate);
+    }
+}
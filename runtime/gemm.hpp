@@ -0,0 +1,180 @@
+// Copyright Mario "Neo" Sieg 2024. All rights reserved. mario.sieg.64@gmail.com
+// CPU backend only!
+// Packed SGEMM (Goto/BLIS style): C = A @ B with row major operands
+// B is packed into K x NR column panels and A into MR x K row panels per cache block, a register blocked micro kernel
+// computes MR x NR tiles of C from the packed panels with unit stride loads only
+// A is packed by a callable, so operands which are not materialized as a matrix (e.g. im2col of a convolution) can be
+// gathered directly into the packed panels (implicit GEMM)
+
+#pragma once
+
+#include <algorithm>
+
+#include "base.hpp"
+#include "blas.hpp"
+
+namespace rtml::blas {
+    // Micro tile and cache block sizes in elements
+    // MR x NR accumulators fill 12 vector registers with AVX-512 (6 rows x 2 vectors), a KC x NR panel of B stays in L1,
+    // an MC x KC block of A in L2 and a KC x NC block of B in L3
+#ifdef __AVX512F__
+    static constexpr dim k_gemm_nr {32};
+#else
+    static constexpr dim k_gemm_nr {16};
+#endif
+    static constexpr dim k_gemm_mr {6};
+    static constexpr dim k_gemm_kc {256};
+    static constexpr dim k_gemm_mc {k_gemm_mr*20};
+    static constexpr dim k_gemm_nc {k_gemm_nr*32};
+    static constexpr std::size_t k_gemm_domain_scratch {k_gemm_kc*k_gemm_nc}; // Shared KC x NC block of B per cache domain
+
+    // Per thread packing buffers, allocated once per thread on first use
+    // The B buffer is only allocated once a thread packs B privately, threads of pinned pools use the shared domain scratch
+    struct gemm_workspace final {
+        float* a;   // mc x KC
+        float* b;   // KC x nc, nullptr until requested
+        dim mc;     // Row block of A
+        dim nc;     // Column block of B
+    };
+    [[nodiscard]] extern auto gemm_thread_workspace(bool with_b) noexcept -> const gemm_workspace*; // nullptr if the allocation failed, retried on next use
+
+    // Packs rows [0, mc) x cols [0, kc) of a row major matrix into MR row panels: dst[panel][p][MR], rows past mc are zero
+    extern auto sgemm_pack_a(float* dst, const float* a, dim lda, dim mc, dim kc) noexcept -> void;
+
+    // Packs rows [0, kc) x cols [0, nc) of a row major matrix into NR column panels: dst[panel][p][NR], cols past nc are zero
+    extern auto sgemm_pack_b(float* dst, const float* b, dim ldb, dim kc, dim nc) noexcept -> void;
+
+    // C[mc, nc] (+)= packed A block @ packed B block
+    extern auto sgemm_macro_kernel(dim kc, dim mc, dim nc, const float* pa, const float* pb, float* c, dim ldc, bool accumulate) noexcept -> void;
+
+    // Row/column range of C computed by one thread: rows are split in multiples of MR, or columns in multiples of NR if there are too few rows
+    // Threads are ordered by their domain rank, so the threads of one cache domain compute adjacent rows
+    struct gemm_range final {
+        dim i0, i1;
+        dim j0, j1;
+        bool split_rows;
+    };
+    [[nodiscard]] extern auto gemm_partition(const compute_ctx& ctx, dim m, dim n) noexcept -> gemm_range;
+
+    namespace detail {
+        // Blocked loop of sgemm_packed over the C range [i0, i1) x [j0, j1) with the block sizes of the workspace
+        template <typename F>
+        RTML_AINLINE inline auto sgemm_blocks(
+            const compute_ctx& ctx,
+            const gemm_range& range,
+            float* const shared_b,
+            const gemm_workspace& ws,
+            const dim k,
+            F& pack_a,
+            const float* const b,
+            const dim ldb,
+            float* const c,
+            const dim ldc,
+            const bool accumulate
+        ) noexcept -> void {
+            const auto [i0, i1, j0, j1, split_rows] {range};
+            const cache_domain& dom {ctx.domain};
+            const dim nc_block {shared_b ? k_gemm_nc : ws.nc}; // All threads of a domain must step through the same blocks of B
+            for (dim jc {j0}; jc < j1; jc += nc_block) {
+                const dim nc {std::min(nc_block, j1 - jc)};
+                for (dim pc {}; pc < k; pc += k_gemm_kc) {
+                    const dim kc {std::min(k_gemm_kc, k - pc)};
+                    const float* pb {ws.b};
+                    if (shared_b) {
+                        const dim panels {(nc + k_gemm_nr - 1) / k_gemm_nr};
+                        const dim per_thread {(panels + dom.num_threads - 1) / dom.num_threads};
+                        const dim p0 {std::min(per_thread*dom.thread_idx, panels)};
+                        const dim p1 {std::min(per_thread*(dom.thread_idx+1), panels)};
+                        if (p0 < p1)
+                            sgemm_pack_b(shared_b + p0*kc*k_gemm_nr, b + pc*ldb + jc + p0*k_gemm_nr, ldb, kc, std::min(p1*k_gemm_nr, nc) - p0*k_gemm_nr);
+                        ctx.shared->domain_sync(dom.idx, dom.num_threads); // Block of B complete
+                        pb = shared_b;
+                    } else {
+                        sgemm_pack_b(ws.b, b + pc*ldb + jc, ldb, kc, nc);
+                    }
+                    for (dim ic {i0}; ic < i1; ic += ws.mc) {
+                        const dim mc {std::min(ws.mc, i1 - ic)};
+                        pack_a(ws.a, ic, mc, pc, kc);
+                        sgemm_macro_kernel(kc, mc, nc, ws.a, pb, c + ic*ldc + jc, ldc, accumulate || pc);
+                    }
+                    if (shared_b)
+                        ctx.shared->domain_sync(dom.idx, dom.num_threads); // All threads are done with the block before it is repacked
+                }
+            }
+        }
+
+        // Out of memory fallback: one MR x KC block of A and one KC x NR panel of B on the stack, slower but allocation free
+        template <typename F>
+        RTML_COLD RTML_NOINLINE auto sgemm_blocks_stack(
+            const compute_ctx& ctx,
+            const gemm_range& range,
+            float* const shared_b,
+            const dim k,
+            F& pack_a,
+            const float* const b,
+            const dim ldb,
+            float* const c,
+            const dim ldc,
+            const bool accumulate
+        ) noexcept -> void {
+            alignas(64) float a_block[k_gemm_mr*k_gemm_kc];
+            alignas(64) float b_panel[k_gemm_kc*k_gemm_nr];
+            const gemm_workspace ws {.a=a_block, .b=b_panel, .mc=k_gemm_mr, .nc=k_gemm_nr};
+            sgemm_blocks(ctx, range, shared_b, ws, k, pack_a, b, ldb, c, ldc, accumulate);
+        }
+    }
+
+    /*
+     * C[m, n] = A[m, k] @ B[k, n] (+ C if accumulate), B and C are row major with leading dims ldb and ldc (in elements)
+     * pack_a(float* dst, dim i0, dim mc, dim p0, dim kc) packs rows [i0, i0+mc) and cols [p0, p0+kc) of A like sgemm_pack_a
+     * Every thread computes a disjoint part of C with a private A buffer
+     * When rows are split in a pinned pool (the domain scratch exists), the threads of a cache domain pack each KC x NC block
+     * of B together into the shared domain scratch (every thread packs a slice of the NR panels) and synchronize before and
+     * after using it, otherwise B is packed per thread
+     * All threads of a dispatch must call this with the same m, n and k, in pinned pools they deadlock otherwise
+     */
+    template <typename F>
+    auto RTML_HOT sgemm_packed(
+        const compute_ctx& ctx,
+        const dim m,
+        const dim n,
+        const dim k,
+        F&& pack_a,
+        const float* const b,
+        const dim ldb,
+        float* const c,
+        const dim ldc,
+        const bool accumulate
+    ) noexcept -> void {
+        const gemm_range range {gemm_partition(ctx, m, n)};
+        const auto [i0, i1, j0, j1, split_rows] {range};
+        const cache_domain& dom {ctx.domain};
+        float* const shared_b {split_rows && ctx.shared && dom.num_threads > 1 ? ctx.shared->domain_scratch(dom.idx) : nullptr};
+        if (!shared_b && (i0 >= i1 || j0 >= j1)) return; // Threads without rows still pack their share of B
+        if (!k) [[unlikely]] {
+            if (!accumulate)
+                for (dim i {i0}; i < i1; ++i)
+                    std::fill(c + i*ldc + j0, c + i*ldc + j1, 0.0f);
+            return;
+        }
+        if (const gemm_workspace* const ws {gemm_thread_workspace(!shared_b)}; ws) [[likely]]
+            detail::sgemm_blocks(ctx, range, shared_b, *ws, k, pack_a, b, ldb, c, ldc, accumulate);
+        else
+            detail::sgemm_blocks_stack(ctx, range, shared_b, k, pack_a, b, ldb, c, ldc, accumulate);
+    }
+
+    // C[m, n] = A[m, k] @ B[k, n] (+ C if accumulate) with row major A, B and C
+    extern auto sgemm(
+        const compute_ctx& ctx,
+        dim m,
+        dim n,
+        dim k,
+        const float* a,
+        dim lda,
+        const float* b,
+        dim ldb,
+        float* c,
+        dim ldc,
+        bool accumulate = false
+    ) noexcept -> void;
+}
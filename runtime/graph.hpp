@@ -2,9 +2,11 @@
 
 #pragma once
 
+#include <array>
 #include <functional>
 #include <span>
 
+#include "base.hpp"
 #include "tensor_base.hpp"
 
 namespace rtml::graph {
@@ -23,7 +25,19 @@ namespace rtml::graph {
         _(sub , 2, "-")__\
         _(mul , 2, "*")__\
         _(div , 2, "/")__\
-        _(matmul, 2, "matmul")__
+        _(matmul, 2, "matmul")__\
+        /* Reductions, the reduced dim is inferred from the result shape */\
+        _(sum, 1, "sum")__\
+        _(mean, 1, "mean")__\
+        _(max, 1, "max")__\
+        _(min, 1, "min")__\
+        _(argmax, 1, "argmax")__\
+        /* Normalization, y holds the affine parameters */\
+        _(layernorm, 2, "layernorm")__\
+        _(rmsnorm, 2, "rmsnorm")__\
+        /* Convolutions, y holds the weights, stride, padding, dilation and groups are op params */\
+        _(conv1d, 2, "conv1d")__\
+        _(conv2d, 2, "conv2d")__
 
     #define _(mnemonic, operands, name) mnemonic
     enum class opcode : std::uint32_t {
@@ -44,6 +58,10 @@ namespace rtml::graph {
     };
     #undef _
 
+    [[nodiscard]] constexpr auto is_reduction(const opcode op) noexcept -> bool {
+        return op >= opcode::sum && op <= opcode::argmax;
+    }
+
     template <typename S> requires is_dtype<S>
     using validate_function = auto (const tensor<S>* dst, std::span<const tensor<S>*> src) -> bool;
     template <typename S> requires is_dtype<S>
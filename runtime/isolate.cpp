@@ -106,4 +106,9 @@ namespace rtml {
             static_cast<double>(pool_mem)/std::pow(1024.0, 3.0)
         );
     }
+
+    isolate::~isolate() {
+        for (auto it {m_finalizers.rbegin()}; it != m_finalizers.rend(); ++it)
+            (*it)();
+    }
 }
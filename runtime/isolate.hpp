@@ -4,6 +4,9 @@
 
 #pragma once
 
+#include <functional>
+#include <vector>
+
 #include "base.hpp"
 #include "tensor_base.hpp"
 
@@ -94,11 +97,22 @@ namespace rtml {
             return m_pool.alloc<tensor<T>>(*this, dims, slice, slice_offset);
         }
 
+        // Creates a tensor which views external memory without copying, e.g. a NumPy array
+        // Data must be aligned to the dtype and outlive all uses of the tensor, strides are in bytes, positive and a multiple of the dtype size
+        template <typename T> requires is_dtype<T>
+        [[nodiscard]] auto new_external_tensor(
+            std::span<const dim> dims,
+            void* data,
+            std::span<const dim> strides
+        ) -> tensor<T>* {
+            return m_pool.alloc<tensor<T>>(*this, dims, static_cast<std::uint8_t*>(data), strides);
+        }
+
         isolate(const isolate&) = delete;
         isolate(isolate&&) = delete;
         auto operator=(const isolate&) -> isolate& = delete;
         auto operator=(isolate&&) -> isolate& = delete;
-        virtual ~isolate() = default;
+        virtual ~isolate();
 
         [[nodiscard]] static auto init_rtml_runtime() -> bool;
         static auto shutdown_rtml_runtime() -> void;
@@ -108,11 +122,16 @@ namespace rtml {
         [[nodiscard]] auto pool() const noexcept -> const pool& { return m_pool; }
         [[nodiscard]] auto pool() noexcept -> class pool& { return m_pool; }
 
+        // Registers a function which is called when the isolate is destroyed, before the pool is freed
+        // Used to release external memory viewed by tensors of this isolate, finalizers run in reverse order of registration
+        auto on_destroy(std::function<void()>&& finalizer) -> void { m_finalizers.emplace_back(std::move(finalizer)); }
+
     private:
         static inline constinit std::atomic_bool s_runtime_initialized;
         const std::string m_name;
         const compute_device m_device;
         class pool m_pool;
+        std::vector<std::function<void()>> m_finalizers {};
 
     protected:
         isolate(std::string&& name, compute_device device, std::size_t pool_mem);
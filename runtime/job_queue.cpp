@@ -0,0 +1,100 @@
+// Copyright Mario "Neo" Sieg 2024. All rights reserved. mario.sieg.64@gmail.com
+// Asynchronous job execution: a single worker thread runs submitted jobs in submission order
+// Completion can be polled, waited for or observed through an eventfd (Linux), which integrates with event loops like asyncio
+
+#include "job_queue.hpp"
+
+#ifdef __linux__
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
+
+namespace rtml {
+    completion::~completion() {
+#ifdef __linux__
+        if (m_fd >= 0) close(m_fd);
+#endif
+    }
+
+    auto completion::wait() const noexcept -> void {
+        m_done.wait(false, std::memory_order_acquire);
+    }
+
+    auto completion::wait_for(const std::chrono::microseconds timeout) const -> bool {
+        const auto deadline {std::chrono::steady_clock::now() + timeout};
+        for (std::uint32_t i {}; !is_done(); ++i) { // std::atomic::wait has no timeout, so back off to short sleeps
+            if (std::chrono::steady_clock::now() >= deadline) return false;
+            if (i < 64) std::this_thread::yield();
+            else std::this_thread::sleep_for(std::chrono::microseconds{50});
+        }
+        return true;
+    }
+
+    auto completion::event_fd() -> int {
+#ifdef __linux__
+        const std::lock_guard lock {m_fd_mtx};
+        if (m_fd < 0) [[unlikely]] {
+            m_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+            if (m_fd >= 0 && is_done()) // Completed before the fd was requested
+                (void)eventfd_write(m_fd, 1);
+        }
+        return m_fd;
+#else
+        return -1;
+#endif
+    }
+
+    auto completion::signal() -> void {
+        m_done.store(true, std::memory_order_release);
+        m_done.notify_all();
+#ifdef __linux__
+        const std::lock_guard lock {m_fd_mtx};
+        if (m_fd >= 0)
+            (void)eventfd_write(m_fd, 1);
+#endif
+    }
+
+    job_queue::job_queue() : m_worker{&job_queue::worker_entry, this} {}
+
+    job_queue::~job_queue() {
+        {
+            const std::lock_guard lock {m_mtx};
+            m_stop = true;
+        }
+        m_cv.notify_one();
+        m_worker.join();
+    }
+
+    auto job_queue::submit(std::function<void()>&& job) -> std::shared_ptr<completion> {
+        auto done {std::make_shared<completion>()};
+        m_pending.fetch_add(1, std::memory_order_relaxed);
+        {
+            const std::lock_guard lock {m_mtx};
+            m_queue.emplace_back(entry{std::move(job), done});
+        }
+        m_cv.notify_one();
+        return done;
+    }
+
+    auto job_queue::drain() -> void {
+        for (std::size_t n {pending()}; n; n = pending())
+            m_pending.wait(n, std::memory_order_acquire);
+    }
+
+    auto job_queue::worker_entry() -> void {
+        for (;;) {
+            entry e {};
+            {
+                std::unique_lock lock {m_mtx};
+                m_cv.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+                if (m_queue.empty()) return; // Stop requested and all jobs completed
+                e = std::move(m_queue.front());
+                m_queue.pop_front();
+            }
+            e.job();
+            e.done->signal();
+            m_pending.fetch_sub(1, std::memory_order_acq_rel);
+            m_pending.notify_all();
+        }
+    }
+}
@@ -0,0 +1,69 @@
+// Copyright Mario "Neo" Sieg 2024. All rights reserved. mario.sieg.64@gmail.com
+// Asynchronous job execution: a single worker thread runs submitted jobs in submission order
+// Completion can be polled, waited for or observed through an eventfd (Linux), which integrates with event loops like asyncio
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "base.hpp"
+
+namespace rtml {
+    // Completion state of a single job, shared between the submitter and the worker
+    class completion final {
+    public:
+        completion() = default;
+        completion(const completion&) = delete;
+        completion(completion&&) = delete;
+        auto operator=(const completion&) -> completion& = delete;
+        auto operator=(completion&&) -> completion& = delete;
+        ~completion();
+
+        [[nodiscard]] auto is_done() const noexcept -> bool { return m_done.load(std::memory_order_acquire); }
+        auto wait() const noexcept -> void;
+        [[nodiscard]] auto wait_for(std::chrono::microseconds timeout) const -> bool; // Returns true if the job completed within the timeout
+        [[nodiscard]] auto event_fd() -> int; // Lazily created eventfd, readable once the job completed, -1 if unsupported
+        auto signal() -> void; // Called by the worker when the job completed
+
+    private:
+        std::atomic_bool m_done {};
+        std::mutex m_fd_mtx {};
+        int m_fd {-1};
+    };
+
+    class job_queue final {
+    public:
+        job_queue();
+        job_queue(const job_queue&) = delete;
+        job_queue(job_queue&&) = delete;
+        auto operator=(const job_queue&) -> job_queue& = delete;
+        auto operator=(job_queue&&) -> job_queue& = delete;
+        ~job_queue(); // Completes all pending jobs
+
+        [[nodiscard]] auto submit(std::function<void()>&& job) -> std::shared_ptr<completion>;
+        auto drain() -> void; // Blocks until all submitted jobs completed
+        [[nodiscard]] auto pending() const noexcept -> std::size_t { return m_pending.load(std::memory_order_acquire); }
+
+    private:
+        struct entry final {
+            std::function<void()> job {};
+            std::shared_ptr<completion> done {};
+        };
+
+        auto worker_entry() -> void;
+
+        std::mutex m_mtx {};
+        std::condition_variable m_cv {};
+        std::deque<entry> m_queue {};
+        std::atomic_size_t m_pending {}; // Submitted but not yet completed jobs
+        bool m_stop {};
+        std::thread m_worker;
+    };
+}
@@ -0,0 +1,199 @@
+// Copyright Mario "Neo" Sieg 2024. All rights reserved. mario.sieg.64@gmail.com
+// CPU backend only!
+// Paged key/value cache for autoregressive decoding
+// Keys and values live in fixed size pages which are carved out of the isolate pool once, sequences map token positions
+// to pages through a block table, so sequences grow without copying and freed pages are reused without fragmentation
+// Pages are reference counted: forked sequences share their prefix pages and copy a shared page only when appending to it
+
+#include "kv_cache.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+
+#include "blas_vec.hpp"
+#include "isolate.hpp"
+#include "tensor.hpp"
+
+namespace rtml {
+    kv_cache::kv_cache(isolate& ctx, const config& cfg)
+        : m_cfg{cfg}, m_page_elems{2*cfg.num_heads*cfg.page_size*cfg.head_dim} {
+        rtml_assert(cfg.num_heads > 0 && cfg.head_dim > 0 && cfg.page_size > 0 && cfg.num_pages > 0, "Invalid KV cache config");
+        m_data = static_cast<float*>(ctx.pool().alloc_raw(cfg.num_pages*m_page_elems*sizeof(float), 64)); // Page sizes are a multiple of the cache line for common head dims
+        m_refs.resize(cfg.num_pages);
+        m_free.reserve(cfg.num_pages);
+        for (dim i {cfg.num_pages-1}; i >= 0; --i) // Page 0 on top of the stack
+            m_free.emplace_back(static_cast<page_id>(i));
+    }
+
+    auto kv_cache::create_sequence() -> seq_id {
+        seq_id seq;
+        if (!m_free_seqs.empty()) {
+            seq = m_free_seqs.back();
+            m_free_seqs.pop_back();
+        } else {
+            seq = static_cast<seq_id>(m_seqs.size());
+            m_seqs.emplace_back();
+        }
+        m_seqs[seq].alive = true;
+        return seq;
+    }
+
+    auto kv_cache::fork(const seq_id parent) -> seq_id {
+        rtml_assert(m_seqs[parent].alive, "Sequence {} is not alive", parent);
+        const seq_id seq {create_sequence()};
+        sequence& s {m_seqs[seq]};
+        const sequence& p {m_seqs[parent]}; // Reference after create_sequence, which may grow m_seqs
+        s.pages = p.pages;
+        s.length = p.length;
+        for (const page_id page : s.pages)
+            ++m_refs[page];
+        return seq;
+    }
+
+    auto kv_cache::free_sequence(const seq_id seq) -> void {
+        sequence& s {m_seqs[seq]};
+        rtml_assert(s.alive, "Sequence {} is not alive", seq);
+        for (const page_id page : s.pages)
+            release(page);
+        s.pages.clear(); // Keeps the capacity of the block table for the next sequence in this slot
+        s.length = 0;
+        s.alive = false;
+        m_free_seqs.emplace_back(seq);
+    }
+
+    auto kv_cache::append(const seq_id seq, const std::span<const float> k, const std::span<const float> v) -> bool {
+        sequence& s {m_seqs[seq]};
+        rtml_assert(s.alive, "Sequence {} is not alive", seq);
+        const auto [num_heads, head_dim, page_size, _] {m_cfg};
+        rtml_assert(k.size() == static_cast<std::size_t>(num_heads*head_dim) && v.size() == k.size(), "Key/value size mismatch");
+        const dim slot {s.length % page_size};
+        if (slot == 0) { // Last page is full (or no page yet)
+            if (m_free.empty()) [[unlikely]] return false;
+            s.pages.emplace_back(m_free.back());
+            m_free.pop_back();
+            m_refs[s.pages.back()] = 1;
+        } else if (m_refs[s.pages.back()] > 1) { // Partially filled page shared with a fork, copy on write
+            if (m_free.empty()) [[unlikely]] return false;
+            const page_id copy {m_free.back()};
+            m_free.pop_back();
+            m_refs[copy] = 1;
+            std::memcpy(page_ptr(copy), page_ptr(s.pages.back()), m_page_elems*sizeof(float));
+            --m_refs[s.pages.back()];
+            s.pages.back() = copy;
+        }
+        const page_id page {s.pages.back()};
+        for (dim h {}; h < num_heads; ++h) {
+            std::memcpy(const_cast<float*>(page_keys(page, h)) + slot*head_dim, k.data() + h*head_dim, head_dim*sizeof(float));
+            std::memcpy(const_cast<float*>(page_values(page, h)) + slot*head_dim, v.data() + h*head_dim, head_dim*sizeof(float));
+        }
+        ++s.length;
+        return true;
+    }
+
+    auto kv_cache::key(const seq_id seq, const dim pos, const dim head) const noexcept -> const float* {
+        const sequence& s {m_seqs[seq]};
+        assert(pos < s.length);
+        return page_keys(s.pages[pos / m_cfg.page_size], head) + pos % m_cfg.page_size * m_cfg.head_dim;
+    }
+
+    auto kv_cache::value(const seq_id seq, const dim pos, const dim head) const noexcept -> const float* {
+        const sequence& s {m_seqs[seq]};
+        assert(pos < s.length);
+        return page_values(s.pages[pos / m_cfg.page_size], head) + pos % m_cfg.page_size * m_cfg.head_dim;
+    }
+
+    auto kv_cache::release(const page_id page) -> void {
+        assert(m_refs[page] > 0);
+        if (--m_refs[page] == 0)
+            m_free.emplace_back(page);
+    }
+
+    // Online softmax attention of one query head over one sequence, scores are computed in blocks of at most k_block tokens
+    // so the running maximum and the accumulator are rescaled once per block instead of once per token
+    static auto RTML_HOT attend(
+        const kv_cache& cache,
+        const std::span<const kv_cache::page_id> pages,
+        const dim len,
+        const dim kv_head,
+        const float* const q,
+        float* const o,
+        const float scale
+    ) noexcept -> void {
+        static constexpr dim k_block {64};
+        const dim head_dim {cache.cfg().head_dim};
+        const dim page_size {cache.cfg().page_size};
+        std::array<float, k_block> scores {};
+        float max {blas::vec::k_online_softmax_max<float>};
+        float sum {};
+        std::fill_n(o, head_dim, 0.0f);
+        for (dim pos {}; pos < len;) {
+            const kv_cache::page_id page {pages[pos / page_size]};
+            const dim slot {pos % page_size};
+            const dim n {std::min({k_block, page_size - slot, len - pos})};
+            const float* const keys {cache.page_keys(page, kv_head) + slot*head_dim};
+            const float* const values {cache.page_values(page, kv_head) + slot*head_dim};
+            float block_max {max};
+            for (dim i {}; i < n; ++i) {
+                blas::vec::hdot(static_cast<std::size_t>(head_dim), &scores[i], q, keys + i*head_dim);
+                scores[i] *= scale;
+                block_max = std::max(block_max, scores[i]);
+            }
+            const float correction {std::exp(max - block_max)};
+            sum *= correction;
+            for (dim j {}; j < head_dim; ++j)
+                o[j] *= correction;
+            for (dim i {}; i < n; ++i) {
+                const float p {std::exp(scores[i] - block_max)};
+                sum += p;
+                const float* const v {values + i*head_dim};
+                for (dim j {}; j < head_dim; ++j)
+                    o[j] += p*v[j];
+            }
+            max = block_max;
+            pos += n;
+        }
+        if (sum > 0.0f) {
+            const float inv {1.0f / sum};
+            for (dim j {}; j < head_dim; ++j)
+                o[j] *= inv;
+        }
+    }
+
+    auto paged_attention(
+        const blas::compute_ctx& ctx,
+        const kv_cache& cache,
+        const std::span<const kv_cache::seq_id> seqs,
+        const tensor<dtypes::f32>& q,
+        tensor<dtypes::f32>& r,
+        const float scale
+    ) noexcept -> void {
+        const auto [head_dim, num_q_heads, batch, _] {q.dims()};
+        const dim num_kv_heads {cache.cfg().num_heads};
+        rtml_assert(head_dim == cache.cfg().head_dim, "Query head dim {} != cache head dim {}", head_dim, cache.cfg().head_dim);
+        rtml_assert(num_q_heads % num_kv_heads == 0, "Query heads {} must be a multiple of key/value heads {}", num_q_heads, num_kv_heads);
+        rtml_assert(batch == static_cast<dim>(seqs.size()), "Batch {} != number of sequences {}", batch, seqs.size());
+        rtml_assert(q.is_shape_eq(&r), "Query and result shape mismatch");
+        rtml_assert(q.strides()[0] == sizeof(float) && r.strides()[0] == sizeof(float), "Query and result rows must be dense");
+        const dim group {num_q_heads / num_kv_heads};
+        const dim total {batch*num_q_heads};
+        const dim per_thread {(total + ctx.num_threads - 1) / ctx.num_threads};
+        const dim start {per_thread*ctx.thread_idx};
+        const dim end {std::min(start + per_thread, total)};
+        for (dim i {start}; i < end; ++i) {
+            const dim b {i / num_q_heads};
+            const dim h {i % num_q_heads};
+            const kv_cache::seq_id seq {seqs[b]};
+            attend(
+                cache,
+                cache.block_table(seq),
+                cache.length(seq),
+                h / group,
+                reinterpret_cast<const float*>(q.ptr() + b*q.strides()[2] + h*q.strides()[1]),
+                reinterpret_cast<float*>(r.ptr() + b*r.strides()[2] + h*r.strides()[1]),
+                scale
+            );
+        }
+    }
+}
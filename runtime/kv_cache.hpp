@@ -0,0 +1,94 @@
+// Copyright Mario "Neo" Sieg 2024. All rights reserved. mario.sieg.64@gmail.com
+// CPU backend only!
+// Paged key/value cache for autoregressive decoding
+// Keys and values live in fixed size pages which are carved out of the isolate pool once, sequences map token positions
+// to pages through a block table, so sequences grow without copying and freed pages are reused without fragmentation
+// Pages are reference counted: forked sequences share their prefix pages and copy a shared page only when appending to it
+
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "base.hpp"
+#include "blas.hpp"
+#include "tensor_base.hpp"
+
+namespace rtml {
+    class isolate;
+
+    class kv_cache final {
+    public:
+        using seq_id = std::uint32_t;
+        using page_id = std::uint32_t;
+        static constexpr seq_id k_invalid_seq {~0u};
+
+        struct config final {
+            dim num_heads {};   // Key/value heads
+            dim head_dim {};    // Elements per head
+            dim page_size {16}; // Tokens per page
+            dim num_pages {};   // Capacity of the cache
+        };
+
+        kv_cache(isolate& ctx, const config& cfg); // Allocates all pages from the isolate pool
+        kv_cache(const kv_cache&) = delete;
+        kv_cache(kv_cache&&) = delete;
+        auto operator=(const kv_cache&) -> kv_cache& = delete;
+        auto operator=(kv_cache&&) -> kv_cache& = delete;
+        ~kv_cache() = default;
+
+        [[nodiscard]] auto create_sequence() -> seq_id;
+        [[nodiscard]] auto fork(seq_id parent) -> seq_id; // New sequence which shares all pages of parent
+        auto free_sequence(seq_id seq) -> void;           // Returns pages which are no longer referenced to the free list
+
+        // Appends the key and value of one token, k and v hold num_heads * head_dim elements (head major)
+        // Returns false if the cache is out of pages, the sequence is unchanged in that case
+        [[nodiscard]] auto append(seq_id seq, std::span<const float> k, std::span<const float> v) -> bool;
+
+        [[nodiscard]] auto length(const seq_id seq) const noexcept -> dim { return m_seqs[seq].length; }
+        [[nodiscard]] auto block_table(const seq_id seq) const noexcept -> std::span<const page_id> { return m_seqs[seq].pages; }
+        [[nodiscard]] auto key(seq_id seq, dim pos, dim head) const noexcept -> const float*;
+        [[nodiscard]] auto value(seq_id seq, dim pos, dim head) const noexcept -> const float*;
+        [[nodiscard]] auto page_keys(const page_id page, const dim head) const noexcept -> const float* { // [page_size, head_dim]
+            return m_data + page*m_page_elems + head*m_cfg.page_size*m_cfg.head_dim;
+        }
+        [[nodiscard]] auto page_values(const page_id page, const dim head) const noexcept -> const float* { // [page_size, head_dim]
+            return page_keys(page, head) + m_cfg.num_heads*m_cfg.page_size*m_cfg.head_dim;
+        }
+        [[nodiscard]] auto cfg() const noexcept -> const config& { return m_cfg; }
+        [[nodiscard]] auto free_pages() const noexcept -> std::size_t { return m_free.size(); }
+        [[nodiscard]] auto ref_count(const page_id page) const noexcept -> std::uint32_t { return m_refs[page]; }
+
+    private:
+        struct sequence final {
+            std::vector<page_id> pages {}; // Block table: token pos / page_size -> page
+            dim length {};                 // Number of tokens
+            bool alive {};
+        };
+
+        [[nodiscard]] auto page_ptr(const page_id page) const noexcept -> float* { return m_data + page*m_page_elems; }
+        auto release(page_id page) -> void;
+
+        const config m_cfg;
+        const dim m_page_elems; // Keys and values of all heads
+        float* m_data {};
+        std::vector<std::uint32_t> m_refs {}; // Page -> number of sequences which reference it
+        std::vector<page_id> m_free {};       // Free pages, used as stack so recently freed (cache warm) pages are reused first
+        std::vector<sequence> m_seqs {};
+        std::vector<seq_id> m_free_seqs {};
+    };
+
+    // Single token (decode) attention which reads keys and values directly from the paged layout
+    // q = [head_dim, num_q_heads, batch], r = q shape, batch entry b attends to all tokens of seqs[b]
+    // num_q_heads must be a multiple of the key/value heads (grouped query attention), (batch, head) pairs are split across threads
+    // Softmax is computed online page by page, so no score buffer proportional to the sequence length is needed
+    extern auto paged_attention(
+        const blas::compute_ctx& ctx,
+        const kv_cache& cache,
+        std::span<const kv_cache::seq_id> seqs,
+        const tensor<dtypes::f32>& q,
+        tensor<dtypes::f32>& r,
+        float scale
+    ) noexcept -> void;
+}
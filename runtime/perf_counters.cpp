@@ -0,0 +1,98 @@
+// Copyright Mario "Neo" Sieg 2024. All rights reserved. mario.sieg.64@gmail.com
+// Hardware performance counters (cycles, instructions, cache misses, dTLB misses, branch misses)
+// Read directly through perf_event_open (Linux only), on other platforms or if the kernel denies access no counters are available
+
+#include "perf_counters.hpp"
+
+#ifdef __linux__
+#   include <linux/perf_event.h>
+#   include <sys/syscall.h>
+#   include <unistd.h>
+#endif
+
+namespace rtml::perf {
+#ifdef __linux__
+    namespace {
+        struct event_config final {
+            std::uint32_t type;
+            std::uint64_t config;
+        };
+
+        constexpr std::array<event_config, k_num_counters> k_configs {{
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+            {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB | PERF_COUNT_HW_CACHE_OP_READ<<8 | PERF_COUNT_HW_CACHE_RESULT_MISS<<16},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES}
+        }};
+
+        [[nodiscard]] auto open_counter(const event_config& cfg, const bool inherit, const int group_fd) noexcept -> int {
+            perf_event_attr attr {};
+            attr.size = sizeof(attr);
+            attr.type = cfg.type;
+            attr.config = cfg.config;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.inherit = inherit;
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            if (!inherit) attr.read_format |= PERF_FORMAT_GROUP; // Members of a group are read through the leader
+            return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0)); // Calling thread, any CPU
+        }
+
+        [[nodiscard]] auto scale(const std::uint64_t value, const std::uint64_t enabled, const std::uint64_t running) noexcept -> std::uint64_t {
+            if (!running || running >= enabled) return value; // Not multiplexed
+            return static_cast<std::uint64_t>(static_cast<double>(value) * static_cast<double>(enabled) / static_cast<double>(running));
+        }
+    }
+
+    counter_group::counter_group(const bool inherit) {
+        m_fds.fill(-1);
+        for (std::size_t i {}; i < k_num_counters; ++i) {
+            const int fd {open_counter(k_configs[i], inherit, inherit ? -1 : m_leader)};
+            if (fd < 0) continue; // Not supported by the PMU (e.g. in VMs) or not permitted
+            m_fds[i] = fd;
+            m_mask |= 1u<<i;
+            if (!inherit && m_leader < 0) m_leader = fd;
+        }
+        rtml_log_info("Opened perf counters, mask: {:#x}", m_mask);
+    }
+
+    counter_group::~counter_group() {
+        for (const int fd : m_fds)
+            if (fd >= 0) close(fd);
+    }
+
+    auto counter_group::read() const noexcept -> counter_values {
+        counter_values values {};
+        if (m_leader >= 0) { // Grouped: nr, time enabled, time running, values in open order
+            std::array<std::uint64_t, 3+k_num_counters> buf {};
+            if (::read(m_leader, buf.data(), sizeof(buf)) <= 0) [[unlikely]] return values;
+            for (std::size_t i {}, j {}; i < k_num_counters && j < buf[0]; ++i)
+                if (m_fds[i] >= 0) values[i] = scale(buf[3+j++], buf[1], buf[2]);
+        } else { // Individually: value, time enabled, time running
+            for (std::size_t i {}; i < k_num_counters; ++i) {
+                if (m_fds[i] < 0) continue;
+                std::array<std::uint64_t, 3> buf {};
+                if (::read(m_fds[i], buf.data(), sizeof(buf)) != sizeof(buf)) [[unlikely]] continue;
+                values[i] = scale(buf[0], buf[1], buf[2]);
+            }
+        }
+        return values;
+    }
+#else
+    counter_group::counter_group(const bool) {
+        m_fds.fill(-1);
+    }
+
+    counter_group::~counter_group() = default;
+
+    auto counter_group::read() const noexcept -> counter_values {
+        return {};
+    }
+#endif
+
+    auto thread_counters() -> const counter_group& {
+        static thread_local const counter_group t_counters {};
+        return t_counters;
+    }
+}
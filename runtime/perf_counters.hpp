@@ -0,0 +1,58 @@
+// Copyright Mario "Neo" Sieg 2024. All rights reserved. mario.sieg.64@gmail.com
+// Hardware performance counters (cycles, instructions, cache misses, dTLB misses, branch misses)
+// Read directly through perf_event_open (Linux only), on other platforms or if the kernel denies access no counters are available
+// Counters only count user space events, so they also work with the default perf_event_paranoid level
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "base.hpp"
+
+namespace rtml::perf {
+    enum class counter : std::uint32_t {
+        cycles,
+        instructions,
+        cache_misses,   // Last level cache misses
+        dtlb_misses,    // Data TLB load misses
+        branch_misses,
+        $count
+    };
+    static constexpr std::size_t k_num_counters {static_cast<std::size_t>(counter::$count)};
+    static constexpr std::array<const char*, k_num_counters> k_counter_names {
+        "cycles",
+        "instructions",
+        "cache_misses",
+        "dtlb_misses",
+        "branch_misses"
+    };
+
+    using counter_values = std::array<std::uint64_t, k_num_counters>;
+
+    // Set of counters of the calling thread
+    // Non inheriting counters are opened as one group and read with a single syscall,
+    // inheriting counters are opened individually because the kernel does not support grouped reads of inherited counters
+    class counter_group final {
+    public:
+        explicit counter_group(bool inherit = false); // Inherit: also count threads which are spawned by the calling thread after construction
+        counter_group(const counter_group&) = delete;
+        counter_group(counter_group&&) = delete;
+        auto operator=(const counter_group&) -> counter_group& = delete;
+        auto operator=(counter_group&&) -> counter_group& = delete;
+        ~counter_group();
+
+        [[nodiscard]] auto is_valid() const noexcept -> bool { return m_mask != 0; } // At least one counter is available
+        [[nodiscard]] auto is_available(const counter c) const noexcept -> bool { return m_mask & 1u<<static_cast<std::uint32_t>(c); }
+        [[nodiscard]] auto mask() const noexcept -> std::uint32_t { return m_mask; } // Bit i is set if counter i is available
+        [[nodiscard]] auto read() const noexcept -> counter_values; // Current counts scaled for multiplexing, unavailable counters read as 0
+
+    private:
+        std::array<int, k_num_counters> m_fds {};
+        std::uint32_t m_mask {};
+        int m_leader {-1}; // Group leader fd, -1 if counters are read individually
+    };
+
+    // Lazily opened (non inheriting) counters of the calling thread, closed when the thread exits
+    [[nodiscard]] extern auto thread_counters() -> const counter_group&;
+}
@@ -0,0 +1,358 @@
+// Copyright Mario "Neo" Sieg 2024. All rights reserved. mario.sieg.64@gmail.com
+// Opt-in hot-path profiler for the CPU backend
+// Every thread records kernel invocations into its own lock-free SPSC ring buffer (the thread is the only producer)
+// The recorded events are drained on demand and exported as Chrome trace JSON (chrome://tracing, Perfetto) or as summary table
+
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+
+#include "graph.hpp"
+#include "tensor.hpp"
+
+namespace rtml::profiler {
+    namespace {
+        using clock = std::chrono::steady_clock;
+
+        const clock::time_point k_epoch {clock::now()}; // All timestamps are relative to library load
+
+        // Owns all thread ring buffers - a ring is handed back to the free list when its thread exits and reused by the
+        // next new thread, so short lived threads don't leak one ring each
+        struct registry final {
+            std::mutex mtx {};
+            std::vector<std::unique_ptr<ring_buffer>> rings {};
+            std::vector<ring_buffer*> free {}; // Capacity is kept >= rings.size(), so releasing never allocates
+            std::vector<event> events {};
+        };
+
+        [[nodiscard]] auto get_registry() -> registry& {
+            static registry s_registry {};
+            return s_registry;
+        }
+
+        [[nodiscard]] auto now_ns() noexcept -> std::uint64_t {
+            return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - k_epoch).count());
+        }
+
+        // Called from the noexcept hot path, so allocation or locking failures return nullptr and the event is dropped
+        [[nodiscard]] auto RTML_COLD acquire_ring() noexcept -> ring_buffer* {
+            registry& reg {get_registry()};
+            try {
+                const std::lock_guard lock {reg.mtx};
+                if (!reg.free.empty()) {
+                    ring_buffer* const ring {reg.free.back()};
+                    reg.free.pop_back();
+                    return ring;
+                }
+                reg.rings.reserve(reg.rings.size()+1);
+                reg.free.reserve(reg.rings.size()+1);
+                reg.rings.emplace_back(std::make_unique<ring_buffer>(static_cast<std::uint32_t>(reg.rings.size())));
+                return reg.rings.back().get();
+            } catch (...) {
+                return nullptr;
+            }
+        }
+
+        auto RTML_COLD release_ring(ring_buffer* const ring) noexcept -> void {
+            registry& reg {get_registry()};
+            try {
+                const std::lock_guard lock {reg.mtx};
+                reg.free.emplace_back(ring); // Recorded events stay in the ring until the next collect
+            } catch (...) {} // The ring is not reused, it is still owned (and drained) by the registry
+        }
+
+        // Thread owned handle to the ring of this thread, returns the ring to the registry on thread exit
+        struct thread_ring final {
+            ring_buffer* ring {};
+
+            thread_ring() = default;
+            thread_ring(const thread_ring&) = delete;
+            thread_ring(thread_ring&&) = delete;
+            auto operator=(const thread_ring&) -> thread_ring& = delete;
+            auto operator=(thread_ring&&) -> thread_ring& = delete;
+            ~thread_ring() {
+                if (ring) release_ring(ring);
+            }
+        };
+
+        thread_local thread_ring t_ring {};
+
+        auto drain_locked(registry& reg) -> void {
+            for (auto& ring : reg.rings)
+                ring->drain([&reg](const event& e) { reg.events.emplace_back(e); });
+        }
+
+        auto append_json_escaped(std::string& out, const char* str) -> void {
+            for (; *str; ++str) {
+                const char c {*str};
+                if (c == '"' || c == '\\') {
+                    out.push_back('\\');
+                    out.push_back(c);
+                } else if (static_cast<unsigned char>(c) < 0x20) {
+                    fmt::format_to(std::back_inserter(out), "\\u{:04x}", static_cast<unsigned>(c));
+                } else {
+                    out.push_back(c);
+                }
+            }
+        }
+    }
+
+    ring_buffer::ring_buffer(const std::uint32_t tid) : m_tid{tid}, m_events{std::make_unique<event[]>(k_capacity)} {}
+
+    auto enable(const bool with_counters) -> void {
+        detail::s_counters.store(with_counters, std::memory_order_seq_cst);
+        detail::s_enabled.store(true, std::memory_order_seq_cst);
+    }
+
+    auto disable() -> void {
+        detail::s_enabled.store(false, std::memory_order_seq_cst);
+        detail::s_counters.store(false, std::memory_order_seq_cst);
+    }
+
+    auto reset() -> void {
+        registry& reg {get_registry()};
+        const std::lock_guard lock {reg.mtx};
+        drain_locked(reg);
+        reg.events.clear();
+    }
+
+    auto collect() -> std::vector<event> {
+        registry& reg {get_registry()};
+        const std::lock_guard lock {reg.mtx};
+        drain_locked(reg);
+        return reg.events; // Copy under the lock, other threads may collect or reset concurrently
+    }
+
+    auto dropped_events() -> std::size_t {
+        registry& reg {get_registry()};
+        const std::lock_guard lock {reg.mtx};
+        std::size_t total {};
+        for (const auto& ring : reg.rings)
+            total += ring->dropped();
+        return total;
+    }
+
+    auto chrome_trace() -> std::string {
+        const std::vector<event> events {collect()};
+        std::string out {};
+        out.reserve(0x100 + events.size()*0x100);
+        out += "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+        for (std::size_t i {}; i < events.size(); ++i) {
+            const event& e {events[i]};
+            fmt::format_to(
+                std::back_inserter(out),
+                "{}{{\"name\":\"{}\",\"cat\":\"rtml\",\"ph\":\"X\",\"pid\":1,\"tid\":{},\"ts\":{:.3f},\"dur\":{:.3f},\"args\":{{\"tensor\":\"",
+                i ? ",\n" : "\n",
+                graph::k_names[static_cast<std::size_t>(e.op)],
+                e.tid,
+                static_cast<double>(e.start_ns) / 1e3,
+                static_cast<double>(e.end_ns - e.start_ns) / 1e3
+            );
+            append_json_escaped(out, e.name.data());
+            out += "\",\"shapes\":[";
+            for (std::uint32_t j {}; j < e.num_tensors; ++j) {
+                const auto& s {e.shapes[j]};
+                fmt::format_to(std::back_inserter(out), "{}[{},{},{},{}]", j ? "," : "", s[0], s[1], s[2], s[3]);
+            }
+            fmt::format_to(
+                std::back_inserter(out),
+                "],\"thread_idx\":{},\"flops\":{},\"bytes\":{}",
+                e.thread_idx,
+                e.flops,
+                e.bytes
+            );
+            for (std::size_t j {}; j < perf::k_num_counters; ++j)
+                if (e.counter_mask & 1u<<j)
+                    fmt::format_to(std::back_inserter(out), ",\"{}\":{}", perf::k_counter_names[j], e.counters[j]);
+            out += "}}";
+        }
+        out += "\n]}\n";
+        return out;
+    }
+
+    auto write_chrome_trace(const char* const path) -> bool {
+        std::ofstream file {path, std::ios::out | std::ios::trunc};
+        if (!file.is_open()) [[unlikely]] {
+            rtml_log_error("Failed to open trace file '{}'", path);
+            return false;
+        }
+        file << chrome_trace();
+        return file.good();
+    }
+
+    auto summary_table() -> std::string {
+        struct op_stats final {
+            std::uint64_t calls {};
+            std::uint64_t total_ns {};
+            std::uint64_t min_ns {std::numeric_limits<std::uint64_t>::max()};
+            std::uint64_t max_ns {};
+            std::uint64_t flops {};
+            std::uint64_t bytes {};
+            std::uint32_t counter_mask {};
+            perf::counter_values counters {};
+        };
+        std::array<op_stats, static_cast<std::size_t>(graph::opcode::$count)> stats {};
+        std::uint64_t total_ns {};
+        for (const event& e : collect()) {
+            op_stats& s {stats[static_cast<std::size_t>(e.op)]};
+            const std::uint64_t ns {e.end_ns - e.start_ns};
+            ++s.calls;
+            s.total_ns += ns;
+            s.min_ns = std::min(s.min_ns, ns);
+            s.max_ns = std::max(s.max_ns, ns);
+            s.flops += e.flops;
+            s.bytes += e.bytes;
+            s.counter_mask |= e.counter_mask;
+            for (std::size_t i {}; i < perf::k_num_counters; ++i)
+                s.counters[i] += e.counters[i];
+            total_ns += ns;
+        }
+        std::array<std::size_t, static_cast<std::size_t>(graph::opcode::$count)> order {};
+        for (std::size_t i {}; i < order.size(); ++i) order[i] = i;
+        std::ranges::sort(order, [&stats](const std::size_t a, const std::size_t b) { return stats[a].total_ns > stats[b].total_ns; });
+        std::string out {};
+        fmt::format_to(
+            std::back_inserter(out),
+            "{:<10} {:>10} {:>12} {:>10} {:>10} {:>10} {:>10} {:>10} {:>7}\n",
+            "Op", "Calls", "Total [ms]", "Avg [us]", "Min [us]", "Max [us]", "GFLOP/s", "GB/s", "Time %"
+        );
+        for (const std::size_t i : order) {
+            const op_stats& s {stats[i]};
+            if (!s.calls) continue;
+            const auto secs {static_cast<double>(s.total_ns) / 1e9};
+            fmt::format_to(
+                std::back_inserter(out),
+                "{:<10} {:>10} {:>12.3f} {:>10.3f} {:>10.3f} {:>10.3f} {:>10.2f} {:>10.2f} {:>7.2f}\n",
+                graph::k_names[i],
+                s.calls,
+                static_cast<double>(s.total_ns) / 1e6,
+                static_cast<double>(s.total_ns) / 1e3 / static_cast<double>(s.calls),
+                static_cast<double>(s.min_ns) / 1e3,
+                static_cast<double>(s.max_ns) / 1e3,
+                secs > 0.0 ? static_cast<double>(s.flops) / secs / 1e9 : 0.0,
+                secs > 0.0 ? static_cast<double>(s.bytes) / secs / 1e9 : 0.0,
+                total_ns ? 100.0 * static_cast<double>(s.total_ns) / static_cast<double>(total_ns) : 0.0
+            );
+        }
+        if (std::ranges::any_of(stats, [](const op_stats& s) { return s.counter_mask != 0; })) { // Hardware counters: IPC and misses per 1000 instructions
+            const auto ratio {[](const op_stats& s, const perf::counter num, const perf::counter den, const double scale) -> double {
+                const auto n {static_cast<std::size_t>(num)};
+                const auto d {static_cast<std::size_t>(den)};
+                if (!(s.counter_mask & 1u<<n) || !(s.counter_mask & 1u<<d) || !s.counters[d]) return 0.0;
+                return scale * static_cast<double>(s.counters[n]) / static_cast<double>(s.counters[d]);
+            }};
+            fmt::format_to(
+                std::back_inserter(out),
+                "\n{:<10} {:>14} {:>14} {:>7} {:>11} {:>11} {:>12}\n",
+                "Op", "Cycles", "Instructions", "IPC", "Cache MPKI", "dTLB MPKI", "Branch MPKI"
+            );
+            for (const std::size_t i : order) {
+                const op_stats& s {stats[i]};
+                if (!s.calls) continue;
+                fmt::format_to(
+                    std::back_inserter(out),
+                    "{:<10} {:>14} {:>14} {:>7.2f} {:>11.3f} {:>11.3f} {:>12.3f}\n",
+                    graph::k_names[i],
+                    s.counters[static_cast<std::size_t>(perf::counter::cycles)],
+                    s.counters[static_cast<std::size_t>(perf::counter::instructions)],
+                    ratio(s, perf::counter::instructions, perf::counter::cycles, 1.0),
+                    ratio(s, perf::counter::cache_misses, perf::counter::instructions, 1e3),
+                    ratio(s, perf::counter::dtlb_misses, perf::counter::instructions, 1e3),
+                    ratio(s, perf::counter::branch_misses, perf::counter::instructions, 1e3)
+                );
+            }
+        }
+        if (const std::size_t dropped {dropped_events()}; dropped) {
+            fmt::format_to(std::back_inserter(out), "{} events dropped (ring buffer full)\n", dropped);
+        }
+        return out;
+    }
+
+    auto op_flops(
+        const graph::opcode op,
+        const tensor<dtypes::f32>& r,
+        const tensor<dtypes::f32>& x,
+        [[maybe_unused]] const tensor<dtypes::f32>* const y
+    ) noexcept -> std::uint64_t {
+        const auto n {static_cast<std::uint64_t>(r.elem_count())};
+        switch (op) {
+            case graph::opcode::matmul: return 2*n*static_cast<std::uint64_t>(x.dims()[0]); // 1 mul + 1 add per K
+            case graph::opcode::softmax: return 3*n; // exp + sum + div
+            case graph::opcode::sigmoid: return 4*n; // neg + exp + add + div
+            case graph::opcode::gelu: return 8*n;
+            case graph::opcode::silu: return 4*n;
+            case graph::opcode::layernorm: return 7*n; // Sum, sum of squares and the affine normalization
+            case graph::opcode::rmsnorm: return 5*n;
+            case graph::opcode::conv1d:
+            case graph::opcode::conv2d: return 2*n*static_cast<std::uint64_t>(y->dims()[1]*y->dims()[2]*y->dims()[3]); // 1 mul + 1 add per tap and input channel of the group
+            case graph::opcode::sum:
+            case graph::opcode::mean:
+            case graph::opcode::max:
+            case graph::opcode::min:
+            case graph::opcode::argmax: return static_cast<std::uint64_t>(x.elem_count()); // One op per reduced element
+            default: return n; // Elementwise ops: one op per element
+        }
+    }
+
+    auto op_bytes(
+        [[maybe_unused]] const graph::opcode op,
+        const tensor<dtypes::f32>& r,
+        const tensor<dtypes::f32>& x,
+        const tensor<dtypes::f32>* const y
+    ) noexcept -> std::uint64_t {
+        return r.size() + x.size() + (y ? y->size() : 0);
+    }
+
+    auto scope::begin(
+        const graph::opcode op,
+        const dim thread_idx,
+        const tensor<dtypes::f32>& r,
+        const tensor<dtypes::f32>& x,
+        const tensor<dtypes::f32>* const y
+    ) noexcept -> void {
+        if (!t_ring.ring) [[unlikely]] {
+            if (is_runtime_locked()) return; // Acquiring the ring allocates, the event is dropped
+            t_ring.ring = acquire_ring();
+            if (!t_ring.ring) [[unlikely]] return; // Out of memory, the event is dropped
+        }
+        m_r = &r;
+        m_x = &x;
+        m_y = y;
+        m_op = op;
+        m_thread_idx = static_cast<std::uint32_t>(thread_idx);
+        m_start_ns = now_ns();
+        if (detail::s_counters.load(std::memory_order_relaxed)) [[unlikely]] { // Read last, so the counters include as little profiler code as possible
+            m_has_counters = true;
+            m_counters = perf::thread_counters().read();
+        }
+    }
+
+    auto scope::end() noexcept -> void {
+        event e {};
+        if (m_has_counters) [[unlikely]] { // Not if counters were enabled while the scope was open
+            const perf::counter_group& counters {perf::thread_counters()};
+            const perf::counter_values end {counters.read()};
+            for (std::size_t i {}; i < perf::k_num_counters; ++i)
+                e.counters[i] = end[i] - m_counters[i];
+            e.counter_mask = counters.mask();
+        }
+        e.end_ns = now_ns();
+        e.start_ns = m_start_ns;
+        e.op = m_op;
+        e.thread_idx = m_thread_idx;
+        e.tid = t_ring.ring->tid();
+        e.flops = op_flops(m_op, *m_r, *m_x, m_y);
+        e.bytes = op_bytes(m_op, *m_r, *m_x, m_y);
+        e.shapes[e.num_tensors++] = m_r->dims();
+        e.shapes[e.num_tensors++] = m_x->dims();
+        if (m_y) e.shapes[e.num_tensors++] = m_y->dims();
+        const std::size_t name_len {::strnlen(m_r->name(), event::k_max_name-1)};
+        std::memcpy(e.name.data(), m_r->name(), name_len);
+        e.name[name_len] = '\0';
+        t_ring.ring->push(e);
+    }
+}
@@ -0,0 +1,161 @@
+// Copyright Mario "Neo" Sieg 2024. All rights reserved. mario.sieg.64@gmail.com
+// Opt-in hot-path profiler for the CPU backend
+// Every thread records kernel invocations into its own lock-free SPSC ring buffer (the thread is the only producer)
+// The recorded events are drained on demand and exported as Chrome trace JSON (chrome://tracing, Perfetto) or as summary table
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "base.hpp"
+#include "perf_counters.hpp"
+#include "tensor_base.hpp"
+
+#define RTML_PROFILER_ENABLE true // Compile-time switch, if false all profiler scopes compile out completely
+
+#if RTML_PROFILER_ENABLE
+#    define rtml_profile_op(op, thread_idx, ...) const ::rtml::profiler::scope rtml_profile_scope__ {(op), (thread_idx), __VA_ARGS__}
+#else
+#    define rtml_profile_op(op, thread_idx, ...)
+#endif
+
+namespace rtml::graph {
+    enum class opcode : std::uint32_t;
+}
+
+namespace rtml::profiler {
+    // A single recorded kernel invocation
+    struct event final {
+        static constexpr std::size_t k_max_name {32};
+        static constexpr std::size_t k_max_tensors {3}; // r, x, y
+
+        std::uint64_t start_ns {};  // Start timestamp in nanoseconds since profiler epoch
+        std::uint64_t end_ns {};    // End timestamp in nanoseconds since profiler epoch
+        std::uint64_t flops {};     // Floating point operations performed by this invocation
+        std::uint64_t bytes {};     // Bytes moved (read + written) by this invocation
+        std::array<std::array<dim, 4>, k_max_tensors> shapes {}; // Shapes of r, x, y
+        graph::opcode op {};        // Operation code
+        std::uint32_t thread_idx {}; // compute_ctx thread index
+        std::uint32_t tid {};       // Profiler ring id (one per live recording OS thread, reused after a thread exits)
+        std::uint32_t num_tensors {}; // Number of valid entries in shapes
+        std::array<char, k_max_name> name {}; // Truncated name of the result tensor
+        std::uint32_t counter_mask {}; // Bit i is set if counters[i] is valid, zero if hardware counters are not recorded
+        perf::counter_values counters {}; // Hardware counter deltas of this invocation
+    };
+
+    // Lock-free bounded single producer single consumer ring buffer of events
+    // The owning thread is the only producer, the collector is the only consumer
+    // If the buffer is full, new events are dropped (and counted) instead of blocking the hot path
+    class ring_buffer final {
+    public:
+        static constexpr std::size_t k_capacity {1<<13}; // Must be a power of two
+
+        explicit ring_buffer(std::uint32_t tid);
+        ring_buffer(const ring_buffer&) = delete;
+        ring_buffer(ring_buffer&&) = delete;
+        auto operator=(const ring_buffer&) -> ring_buffer& = delete;
+        auto operator=(ring_buffer&&) -> ring_buffer& = delete;
+        ~ring_buffer() = default;
+
+        auto push(const event& e) noexcept -> bool {
+            static_assert((k_capacity & (k_capacity-1)) == 0);
+            const std::size_t head {m_head.load(std::memory_order_relaxed)};
+            if (head - m_tail.load(std::memory_order_acquire) >= k_capacity) [[unlikely]] {
+                m_dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            m_events[head & (k_capacity-1)] = e;
+            m_head.store(head+1, std::memory_order_release);
+            return true;
+        }
+        template <typename F>
+        auto drain(F&& callback) -> std::size_t {
+            const std::size_t tail {m_tail.load(std::memory_order_relaxed)};
+            const std::size_t head {m_head.load(std::memory_order_acquire)};
+            for (std::size_t i {tail}; i < head; ++i)
+                callback(m_events[i & (k_capacity-1)]);
+            m_tail.store(head, std::memory_order_release);
+            return head - tail;
+        }
+        [[nodiscard]] auto tid() const noexcept -> std::uint32_t { return m_tid; }
+        [[nodiscard]] auto dropped() const noexcept -> std::size_t { return m_dropped.load(std::memory_order_relaxed); }
+
+    private:
+        alignas(64) std::atomic_size_t m_head {}; // Written by producer only
+        alignas(64) std::atomic_size_t m_tail {}; // Written by consumer only
+        std::atomic_size_t m_dropped {};
+        const std::uint32_t m_tid;
+        std::unique_ptr<event[]> m_events;
+    };
+
+    namespace detail {
+        inline constinit std::atomic_bool s_enabled {false};
+        inline constinit std::atomic_bool s_counters {false};
+    }
+
+    [[nodiscard]] inline auto is_enabled() noexcept -> bool {
+        return detail::s_enabled.load(std::memory_order_relaxed);
+    }
+    extern auto RTML_COLD enable(bool with_counters = false) -> void; // Start recording on all threads, optionally with hardware counters
+    extern auto RTML_COLD disable() -> void; // Stop recording, already recorded events are kept
+    extern auto RTML_COLD reset() -> void;   // Discard all recorded and collected events
+    extern auto RTML_COLD collect() -> std::vector<event>; // Drain all thread ring buffers into the collected event list, returns a copy of it
+    [[nodiscard]] extern auto RTML_COLD dropped_events() -> std::size_t; // Total number of events dropped because a ring was full
+    [[nodiscard]] extern auto RTML_COLD chrome_trace() -> std::string; // Collect and format as Chrome trace JSON
+    extern auto RTML_COLD write_chrome_trace(const char* path) -> bool; // Collect and write Chrome trace JSON to file
+    [[nodiscard]] extern auto RTML_COLD summary_table() -> std::string; // Collect and format per opcode summary table
+
+    // Cost model of a single kernel invocation, also used by the benchmarks for throughput counters
+    [[nodiscard]] extern auto op_flops(graph::opcode op, const tensor<dtypes::f32>& r, const tensor<dtypes::f32>& x, const tensor<dtypes::f32>* y) noexcept -> std::uint64_t;
+    [[nodiscard]] extern auto op_bytes(graph::opcode op, const tensor<dtypes::f32>& r, const tensor<dtypes::f32>& x, const tensor<dtypes::f32>* y) noexcept -> std::uint64_t;
+
+    // RAII scope which records one kernel invocation
+    // When the profiler is disabled the whole scope costs a single predictable branch
+    class scope final {
+    public:
+        RTML_AINLINE scope(
+            const graph::opcode op,
+            const dim thread_idx,
+            const tensor<dtypes::f32>& r,
+            const tensor<dtypes::f32>& x,
+            const tensor<dtypes::f32>& y
+        ) noexcept {
+            if (!is_enabled()) [[likely]] return;
+            begin(op, thread_idx, r, x, &y);
+        }
+        RTML_AINLINE scope(
+            const graph::opcode op,
+            const dim thread_idx,
+            const tensor<dtypes::f32>& r,
+            const tensor<dtypes::f32>& x
+        ) noexcept {
+            if (!is_enabled()) [[likely]] return;
+            begin(op, thread_idx, r, x, nullptr);
+        }
+        scope(const scope&) = delete;
+        scope(scope&&) = delete;
+        auto operator=(const scope&) -> scope& = delete;
+        auto operator=(scope&&) -> scope& = delete;
+        RTML_AINLINE ~scope() {
+            if (m_r) [[unlikely]] end();
+        }
+
+    private:
+        auto RTML_COLD begin(graph::opcode op, dim thread_idx, const tensor<dtypes::f32>& r, const tensor<dtypes::f32>& x, const tensor<dtypes::f32>* y) noexcept -> void;
+        auto RTML_COLD end() noexcept -> void;
+
+        const tensor<dtypes::f32>* m_r {};
+        const tensor<dtypes::f32>* m_x {};
+        const tensor<dtypes::f32>* m_y {};
+        std::uint64_t m_start_ns {};
+        graph::opcode m_op {};
+        std::uint32_t m_thread_idx {};
+        bool m_has_counters {}; // True if begin read m_counters
+        perf::counter_values m_counters; // Not initialized, only valid if m_has_counters - keeps the disabled path cheap
+    };
+}
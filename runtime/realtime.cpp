@@ -0,0 +1,121 @@
+// Copyright Mario "Neo" Sieg 2024. All rights reserved. mario.sieg.64@gmail.com
+// CPU backend only!
+// Deadline aware graph execution for real time use
+// A realtime_executor owns a thread pool which is pinned to cores and runs at SCHED_FIFO priority where permitted,
+// every run is timed against a deadline and misses are counted, all bookkeeping is preallocated so runs do not allocate
+// Executors have an isolate priority: while a run of a higher priority executor is in flight, runs of lower priority
+// executors which are abortable stop at the next op boundary and give the cores to the higher priority run
+
+#include "realtime.hpp"
+
+#include <algorithm>
+#include <array>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+#include "executor.hpp"
+
+namespace rtml {
+    // Claims in flight per isolate priority
+    static constinit std::array<std::atomic_uint32_t, realtime_executor::k_max_priority+1> s_claims {};
+
+    realtime_executor::core_claim::core_claim(const std::uint32_t priority) noexcept : m_priority{std::min(priority, k_max_priority)} {
+        s_claims[m_priority].fetch_add(1, std::memory_order_acq_rel);
+    }
+
+    realtime_executor::core_claim::~core_claim() {
+        s_claims[m_priority].fetch_sub(1, std::memory_order_acq_rel);
+    }
+
+    auto realtime_executor::is_preempted(const std::uint32_t priority) noexcept -> bool {
+        for (std::uint32_t p {priority+1}; p <= k_max_priority; ++p)
+            if (s_claims[p].load(std::memory_order_acquire)) return true;
+        return false;
+    }
+
+    // Scheduling policy, priority, nice value and affinity of the thread which constructs the executor
+    struct realtime_executor::saved_policy final {
+#ifdef __linux__
+        int policy {};
+        sched_param param {};
+        int nice {};
+        cpu_set_t affinity {};
+        bool has_affinity {};
+
+        saved_policy() noexcept {
+            (void)pthread_getschedparam(pthread_self(), &policy, &param);
+            nice = getpriority(PRIO_PROCESS, static_cast<id_t>(gettid()));
+            has_affinity = pthread_getaffinity_np(pthread_self(), sizeof(affinity), &affinity) == 0;
+        }
+
+        auto restore() const noexcept -> void {
+            (void)pthread_setschedparam(pthread_self(), policy, &param);
+            (void)setpriority(PRIO_PROCESS, static_cast<id_t>(gettid()), nice);
+            if (has_affinity) (void)pthread_setaffinity_np(pthread_self(), sizeof(affinity), &affinity);
+        }
+#else
+        auto restore() const noexcept -> void {}
+#endif
+    };
+
+    realtime_executor::realtime_executor(const realtime_config& cfg) : m_cfg{cfg}, m_caller_policy{std::make_unique<saved_policy>()} {
+        rtml_assert(cfg.priority <= k_max_priority && cfg.latency_log > 0, "Invalid realtime executor config");
+        const dim threads {
+            cfg.num_threads > 0 ? cfg.num_threads
+            : !cfg.cores.empty() ? static_cast<dim>(cfg.cores.size())
+            : static_cast<dim>(std::thread::hardware_concurrency())
+        };
+        m_pool = std::make_unique<thread_pool>(threads);
+        m_scheduling = m_pool->set_realtime(cfg.fifo_priority, cfg.cores);
+        m_log.resize(cfg.latency_log);
+        m_sorted.reserve(cfg.latency_log);
+    }
+
+    realtime_executor::~realtime_executor() {
+        m_pool.reset(); // Workers exit first
+        m_caller_policy->restore();
+    }
+
+    auto realtime_executor::run(const graph::executor& graph) -> run_result {
+        using clock = std::chrono::steady_clock;
+        const clock::time_point t0 {clock::now()};
+        const core_claim claim {m_cfg.priority};
+        run_result result {};
+        for (const graph::node& n : graph.nodes()) {
+            if (m_cfg.abortable && is_preempted(m_cfg.priority)) [[unlikely]] {
+                result.aborted = true;
+                break;
+            }
+            graph::run(*m_pool, n);
+            ++result.nodes_run;
+        }
+        result.latency = std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - t0);
+        result.missed = result.latency > m_cfg.deadline;
+        ++m_stats.runs;
+        m_stats.misses += result.missed;
+        m_stats.aborts += result.aborted;
+        m_stats.min_latency = std::min(m_stats.min_latency, result.latency);
+        m_stats.max_latency = std::max(m_stats.max_latency, result.latency);
+        m_stats.total_latency += result.latency;
+        m_log[m_log_next++ % m_log.size()] = result.latency;
+        return result;
+    }
+
+    auto realtime_executor::reset_stats() noexcept -> void {
+        m_stats = {};
+        m_log_next = 0;
+    }
+
+    auto realtime_executor::latency_percentile(const double p) noexcept -> std::chrono::nanoseconds {
+        const std::size_t n {std::min(m_log_next, m_log.size())};
+        if (!n) return {};
+        m_sorted.assign(m_log.cbegin(), m_log.cbegin() + static_cast<std::ptrdiff_t>(n));
+        std::ranges::sort(m_sorted);
+        return m_sorted[static_cast<std::size_t>(std::clamp(p, 0.0, 1.0) * static_cast<double>(n-1) + 0.5)];
+    }
+}
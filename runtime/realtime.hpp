@@ -0,0 +1,102 @@
+// Copyright Mario "Neo" Sieg 2024. All rights reserved. mario.sieg.64@gmail.com
+// CPU backend only!
+// Deadline aware graph execution for real time use
+// A realtime_executor owns a thread pool which is pinned to cores and runs at SCHED_FIFO priority where permitted,
+// every run is timed against a deadline and misses are counted, all bookkeeping is preallocated so runs do not allocate
+// Executors have an isolate priority: while a run of a higher priority executor is in flight, runs of lower priority
+// executors which are abortable stop at the next op boundary and give the cores to the higher priority run
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+
+#include "base.hpp"
+#include "thread_pool.hpp"
+
+namespace rtml::graph {
+    class executor;
+}
+
+namespace rtml {
+    struct realtime_config final {
+        std::chrono::nanoseconds deadline {};   // Latency bound of a single run
+        dim num_threads {0};                    // 0 = one thread per core in cores, or all hardware threads
+        std::vector<int> cores {};              // Thread i is pinned to cores[i % cores.size()], empty = no pinning
+        int fifo_priority {50};                 // SCHED_FIFO priority (1 - 99)
+        std::uint32_t priority {0};             // Isolate priority, 0 - k_max_priority
+        bool abortable {false};                 // Runs stop when a higher priority executor starts a run
+        std::size_t latency_log {4096};         // Latencies of the most recent runs kept for percentiles
+    };
+
+    struct run_result final {
+        std::chrono::nanoseconds latency {};
+        std::size_t nodes_run {};   // Less than the graph size if aborted
+        bool missed {};             // latency > deadline
+        bool aborted {};
+    };
+
+    struct realtime_stats final {
+        std::uint64_t runs {};
+        std::uint64_t misses {};
+        std::uint64_t aborts {};
+        std::chrono::nanoseconds min_latency {std::chrono::nanoseconds::max()};
+        std::chrono::nanoseconds max_latency {};
+        std::chrono::nanoseconds total_latency {};
+    };
+
+    class realtime_executor final {
+    public:
+        static constexpr std::uint32_t k_max_priority {7};
+
+        // Holds the cores for the lifetime of the object: abortable runs of lower priority executors stop at their next op
+        class core_claim final {
+        public:
+            explicit core_claim(std::uint32_t priority) noexcept;
+            core_claim(const core_claim&) = delete;
+            core_claim(core_claim&&) = delete;
+            auto operator=(const core_claim&) -> core_claim& = delete;
+            auto operator=(core_claim&&) -> core_claim& = delete;
+            ~core_claim();
+
+        private:
+            const std::uint32_t m_priority;
+        };
+
+        // Must be constructed on the thread which calls run, that thread is thread 0 of the pool and gets the same policy
+        // The previous scheduling policy and affinity of the calling thread are restored on destruction
+        explicit realtime_executor(const realtime_config& cfg);
+        realtime_executor(const realtime_executor&) = delete;
+        realtime_executor(realtime_executor&&) = delete;
+        auto operator=(const realtime_executor&) -> realtime_executor& = delete;
+        auto operator=(realtime_executor&&) -> realtime_executor& = delete;
+        ~realtime_executor();
+
+        auto run(const graph::executor& graph) -> run_result;
+
+        [[nodiscard]] auto config() const noexcept -> const realtime_config& { return m_cfg; }
+        [[nodiscard]] auto scheduling() const noexcept -> thread_priority { return m_scheduling; }
+        [[nodiscard]] auto pool() noexcept -> thread_pool& { return *m_pool; }
+        [[nodiscard]] auto stats() const noexcept -> const realtime_stats& { return m_stats; }
+        auto reset_stats() noexcept -> void;
+        // Latency of the given percentile (0 - 1) over the logged runs, sorts a preallocated copy of the log
+        [[nodiscard]] auto latency_percentile(double p) noexcept -> std::chrono::nanoseconds;
+        [[nodiscard]] static auto is_preempted(std::uint32_t priority) noexcept -> bool; // A higher priority claim is held
+
+    private:
+        struct saved_policy;
+
+        const realtime_config m_cfg;
+        std::unique_ptr<saved_policy> m_caller_policy;
+        std::unique_ptr<thread_pool> m_pool;
+        thread_priority m_scheduling {thread_priority::normal};
+        realtime_stats m_stats {};
+        std::vector<std::chrono::nanoseconds> m_log {};     // Ring of the latest latencies
+        std::vector<std::chrono::nanoseconds> m_sorted {};  // Scratch of latency_percentile
+        std::size_t m_log_next {};
+    };
+}
@@ -0,0 +1,113 @@
+// Copyright Mario "Neo" Sieg 2024. All rights reserved. mario.sieg.64@gmail.com
+// CPU backend only!
+// Sliding window ring buffer for streaming time series input
+// Frames of `features` elements are appended to a ring, the latest `window` frames are always visible as one dense
+// [features, window] tensor which slices the ring storage, so consumers never copy or allocate per new window
+// The ring pages are mapped twice back to back (Linux memfd), so a window which wraps around the end of the ring is still
+// contiguous in virtual memory - without the double mapping the ring falls back to pool memory and writes every frame twice
+
+#include "ring_tensor.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <numeric>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "isolate.hpp"
+#include "tensor.hpp"
+
+namespace rtml {
+    // Maps size bytes of shared memory twice back to back, returns nullptr if not supported
+    // size must be a multiple of the page size, the memory is zero initialized
+    [[nodiscard]] static auto map_mirrored(const std::size_t size) noexcept -> std::uint8_t* {
+#ifdef __linux__
+        const int fd {memfd_create("rtml_ring_tensor", MFD_CLOEXEC)};
+        if (fd < 0) [[unlikely]] return nullptr;
+        std::uint8_t* base {};
+        if (ftruncate(fd, static_cast<off_t>(size)) == 0) {
+            void* const reserved {mmap(nullptr, 2*size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)}; // Reserve both halves at once
+            if (reserved != MAP_FAILED) {
+                base = static_cast<std::uint8_t*>(reserved);
+                for (std::uint8_t* const half : {base, base+size}) {
+                    if (mmap(half, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) [[unlikely]] {
+                        munmap(reserved, 2*size);
+                        base = nullptr;
+                        break;
+                    }
+                }
+            }
+        }
+        close(fd); // The mappings keep the memory alive
+        return base;
+#else
+        return nullptr;
+#endif
+    }
+
+    ring_tensor::ring_tensor(isolate& ctx, const dim features, const dim window) : m_features{features}, m_window_frames{window} {
+        rtml_assert(features > 0 && window > 0, "Invalid ring tensor config");
+        const auto frame_bytes {static_cast<std::size_t>(features)*sizeof(float)};
+        std::uint8_t* data {};
+#ifdef __linux__
+        const auto page {static_cast<std::size_t>(sysconf(_SC_PAGESIZE))};
+        const std::size_t granule {std::lcm(frame_bytes, page)}; // Ring size must be a whole number of frames and pages
+        const std::size_t size {(static_cast<std::size_t>(window)*frame_bytes + granule-1) / granule * granule};
+        if ((data = map_mirrored(size))) {
+            m_capacity = static_cast<dim>(size / frame_bytes);
+            m_double_mapped = true;
+            ctx.on_destroy([data, size] { munmap(data, 2*size); });
+        }
+#endif
+        if (!data) { // Fallback: plain pool memory, the second half is kept in sync by the writers
+            m_capacity = window;
+            data = static_cast<std::uint8_t*>(ctx.pool().alloc_raw(2*m_capacity*frame_bytes, 64));
+            std::memset(data, 0, 2*m_capacity*frame_bytes);
+        }
+        m_data = reinterpret_cast<float*>(data);
+        const std::array<dim, 2> dims {features, 2*m_capacity};
+        const std::array<dim, 2> strides {static_cast<dim>(sizeof(float)), static_cast<dim>(frame_bytes)};
+        m_ring = ctx.new_external_tensor<dtypes::f32>(dims, data, strides);
+        m_ring->set_name("ring");
+        m_window = ctx.new_tensor<dtypes::f32>({features, window}, m_ring, 0);
+        m_window->set_name("ring (window)");
+        commit(0); // Window ends at slot 0, the first window() frames are the zeros before the stream start
+    }
+
+    auto ring_tensor::push(std::span<const float> frames) noexcept -> void {
+        assert(frames.size() % m_features == 0);
+        auto n {static_cast<dim>(frames.size()) / m_features};
+        if (n > m_capacity) { // Only the newest capacity() frames survive
+            frames = frames.subspan((n - m_capacity)*m_features);
+            m_frames += n - m_capacity;
+            n = m_capacity;
+        }
+        std::ranges::copy(frames, acquire(n).begin());
+        commit(n);
+    }
+
+    auto ring_tensor::acquire(const dim n) const noexcept -> std::span<float> {
+        assert(n >= 0 && n <= m_capacity);
+        return {m_data + m_head*m_features, static_cast<std::size_t>(n*m_features)}; // Slots past the end of the ring are the mirror
+    }
+
+    auto ring_tensor::commit(const dim n) noexcept -> void {
+        assert(n >= 0 && n <= m_capacity);
+        if (!m_double_mapped && n) { // Copy the written slots to their twin in the other half
+            const dim end {m_head + n};
+            const auto copy {[this](const dim src, const dim dst, const dim count) noexcept {
+                if (count > 0) std::memcpy(m_data + dst*m_features, m_data + src*m_features, count*m_features*sizeof(float));
+            }};
+            copy(m_head, m_head + m_capacity, std::min(end, m_capacity) - m_head); // First half -> mirror
+            copy(m_capacity, 0, end - m_capacity);                                  // Mirror -> first half
+        }
+        m_head = (m_head + n) % m_capacity;
+        m_frames += n;
+        const dim start {m_head >= m_window_frames ? m_head - m_window_frames : m_head - m_window_frames + m_capacity};
+        m_window->reslice(static_cast<std::size_t>(start*m_features)*sizeof(float));
+    }
+}
@@ -0,0 +1,57 @@
+// Copyright Mario "Neo" Sieg 2024. All rights reserved. mario.sieg.64@gmail.com
+// CPU backend only!
+// Sliding window ring buffer for streaming time series input
+// Frames of `features` elements are appended to a ring, the latest `window` frames are always visible as one dense
+// [features, window] tensor which slices the ring storage, so consumers never copy or allocate per new window
+// The ring pages are mapped twice back to back (Linux memfd), so a window which wraps around the end of the ring is still
+// contiguous in virtual memory - without the double mapping the ring falls back to pool memory and writes every frame twice
+
+#pragma once
+
+#include <span>
+
+#include "base.hpp"
+#include "tensor_base.hpp"
+
+namespace rtml {
+    class isolate;
+
+    class ring_tensor final {
+    public:
+        // The ring memory is owned by the isolate and released when it is destroyed, like all tensors of the isolate
+        ring_tensor(isolate& ctx, dim features, dim window);
+        ring_tensor(const ring_tensor&) = delete;
+        ring_tensor(ring_tensor&&) = delete;
+        auto operator=(const ring_tensor&) -> ring_tensor& = delete;
+        auto operator=(ring_tensor&&) -> ring_tensor& = delete;
+        ~ring_tensor() = default;
+
+        // Appends frames (a multiple of features elements), overwriting the oldest frames
+        auto push(std::span<const float> frames) noexcept -> void;
+
+        // In place producer API: returns contiguous storage for the next n <= capacity() frames, commit publishes them
+        // The n oldest frames are overwritten, so the window must not be read concurrently if n > capacity() - window()
+        [[nodiscard]] auto acquire(dim n) const noexcept -> std::span<float>;
+        auto commit(dim n) noexcept -> void;
+
+        // Latest window() frames, oldest first, frames which were not pushed yet are zero
+        // Always the same tensor, its data pointer is moved by push and commit
+        [[nodiscard]] auto latest() const noexcept -> tensor<dtypes::f32>& { return *m_window; }
+        [[nodiscard]] auto features() const noexcept -> dim { return m_features; }
+        [[nodiscard]] auto window() const noexcept -> dim { return m_window_frames; }
+        [[nodiscard]] auto capacity() const noexcept -> dim { return m_capacity; } // Frames in the ring, >= window
+        [[nodiscard]] auto frames() const noexcept -> dim { return m_frames; }     // Frames pushed so far
+        [[nodiscard]] auto is_double_mapped() const noexcept -> bool { return m_double_mapped; }
+
+    private:
+        const dim m_features;
+        const dim m_window_frames;
+        dim m_capacity {};
+        bool m_double_mapped {};
+        float* m_data {};                       // 2 * capacity frames, the second half mirrors the first
+        tensor<dtypes::f32>* m_ring {};         // [features, 2 * capacity] view of the whole mapping
+        tensor<dtypes::f32>* m_window {};       // [features, window] slice of m_ring
+        dim m_head {};                          // Ring slot of the next frame
+        dim m_frames {};
+    };
+}
@@ -0,0 +1,166 @@
+// Copyright Mario "Neo" Sieg 2024. All rights reserved. mario.sieg.64@gmail.com
+// Stable C ABI of the RTML runtime, used by the Python bindings (tools/gen_ffi.sh generates python/rtml_runtime.py from this file)
+// Isolates, tensors and graphs are referenced by integer handles, which are resolved in O(1) without any string lookup
+// Handles are never reused while their isolate is alive, handles of destroyed isolates are detected as invalid
+// Functions return false, 0 or NULL on failure, rtml_last_error returns the reason
+// An isolate and everything created from it must only be used by one thread at a time
+
+#ifndef RTML_CAPI_H
+#define RTML_CAPI_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef RTML_EXPORT /* Also defined in base.hpp */
+#   ifdef _MSC_VER
+#       define RTML_EXPORT __declspec(dllexport)
+#   else
+#       define RTML_EXPORT __attribute__((visibility("default")))
+#   endif
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RTML_MAX_DIMS 4
+#define RTML_MAX_OP_PARAMS 8
+#define RTML_INVALID_HANDLE 0
+#define RTML_MAX_THREADS 1024 /* Upper bound of rtml_isolate_set_num_threads */
+#define RTML_NODE_RESULT_BIT 0x80000000u
+#define RTML_NODE_RESULT(i) (RTML_NODE_RESULT_BIT | (uint32_t)(i))
+
+typedef uint32_t rtml_isolate_id_t; /* Isolate handle, 0 is invalid */
+typedef uint32_t rtml_tensor_id_t;  /* Tensor handle, unique within its isolate, 0 is invalid */
+typedef uint32_t rtml_graph_id_t;   /* Graph handle, unique within its isolate, 0 is invalid */
+typedef uint64_t rtml_job_id_t;     /* Asynchronous job handle, unique within its isolate until released, 0 is invalid */
+
+/* Must match rtml::isolate::compute_device */
+typedef enum rtml_compute_device_t {
+    RTML_DEVICE_AUTO = 0,
+    RTML_DEVICE_CPU = 1,
+    RTML_DEVICE_GPU = 2,
+    RTML_DEVICE_TPU = 3
+} rtml_compute_device_t;
+
+typedef enum rtml_dtype_t {
+    RTML_DTYPE_F32 = 0
+} rtml_dtype_t;
+
+/* Must match rtml::graph::opcode */
+typedef enum rtml_opcode_t {
+    RTML_OP_SOFTMAX = 0,
+    RTML_OP_SIGMOID,
+    RTML_OP_TANH,
+    RTML_OP_RELU,
+    RTML_OP_GELU,
+    RTML_OP_SILU,
+    RTML_OP_ADD,
+    RTML_OP_SUB,
+    RTML_OP_MUL,
+    RTML_OP_DIV,
+    RTML_OP_MATMUL,
+    RTML_OP_SUM,    /* Reductions: the reduced dim is the dim where r has size 1 and x not */
+    RTML_OP_MEAN,
+    RTML_OP_MAX,
+    RTML_OP_MIN,
+    RTML_OP_ARGMAX, /* Index of the first maximum, stored as float */
+    RTML_OP_LAYERNORM, /* y = [d0, 2] holds gamma and beta */
+    RTML_OP_RMSNORM,   /* y = [d0] holds gamma */
+    RTML_OP_CONV1D,    /* x = [C_in, T, B], y = [C_out, C_in / groups, K], r = [C_out, T_out, B] */
+    RTML_OP_CONV2D,    /* x = [C_in, W, H, B], y = [C_out, C_in / groups, KW, KH], r = [C_out, W_out, H_out, B] */
+    RTML_OP_COUNT
+} rtml_opcode_t;
+
+/* Tensor description for bulk creation, unused dims must be 1 */
+typedef struct rtml_tensor_desc_t {
+    uint32_t dtype;
+    uint32_t num_dims;
+    int64_t dims[RTML_MAX_DIMS];
+    rtml_tensor_id_t slice;     /* Tensor to view into or RTML_INVALID_HANDLE to allocate new memory */
+    size_t slice_offset;        /* Byte offset into the sliced tensor */
+} rtml_tensor_desc_t;
+
+/* Single graph op: r = op(x, y), y is RTML_INVALID_HANDLE for unary ops */
+/* If r is RTML_INVALID_HANDLE, the result tensor is allocated when the graph is built and its handle is written back, reductions then reduce dim 0 */
+/* x and y can refer to the result of an earlier node of the same graph with RTML_NODE_RESULT(node index) */
+/* params are op specific, zero selects the default: convolutions use stride W, stride H, padding W, padding H, dilation W, dilation H, groups */
+typedef struct rtml_graph_node_t {
+    uint32_t opcode;
+    rtml_tensor_id_t r;
+    rtml_tensor_id_t x;
+    rtml_tensor_id_t y;
+    int64_t params[RTML_MAX_OP_PARAMS];
+} rtml_graph_node_t;
+
+RTML_EXPORT bool rtml_global_init(void);
+RTML_EXPORT void rtml_global_shutdown(void); /* Destroys all isolates */
+RTML_EXPORT const char* rtml_last_error(void); /* Error of the last failed call on this thread, empty if none */
+
+RTML_EXPORT rtml_isolate_id_t rtml_isolate_create(const char* name, uint32_t device, size_t pool_mem);
+RTML_EXPORT bool rtml_isolate_destroy(rtml_isolate_id_t iso);
+RTML_EXPORT bool rtml_isolate_exists(rtml_isolate_id_t iso);
+RTML_EXPORT rtml_isolate_id_t rtml_isolate_find(const char* name); /* Slow path, resolve once and keep the handle */
+RTML_EXPORT bool rtml_isolate_set_num_threads(rtml_isolate_id_t iso, uint32_t num_threads); /* Threads used to execute ops and graphs, 0 = all hardware threads, at most RTML_MAX_THREADS */
+
+RTML_EXPORT rtml_tensor_id_t rtml_isolate_create_tensor(
+    rtml_isolate_id_t iso,
+    uint32_t dtype,
+    int64_t d0,
+    int64_t d1,
+    int64_t d2,
+    int64_t d3,
+    uint32_t num_dims,
+    rtml_tensor_id_t slice,
+    size_t slice_offset
+);
+/* Zero-copy view of external memory, e.g. a NumPy array, data must be aligned to the dtype and outlive all uses of the tensor */
+/* Strides are in bytes, positive and a multiple of the dtype size, NULL for dense */
+RTML_EXPORT rtml_tensor_id_t rtml_isolate_wrap_tensor(
+    rtml_isolate_id_t iso,
+    uint32_t dtype,
+    const int64_t* dims,
+    const int64_t* strides,
+    uint32_t num_dims,
+    void* data
+);
+RTML_EXPORT bool rtml_isolate_create_tensors(rtml_isolate_id_t iso, const rtml_tensor_desc_t* descs, uint32_t num, rtml_tensor_id_t* out_ids);
+
+RTML_EXPORT bool rtml_tensor_shape(rtml_isolate_id_t iso, rtml_tensor_id_t t, int64_t* out_dims, uint32_t* out_num_dims); /* out_dims must hold RTML_MAX_DIMS */
+RTML_EXPORT bool rtml_tensor_strides(rtml_isolate_id_t iso, rtml_tensor_id_t t, int64_t* out_strides); /* Byte strides, out_strides must hold RTML_MAX_DIMS */
+RTML_EXPORT void* rtml_tensor_data(rtml_isolate_id_t iso, rtml_tensor_id_t t);
+RTML_EXPORT size_t rtml_tensor_data_size(rtml_isolate_id_t iso, rtml_tensor_id_t t); /* Size in bytes */
+RTML_EXPORT bool rtml_tensor_fill(rtml_isolate_id_t iso, rtml_tensor_id_t t, float value);
+RTML_EXPORT bool rtml_tensor_set_name(rtml_isolate_id_t iso, rtml_tensor_id_t t, const char* name);
+RTML_EXPORT const char* rtml_tensor_print(rtml_isolate_id_t iso, rtml_tensor_id_t t); /* Valid until the next call on this thread */
+
+/* DLPack exchange (dlpack.h), both directions are zero-copy */
+struct DLManagedTensor;
+/* The exported tensor keeps the isolate alive until its deleter is called, even if the isolate is destroyed before */
+RTML_EXPORT struct DLManagedTensor* rtml_tensor_to_dlpack(rtml_isolate_id_t iso, rtml_tensor_id_t t);
+/* On success the isolate takes ownership and calls the deleter when it is destroyed, on failure the caller keeps ownership */
+RTML_EXPORT rtml_tensor_id_t rtml_isolate_from_dlpack(rtml_isolate_id_t iso, struct DLManagedTensor* managed);
+RTML_EXPORT void rtml_dlpack_release(struct DLManagedTensor* managed); /* Calls the deleter, for bindings which can not call function pointers */
+
+RTML_EXPORT bool rtml_tensor_op(rtml_isolate_id_t iso, uint32_t opcode, rtml_tensor_id_t r, rtml_tensor_id_t x, rtml_tensor_id_t y); /* Validates and executes a single op */
+RTML_EXPORT bool rtml_tensor_op_params(rtml_isolate_id_t iso, uint32_t opcode, rtml_tensor_id_t r, rtml_tensor_id_t x, rtml_tensor_id_t y, const int64_t* params); /* params holds RTML_MAX_OP_PARAMS or is NULL */
+
+RTML_EXPORT rtml_graph_id_t rtml_graph_build(rtml_isolate_id_t iso, rtml_graph_node_t* nodes, uint32_t num_nodes); /* Validates all nodes once */
+RTML_EXPORT bool rtml_graph_execute(rtml_isolate_id_t iso, rtml_graph_id_t graph);
+RTML_EXPORT bool rtml_graph_destroy(rtml_isolate_id_t iso, rtml_graph_id_t graph);
+RTML_EXPORT bool rtml_graph_run(rtml_isolate_id_t iso, rtml_graph_node_t* nodes, uint32_t num_nodes); /* Build and execute a one-shot graph in a single call */
+
+/* Asynchronous execution: jobs of one isolate run in submission order on a worker thread, jobs of different isolates run concurrently */
+/* The tensors of a graph must not be accessed until its job completed, synchronous calls on the isolate wait for all pending jobs */
+RTML_EXPORT rtml_job_id_t rtml_graph_submit(rtml_isolate_id_t iso, rtml_graph_id_t graph);
+RTML_EXPORT int rtml_job_poll(rtml_isolate_id_t iso, rtml_job_id_t job); /* 1 if completed, 0 if pending, -1 on error */
+RTML_EXPORT bool rtml_job_wait(rtml_isolate_id_t iso, rtml_job_id_t job, int64_t timeout_us); /* Returns true if completed, timeout < 0 waits forever */
+RTML_EXPORT int rtml_job_eventfd(rtml_isolate_id_t iso, rtml_job_id_t job); /* Linux eventfd which becomes readable on completion, owned by the job, -1 on error */
+RTML_EXPORT bool rtml_job_release(rtml_isolate_id_t iso, rtml_job_id_t job); /* Frees the handle, a pending job still runs to completion and then closes its eventfd */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
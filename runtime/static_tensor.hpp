@@ -0,0 +1,158 @@
+// Copyright Mario "Neo" Sieg 2024. All rights reserved. mario.sieg.64@gmail.com
+// CPU backend only!
+// Tensors with a compile time shape for models whose shapes are known at build time (e.g. embedded controllers)
+// A static_tensor is a dense view of tensor storage (usually a pool allocated tensor<T>), dims and strides are constants,
+// so the kernels below have no shape checks, stride math or row partitioning and the compiler fully unrolls and
+// vectorizes their loops for the concrete shape - all kernels run on the calling thread
+
+#pragma once
+
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <span>
+
+#include "blas_vec.hpp"
+#include "tensor.hpp"
+
+namespace rtml {
+    template <typename T, const dim D0, const dim D1 = 1, const dim D2 = 1, const dim D3 = 1> requires is_dtype<T> && (D0 > 0 && D1 > 0 && D2 > 0 && D3 > 0)
+    class static_tensor final {
+    public:
+        using dtype = T;
+        static constexpr std::array<dim, tensor<T>::k_max_dims> k_dims {D0, D1, D2, D3};
+        static constexpr std::array<dim, tensor<T>::k_max_dims> k_strides {1, D0, D0*D1, D0*D1*D2}; // Element strides
+        static constexpr dim k_elems {D0*D1*D2*D3};
+        static constexpr dim k_rows {D1*D2*D3};
+        static constexpr std::size_t k_rank {D3 > 1 ? 4 : D2 > 1 ? 3 : D1 > 1 ? 2 : 1};
+
+        constexpr explicit static_tensor(T* const data) noexcept : m_data{data} {}
+        explicit static_tensor(const tensor<T>& t) noexcept : m_data{reinterpret_cast<T*>(t.ptr())} { // View of tensor storage, shape must match
+            assert(matches(t));
+        }
+
+        // True if t is dense and has exactly this shape, so it can be viewed as a static_tensor
+        [[nodiscard]] static auto matches(const tensor<T>& t) noexcept -> bool {
+            return t.dims() == k_dims && t.is_dense();
+        }
+        // Allocates a tensor of this shape from the isolate pool, view it with static_tensor{*t}
+        [[nodiscard]] static auto new_tensor(isolate& ctx) -> tensor<T>* {
+            return ctx.new_tensor<T>(std::span<const dim>{k_dims.data(), k_rank});
+        }
+
+        [[nodiscard]] constexpr auto ptr() const noexcept -> T* { return m_data; }
+        [[nodiscard]] constexpr auto data() const noexcept -> std::span<T, k_elems> { return std::span<T, k_elems>{m_data, k_elems}; }
+        [[nodiscard]] constexpr auto row(const dim i) const noexcept -> T* { return m_data + i*D0; }
+
+        [[nodiscard]] constexpr auto operator()(const std::array<dim, tensor<T>::k_max_dims>& indices) const noexcept -> T& {
+            return m_data[indices[0] + indices[1]*k_strides[1] + indices[2]*k_strides[2] + indices[3]*k_strides[3]];
+        }
+        [[nodiscard]] constexpr auto operator()(const dim i) const noexcept -> T& { return m_data[i]; }
+
+    private:
+        T* m_data;
+    };
+
+    template <typename>
+    struct is_static_tensor : std::false_type {};
+    template <typename T, const dim D0, const dim D1, const dim D2, const dim D3>
+    struct is_static_tensor<static_tensor<T, D0, D1, D2, D3>> : std::true_type {};
+
+    // Y can be repeated to the shape of X: every dim of Y is 1 or equal to the dim of X
+    template <typename X, typename Y>
+    concept static_broadcastable =
+        is_static_tensor<X>::value && is_static_tensor<Y>::value && std::is_same_v<typename X::dtype, typename Y::dtype> &&
+        []() consteval {
+            for (std::size_t i {}; i < X::k_dims.size(); ++i)
+                if (Y::k_dims[i] != 1 && Y::k_dims[i] != X::k_dims[i]) return false;
+            return true;
+        }();
+}
+
+namespace rtml::blas {
+    namespace detail {
+        // r = op(x, y) with y repeated to the shape of r, the row loop nest and all offsets are constants
+        template <typename R, typename Y, typename F>
+        RTML_AINLINE inline auto static_binary(const R& r, const R& x, const Y& y, F&& op) noexcept -> void {
+            using S = typename R::dtype;
+            S* const pr {r.ptr()};
+            const S* const px {x.ptr()};
+            const S* const py {y.ptr()};
+            if constexpr (Y::k_dims == R::k_dims) { // Same shape: one flat loop
+                for (dim i {}; i < R::k_elems; ++i)
+                    pr[i] = op(px[i], py[i]);
+            } else {
+                for (dim i3 {}; i3 < R::k_dims[3]; ++i3)
+                    for (dim i2 {}; i2 < R::k_dims[2]; ++i2)
+                        for (dim i1 {}; i1 < R::k_dims[1]; ++i1) {
+                            const dim o {i1*R::k_strides[1] + i2*R::k_strides[2] + i3*R::k_strides[3]};
+                            const S* const yr {py + (Y::k_dims[1] == 1 ? 0 : i1*Y::k_strides[1]) + (Y::k_dims[2] == 1 ? 0 : i2*Y::k_strides[2]) + (Y::k_dims[3] == 1 ? 0 : i3*Y::k_strides[3])};
+                            if constexpr (Y::k_dims[0] == 1) { // Scalar per row, e.g. per channel scale
+                                const S b {*yr};
+                                for (dim i0 {}; i0 < R::k_dims[0]; ++i0)
+                                    pr[o + i0] = op(px[o + i0], b);
+                            } else {
+                                for (dim i0 {}; i0 < R::k_dims[0]; ++i0)
+                                    pr[o + i0] = op(px[o + i0], yr[i0]);
+                            }
+                        }
+            }
+        }
+    }
+
+    // Element wise ops: r = x op y, y is repeated (broadcasted) to the shape of x, r may alias x
+    template <typename R, typename Y> requires static_broadcastable<R, Y>
+    inline auto add(const R& r, const R& x, const Y& y) noexcept -> void {
+        detail::static_binary(r, x, y, [](const typename R::dtype a, const typename R::dtype b) noexcept { return scalar::add(a, b); });
+    }
+    template <typename R, typename Y> requires static_broadcastable<R, Y>
+    inline auto sub(const R& r, const R& x, const Y& y) noexcept -> void {
+        detail::static_binary(r, x, y, [](const typename R::dtype a, const typename R::dtype b) noexcept { return scalar::sub(a, b); });
+    }
+    template <typename R, typename Y> requires static_broadcastable<R, Y>
+    inline auto mul(const R& r, const R& x, const Y& y) noexcept -> void {
+        detail::static_binary(r, x, y, [](const typename R::dtype a, const typename R::dtype b) noexcept { return scalar::mul(a, b); });
+    }
+    template <typename R, typename Y> requires static_broadcastable<R, Y>
+    inline auto div(const R& r, const R& x, const Y& y) noexcept -> void {
+        detail::static_binary(r, x, y, [](const typename R::dtype a, const typename R::dtype b) noexcept { return scalar::div(a, b); });
+    }
+
+    // Unary ops use the vector kernels with a constant element count, softmax is per row (dim 0)
+    // The transcendental ops are kept out of line: inlined into a loop of the caller, GCC completely unrolls the short
+    // constant trip count loop before the vectorizer runs, which leaves one scalar libm call per element (~30x slower)
+    template <typename R> requires is_static_tensor<R>::value
+    RTML_NOINLINE auto sigmoid(const R& r, const R& x) noexcept -> void { vec::sigmoid(R::k_elems, r.ptr(), x.ptr()); }
+    template <typename R> requires is_static_tensor<R>::value
+    RTML_NOINLINE auto tanh(const R& r, const R& x) noexcept -> void { vec::tanh(R::k_elems, r.ptr(), x.ptr()); }
+    template <typename R> requires is_static_tensor<R>::value
+    inline auto relu(const R& r, const R& x) noexcept -> void { vec::relu(R::k_elems, r.ptr(), x.ptr()); }
+    template <typename R> requires is_static_tensor<R>::value
+    RTML_NOINLINE auto gelu(const R& r, const R& x) noexcept -> void { vec::gelu(R::k_elems, r.ptr(), x.ptr()); }
+    template <typename R> requires is_static_tensor<R>::value
+    RTML_NOINLINE auto silu(const R& r, const R& x) noexcept -> void { vec::silu(R::k_elems, r.ptr(), x.ptr()); }
+    template <typename R> requires is_static_tensor<R>::value
+    RTML_NOINLINE auto softmax(const R& r, const R& x) noexcept -> void {
+        for (dim i {}; i < R::k_rows; ++i)
+            vec::softmax(R::k_dims[0], r.row(i), x.row(i));
+    }
+
+    // r = x @ y with the layout of blas::matmul: x = [K, M], y = [N, K], r = [N, M], batch dims are not supported
+    // Every row of r accumulates K rows of y scaled by x, with N constant the row update is one unrolled vector loop
+    template <typename S, const dim M, const dim N, const dim K>
+    inline auto matmul(const static_tensor<S, N, M>& r, const static_tensor<S, K, M>& x, const static_tensor<S, N, K>& y) noexcept -> void {
+        for (dim m {}; m < M; ++m) {
+            S acc[N] {};
+            const S* const xr {x.row(m)};
+            for (dim k {}; k < K; ++k) {
+                const S a {xr[k]};
+                const S* const yr {y.row(k)};
+                for (dim n {}; n < N; ++n)
+                    acc[n] += a*yr[n];
+            }
+            S* const rr {r.row(m)};
+            for (dim n {}; n < N; ++n)
+                rr[n] = acc[n];
+        }
+    }
+}
@@ -122,8 +122,8 @@ namespace rtml {
             const dim xi {i - lambda*d2*d1*d0 - zeta*d1*d0 - eta * d0};
             return {
                 xi,
-                zeta,
                 eta,
+                zeta,
                 lambda
             };
         }
@@ -143,8 +143,28 @@ namespace rtml {
             ts->format_name("{} (slice)", m_name.data());
             return ts;
         }
+        // Moves a slice view to another byte offset of its base tensor, shape and strides are kept
+        // Lets views slide over a buffer (e.g. ring_tensor windows) without allocating a new tensor per position
+        auto reslice(const std::size_t slice_offset) noexcept -> void {
+            assert(m_slice && m_datasize + slice_offset <= m_slice->m_datasize);
+            m_x.u8 = m_slice->m_x.u8 + slice_offset;
+            m_slice_offset = slice_offset;
+        }
+        [[nodiscard]] auto transposed_clone() noexcept -> tensor* { // Strided view with dims 0 and 1 swapped, shares data
+            std::array<dim, k_max_dims> dims {m_shape};
+            std::swap(dims[0], dims[1]);
+            auto* const ts {m_ctx.new_tensor<T>(
+                std::span<const dim>{dims.cbegin(), std::max<std::size_t>(m_num_dims, 2)},
+                this,
+                0
+            )};
+            std::ranges::copy(m_strides.cbegin(), m_strides.cend(), ts->m_strides.begin());
+            std::swap(ts->m_strides[0], ts->m_strides[1]);
+            ts->format_name("{} (transposed)", m_name.data());
+            return ts;
+        }
         [[nodiscard]] auto clone() noexcept -> tensor* {
-            auto* const ts {m_ctx.new_tensor(
+            auto* const ts {m_ctx.new_tensor<T>(
                 used_dims()
             )};
             std::ranges::copy(data(), ts->data().begin());
@@ -166,6 +186,11 @@ namespace rtml {
             m_operands.emplace_back(x);
         }
 
+        // Evaluates a lazy tensor expression into this tensor in one fused loop without temporaries, e.g. *r = gelu(*a * *b + *c)
+        // Defined in tensor_expr.hpp, which also defines the operators building the expressions
+        template <typename E> requires std::is_base_of_v<expr::base, E>
+        auto operator=(const E& e) -> tensor&;
+
         [[nodiscard]] auto operator()(const std::array<dim, k_max_dims>& indices) const noexcept -> T& {
             return *reinterpret_cast<T*>(
                 m_x.u8 +
@@ -185,11 +210,13 @@ namespace rtml {
             m_name[k_max_name-1] = '\0';
         }
         template<typename... Args>
-        auto RTML_COLD format_name(const fmt::format_string<Args...>& fmt, Args&&... args) -> void {
-            const std::string formatted {fmt::format(fmt, std::forward<Args>(args)...)}; // TODO: avoid clone
-            set_name(formatted.c_str());
+        auto RTML_COLD format_name(const fmt::format_string<Args...>& fmt, Args&&... args) -> void { // Formats in place, does not allocate
+            const auto result {fmt::format_to_n(m_name.data(), k_max_name-1, fmt, std::forward<Args>(args)...)};
+            *result.out = '\0';
         }
-        [[nodiscard]] auto RTML_COLD to_string(const std::size_t with_data_elems = 0) const -> std::string {
+        // Writes the description (and the first data elements) to out, does not allocate if out does not
+        template <typename O>
+        auto RTML_COLD format_to(O out, const std::size_t with_data_elems = 0) const -> O {
             static_assert(k_max_dims == 4);
             const std::size_t total_size = m_datasize+sizeof(*this);
             auto size {static_cast<double>(total_size)};
@@ -204,9 +231,8 @@ namespace rtml {
                 size /= static_cast<double>(1<<10);
                 unit = "KiB";
             }
-            std::string fmt {};
-            fmt.reserve(0x100+sizeof("2.000")*with_data_elems);
-            fmt += fmt::format(
+            out = fmt::format_to(
+                out,
                 "Tensor {}{}{} * {}D, Shape [{} X {} X {} X {}], Strides [{}B X {}B X {}B X {}B] {:.01f}{}",
                 m_name.data(),
                 m_name[0] ? ": " : "",
@@ -224,23 +250,30 @@ namespace rtml {
                 unit
             );
             if (with_data_elems > 0) {
-                fmt += "\n[\n";
+                out = fmt::format_to(out, "\n[\n");
                 for (dim i3 {}; i3 < m_shape[2]; ++i3) {
                     for (dim i2 {}; i2 < m_shape[1]; ++i2) {
-                        fmt.push_back('\t');
+                        *out++ = '\t';
                         for (dim i1 {}; i1 < m_shape[0]; ++i1) {
                             const T x {reinterpret_cast<T&>(m_x.u8[dtype_traits<T>::k_size*(i3*m_shape[1]*m_shape[0] + i2*m_shape[0] + i1)])};
-                            fmt += fmt::format("{:.03f} ", x);
+                            out = fmt::format_to(out, "{:.03f} ", x);
                         }
-                        fmt.push_back('\n');
+                        *out++ = '\n';
                     }
                 }
-                fmt += "\t...\n]";
+                out = fmt::format_to(out, "\t...\n]");
             }
-            return fmt;
+            return out;
+        }
+        [[nodiscard]] auto RTML_COLD to_string(const std::size_t with_data_elems = 0) const -> std::string {
+            std::string str {};
+            str.reserve(0x100+sizeof("2.000")*with_data_elems);
+            format_to(std::back_inserter(str), with_data_elems);
+            return str;
         }
         auto RTML_COLD print(const std::size_t with_data_elems = std::numeric_limits<std::size_t>::max()) const -> void {
-            std::cout << to_string(with_data_elems) << std::endl;
+            format_to(std::ostreambuf_iterator<char>{std::cout}, with_data_elems);
+            std::cout << std::endl;
         }
 
     private:
@@ -263,7 +296,7 @@ namespace rtml {
                 datasize *= dims[i];
             }
             assert(!slice || datasize+slice_offset <= slice->m_datasize); // Check if slice has enough space
-            static constexpr bool k_align_scalar = false; // Aligned data address to scalar alignment?
+            static constexpr bool k_align_scalar = true; // Aligned data address to scalar alignment?
             m_x.u8 = slice
                 ? slice->m_x.u8+slice_offset
                 : static_cast<std::uint8_t*>(k_align_scalar
@@ -280,6 +313,29 @@ namespace rtml {
                 m_strides[i] = m_strides[i-1]*m_shape[i-1];
         }
 
+        tensor( // View of external memory with arbitrary byte strides, the memory is not owned
+             isolate& ctx,
+             std::span<const dim> dims,
+             std::uint8_t* external,
+             std::span<const dim> strides
+        ) noexcept : m_ctx{ctx} {
+            assert(!dims.empty() && dims.size() <= k_max_dims && strides.size() == dims.size());
+            assert(external && reinterpret_cast<std::uintptr_t>(external) % dtype_traits<T>::k_align == 0);
+            std::size_t extent {dtype_traits<T>::k_size}; // Bytes spanned from the first to one past the last element
+            for (std::size_t i {0}; i < dims.size(); ++i) {
+                assert(dims[i] > 0 && strides[i] > 0 && strides[i] % dtype_traits<T>::k_size == 0);
+                extent += (dims[i]-1)*strides[i];
+            }
+            m_x.u8 = external;
+            m_datasize = extent;
+            m_num_dims = dims.size();
+            std::ranges::fill(m_shape.begin(), m_shape.end(), 1);
+            std::ranges::copy(dims.begin(), dims.end(), m_shape.begin());
+            std::ranges::copy(strides.begin(), strides.end(), m_strides.begin());
+            for (std::size_t i {dims.size()}; i < k_max_dims; ++i) // Strides of unused dims
+                m_strides[i] = m_strides[i-1]*m_shape[i-1];
+        }
+
         isolate& m_ctx; // Associated isolate
         std::array<char, k_max_name> m_name {}; // Tensor name - cannot use std::string because we must be trivially destructable
         std::size_t m_datasize {}; // Tensor data size in bytes
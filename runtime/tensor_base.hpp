@@ -33,4 +33,8 @@ namespace rtml {
 
     template <typename T> requires is_dtype<T>
     class tensor;
+
+    namespace expr {
+        struct base {}; // Base of all lazy tensor expression types, see tensor_expr.hpp
+    }
 }
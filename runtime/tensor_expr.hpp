@@ -0,0 +1,316 @@
+// Copyright Mario "Neo" Sieg 2024. All rights reserved. mario.sieg.64@gmail.com
+// CPU backend only!
+// Lazy element wise tensor arithmetic with expression templates: operators and activation functions on tensors build an
+// expression tree (by value, tensors are referenced) which is evaluated on assignment to a tensor in one fused loop:
+//     *r = gelu(*a * *b + *c);
+// computes every element of r in a single pass over a, b and c, no intermediate tensors are allocated from the pool
+// Operands are repeated to the shape of the result like the binary blas ops: dims 1-3 must divide the result dims,
+// dim 0 must be equal or 1 (broadcast rows are splatted into a small stack buffer, so the inner loop stays contiguous)
+// The rows are split across the threads of the thread_pool of the innermost pool_scope of the assigning thread,
+// small expressions (see blas::small_op_limit) and assignments without a pool_scope run on the calling thread
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <type_traits>
+
+#include "blas_vec.hpp"
+#include "tensor.hpp"
+#include "thread_pool.hpp"
+
+namespace rtml::expr {
+    static constexpr dim k_block {256};             // Elements per fused inner loop
+    static constexpr dim k_cost_arith {1};          // Cost of one element, same scale as blas::op_cost
+    static constexpr dim k_cost_transcendental {8};
+
+    template <typename E>
+    concept expression = std::is_base_of_v<base, E>;
+
+    template <typename>
+    struct is_tensor : std::false_type {};
+    template <typename T>
+    struct is_tensor<tensor<T>> : std::true_type {};
+
+    // Every expression type has a cursor type which is built on the stack of each evaluating thread:
+    // seek moves it to a row of the result, block to an element offset in that row and load(j) computes element offset + j
+    // Operand leaf: element i of the current row block of a tensor
+    template <typename T>
+    class tensor_leaf final : public base {
+    public:
+        using dtype = T;
+        static constexpr dim k_cost {0};
+
+        class cursor final {
+        public:
+            cursor(const tensor_leaf& e, const dim r_d0) noexcept : m_t{e.m_t}, m_splat_count{m_t.dims()[0] == 1 ? std::min(r_d0, k_block) : 0} {}
+
+            RTML_AINLINE auto seek(const dim i1, const dim i2, const dim i3) noexcept -> void {
+                const std::array<dim, tensor<T>::k_max_dims>& dims {m_t.dims()};
+                const std::array<dim, tensor<T>::k_max_dims>& strides {m_t.strides()};
+                m_row = reinterpret_cast<const T*>(m_t.ptr() + i1%dims[1]*strides[1] + i2%dims[2]*strides[2] + i3%dims[3]*strides[3]);
+                if (m_splat_count) std::fill_n(m_splat.begin(), m_splat_count, *m_row);
+            }
+            RTML_AINLINE auto block(const dim b) noexcept -> void { m_p = m_splat_count ? m_splat.data() : m_row + b; }
+            [[nodiscard]] RTML_AINLINE auto load(const dim j) const noexcept -> T { return m_p[j]; }
+
+        private:
+            const tensor<T>& m_t;
+            const dim m_splat_count;
+            const T* m_row {};
+            const T* m_p {};
+            alignas(64) std::array<T, k_block> m_splat;
+        };
+
+        explicit tensor_leaf(const tensor<T>& t) noexcept : m_t{t} {}
+
+        [[nodiscard]] auto validate(const tensor<T>& r) const noexcept -> const char* {
+            const std::array<dim, tensor<T>::k_max_dims>& dims {m_t.dims()};
+            if (dims[0] != 1 && dims[0] != r.dims()[0]) return "expression operand dim 0 must be 1 or equal to the result";
+            if (!m_t.can_repeat(&r)) return "expression operand can not be repeated to the result shape";
+            if (dims[0] != 1 && m_t.strides()[0] != dtype_traits<T>::k_size) return "expression operand must be dense in dim 0";
+            return nullptr;
+        }
+
+    private:
+        const tensor<T>& m_t;
+    };
+
+    // Constant operand, e.g. the 0.5 of *x * 0.5f
+    template <typename T>
+    class scalar_leaf final : public base {
+    public:
+        using dtype = T;
+        static constexpr dim k_cost {0};
+
+        class cursor final {
+        public:
+            cursor(const scalar_leaf& e, dim) noexcept : m_v{e.m_v} {}
+            RTML_AINLINE auto seek(dim, dim, dim) const noexcept -> void {}
+            RTML_AINLINE auto block(dim) const noexcept -> void {}
+            [[nodiscard]] RTML_AINLINE auto load(dim) const noexcept -> T { return m_v; }
+
+        private:
+            const T m_v;
+        };
+
+        explicit scalar_leaf(const T v) noexcept : m_v{v} {}
+
+        [[nodiscard]] auto validate(const tensor<T>&) const noexcept -> const char* { return nullptr; }
+
+    private:
+        T m_v;
+    };
+
+    template <typename Op, typename X>
+    class unary final : public base {
+    public:
+        using dtype = typename X::dtype;
+        static constexpr dim k_cost {Op::k_cost + X::k_cost};
+
+        class cursor final {
+        public:
+            cursor(const unary& e, const dim r_d0) noexcept : m_x{e.m_x, r_d0} {}
+            RTML_AINLINE auto seek(const dim i1, const dim i2, const dim i3) noexcept -> void { m_x.seek(i1, i2, i3); }
+            RTML_AINLINE auto block(const dim b) noexcept -> void { m_x.block(b); }
+            [[nodiscard]] RTML_AINLINE auto load(const dim j) const noexcept -> dtype { return Op::apply(m_x.load(j)); }
+
+        private:
+            typename X::cursor m_x;
+        };
+
+        explicit unary(const X& x) noexcept : m_x{x} {}
+
+        [[nodiscard]] auto validate(const tensor<dtype>& r) const noexcept -> const char* { return m_x.validate(r); }
+
+    private:
+        X m_x;
+    };
+
+    template <typename Op, typename X, typename Y> requires std::is_same_v<typename X::dtype, typename Y::dtype>
+    class binary final : public base {
+    public:
+        using dtype = typename X::dtype;
+        static constexpr dim k_cost {Op::k_cost + X::k_cost + Y::k_cost};
+
+        class cursor final {
+        public:
+            cursor(const binary& e, const dim r_d0) noexcept : m_x{e.m_x, r_d0}, m_y{e.m_y, r_d0} {}
+            RTML_AINLINE auto seek(const dim i1, const dim i2, const dim i3) noexcept -> void {
+                m_x.seek(i1, i2, i3);
+                m_y.seek(i1, i2, i3);
+            }
+            RTML_AINLINE auto block(const dim b) noexcept -> void {
+                m_x.block(b);
+                m_y.block(b);
+            }
+            [[nodiscard]] RTML_AINLINE auto load(const dim j) const noexcept -> dtype { return Op::apply(m_x.load(j), m_y.load(j)); }
+
+        private:
+            typename X::cursor m_x;
+            typename Y::cursor m_y;
+        };
+
+        binary(const X& x, const Y& y) noexcept : m_x{x}, m_y{y} {}
+
+        [[nodiscard]] auto validate(const tensor<dtype>& r) const noexcept -> const char* {
+            const char* const err {m_x.validate(r)};
+            return err ? err : m_y.validate(r);
+        }
+
+    private:
+        X m_x;
+        Y m_y;
+    };
+
+    // Element ops, the formulas are the ones of the vector kernels in blas_vec.hpp
+    struct op_add final { static constexpr dim k_cost {k_cost_arith}; template <typename S> static RTML_AINLINE auto apply(const S x, const S y) noexcept -> S { return blas::scalar::add(x, y); } };
+    struct op_sub final { static constexpr dim k_cost {k_cost_arith}; template <typename S> static RTML_AINLINE auto apply(const S x, const S y) noexcept -> S { return blas::scalar::sub(x, y); } };
+    struct op_mul final { static constexpr dim k_cost {k_cost_arith}; template <typename S> static RTML_AINLINE auto apply(const S x, const S y) noexcept -> S { return blas::scalar::mul(x, y); } };
+    struct op_div final { static constexpr dim k_cost {k_cost_arith}; template <typename S> static RTML_AINLINE auto apply(const S x, const S y) noexcept -> S { return blas::scalar::div(x, y); } };
+    struct op_neg final { static constexpr dim k_cost {k_cost_arith}; template <typename S> static RTML_AINLINE auto apply(const S x) noexcept -> S { return -x; } };
+    struct op_relu final { static constexpr dim k_cost {k_cost_arith}; template <typename S> static RTML_AINLINE auto apply(const S x) noexcept -> S { return std::max(x, 0.0f); } };
+    struct op_sigmoid final { static constexpr dim k_cost {k_cost_transcendental}; template <typename S> static RTML_AINLINE auto apply(const S x) noexcept -> S { return 1.0f / (1.0f + std::exp(-x)); } };
+    struct op_tanh final { static constexpr dim k_cost {k_cost_transcendental}; template <typename S> static RTML_AINLINE auto apply(const S x) noexcept -> S { return std::tanh(x); } };
+    struct op_silu final { static constexpr dim k_cost {k_cost_transcendental}; template <typename S> static RTML_AINLINE auto apply(const S x) noexcept -> S { return x / (1.0f + std::exp(-x)); } };
+    struct op_gelu final {
+        static constexpr dim k_cost {k_cost_transcendental};
+        template <typename S>
+        static RTML_AINLINE auto apply(const S x) noexcept -> S {
+            return 0.5f * x * (1.0f + std::tanh(blas::vec::k_rtml_sqrt2pi * x * (1.0f + blas::vec::k_rtml_gelu_coeff * x * x)));
+        }
+    };
+
+    // Tensors and expressions are operands, scalars only next to an operand which determines the dtype
+    template <typename X>
+    concept operand = expression<X> || is_tensor<X>::value;
+
+    template <typename X>
+    struct dtype_of { using type = typename X::dtype; };
+
+    template <typename X, typename Y>
+    concept operand_pair =
+        (operand<X> && operand<Y> && std::is_same_v<typename dtype_of<X>::type, typename dtype_of<Y>::type>) ||
+        (operand<X> && std::is_arithmetic_v<Y>) ||
+        (std::is_arithmetic_v<X> && operand<Y>);
+
+    template <typename S, typename X>
+    [[nodiscard]] constexpr auto as_expr(const X& x) noexcept {
+        if constexpr (is_tensor<X>::value) return tensor_leaf<S>{x};
+        else if constexpr (expression<X>) return x;
+        else return scalar_leaf<S>{static_cast<S>(x)};
+    }
+
+    template <typename X, typename Y>
+    using pair_dtype = typename dtype_of<std::conditional_t<operand<X>, X, Y>>::type;
+
+    // Checks shapes and layouts, returns an error message or nullptr
+    template <typename T, typename E> requires expression<E> && std::is_same_v<T, typename E::dtype>
+    [[nodiscard]] auto validate(const tensor<T>& r, const E& e) noexcept -> const char* {
+        if (r.strides()[0] != dtype_traits<T>::k_size) return "expression result must be dense in dim 0";
+        return e.validate(r);
+    }
+
+    // Evaluates the rows of r assigned to this thread, called on all threads of a dispatch like an op kernel
+    // Work is split into (row, k_block elements) units, so long single rows are split across threads as well
+    template <typename T, typename E> requires expression<E> && std::is_same_v<T, typename E::dtype>
+    auto eval(const blas::compute_ctx& ctx, tensor<T>& r, const E& e) noexcept -> void {
+        assert(validate(r, e) == nullptr); // Debug only verification - ! checked by assign
+        const std::array<dim, tensor<T>::k_max_dims>& dims {r.dims()};
+        const std::array<dim, tensor<T>::k_max_dims>& strides {r.strides()};
+        const dim blocks {(dims[0] + k_block - 1) / k_block};
+        const dim units {r.row_count() * blocks};
+        const dim per_thread {(units + ctx.num_threads - 1) / ctx.num_threads};
+        const dim unit_start {std::min(units, ctx.thread_idx * per_thread)};
+        const dim unit_end {std::min(units, unit_start + per_thread)};
+        typename E::cursor c {e, dims[0]}; // Cursor tree on the stack of this thread
+        dim row {-1};
+        T* pr {};
+        for (dim u {unit_start}; u < unit_end; ++u) {
+            if (u / blocks != row) {
+                row = u / blocks;
+                const dim i1 {row % dims[1]};
+                const dim i2 {row / dims[1] % dims[2]};
+                const dim i3 {row / (dims[1]*dims[2])};
+                c.seek(i1, i2, i3);
+                pr = reinterpret_cast<T*>(r.ptr() + i1*strides[1] + i2*strides[2] + i3*strides[3]);
+            }
+            const dim b {u % blocks * k_block};
+            const dim n {std::min(k_block, dims[0] - b)};
+            c.block(b);
+            T* const po {pr + b};
+            for (dim j {}; j < n; ++j) // The fused loop: one load per tensor operand, all ops in registers
+                po[j] = c.load(j);
+        }
+    }
+
+    namespace detail {
+        inline thread_local thread_pool* t_pool {};
+    }
+
+    // Tensor assignments of this thread are evaluated on the pool while the scope is alive, scopes nest
+    class pool_scope final {
+    public:
+        explicit pool_scope(thread_pool& pool) noexcept : m_prev{detail::t_pool} { detail::t_pool = &pool; }
+        pool_scope(const pool_scope&) = delete;
+        pool_scope(pool_scope&&) = delete;
+        auto operator=(const pool_scope&) -> pool_scope& = delete;
+        auto operator=(pool_scope&&) -> pool_scope& = delete;
+        ~pool_scope() { detail::t_pool = m_prev; }
+
+    private:
+        thread_pool* const m_prev;
+    };
+
+    // r = e, on the pool if given and the expression is not small, otherwise on the calling thread
+    // Panics if the shapes or layouts are invalid (see validate)
+    template <typename T, typename E> requires expression<E> && std::is_same_v<T, typename E::dtype>
+    auto assign(thread_pool* const pool, tensor<T>& r, const E& e) -> void {
+        if (const char* const err {validate(r, e)}; err) [[unlikely]]
+            panic(fmt::format("invalid tensor expression assignment to '{}': {}", r.name(), err));
+        if (!pool || pool->num_threads() == 1 || r.elem_count() * std::max<dim>(1, E::k_cost) <= blas::small_op_limit()) {
+            eval(blas::compute_ctx{}, r, e);
+            return;
+        }
+        pool->parallel_for([&](const blas::compute_ctx& ctx) { eval(ctx, r, e); });
+    }
+}
+
+namespace rtml {
+    template <typename T> requires is_dtype<T>
+    template <typename E> requires std::is_base_of_v<expr::base, E>
+    auto tensor<T>::operator=(const E& e) -> tensor& {
+        expr::assign(expr::detail::t_pool, *this, e);
+        return *this;
+    }
+
+    #define rtml_expr_binary_operator(op, name) \
+        template <typename X, typename Y> requires expr::operand_pair<X, Y> \
+        [[nodiscard]] auto operator op(const X& x, const Y& y) noexcept { \
+            using S = expr::pair_dtype<X, Y>; \
+            using XE = decltype(expr::as_expr<S>(x)); \
+            using YE = decltype(expr::as_expr<S>(y)); \
+            return expr::binary<expr::name, XE, YE>{expr::as_expr<S>(x), expr::as_expr<S>(y)}; \
+        }
+    rtml_expr_binary_operator(+, op_add)
+    rtml_expr_binary_operator(-, op_sub)
+    rtml_expr_binary_operator(*, op_mul)
+    rtml_expr_binary_operator(/, op_div)
+    #undef rtml_expr_binary_operator
+
+    #define rtml_expr_unary_function(fn, name) \
+        template <typename X> requires expr::operand<X> \
+        [[nodiscard]] auto fn(const X& x) noexcept { \
+            using S = typename expr::dtype_of<X>::type; \
+            return expr::unary<expr::name, decltype(expr::as_expr<S>(x))>{expr::as_expr<S>(x)}; \
+        }
+    rtml_expr_unary_function(operator -, op_neg)
+    rtml_expr_unary_function(relu, op_relu)
+    rtml_expr_unary_function(sigmoid, op_sigmoid)
+    rtml_expr_unary_function(tanh, op_tanh)
+    rtml_expr_unary_function(gelu, op_gelu)
+    rtml_expr_unary_function(silu, op_silu)
+    #undef rtml_expr_unary_function
+}
@@ -0,0 +1,113 @@
+// Copyright Mario "Neo" Sieg 2024. All rights reserved. mario.sieg.64@gmail.com
+// Lock free bounded handoff of input tensors from producer threads (capture, network) to the inference thread
+// All slots are tensors of one shape preallocated from the isolate pool: producers fill a free slot in place and publish it,
+// the consumer executes its graph on the slot and recycles it, there is no allocation and no lock after construction
+// Slot indices travel through two bounded rings of sequence numbered cells (Vyukov's bounded queue):
+// free slots from the consumer to the producers and filled slots from the producers to the consumer
+
+#include "tensor_queue.hpp"
+
+#include <bit>
+#include <thread>
+
+#include "isolate.hpp"
+#include "tensor.hpp"
+
+namespace rtml {
+    // Busy wait with a short spin phase, then yield the core to the other side of the queue
+    static auto backoff(const std::uint32_t i) noexcept -> void {
+        if (i < 64) {
+#if defined(__x86_64__) || defined(__i386__)
+            __builtin_ia32_pause();
+#endif
+        } else {
+            std::this_thread::yield();
+        }
+    }
+
+    tensor_queue::ring::ring(const std::uint32_t capacity)
+        : m_mask{std::bit_ceil(capacity)-1}, m_cells{std::make_unique<cell[]>(m_mask+1)} {
+        for (std::uint64_t i {}; i <= m_mask; ++i)
+            m_cells[i].seq.store(i, std::memory_order_relaxed); // Cell i is free for the push at position i
+    }
+
+    auto tensor_queue::ring::push(const std::uint32_t idx, const bool shared) noexcept -> void {
+        std::uint64_t pos {m_push_pos.load(std::memory_order_relaxed)};
+        for (std::uint32_t i {};; backoff(i++)) {
+            cell& c {m_cells[pos & m_mask]};
+            const std::uint64_t seq {c.seq.load(std::memory_order_acquire)};
+            if (seq == pos) { // Cell is free
+                if (!shared) {
+                    m_push_pos.store(pos+1, std::memory_order_relaxed);
+                } else if (!m_push_pos.compare_exchange_weak(pos, pos+1, std::memory_order_relaxed)) {
+                    continue; // Another producer took this position, pos was reloaded
+                }
+                c.idx = idx;
+                c.seq.store(pos+1, std::memory_order_release); // Publish to the popping side
+                return;
+            }
+            // The ring capacity is at least the number of slots, so a full cell can only be a concurrent push which is not done yet
+            pos = m_push_pos.load(std::memory_order_relaxed);
+        }
+    }
+
+    auto tensor_queue::ring::pop(std::uint32_t& idx, const bool shared) noexcept -> bool {
+        std::uint64_t pos {m_pop_pos.load(std::memory_order_relaxed)};
+        for (;;) {
+            cell& c {m_cells[pos & m_mask]};
+            const std::uint64_t seq {c.seq.load(std::memory_order_acquire)};
+            if (seq == pos+1) { // Cell holds an element
+                if (!shared) {
+                    m_pop_pos.store(pos+1, std::memory_order_relaxed);
+                } else if (!m_pop_pos.compare_exchange_weak(pos, pos+1, std::memory_order_relaxed)) {
+                    continue;
+                }
+                idx = c.idx;
+                c.seq.store(pos+m_mask+1, std::memory_order_release); // Free for the push one lap later
+                return true;
+            }
+            if (seq < pos+1) return false; // Empty
+            pos = m_pop_pos.load(std::memory_order_relaxed); // Another thread popped this position
+        }
+    }
+
+    tensor_queue::tensor_queue(isolate& ctx, const std::span<const dim> dims, const std::uint32_t num_slots, const producers mode)
+        : m_mode{mode}, m_num_slots{num_slots}, m_slots{std::make_unique<slot[]>(num_slots)}, m_free{num_slots}, m_ready{num_slots} {
+        rtml_assert(num_slots > 0 && !dims.empty() && dims.size() <= 4, "Invalid tensor queue config");
+        for (std::uint32_t i {}; i < num_slots; ++i) {
+            m_slots[i].input = ctx.new_tensor<dtypes::f32>(dims);
+            m_slots[i].input->format_name("queue slot {}", i);
+            m_slots[i].index = i;
+            m_free.push(i, false);
+        }
+    }
+
+    auto tensor_queue::try_acquire() noexcept -> slot* {
+        std::uint32_t idx;
+        return m_free.pop(idx, m_mode == producers::multi) ? &m_slots[idx] : nullptr;
+    }
+
+    auto tensor_queue::acquire() noexcept -> slot* {
+        for (std::uint32_t i {};; backoff(i++))
+            if (slot* const s {try_acquire()}) return s;
+    }
+
+    auto tensor_queue::publish(slot* const s) noexcept -> void {
+        s->published = std::chrono::steady_clock::now();
+        m_ready.push(s->index, m_mode == producers::multi);
+    }
+
+    auto tensor_queue::try_pop() noexcept -> slot* {
+        std::uint32_t idx;
+        return m_ready.pop(idx, false) ? &m_slots[idx] : nullptr;
+    }
+
+    auto tensor_queue::pop() noexcept -> slot* {
+        for (std::uint32_t i {};; backoff(i++))
+            if (slot* const s {try_pop()}) return s;
+    }
+
+    auto tensor_queue::recycle(slot* const s) noexcept -> void {
+        m_free.push(s->index, false);
+    }
+}
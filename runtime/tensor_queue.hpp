@@ -0,0 +1,83 @@
+// Copyright Mario "Neo" Sieg 2024. All rights reserved. mario.sieg.64@gmail.com
+// Lock free bounded handoff of input tensors from producer threads (capture, network) to the inference thread
+// All slots are tensors of one shape preallocated from the isolate pool: producers fill a free slot in place and publish it,
+// the consumer executes its graph on the slot and recycles it, there is no allocation and no lock after construction
+// Slot indices travel through two bounded rings of sequence numbered cells (Vyukov's bounded queue):
+// free slots from the consumer to the producers and filled slots from the producers to the consumer
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <span>
+
+#include "base.hpp"
+#include "tensor_base.hpp"
+
+namespace rtml {
+    class isolate;
+
+    class tensor_queue final {
+    public:
+        enum class producers {
+            single, // SPSC: one producer thread, ring positions are advanced without compare and swap
+            multi   // MPSC: any number of producer threads
+        };
+
+        struct slot final {
+            tensor<dtypes::f32>* input {};                        // Filled in place by the producer
+            std::uint32_t index {};                                 // Position in slots(), e.g. to select a graph built for this slot
+            std::uint64_t tag {};                                   // Free for the producer, e.g. a frame number
+            std::chrono::steady_clock::time_point published {};     // Set by publish
+        };
+
+        // num_slots input tensors of the given shape are allocated from the isolate
+        tensor_queue(isolate& ctx, std::span<const dim> dims, std::uint32_t num_slots, producers mode);
+        tensor_queue(const tensor_queue&) = delete;
+        tensor_queue(tensor_queue&&) = delete;
+        auto operator=(const tensor_queue&) -> tensor_queue& = delete;
+        auto operator=(tensor_queue&&) -> tensor_queue& = delete;
+        ~tensor_queue() = default;
+
+        // Producer side: take a free slot (nullptr if all slots are in flight), fill slot->input and hand it to the consumer
+        [[nodiscard]] auto try_acquire() noexcept -> slot*;
+        [[nodiscard]] auto acquire() noexcept -> slot*; // Spins until a slot is free
+        auto publish(slot* s) noexcept -> void;
+
+        // Consumer side (one thread): take the oldest published slot (nullptr if none) and return it to the producers when done
+        [[nodiscard]] auto try_pop() noexcept -> slot*;
+        [[nodiscard]] auto pop() noexcept -> slot*; // Spins until a slot was published
+        auto recycle(slot* s) noexcept -> void;
+
+        [[nodiscard]] auto slots() const noexcept -> std::span<slot> { return {m_slots.get(), m_num_slots}; }
+        [[nodiscard]] auto mode() const noexcept -> producers { return m_mode; }
+
+    private:
+        // Bounded ring of slot indices, the capacity is a power of two >= the number of slots so pushes never fail
+        class ring final {
+        public:
+            explicit ring(std::uint32_t capacity);
+            auto push(std::uint32_t idx, bool shared) noexcept -> void;                 // shared: other threads push concurrently
+            [[nodiscard]] auto pop(std::uint32_t& idx, bool shared) noexcept -> bool;   // shared: other threads pop concurrently
+
+        private:
+            struct alignas(64) cell final {
+                std::atomic<std::uint64_t> seq {};
+                std::uint32_t idx {};
+            };
+
+            const std::uint64_t m_mask;
+            std::unique_ptr<cell[]> m_cells;
+            alignas(64) std::atomic<std::uint64_t> m_push_pos {};
+            alignas(64) std::atomic<std::uint64_t> m_pop_pos {};
+        };
+
+        const producers m_mode;
+        const std::uint32_t m_num_slots;
+        std::unique_ptr<slot[]> m_slots;
+        ring m_free;    // Consumer -> producers
+        ring m_ready;   // Producers -> consumer
+    };
+}
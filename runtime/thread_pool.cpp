@@ -0,0 +1,197 @@
+// Copyright Mario "Neo" Sieg 2024. All rights reserved. mario.sieg.64@gmail.com
+// CPU backend only!
+// Fixed size pool of worker threads which run a kernel once per compute_ctx thread index
+// The calling thread participates as thread index 0, so a pool of N threads spawns N-1 workers
+
+#include "thread_pool.hpp"
+#include "gemm.hpp"
+
+#include <map>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+namespace rtml {
+    struct thread_pool::affinity_mask final {
+#ifdef __linux__
+        cpu_set_t set;
+#endif
+        bool valid;
+    };
+
+    thread_pool::thread_pool(const dim num_threads) : m_num_threads{std::max<dim>(1, num_threads)}, m_shared{m_num_threads} {
+        assign_domains({}, cpu_topology::system());
+        m_workers.reserve(m_num_threads-1);
+        for (dim i {1}; i < m_num_threads; ++i)
+            m_workers.emplace_back(&thread_pool::worker_entry, this, i);
+        rtml_log_info("Created thread pool with {} threads", m_num_threads);
+    }
+
+    thread_pool::~thread_pool() {
+        m_stop.store(true, std::memory_order_relaxed);
+        m_generation.fetch_add(1, std::memory_order_release);
+        m_generation.notify_all();
+        for (std::thread& worker : m_workers)
+            worker.join();
+    }
+
+    auto thread_pool::dispatch(kernel_function* const fn, void* const usr) -> void {
+        m_fn = fn;
+        m_usr = usr;
+        m_pending.store(m_num_threads-1, std::memory_order_relaxed);
+        m_shared.reset_calls(0);
+        m_generation.fetch_add(1, std::memory_order_release); // Publish kernel to workers
+        m_generation.notify_all();
+        (*fn)(usr, blas::compute_ctx{0, m_num_threads, &m_shared, m_domains[0]}); // Calling thread is thread 0
+        for (std::uint32_t i {}; m_pending.load(std::memory_order_acquire); ++i) { // Wait for workers
+            if (i < k_spin_iters) {
+                std::this_thread::yield();
+            } else {
+                const dim pending {m_pending.load(std::memory_order_acquire)};
+                if (!pending) break;
+                m_pending.wait(pending, std::memory_order_acquire);
+            }
+        }
+    }
+
+    auto thread_pool::worker_entry(const dim thread_idx) -> void {
+        std::uint32_t generation {}; // Not loaded from m_generation, the first dispatch may happen before this thread starts
+        for (;;) {
+            for (std::uint32_t i {}; m_generation.load(std::memory_order_acquire) == generation; ++i) { // Wait for next dispatch
+                if (i < k_spin_iters) std::this_thread::yield();
+                else m_generation.wait(generation, std::memory_order_acquire);
+            }
+            generation = m_generation.load(std::memory_order_acquire);
+            if (m_stop.load(std::memory_order_relaxed)) [[unlikely]]
+                return;
+            m_shared.reset_calls(thread_idx);
+            (*m_fn)(m_usr, blas::compute_ctx{thread_idx, m_num_threads, &m_shared, m_domains[thread_idx]});
+            if (m_pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                m_pending.notify_one();
+        }
+    }
+
+    // Pins the calling thread to a single CPU
+    static auto pin_thread(const int core) noexcept -> bool {
+#ifdef __linux__
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(core, &set);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0) return true;
+        rtml_log_warn("Failed to pin thread to core {}", core);
+#endif
+        return false;
+    }
+
+    // Saves the CPU affinity of the calling thread
+    static auto save_affinity(auto& mask) noexcept -> void {
+#ifdef __linux__
+        mask.valid = pthread_getaffinity_np(pthread_self(), sizeof(mask.set), &mask.set) == 0;
+#else
+        mask.valid = false;
+#endif
+    }
+
+    // Restores a saved CPU affinity of the calling thread
+    static auto restore_affinity(const auto& mask) noexcept -> void {
+#ifdef __linux__
+        if (mask.valid && pthread_setaffinity_np(pthread_self(), sizeof(mask.set), &mask.set) != 0) {
+            rtml_log_warn("Failed to restore thread affinity");
+        }
+#endif
+    }
+
+    // Applies the scheduling policy to the calling thread, pinned is set to false if the thread could not be pinned to core
+    static auto apply_thread_policy(const int fifo_priority, const int core, bool& pinned) noexcept -> thread_priority {
+        pinned = core < 0;
+#ifdef __linux__
+        if (core >= 0)
+            pinned = pin_thread(core);
+        const sched_param param {.sched_priority=std::clamp(fifo_priority, sched_get_priority_min(SCHED_FIFO), sched_get_priority_max(SCHED_FIFO))};
+        if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0)
+            return thread_priority::realtime;
+        static constexpr int k_fallback_nice {-10};
+        if (setpriority(PRIO_PROCESS, static_cast<id_t>(gettid()), k_fallback_nice) == 0) // Per thread on Linux
+            return thread_priority::elevated;
+#endif
+        return thread_priority::normal;
+    }
+
+    // Threads on CPUs of the same L3 domain form a cache domain, domains are numbered in order of their first thread
+    // Without placement (no pinning) all threads are one domain and there is no shared scratch, kernels use private buffers
+    auto thread_pool::assign_domains(const std::span<const int> cpus, const cpu_topology& topology) -> void {
+        std::vector<dim> domain_of(m_num_threads);
+        std::map<dim, dim> ids {};
+        for (dim i {}; i < m_num_threads && !cpus.empty(); ++i) {
+            const cpu_info* const info {topology.find(cpus[i % cpus.size()])};
+            domain_of[i] = ids.try_emplace(info ? info->l3 : 0, static_cast<dim>(ids.size())).first->second;
+        }
+        const dim count {std::max<dim>(1, static_cast<dim>(ids.size()))};
+        std::vector<dim> sizes(count), first(count);
+        for (const dim d : domain_of) ++sizes[d];
+        for (dim d {1}; d < count; ++d) first[d] = first[d-1] + sizes[d-1];
+        m_domains.assign(m_num_threads, {});
+        std::vector<dim> next(count);
+        for (dim i {}; i < m_num_threads; ++i) {
+            const dim d {domain_of[i]};
+            m_domains[i] = {.idx=d, .count=count, .thread_idx=next[d], .num_threads=sizes[d], .rank=first[d] + next[d]};
+            ++next[d];
+        }
+        m_shared.set_domains(count, m_num_threads > 1 && !cpus.empty() ? blas::k_gemm_domain_scratch : 0);
+    }
+
+    auto thread_pool::pin(const pin_policy policy, const cpu_topology& topology) -> bool {
+        const std::vector<int> cpus {topology.placement(policy, m_num_threads)};
+        if (cpus.empty()) {
+            unpin();
+            return true;
+        }
+        const bool save {!m_saved_affinity};
+        if (save) m_saved_affinity = std::make_unique<affinity_mask[]>(m_num_threads);
+        std::atomic_bool pinned {true};
+        parallel_for([&](const blas::compute_ctx& ctx) {
+            if (save) save_affinity(m_saved_affinity[ctx.thread_idx]);
+            if (!pin_thread(cpus[ctx.thread_idx])) pinned.store(false, std::memory_order_relaxed);
+        });
+        // After the dispatch, the domains of a dispatch must not change while it runs
+        // Threads which are not pinned may migrate across L3 domains, so domains and shared scratch require all threads pinned
+        const bool all_pinned {pinned.load(std::memory_order_relaxed)};
+        if (all_pinned) assign_domains(cpus, topology);
+        else assign_domains({}, topology);
+        return all_pinned;
+    }
+
+    auto thread_pool::unpin() -> void {
+        if (m_saved_affinity) {
+            parallel_for([this](const blas::compute_ctx& ctx) { restore_affinity(m_saved_affinity[ctx.thread_idx]); });
+            m_saved_affinity.reset();
+        }
+        assign_domains({}, cpu_topology::system());
+    }
+
+    auto thread_pool::set_realtime(const int fifo_priority, const std::span<const int> cores) -> thread_priority {
+        std::atomic<thread_priority> worst {thread_priority::realtime};
+        std::atomic_bool all_pinned {true};
+        parallel_for([&](const blas::compute_ctx& ctx) {
+            const int core {cores.empty() ? -1 : cores[ctx.thread_idx % cores.size()]};
+            bool pinned;
+            const thread_priority p {apply_thread_policy(fifo_priority, core, pinned)};
+            if (!pinned) all_pinned.store(false, std::memory_order_relaxed);
+            thread_priority cur {worst.load(std::memory_order_relaxed)};
+            while (p > cur && !worst.compare_exchange_weak(cur, p, std::memory_order_relaxed));
+        });
+        if (!cores.empty()) { // Domains only for cores which were applied, see pin
+            if (all_pinned.load(std::memory_order_relaxed)) assign_domains(cores, cpu_topology::system());
+            else assign_domains({}, cpu_topology::system());
+        }
+        const thread_priority result {worst.load(std::memory_order_relaxed)};
+        if (result != thread_priority::realtime) {
+            rtml_log_warn("SCHED_FIFO not permitted, thread pool runs with {} priority", result == thread_priority::elevated ? "elevated" : "normal");
+        }
+        return result;
+    }
+}
@@ -0,0 +1,98 @@
+// Copyright Mario "Neo" Sieg 2024. All rights reserved. mario.sieg.64@gmail.com
+// CPU backend only!
+// Fixed size pool of worker threads which run a kernel once per compute_ctx thread index
+// The calling thread participates as thread index 0, so a pool of N threads spawns N-1 workers
+
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <span>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "base.hpp"
+#include "blas.hpp"
+#include "topology.hpp"
+
+namespace rtml {
+    // Scheduling class applied by thread_pool::set_realtime, ordered from best to worst
+    enum class thread_priority {
+        realtime,   // SCHED_FIFO
+        elevated,   // Negative nice value (SCHED_OTHER), when SCHED_FIFO is not permitted
+        normal      // Unchanged, when neither is permitted
+    };
+
+    class thread_pool final {
+    public:
+        using kernel_function = auto (void* usr, const blas::compute_ctx& ctx) -> void;
+
+        explicit thread_pool(dim num_threads = static_cast<dim>(std::thread::hardware_concurrency()));
+        thread_pool(const thread_pool&) = delete;
+        thread_pool(thread_pool&&) = delete;
+        auto operator=(const thread_pool&) -> thread_pool& = delete;
+        auto operator=(thread_pool&&) -> thread_pool& = delete;
+        ~thread_pool();
+
+        [[nodiscard]] auto num_threads() const noexcept -> dim { return m_num_threads; }
+
+        // Pins the threads to the CPUs selected by the policy and groups them into the L3 cache domains of the topology
+        // The threads of a domain then pack GEMM panels together (see blas::matmul), pin_policy::none is unpin()
+        // The CPU affinity of every thread is saved by the first pin and restored by unpin
+        // Thread 0 is the calling thread, so this must be called from the thread which dispatches the kernels
+        // Returns false if a thread could not be pinned (e.g. the CPU is not in the affinity mask of the process),
+        // the pool is a single domain without shared scratch then
+        auto pin(pin_policy policy, const cpu_topology& topology = cpu_topology::system()) -> bool;
+        // Restores the CPU affinity the threads had before the first pin, the pool is a single domain without shared scratch again
+        // Must be called from the same thread as pin
+        auto unpin() -> void;
+        [[nodiscard]] auto domain(const dim thread_idx) const noexcept -> const blas::cache_domain& { return m_domains[thread_idx]; }
+
+        // Row schedule of the row partitioned kernels (element wise ops) of all following dispatches, see blas::row_schedule
+        auto set_schedule(const blas::row_schedule schedule) noexcept -> void { m_shared.schedule = schedule; }
+        [[nodiscard]] auto schedule() const noexcept -> blas::row_schedule { return m_shared.schedule; }
+
+        // Pins thread i to cores[i % cores.size()] (no pinning if empty) and raises the priority of all threads
+        // The threads are grouped into cache domains like pin only if all of them could be pinned
+        // Applies SCHED_FIFO with fifo_priority if permitted, otherwise falls back to a negative nice value
+        // Thread 0 is the calling thread, so this must be called from the thread which dispatches the kernels
+        // Returns the worst scheduling class applied to any thread
+        auto set_realtime(int fifo_priority, std::span<const int> cores) -> thread_priority;
+
+        // Invokes kernel(compute_ctx{i, num_threads}) for every thread index i and blocks until all invocations returned
+        template <typename F> requires std::is_invocable_v<F, const blas::compute_ctx&>
+        auto parallel_for(F&& kernel) -> void {
+            if (m_num_threads == 1) {
+                std::invoke(kernel, blas::compute_ctx{0, 1});
+                return;
+            }
+            dispatch(
+                [](void* const usr, const blas::compute_ctx& ctx) -> void {
+                    std::invoke(*static_cast<std::remove_reference_t<F>*>(usr), ctx);
+                },
+                const_cast<void*>(static_cast<const void*>(&kernel))
+            );
+        }
+
+    private:
+        static constexpr std::uint32_t k_spin_iters {1<<12}; // Busy wait iterations before blocking
+
+        auto dispatch(kernel_function* fn, void* usr) -> void;
+        auto assign_domains(std::span<const int> cpus, const cpu_topology& topology) -> void;
+        struct affinity_mask; // Saved CPU affinity of one thread, platform specific
+        auto worker_entry(dim thread_idx) -> void;
+
+        const dim m_num_threads;
+        blas::compute_shared m_shared;
+        std::vector<blas::cache_domain> m_domains {}; // Per thread
+        std::unique_ptr<affinity_mask[]> m_saved_affinity {}; // Per thread, nullptr if the pool was never pinned
+        std::vector<std::thread> m_workers {};
+        kernel_function* m_fn {};
+        void* m_usr {};
+        alignas(64) std::atomic_uint32_t m_generation {}; // Incremented for every dispatch, workers wait for changes
+        alignas(64) std::atomic<dim> m_pending {}; // Number of workers which have not finished the current dispatch
+        std::atomic_bool m_stop {};
+    };
+}
@@ -0,0 +1,161 @@
+// Copyright Mario "Neo" Sieg 2024. All rights reserved. mario.sieg.64@gmail.com
+// CPU topology discovery and thread placement
+// Packages (sockets), physical cores, SMT siblings and the CPUs which share an L2 or L3 cache are read from sysfs (Linux),
+// other systems get a flat topology (one package, one L3 domain, no SMT)
+// Placement policies map pool threads to CPUs, the thread pool derives the cache domains of compute_ctx from the placement
+
+#include "topology.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <map>
+#include <optional>
+#include <string>
+#include <thread>
+#include <tuple>
+
+namespace rtml {
+    // Parses a sysfs CPU list like "0-3,8,10-11"
+    [[nodiscard]] static auto parse_cpu_list(const std::string& list) -> std::vector<int> {
+        std::vector<int> cpus {};
+        std::size_t pos {};
+        while (pos < list.size()) {
+            std::size_t end {list.find(',', pos)};
+            if (end == std::string::npos) end = list.size();
+            const std::string range {list.substr(pos, end - pos)};
+            if (!range.empty()) {
+                const std::size_t dash {range.find('-')};
+                const int first {std::stoi(range.substr(0, dash))};
+                const int last {dash == std::string::npos ? first : std::stoi(range.substr(dash+1))};
+                for (int c {first}; c <= last; ++c)
+                    cpus.emplace_back(c);
+            }
+            pos = end + 1;
+        }
+        return cpus;
+    }
+
+    [[nodiscard]] static auto read_line(const std::filesystem::path& path) -> std::optional<std::string> {
+        std::ifstream in {path};
+        std::string line {};
+        if (!in || !std::getline(in, line)) return std::nullopt;
+        while (!line.empty() && std::isspace(static_cast<unsigned char>(line.back()))) line.pop_back();
+        return line;
+    }
+
+    // Lowest CPU which shares the unified or data cache of the given level with cpu, -1 if there is no such cache
+    [[nodiscard]] static auto cache_leader(const std::filesystem::path& cpu_dir, const int level) -> int {
+        std::error_code ec {};
+        for (const auto& entry : std::filesystem::directory_iterator{cpu_dir / "cache", ec}) {
+            if (!entry.path().filename().string().starts_with("index")) continue;
+            const auto lvl {read_line(entry.path() / "level")};
+            const auto type {read_line(entry.path() / "type")};
+            const auto shared {read_line(entry.path() / "shared_cpu_list")};
+            if (!lvl || !type || !shared || std::stoi(*lvl) != level || *type == "Instruction") continue;
+            const std::vector<int> cpus {parse_cpu_list(*shared)};
+            if (!cpus.empty()) return *std::ranges::min_element(cpus);
+        }
+        return -1;
+    }
+
+    auto cpu_topology::discover(const std::filesystem::path& root) -> cpu_topology {
+        const auto online {read_line(root / "online")};
+        if (!online) [[unlikely]]
+            return flat(static_cast<dim>(std::max(1u, std::thread::hardware_concurrency())));
+        cpu_topology topo {};
+        std::map<std::pair<dim, dim>, dim> cores {}; // (package, core_id) -> first CPU, core ids are only unique per package
+        try {
+            for (const int cpu : parse_cpu_list(*online)) {
+                const std::filesystem::path dir {root / ("cpu" + std::to_string(cpu))};
+                const auto package {read_line(dir / "topology" / "physical_package_id")};
+                const auto core {read_line(dir / "topology" / "core_id")};
+                cpu_info info {.cpu=cpu};
+                info.package = package ? std::max(0, std::stoi(*package)) : 0;
+                const dim core_id {core ? std::stoi(*core) : cpu};
+                info.core = cores.try_emplace({info.package, core_id}, cpu).first->second;
+                const int l2 {cache_leader(dir, 2)};
+                const int l3 {cache_leader(dir, 3)};
+                info.l2 = l2 >= 0 ? l2 : info.core;
+                info.l3 = l3 >= 0 ? l3 : -1 - info.package; // Package as domain, negative so it can not collide with CPU ids
+                topo.m_cpus.emplace_back(info);
+            }
+        } catch (const std::exception&) { // Malformed sysfs content
+            return flat(static_cast<dim>(std::max(1u, std::thread::hardware_concurrency())));
+        }
+        if (topo.m_cpus.empty()) [[unlikely]]
+            return flat(1);
+        topo.finalize();
+        return topo;
+    }
+
+    auto cpu_topology::flat(const dim num_cpus) -> cpu_topology {
+        cpu_topology topo {};
+        for (dim i {}; i < num_cpus; ++i)
+            topo.m_cpus.emplace_back(cpu_info{.cpu=static_cast<int>(i), .core=i, .l2=i});
+        topo.finalize();
+        return topo;
+    }
+
+    auto cpu_topology::system() -> const cpu_topology& {
+        static const cpu_topology s_topology {discover()};
+        return s_topology;
+    }
+
+    auto cpu_topology::finalize() -> void {
+        std::ranges::sort(m_cpus, {}, &cpu_info::cpu);
+        const auto densify {[this](dim cpu_info::* const field) -> dim { // Ids in order of first appearance (lowest CPU)
+            std::map<dim, dim> ids {};
+            for (cpu_info& c : m_cpus)
+                c.*field = ids.try_emplace(c.*field, static_cast<dim>(ids.size())).first->second;
+            return static_cast<dim>(ids.size());
+        }};
+        m_num_packages = densify(&cpu_info::package);
+        m_num_cores = densify(&cpu_info::core);
+        m_num_l2 = densify(&cpu_info::l2);
+        m_num_l3 = densify(&cpu_info::l3);
+        std::vector<dim> siblings(m_num_cores);
+        for (cpu_info& c : m_cpus)
+            c.smt = siblings[c.core]++;
+    }
+
+    auto cpu_topology::find(const int cpu) const noexcept -> const cpu_info* {
+        const auto it {std::ranges::lower_bound(m_cpus, cpu, {}, &cpu_info::cpu)};
+        return it != m_cpus.end() && it->cpu == cpu ? &*it : nullptr;
+    }
+
+    auto cpu_topology::placement(const pin_policy policy, const dim num_threads) const -> std::vector<int> {
+        if (policy == pin_policy::none || num_threads <= 0) return {};
+        std::vector<cpu_info> order {m_cpus};
+        const auto compact_key {[](const cpu_info& c) { return std::tuple{c.package, c.l3, c.l2, c.core, c.smt}; }};
+        switch (policy) {
+            case pin_policy::compact:
+                std::ranges::sort(order, {}, compact_key);
+                break;
+            case pin_policy::physical:
+                std::erase_if(order, [](const cpu_info& c) { return c.smt != 0; });
+                std::ranges::sort(order, {}, compact_key);
+                break;
+            case pin_policy::scatter: {
+                // Round robin over packages, then over the L3 domains of a package, then over the cores of a domain
+                std::map<dim, dim> core_rank {};  // Core -> rank within its L3 domain
+                std::map<dim, dim> l3_rank {};    // L3 domain -> rank within its package
+                std::map<dim, dim> next_core {}, next_l3 {};
+                std::ranges::sort(order, {}, compact_key);
+                for (const cpu_info& c : order) {
+                    if (!core_rank.contains(c.core)) core_rank[c.core] = next_core[c.l3]++;
+                    if (!l3_rank.contains(c.l3)) l3_rank[c.l3] = next_l3[c.package]++;
+                }
+                std::ranges::sort(order, {}, [&](const cpu_info& c) {
+                    return std::tuple{c.smt, core_rank[c.core], l3_rank[c.l3], c.package};
+                });
+                break;
+            }
+            default: return {};
+        }
+        std::vector<int> cpus(num_threads);
+        for (dim i {}; i < num_threads; ++i)
+            cpus[i] = order[i % order.size()].cpu;
+        return cpus;
+    }
+}
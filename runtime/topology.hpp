@@ -0,0 +1,60 @@
+// Copyright Mario "Neo" Sieg 2024. All rights reserved. mario.sieg.64@gmail.com
+// CPU topology discovery and thread placement
+// Packages (sockets), physical cores, SMT siblings and the CPUs which share an L2 or L3 cache are read from sysfs (Linux),
+// other systems get a flat topology (one package, one L3 domain, no SMT)
+// Placement policies map pool threads to CPUs, the thread pool derives the cache domains of compute_ctx from the placement
+
+#pragma once
+
+#include <filesystem>
+#include <span>
+#include <vector>
+
+#include "base.hpp"
+#include "tensor_base.hpp"
+
+namespace rtml {
+    enum class pin_policy {
+        none,       // Threads are not pinned, the pool is a single cache domain
+        compact,    // Fill SMT siblings, then cores of the same L3 domain, then the next domain and package
+        scatter,    // Spread threads over packages and L3 domains first, SMT siblings are used last
+        physical    // One thread per physical core in compact order, SMT siblings are never used
+    };
+
+    // Domain ids are dense (0 - count-1) and ordered by the lowest CPU of the domain
+    struct cpu_info final {
+        int cpu {};         // OS CPU id
+        dim package {};
+        dim core {};        // Physical core, unique over all packages
+        dim smt {};         // Rank among the SMT siblings of the core, 0 for the first hardware thread
+        dim l2 {};          // L2 cache domain
+        dim l3 {};          // Last level cache domain, the package if there is no L3
+    };
+
+    class cpu_topology final {
+    public:
+        // Reads the online CPUs below root (e.g. /sys/devices/system/cpu), falls back to flat() if it can not be read
+        [[nodiscard]] static auto discover(const std::filesystem::path& root = "/sys/devices/system/cpu") -> cpu_topology;
+        [[nodiscard]] static auto flat(dim num_cpus) -> cpu_topology;
+        [[nodiscard]] static auto system() -> const cpu_topology&; // Discovered once
+
+        [[nodiscard]] auto cpus() const noexcept -> std::span<const cpu_info> { return m_cpus; }
+        [[nodiscard]] auto find(int cpu) const noexcept -> const cpu_info*;
+        [[nodiscard]] auto num_packages() const noexcept -> dim { return m_num_packages; }
+        [[nodiscard]] auto num_cores() const noexcept -> dim { return m_num_cores; }
+        [[nodiscard]] auto num_l2_domains() const noexcept -> dim { return m_num_l2; }
+        [[nodiscard]] auto num_l3_domains() const noexcept -> dim { return m_num_l3; }
+
+        // CPU of every pool thread, threads wrap around if there are more threads than CPUs, empty for pin_policy::none
+        [[nodiscard]] auto placement(pin_policy policy, dim num_threads) const -> std::vector<int>;
+
+    private:
+        auto finalize() -> void; // Makes the domain ids dense and computes the counts
+
+        std::vector<cpu_info> m_cpus {}; // Ascending CPU ids
+        dim m_num_packages {};
+        dim m_num_cores {};
+        dim m_num_l2 {};
+        dim m_num_l3 {};
+    };
+}
@@ -0,0 +1,85 @@
+// Copyright Mario "Neo" Sieg 2024. All rights reserved. mario.sieg.64@gmail.com
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include <attention.hpp>
+#include <isolate.hpp>
+#include <tensor.hpp>
+#include <thread_pool.hpp>
+
+using namespace rtml;
+
+// Reference attention which materializes all scores of a query row
+static auto reference(const tensor<>& q, const tensor<>& k, const tensor<>& v, const blas::attention_params& params, const dim b, const dim h, const dim i) -> std::vector<float> {
+    const dim head_dim {q.dims()[0]};
+    const dim seq_kv {k.dims()[1]};
+    const dim kvh {h / (q.dims()[2] / k.dims()[2])};
+    const dim visible {params.causal ? std::clamp<dim>(i + seq_kv - q.dims()[1] + 1, 0, seq_kv) : seq_kv};
+    std::vector<float> o(head_dim);
+    if (!visible) return o;
+    std::vector<float> s(visible);
+    float max {-INFINITY};
+    for (dim j {}; j < visible; ++j) {
+        float dot {};
+        for (dim d {}; d < head_dim; ++d) dot += q({d, i, h, b})*k({d, j, kvh, b});
+        s[j] = dot*params.scale;
+        max = std::max(max, s[j]);
+    }
+    float sum {};
+    for (float& x : s) sum += x = std::exp(x - max);
+    for (dim j {}; j < visible; ++j)
+        for (dim d {}; d < head_dim; ++d)
+            o[d] += s[j]/sum*v({d, j, kvh, b});
+    return o;
+}
+
+static auto check_attention(const dim head_dim, const dim seq_q, const dim seq_kv, const dim heads, const dim kv_heads, const dim batch, const bool causal, const dim threads) -> void {
+    auto ctx {isolate::create("attention_test", isolate::compute_device::cpu, 0x1000<<10)};
+    tensor<>* const q {ctx->new_tensor<float>({head_dim, seq_q, heads, batch})};
+    tensor<>* const k {ctx->new_tensor<float>({head_dim, seq_kv, kv_heads, batch})};
+    tensor<>* const v {ctx->new_tensor<float>({head_dim, seq_kv, kv_heads, batch})};
+    tensor<>* const r {ctx->new_tensor<float>({head_dim, seq_q, heads, batch})};
+    std::mt19937 prng {static_cast<std::mt19937::result_type>(seq_q*seq_kv)};
+    std::uniform_real_distribution<float> dist {-1.0f, 1.0f};
+    for (tensor<>* const t : {q, k, v})
+        for (float& x : t->data()) x = dist(prng);
+    ASSERT_EQ(blas::validate_attention(*r, *q, *k, *v), nullptr);
+    const blas::attention_params params {.scale=1.0f / std::sqrt(static_cast<float>(head_dim)), .causal=causal};
+    thread_pool pool {threads};
+    pool.parallel_for([&](const blas::compute_ctx& cctx) { blas::attention(cctx, *r, *q, *k, *v, params); });
+    for (dim b {}; b < batch; ++b)
+        for (dim h {}; h < heads; ++h)
+            for (dim i {}; i < seq_q; ++i) {
+                const std::vector<float> o {reference(*q, *k, *v, params, b, h, i)};
+                for (dim d {}; d < head_dim; ++d)
+                    ASSERT_NEAR((*r)({d, i, h, b}), o[d], 1e-4f) << "b=" << b << " h=" << h << " i=" << i << " d=" << d;
+            }
+}
+
+TEST(attention, single_tile) {
+    check_attention(16, 8, 8, 1, 1, 1, false, 1);
+}
+
+TEST(attention, multiple_tiles) {
+    check_attention(32, 150, 200, 2, 2, 2, false, 3);
+}
+
+TEST(attention, causal) {
+    check_attention(32, 130, 130, 2, 1, 1, true, 2);
+}
+
+TEST(attention, causal_decode_offset) { // Fewer queries than keys, queries are aligned to the end of the keys
+    check_attention(16, 5, 100, 4, 2, 1, true, 2);
+}
+
+TEST(attention, rejects_mismatch) {
+    auto ctx {isolate::create("attention_test", isolate::compute_device::cpu, 0x1000<<4)};
+    tensor<>* const q {ctx->new_tensor<float>({16, 4, 3, 1})};
+    tensor<>* const k {ctx->new_tensor<float>({16, 8, 2, 1})};
+    tensor<>* const r {ctx->new_tensor<float>({16, 4, 3, 1})};
+    ASSERT_NE(blas::validate_attention(*r, *q, *k, *k), nullptr); // 3 heads are not a multiple of 2
+}
@@ -0,0 +1,76 @@
+// Copyright Mario "Neo" Sieg 2024. All rights reserved. mario.sieg.64@gmail.com
+
+#include <gtest/gtest.h>
+
+#include <batch_scheduler.hpp>
+#include <graph.hpp>
+#include <isolate.hpp>
+#include <tensor.hpp>
+
+using namespace rtml;
+
+static constexpr dim k_in {16};
+static constexpr dim k_out {8};
+
+// relu(x @ W + b) with x = [k_in, batch], W = [k_out, k_in] filled with 1 / k_in, b = 1
+static auto build_linear(isolate& ctx, const dim batch) -> batch_graph {
+    batch_graph g {};
+    tensor<>* const w {ctx.new_tensor<float>({k_out, k_in})};
+    tensor<>* const b {ctx.new_tensor<float>({k_out, 1})};
+    w->splat(1.0f / static_cast<float>(k_in));
+    b->splat(1.0f);
+    g.input = ctx.new_tensor<float>({k_in, batch});
+    tensor<>* const mm {ctx.new_tensor<float>({k_out, batch})};
+    tensor<>* const add {ctx.new_tensor<float>({k_out, batch})};
+    g.output = ctx.new_tensor<float>({k_out, batch});
+    (void)g.exec.push({graph::opcode::matmul, mm, g.input, w});
+    (void)g.exec.push({graph::opcode::add, add, mm, b});
+    (void)g.exec.push({graph::opcode::relu, g.output, add, nullptr});
+    return g;
+}
+
+TEST(batch_scheduler, single_request) {
+    auto ctx {isolate::create("batch_test", isolate::compute_device::cpu, 0x1000<<8)};
+    batch_scheduler sched {ctx, &build_linear, {.max_batch=8, .max_wait=std::chrono::microseconds{100}, .num_threads=2}};
+    ASSERT_EQ(sched.sample_input_size(), k_in);
+    ASSERT_EQ(sched.sample_output_size(), k_out);
+    std::array<float, k_in> x {};
+    std::array<float, k_out> y {};
+    x.fill(2.0f);
+    const request_timing t {sched.run(x, y)};
+    ASSERT_EQ(t.batch_size, 1);
+    for (const float v : y)
+        ASSERT_FLOAT_EQ(v, 3.0f);
+    ASSERT_EQ(sched.stats().requests, 1);
+    ASSERT_EQ(sched.stats().batches, 1);
+}
+
+TEST(batch_scheduler, concurrent_requests_are_batched) {
+    auto ctx {isolate::create("batch_test", isolate::compute_device::cpu, 0x1000<<8)};
+    batch_scheduler sched {ctx, &build_linear, {.max_batch=8, .max_wait=std::chrono::milliseconds{20}, .num_threads=1}};
+    constexpr int k_clients {8};
+    constexpr int k_requests {16};
+    std::vector<std::thread> clients {};
+    std::atomic_int errors {};
+    for (int c {}; c < k_clients; ++c) {
+        clients.emplace_back([&, c] {
+            for (int r {}; r < k_requests; ++r) {
+                const auto v {static_cast<float>(c*k_requests + r)};
+                std::array<float, k_in> x {};
+                std::array<float, k_out> y {};
+                x.fill(v);
+                const request_timing t {sched.run(x, y)};
+                if (t.batch_size < 1 || t.batch_size > 8) ++errors;
+                for (const float o : y) // Every request gets its own result back
+                    if (o != v + 1.0f) ++errors;
+            }
+        });
+    }
+    for (std::thread& t : clients)
+        t.join();
+    ASSERT_EQ(errors.load(), 0);
+    const batch_stats stats {sched.stats()};
+    ASSERT_EQ(stats.requests, k_clients*k_requests);
+    ASSERT_LT(stats.batches, stats.requests); // Concurrent requests share graph runs
+    ASSERT_GT(stats.mean_batch_size(), 1.0);
+}
@@ -3,9 +3,16 @@
 #include <gtest/gtest.h>
 
 #include <blas.hpp>
+#include <graph.hpp>
 #include <isolate.hpp>
 #include <tensor.hpp>
+#include <thread_pool.hpp>
 
+#include "test_util.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
 #include <vector>
 #include <random>
 
@@ -209,3 +216,347 @@ TEST(blas, tensor_matmul2) {
         ASSERT_FLOAT_EQ((*c)(i), result[i]);
     }
 }
+
+TEST(blas, tensor_matmul_rect) {
+    constexpr dim M {3}, N {5}, K {4};
+    auto ctx = isolate::create("test", isolate::compute_device::cpu, 0x1000<<3);
+    tensor<float>* a = ctx->new_tensor<float>({K, M});
+    tensor<float>* b = ctx->new_tensor<float>({N, K});
+    tensor<float>* c = ctx->new_tensor<float>({N, M});
+    for (dim i {}; i < K*M; ++i) (*a)(i) = static_cast<float>(i % 7) - 3.0f;
+    for (dim i {}; i < N*K; ++i) (*b)(i) = static_cast<float>(i % 5) * 0.5f;
+    blas::compute_ctx cctx {};
+    blas::matmul(cctx, *c, *a, *b);
+    for (dim m {}; m < M; ++m) {
+        for (dim n {}; n < N; ++n) {
+            float acc {};
+            for (dim k {}; k < K; ++k)
+                acc += (*a)({k, m, 0, 0}) * (*b)({n, k, 0, 0});
+            ASSERT_FLOAT_EQ((*c)({n, m, 0, 0}), acc);
+        }
+    }
+}
+
+TEST(blas, tensor_softmax) {
+    auto ctx = isolate::create("test", isolate::compute_device::cpu, 0x1000<<3);
+    tensor<float>* a = ctx->new_tensor<float>({16, 7, 3});
+    tensor<float>* c = ctx->new_tensor<float>({16, 7, 3});
+    std::mt19937_64 prng {};
+    std::uniform_real_distribution<float> dist{-4.0f, 4.0f};
+    for (float& v : a->data()) v = dist(prng);
+    for (dim t {}; t < 3; ++t) // Rows are partitioned across threads
+        blas::softmax(blas::compute_ctx{t, 3}, *c, *a);
+    for (dim row {}; row < 7*3; ++row) {
+        float sum {};
+        float max {-std::numeric_limits<float>::infinity()};
+        for (dim i {}; i < 16; ++i)
+            max = std::max(max, (*a)(row*16 + i));
+        for (dim i {}; i < 16; ++i)
+            sum += std::exp((*a)(row*16 + i) - max);
+        for (dim i {}; i < 16; ++i)
+            ASSERT_NEAR((*c)(row*16 + i), std::exp((*a)(row*16 + i) - max) / sum, 1e-6f);
+    }
+}
+
+TEST(blas, tensor_relu) {
+    auto ctx = isolate::create("test", isolate::compute_device::cpu, 0x1000<<3);
+    tensor<float>* a = ctx->new_tensor<float>({8, 4});
+    tensor<float>* c = ctx->new_tensor<float>({8, 4});
+    for (dim i {}; i < 32; ++i) (*a)(i) = static_cast<float>(i) - 16.0f;
+    blas::compute_ctx cctx {};
+    blas::relu(cctx, *c, *a);
+    for (dim i {}; i < 32; ++i)
+        ASSERT_FLOAT_EQ((*c)(i), std::max((*a)(i), 0.0f));
+}
+
+// Reference reduction of x along axis into r (same shape with size 1 in axis)
+static auto reference_reduce(const tensor<float>& x, const dim axis, const char op) -> std::vector<float> {
+    std::array<dim, tensor<>::k_max_dims> rd {x.dims()};
+    rd[axis] = 1;
+    std::vector<float> out(rd[0]*rd[1]*rd[2]*rd[3]);
+    for (dim i3 {}; i3 < rd[3]; ++i3) for (dim i2 {}; i2 < rd[2]; ++i2) for (dim i1 {}; i1 < rd[1]; ++i1) for (dim i0 {}; i0 < rd[0]; ++i0) {
+        double sum {};
+        float max {-INFINITY}, min {INFINITY};
+        dim arg {};
+        for (dim k {}; k < x.dims()[axis]; ++k) {
+            std::array<dim, tensor<>::k_max_dims> idx {i0, i1, i2, i3};
+            idx[axis] = k;
+            const float v {x(idx)};
+            sum += v;
+            if (v > max) { max = v; arg = k; }
+            min = std::min(min, v);
+        }
+        float r {};
+        switch (op) {
+            case 's': r = static_cast<float>(sum); break;
+            case 'm': r = static_cast<float>(sum / static_cast<double>(x.dims()[axis])); break;
+            case '>': r = max; break;
+            case '<': r = min; break;
+            default: r = static_cast<float>(arg); break;
+        }
+        out[((i3*rd[2] + i2)*rd[1] + i1)*rd[0] + i0] = r;
+    }
+    return out;
+}
+
+static auto check_reductions(const std::array<dim, tensor<>::k_max_dims>& shape, const dim threads) -> void {
+    auto ctx {isolate::create("test", isolate::compute_device::cpu, 0x1000<<10)};
+    tensor<float>* const x {ctx->new_tensor<float>(shape)};
+    std::mt19937_64 prng {};
+    std::uniform_real_distribution<float> dist {-1.0f, 1.0f};
+    for (float& v : x->data()) v = dist(prng);
+    thread_pool pool {threads};
+    for (dim axis {}; axis < static_cast<dim>(tensor<>::k_max_dims); ++axis) {
+        std::array<dim, tensor<>::k_max_dims> rd {shape};
+        rd[axis] = 1;
+        tensor<float>* const r {ctx->new_tensor<float>(rd)};
+        ASSERT_EQ(blas::reduction_axis(*r, *x), shape[axis] == 1 ? std::ranges::find(shape, 1) - shape.begin() : axis);
+        const auto run {[&](auto* const op, const char ref, const float eps) {
+            pool.parallel_for([&](const blas::compute_ctx& cctx) { op(cctx, *r, *x); });
+            const std::vector<float> expected {reference_reduce(*x, axis, ref)};
+            for (dim i {}; i < r->elem_count(); ++i)
+                ASSERT_NEAR((*r)(i), expected[i], eps) << "axis " << axis << " op " << ref << " i " << i;
+        }};
+        const float sum_eps {1e-6f*static_cast<float>(shape[axis]) + 1e-5f};
+        run(&blas::sum, 's', sum_eps);
+        run(&blas::mean, 'm', 1e-5f);
+        run(&blas::max, '>', 0.0f);
+        run(&blas::min, '<', 0.0f);
+        run(&blas::argmax, 'a', 0.0f);
+    }
+}
+
+TEST(blas, tensor_reduce_axes) {
+    check_reductions({37, 5, 3, 2}, 1);
+    check_reductions({300, 7, 4, 3}, 3);
+}
+
+TEST(blas, tensor_reduce_split_rows) { // Few long rows are split across threads and combined
+    check_reductions({100003, 3, 1, 1}, 4);
+}
+
+TEST(blas, tensor_reduce_split_rows_multiple_per_dispatch) { // Threads leaving one split reduction must not clobber its partials
+    auto ctx {isolate::create("test", isolate::compute_device::cpu, 0x1000<<10)};
+    tensor<float>* const x {ctx->new_tensor<float>({1<<16, 2})};
+    tensor<float>* const y {ctx->new_tensor<float>({1<<16})};
+    tensor<float>* const rx {ctx->new_tensor<float>({1, 2})};
+    tensor<float>* const ry {ctx->new_tensor<float>({1})};
+    tensor<float>* const rz {ctx->new_tensor<float>({1})};
+    test::fill_random(*x, 1);
+    test::fill_random(*y, 2);
+    const std::vector<float> expected_x {reference_reduce(*x, 0, 's')};
+    const std::vector<float> expected_y {reference_reduce(*y, 0, 's')};
+    const std::vector<float> expected_z {reference_reduce(*y, 0, '>')};
+    thread_pool pool {4};
+    for (int i {}; i < 64; ++i) {
+        pool.parallel_for([&](const blas::compute_ctx& cctx) {
+            blas::sum(cctx, *rx, *x);
+            blas::sum(cctx, *ry, *y);
+            blas::max(cctx, *rz, *y);
+        });
+        ASSERT_NEAR((*rx)(0), expected_x[0], 1e-2f) << "run " << i;
+        ASSERT_NEAR((*rx)(1), expected_x[1], 1e-2f) << "run " << i;
+        ASSERT_NEAR((*ry)(0), expected_y[0], 1e-2f) << "run " << i;
+        ASSERT_EQ((*rz)(0), expected_z[0]) << "run " << i;
+    }
+}
+
+TEST(blas, tensor_reduce_deterministic) {
+    auto ctx {isolate::create("test", isolate::compute_device::cpu, 0x1000<<10)};
+    tensor<float>* const x {ctx->new_tensor<float>({1<<18})};
+    tensor<float>* const r {ctx->new_tensor<float>({1})};
+    std::mt19937_64 prng {};
+    std::uniform_real_distribution<float> dist {-1.0f, 1.0f};
+    for (float& v : x->data()) v = dist(prng);
+    thread_pool pool {3};
+    pool.parallel_for([&](const blas::compute_ctx& cctx) { blas::sum(cctx, *r, *x); });
+    const float first {(*r)(0)};
+    for (int i {}; i < 16; ++i) {
+        pool.parallel_for([&](const blas::compute_ctx& cctx) { blas::sum(cctx, *r, *x); });
+        ASSERT_EQ((*r)(0), first);
+    }
+}
+
+// Double precision layernorm (params = gamma, beta) or rmsnorm (params = gamma) of one row
+static auto reference_norm(const std::vector<double>& x, const std::vector<double>& params, const bool rms) -> std::vector<double> {
+    const auto n {static_cast<double>(x.size())};
+    double mean {}, var {};
+    if (!rms) for (const double v : x) mean += v/n;
+    for (const double v : x) var += (v - mean)*(v - mean)/n;
+    const double rstd {1.0 / std::sqrt(var + blas::k_norm_eps)};
+    std::vector<double> r(x.size());
+    for (std::size_t i {}; i < x.size(); ++i)
+        r[i] = (x[i] - mean)*rstd*params[i] + (rms ? 0.0 : params[x.size() + i]);
+    return r;
+}
+
+static auto check_norm(const std::array<dim, tensor<>::k_max_dims>& shape, const bool rms, const float offset, const dim threads) -> void {
+    auto ctx {isolate::create("test", isolate::compute_device::cpu, 0x1000<<12)};
+    tensor<float>* const x {ctx->new_tensor<float>(shape)};
+    tensor<float>* const p {ctx->new_tensor<float>({shape[0], rms ? 1 : 2})};
+    tensor<float>* const r {ctx->new_tensor<float>(shape)};
+    std::mt19937_64 prng {static_cast<std::uint64_t>(shape[0])};
+    std::uniform_real_distribution<float> dist {-1.0f, 1.0f};
+    for (float& v : x->data()) v = offset + dist(prng);
+    for (float& v : p->data()) v = dist(prng);
+    thread_pool pool {threads};
+    pool.parallel_for([&](const blas::compute_ctx& cctx) {
+        if (rms) blas::rmsnorm(cctx, *r, *x, *p);
+        else blas::layernorm(cctx, *r, *x, *p);
+    });
+    const dim d0 {shape[0]};
+    const std::vector<double> params {p->data().begin(), p->data().end()};
+    for (dim row {}; row < x->row_count(); ++row) {
+        const std::vector<double> xr {x->data().begin() + row*d0, x->data().begin() + (row+1)*d0};
+        const std::vector<double> expected {reference_norm(xr, params, rms)};
+        for (dim i {}; i < d0; ++i)
+            ASSERT_NEAR((*r)(row*d0 + i), expected[i], 2e-4) << "row " << row << " i " << i;
+    }
+}
+
+TEST(blas, tensor_layernorm) {
+    check_norm({64, 9, 2, 1}, false, 0.0f, 3);
+    check_norm({4099, 5, 1, 1}, false, 0.0f, 2); // Single pass statistics
+    check_norm({5000, 3, 1, 1}, false, 100.0f, 2); // Large mean, shifted single pass statistics must not cancel
+}
+
+TEST(blas, tensor_rmsnorm) {
+    check_norm({64, 9, 2, 1}, true, 0.0f, 3);
+    check_norm({4099, 5, 1, 1}, true, 0.5f, 2);
+}
+
+// Gradients of loss = sum(r * w) against central differences of the double reference
+static auto check_norm_backward(const bool rms) -> void {
+    static constexpr dim d0 {24}, rows {5};
+    auto ctx {isolate::create("test", isolate::compute_device::cpu, 0x1000<<4)};
+    tensor<float>* const x {ctx->new_tensor<float>({d0, rows})};
+    tensor<float>* const p {ctx->new_tensor<float>({d0, rms ? 1 : 2})};
+    tensor<float>* const dr {ctx->new_tensor<float>({d0, rows})};
+    tensor<float>* const dx {ctx->new_tensor<float>({d0, rows})};
+    tensor<float>* const dp {ctx->new_tensor<float>({d0, rms ? 1 : 2})};
+    tensor<float>* const stats {ctx->new_tensor<float>({rms ? 1 : 2, rows})};
+    std::mt19937_64 prng {};
+    std::uniform_real_distribution<float> dist {-1.0f, 1.0f};
+    for (tensor<float>* const t : {x, p, dr})
+        for (float& v : t->data()) v = dist(prng);
+    thread_pool pool {3};
+    pool.parallel_for([&](const blas::compute_ctx& cctx) {
+        if (rms) blas::rmsnorm_stats(cctx, *stats, *x);
+        else blas::layernorm_stats(cctx, *stats, *x);
+    });
+    pool.parallel_for([&](const blas::compute_ctx& cctx) {
+        if (rms) blas::rmsnorm_backward(cctx, *dx, *dp, *dr, *x, *p, *stats);
+        else blas::layernorm_backward(cctx, *dx, *dp, *dr, *x, *p, *stats);
+    });
+    std::vector<double> xs {x->data().begin(), x->data().end()};
+    std::vector<double> ps {p->data().begin(), p->data().end()};
+    const auto loss {[&]() -> double {
+        double l {};
+        for (dim row {}; row < rows; ++row) {
+            const std::vector<double> r {reference_norm({xs.begin() + row*d0, xs.begin() + (row+1)*d0}, ps, rms)};
+            for (dim i {}; i < d0; ++i) l += r[i]*(*dr)(row*d0 + i);
+        }
+        return l;
+    }};
+    const auto numeric {[&](double& v) -> double {
+        static constexpr double h {1e-5};
+        const double v0 {v};
+        v = v0 + h;
+        const double hi {loss()};
+        v = v0 - h;
+        const double lo {loss()};
+        v = v0;
+        return (hi - lo) / (2.0*h);
+    }};
+    for (dim i {}; i < d0*rows; ++i)
+        ASSERT_NEAR((*dx)(i), numeric(xs[i]), 1e-3) << "dx " << i;
+    for (dim i {}; i < p->elem_count(); ++i)
+        ASSERT_NEAR((*dp)(i), numeric(ps[i]), 1e-3) << "dparams " << i;
+}
+
+TEST(blas, tensor_layernorm_backward) {
+    check_norm_backward(false);
+}
+
+TEST(blas, tensor_rmsnorm_backward) {
+    check_norm_backward(true);
+}
+
+// The small op fast path must match the generic kernels (limit 0) for dense, broadcast, tiled and strided operands of all ranks
+TEST(blas, tensor_small_op_fast_path) {
+    auto ctx {isolate::create("test", isolate::compute_device::cpu, 0x1000<<6)};
+    struct binary_case final {
+        std::array<dim, 4> x;
+        std::array<dim, 4> y;
+        bool transposed_y;
+    };
+    static constexpr std::array k_cases {
+        binary_case{{7, 1, 1, 1}, {7, 1, 1, 1}, false},     // Rank 1, same shape
+        binary_case{{9, 1, 1, 1}, {1, 1, 1, 1}, false},     // Rank 1, scalar
+        binary_case{{5, 6, 1, 1}, {5, 1, 1, 1}, false},     // Rank 2, row broadcast
+        binary_case{{5, 6, 1, 1}, {1, 6, 1, 1}, false},     // Rank 2, column broadcast
+        binary_case{{3, 4, 5, 1}, {3, 1, 5, 1}, false},     // Rank 3
+        binary_case{{2, 3, 4, 5}, {1, 3, 1, 5}, false},     // Rank 4
+        binary_case{{6, 4, 1, 1}, {2, 2, 1, 1}, false},     // Tiled repeat, generic fallback
+        binary_case{{6, 6, 1, 1}, {6, 6, 1, 1}, true},      // Strided Y, generic fallback
+    };
+    std::mt19937 prng {3};
+    std::uniform_real_distribution<float> dist {-1.0f, 1.0f};
+    thread_pool pool {3};
+    for (const binary_case& c : k_cases) {
+        tensor<>* const x {ctx->new_tensor<float>(c.x)};
+        tensor<>* y {ctx->new_tensor<float>(c.y)};
+        tensor<>* const r {ctx->new_tensor<float>(c.x)};
+        tensor<>* const expected {ctx->new_tensor<float>(c.x)};
+        for (tensor<>* const t : {x, y})
+            for (float& v : t->data()) v = dist(prng) + 2.0f;
+        if (c.transposed_y) y = y->transposed_clone();
+        using binary_fn = decltype(&blas::add);
+        static constexpr std::array<std::pair<graph::opcode, binary_fn>, 4> k_ops {{
+            {graph::opcode::add, &blas::add},
+            {graph::opcode::sub, &blas::sub},
+            {graph::opcode::mul, &blas::mul},
+            {graph::opcode::div, &blas::div}
+        }};
+        for (const auto [opcode, op] : k_ops) {
+            ASSERT_TRUE(blas::is_small_op(opcode, *r, *x, y));
+            {
+                const test::small_op_limit_guard generic {0};
+                pool.parallel_for([&](const blas::compute_ctx& cctx) { (*op)(cctx, *expected, *x, *y); });
+            }
+            r->splat(0.0f);
+            pool.parallel_for([&](const blas::compute_ctx& cctx) { (*op)(cctx, *r, *x, *y); });
+            for (dim i {}; i < r->elem_count(); ++i)
+                ASSERT_FLOAT_EQ((*r)(i), (*expected)(i)) << "x " << c.x[0] << "x" << c.x[1] << "x" << c.x[2] << "x" << c.x[3] << " i " << i;
+            r->splat(0.0f);
+            (*op)(blas::compute_ctx{}, *r, *x, *y);
+            for (dim i {}; i < r->elem_count(); ++i)
+                ASSERT_FLOAT_EQ((*r)(i), (*expected)(i));
+        }
+    }
+    tensor<>* const x {ctx->new_tensor<float>({10, 12})};
+    tensor<>* const r {ctx->new_tensor<float>({10, 12})};
+    tensor<>* const expected {ctx->new_tensor<float>({10, 12})};
+    for (float& v : x->data()) v = dist(prng);
+    for (auto* const op : {&blas::softmax, &blas::relu, &blas::gelu, &blas::silu}) {
+        {
+            const test::small_op_limit_guard generic {0};
+            pool.parallel_for([&](const blas::compute_ctx& cctx) { (*op)(cctx, *expected, *x); });
+        }
+        pool.parallel_for([&](const blas::compute_ctx& cctx) { (*op)(cctx, *r, *x); });
+        for (dim i {}; i < r->elem_count(); ++i)
+            ASSERT_FLOAT_EQ((*r)(i), (*expected)(i));
+    }
+}
+
+TEST(blas, op_cost_model) {
+    auto ctx {isolate::create("test", isolate::compute_device::cpu, 0x1000<<10)};
+    tensor<>* const small {ctx->new_tensor<float>({16, 16})};
+    tensor<>* const large {ctx->new_tensor<float>({256, 256})};
+    ASSERT_TRUE(blas::is_small_op(graph::opcode::add, *small, *small, small));
+    ASSERT_FALSE(blas::is_small_op(graph::opcode::add, *large, *large, large));
+    ASSERT_GT(blas::op_cost(graph::opcode::gelu, *small, *small, nullptr), blas::op_cost(graph::opcode::relu, *small, *small, nullptr));
+    ASSERT_EQ(blas::op_cost(graph::opcode::matmul, *small, *small, small), 16*16*16);
+    const test::small_op_limit_guard disabled {0};
+    ASSERT_FALSE(blas::is_small_op(graph::opcode::add, *small, *small, small));
+}
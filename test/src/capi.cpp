@@ -0,0 +1,305 @@
+// Copyright Mario "Neo" Sieg 2024. All rights reserved. mario.sieg.64@gmail.com
+
+#include <array>
+
+#include <gtest/gtest.h>
+
+#include <base.hpp>
+#include <dlpack.h>
+#include <rtml_capi.h>
+
+TEST(capi, isolate_handles) {
+    const rtml_isolate_id_t iso {rtml_isolate_create("capi_test", RTML_DEVICE_CPU, 0x1000<<4)};
+    ASSERT_NE(iso, RTML_INVALID_HANDLE);
+    ASSERT_TRUE(rtml_isolate_exists(iso));
+    ASSERT_EQ(rtml_isolate_find("capi_test"), iso);
+    ASSERT_TRUE(rtml_isolate_destroy(iso));
+    ASSERT_FALSE(rtml_isolate_exists(iso));
+    ASSERT_FALSE(rtml_isolate_destroy(iso));
+    ASSERT_NE(std::string{rtml_last_error()}.find("invalid isolate handle"), std::string::npos);
+    const rtml_isolate_id_t reused {rtml_isolate_create("capi_test", RTML_DEVICE_CPU, 0x1000<<4)};
+    ASSERT_NE(reused, iso); // Same slot, new generation
+    ASSERT_FALSE(rtml_isolate_exists(iso));
+    ASSERT_EQ(rtml_isolate_create_tensor(iso, RTML_DTYPE_F32, 4, 1, 1, 1, 1, 0, 0), RTML_INVALID_HANDLE);
+    ASSERT_TRUE(rtml_isolate_destroy(reused));
+}
+
+TEST(capi, tensors) {
+    const rtml_isolate_id_t iso {rtml_isolate_create("capi_test", RTML_DEVICE_CPU, 0x1000<<4)};
+    const rtml_tensor_id_t t {rtml_isolate_create_tensor(iso, RTML_DTYPE_F32, 4, 3, 1, 1, 2, 0, 0)};
+    ASSERT_NE(t, RTML_INVALID_HANDLE);
+    std::int64_t dims[RTML_MAX_DIMS] {};
+    std::uint32_t num_dims {};
+    ASSERT_TRUE(rtml_tensor_shape(iso, t, dims, &num_dims));
+    ASSERT_EQ(num_dims, 2);
+    ASSERT_EQ(dims[0], 4);
+    ASSERT_EQ(dims[1], 3);
+    ASSERT_EQ(dims[2], 1);
+    ASSERT_EQ(rtml_tensor_data_size(iso, t), 4*3*sizeof(float));
+    ASSERT_TRUE(rtml_tensor_fill(iso, t, 2.5f));
+    const auto* data {static_cast<const float*>(rtml_tensor_data(iso, t))};
+    for (int i {}; i < 12; ++i)
+        ASSERT_FLOAT_EQ(data[i], 2.5f);
+    ASSERT_TRUE(rtml_tensor_set_name(iso, t, "weights"));
+    ASSERT_NE(std::string{rtml_tensor_print(iso, t)}.find("weights"), std::string::npos);
+    const rtml_tensor_desc_t descs[] {
+        {.dtype=RTML_DTYPE_F32, .num_dims=1, .dims={4, 1, 1, 1}, .slice=t, .slice_offset=4*sizeof(float)}, // View of row 1
+        {.dtype=RTML_DTYPE_F32, .num_dims=1, .dims={8, 1, 1, 1}, .slice=RTML_INVALID_HANDLE, .slice_offset=0},
+    };
+    rtml_tensor_id_t ids[2] {};
+    ASSERT_TRUE(rtml_isolate_create_tensors(iso, descs, 2, ids));
+    ASSERT_EQ(rtml_tensor_data(iso, ids[0]), static_cast<const void*>(data+4));
+    ASSERT_EQ(rtml_isolate_create_tensor(iso, RTML_DTYPE_F32, 16, 1, 1, 1, 1, t, 0), RTML_INVALID_HANDLE); // Slice exceeds base
+    ASSERT_EQ(rtml_isolate_create_tensor(iso, RTML_DTYPE_F32, 0, 1, 1, 1, 1, 0, 0), RTML_INVALID_HANDLE);
+    ASSERT_EQ(rtml_isolate_create_tensor(iso, RTML_DTYPE_F32, 1<<20, 1, 1, 1, 1, 0, 0), RTML_INVALID_HANDLE); // Out of pool memory
+    ASSERT_EQ(rtml_tensor_data(iso, 1234), nullptr);
+    ASSERT_TRUE(rtml_isolate_destroy(iso));
+}
+
+TEST(capi, graph_build_execute) {
+    const rtml_isolate_id_t iso {rtml_isolate_create("capi_test", RTML_DEVICE_CPU, 0x1000<<6)};
+    ASSERT_FALSE(rtml_isolate_set_num_threads(iso, RTML_MAX_THREADS+1));
+    ASSERT_TRUE(rtml_isolate_set_num_threads(iso, 2));
+    const rtml_tensor_id_t x {rtml_isolate_create_tensor(iso, RTML_DTYPE_F32, 8, 4, 1, 1, 2, 0, 0)};  // [K=8, M=4]
+    const rtml_tensor_id_t w {rtml_isolate_create_tensor(iso, RTML_DTYPE_F32, 6, 8, 1, 1, 2, 0, 0)};  // [N=6, K=8]
+    const rtml_tensor_id_t b {rtml_isolate_create_tensor(iso, RTML_DTYPE_F32, 6, 1, 1, 1, 1, 0, 0)};  // [N=6]
+    rtml_tensor_fill(iso, x, 1.0f);
+    rtml_tensor_fill(iso, w, 0.5f);
+    rtml_tensor_fill(iso, b, -5.0f);
+    rtml_graph_node_t nodes[] {
+        {.opcode=RTML_OP_MATMUL, .r=RTML_INVALID_HANDLE, .x=x, .y=w, .params={}},
+        {.opcode=RTML_OP_ADD, .r=RTML_INVALID_HANDLE, .x=RTML_NODE_RESULT(0), .y=b, .params={}},
+        {.opcode=RTML_OP_RELU, .r=RTML_INVALID_HANDLE, .x=RTML_NODE_RESULT(1), .y=RTML_INVALID_HANDLE, .params={}},
+    };
+    const rtml_graph_id_t g {rtml_graph_build(iso, nodes, 3)};
+    ASSERT_NE(g, RTML_INVALID_HANDLE);
+    ASSERT_EQ(nodes[1].x, nodes[0].r); // References and allocated results are written back
+    ASSERT_EQ(nodes[2].x, nodes[1].r);
+    for (int rep {}; rep < 3; ++rep) {
+        ASSERT_TRUE(rtml_graph_execute(iso, g));
+        std::int64_t dims[RTML_MAX_DIMS] {};
+        ASSERT_TRUE(rtml_tensor_shape(iso, nodes[2].r, dims, nullptr));
+        ASSERT_EQ(dims[0], 6);
+        ASSERT_EQ(dims[1], 4);
+        const auto* r {static_cast<const float*>(rtml_tensor_data(iso, nodes[2].r))};
+        for (int i {}; i < 6*4; ++i)
+            ASSERT_FLOAT_EQ(r[i], 0.0f); // relu(8 * 0.5 - 5)
+    }
+    rtml_tensor_fill(iso, b, 1.0f);
+    ASSERT_TRUE(rtml_graph_run(iso, nodes, 3)); // Reuses the result tensors of the nodes
+    ASSERT_TRUE(rtml_graph_destroy(iso, g));
+    ASSERT_FALSE(rtml_graph_execute(iso, g));
+    const auto* r {static_cast<const float*>(rtml_tensor_data(iso, nodes[2].r))};
+    for (int i {}; i < 6*4; ++i)
+        ASSERT_FLOAT_EQ(r[i], 5.0f);
+    ASSERT_TRUE(rtml_isolate_destroy(iso));
+}
+
+TEST(capi, graph_run_locked) { // Locked mode must run all nodes of an immediate graph, not silently drop them
+    const rtml_isolate_id_t iso {rtml_isolate_create("capi_locked", RTML_DEVICE_CPU, 0x1000<<6)};
+    ASSERT_TRUE(rtml_isolate_set_num_threads(iso, 1));
+    const rtml_tensor_id_t x {rtml_isolate_create_tensor(iso, RTML_DTYPE_F32, 8, 4, 1, 1, 2, 0, 0)};
+    const rtml_tensor_id_t y {rtml_isolate_create_tensor(iso, RTML_DTYPE_F32, 8, 4, 1, 1, 2, 0, 0)};
+    rtml_tensor_fill(iso, x, 2.0f);
+    rtml_tensor_fill(iso, y, 3.0f);
+    rtml_graph_node_t nodes[] {
+        {.opcode=RTML_OP_ADD, .r=RTML_INVALID_HANDLE, .x=x, .y=y, .params={}},
+        {.opcode=RTML_OP_MUL, .r=RTML_INVALID_HANDLE, .x=RTML_NODE_RESULT(0), .y=y, .params={}},
+    };
+    ASSERT_TRUE(rtml_graph_run(iso, nodes, 2)); // Allocates the result tensors and the thread pool
+    rtml_tensor_fill(iso, nodes[1].r, 0.0f);
+    rtml::lock_runtime();
+    const bool ok {rtml_graph_run(iso, nodes, 2)};
+    rtml::unlock_runtime();
+    ASSERT_TRUE(ok);
+    const auto* r {static_cast<const float*>(rtml_tensor_data(iso, nodes[1].r))};
+    for (int i {}; i < 8*4; ++i)
+        ASSERT_FLOAT_EQ(r[i], 15.0f); // (2 + 3) * 3
+    ASSERT_TRUE(rtml_isolate_destroy(iso));
+}
+
+TEST(capi, graph_conv_params) {
+    const rtml_isolate_id_t iso {rtml_isolate_create("capi_conv", RTML_DEVICE_CPU, 0x1000<<4)};
+    const rtml_tensor_id_t x {rtml_isolate_create_tensor(iso, RTML_DTYPE_F32, 4, 9, 1, 1, 2, 0, 0)};  // [C_in=4, T=9]
+    const rtml_tensor_id_t w {rtml_isolate_create_tensor(iso, RTML_DTYPE_F32, 6, 4, 3, 1, 3, 0, 0)};  // [C_out=6, C_in=4, K=3]
+    rtml_tensor_fill(iso, x, 1.0f);
+    rtml_tensor_fill(iso, w, 0.25f);
+    rtml_graph_node_t node {.opcode=RTML_OP_CONV1D, .r=RTML_INVALID_HANDLE, .x=x, .y=w, .params={2, 0, 1}}; // Stride 2, padding 1
+    ASSERT_TRUE(rtml_graph_run(iso, &node, 1));
+    std::int64_t dims[RTML_MAX_DIMS] {};
+    ASSERT_TRUE(rtml_tensor_shape(iso, node.r, dims, nullptr));
+    ASSERT_EQ(dims[0], 6);
+    ASSERT_EQ(dims[1], 5); // (9 + 2 - 3) / 2 + 1
+    const auto* r {static_cast<const float*>(rtml_tensor_data(iso, node.r))};
+    ASSERT_FLOAT_EQ(r[0], 2.0f);    // 2 taps in bounds * 4 channels * 0.25
+    ASSERT_FLOAT_EQ(r[6], 3.0f);
+    const std::int64_t bad[RTML_MAX_OP_PARAMS] {1, 0, 0, 0, 0, 0, 3}; // 3 groups do not divide 4 channels
+    ASSERT_FALSE(rtml_tensor_op_params(iso, RTML_OP_CONV1D, node.r, x, w, bad));
+    ASSERT_TRUE(rtml_isolate_destroy(iso));
+}
+
+TEST(capi, graph_validation) {
+    const rtml_isolate_id_t iso {rtml_isolate_create("capi_test", RTML_DEVICE_CPU, 0x1000<<4)};
+    const rtml_tensor_id_t a {rtml_isolate_create_tensor(iso, RTML_DTYPE_F32, 8, 4, 1, 1, 2, 0, 0)};
+    const rtml_tensor_id_t b {rtml_isolate_create_tensor(iso, RTML_DTYPE_F32, 3, 4, 1, 1, 2, 0, 0)};
+    const rtml_tensor_id_t c {rtml_isolate_create_tensor(iso, RTML_DTYPE_F32, 8, 4, 1, 1, 2, 0, 0)};
+    ASSERT_FALSE(rtml_tensor_op(iso, RTML_OP_ADD, c, a, b)); // 3 does not divide 8
+    ASSERT_NE(std::string{rtml_last_error()}.find("broadcast"), std::string::npos);
+    ASSERT_FALSE(rtml_tensor_op(iso, RTML_OP_MATMUL, c, a, b));
+    ASSERT_FALSE(rtml_tensor_op(iso, RTML_OP_COUNT, c, a, b));
+    ASSERT_FALSE(rtml_tensor_op(iso, RTML_OP_RELU, c, a, a)); // Unary with two operands
+    ASSERT_FALSE(rtml_tensor_op(iso, RTML_OP_RELU, a, a, 0)); // Aliasing
+    rtml_graph_node_t bad {.opcode=RTML_OP_ADD, .r=0, .x=a, .y=99, .params={}};
+    ASSERT_EQ(rtml_graph_build(iso, &bad, 1), RTML_INVALID_HANDLE);
+    rtml_graph_node_t self_ref {.opcode=RTML_OP_RELU, .r=0, .x=RTML_NODE_RESULT(0), .y=0, .params={}};
+    ASSERT_EQ(rtml_graph_build(iso, &self_ref, 1), RTML_INVALID_HANDLE);
+    rtml_tensor_fill(iso, a, 1.0f);
+    ASSERT_TRUE(rtml_tensor_op(iso, RTML_OP_ADD, c, a, a));
+    ASSERT_FLOAT_EQ(static_cast<const float*>(rtml_tensor_data(iso, c))[7], 2.0f);
+    ASSERT_TRUE(rtml_isolate_destroy(iso));
+}
+
+TEST(capi, wrap_external) {
+    const rtml_isolate_id_t iso {rtml_isolate_create("capi_test", RTML_DEVICE_CPU, 0x1000<<4)};
+    alignas(64) std::array<float, 8*4> x {};
+    alignas(64) std::array<float, 8*4> r {};
+    std::ranges::fill(x, -2.0f);
+    const std::int64_t dims[] {8, 4};
+    const rtml_tensor_id_t tx {rtml_isolate_wrap_tensor(iso, RTML_DTYPE_F32, dims, nullptr, 2, x.data())};
+    const rtml_tensor_id_t tr {rtml_isolate_wrap_tensor(iso, RTML_DTYPE_F32, dims, nullptr, 2, r.data())};
+    ASSERT_NE(tx, RTML_INVALID_HANDLE);
+    ASSERT_EQ(rtml_tensor_data(iso, tx), x.data()); // No copy
+    ASSERT_EQ(rtml_tensor_data_size(iso, tx), sizeof(x));
+    ASSERT_TRUE(rtml_tensor_op(iso, RTML_OP_ADD, tr, tx, tx));
+    for (const float v : r)
+        ASSERT_FLOAT_EQ(v, -4.0f); // Written directly into external memory
+
+    const std::int64_t col_dims[] {4, 4}; // Every second column of x: strided view
+    const std::int64_t col_strides[] {8, 32};
+    const rtml_tensor_id_t cols {rtml_isolate_wrap_tensor(iso, RTML_DTYPE_F32, col_dims, col_strides, 2, x.data())};
+    ASSERT_NE(cols, RTML_INVALID_HANDLE);
+    std::int64_t strides[RTML_MAX_DIMS] {};
+    ASSERT_TRUE(rtml_tensor_strides(iso, cols, strides));
+    ASSERT_EQ(strides[0], 8);
+    ASSERT_EQ(strides[1], 32);
+    ASSERT_EQ(strides[2], 128);
+    ASSERT_TRUE(rtml_tensor_fill(iso, cols, 1.0f));
+    for (std::size_t i {}; i < x.size(); ++i)
+        ASSERT_FLOAT_EQ(x[i], i % 2 ? -2.0f : 1.0f); // Gaps are untouched
+
+    const std::int64_t bad_strides[] {6, 32};
+    ASSERT_EQ(rtml_isolate_wrap_tensor(iso, RTML_DTYPE_F32, col_dims, bad_strides, 2, x.data()), RTML_INVALID_HANDLE);
+    ASSERT_EQ(rtml_isolate_wrap_tensor(iso, RTML_DTYPE_F32, dims, nullptr, 2, reinterpret_cast<std::uint8_t*>(x.data())+1), RTML_INVALID_HANDLE);
+    ASSERT_TRUE(rtml_isolate_destroy(iso));
+}
+
+TEST(capi, dlpack_roundtrip) {
+    const rtml_isolate_id_t src {rtml_isolate_create("capi_dlpack_src", RTML_DEVICE_CPU, 0x1000<<4)};
+    const rtml_tensor_id_t a {rtml_isolate_create_tensor(src, RTML_DTYPE_F32, 8, 4, 2, 1, 3, 0, 0)};
+    rtml_tensor_fill(src, a, 3.0f);
+    DLManagedTensor* const managed {rtml_tensor_to_dlpack(src, a)};
+    ASSERT_NE(managed, nullptr);
+    const DLTensor& dl {managed->dl_tensor};
+    ASSERT_EQ(dl.data, rtml_tensor_data(src, a));
+    ASSERT_EQ(dl.ndim, 3);
+    ASSERT_EQ(dl.shape[0], 2); // Outermost first
+    ASSERT_EQ(dl.shape[2], 8);
+    ASSERT_EQ(dl.strides[0], 32); // Element strides
+    ASSERT_EQ(dl.strides[2], 1);
+    ASSERT_EQ(dl.dtype.code, kDLFloat);
+    ASSERT_EQ(dl.dtype.bits, 32);
+    ASSERT_TRUE(rtml_isolate_destroy(src)); // The export keeps the memory alive
+    ASSERT_FLOAT_EQ(static_cast<const float*>(dl.data)[63], 3.0f);
+
+    const rtml_isolate_id_t dst {rtml_isolate_create("capi_dlpack_dst", RTML_DEVICE_CPU, 0x1000<<4)};
+    const rtml_tensor_id_t b {rtml_isolate_from_dlpack(dst, managed)};
+    ASSERT_NE(b, RTML_INVALID_HANDLE) << rtml_last_error();
+    ASSERT_EQ(rtml_tensor_data(dst, b), dl.data); // No copy
+    std::int64_t dims[RTML_MAX_DIMS] {};
+    std::uint32_t num_dims {};
+    ASSERT_TRUE(rtml_tensor_shape(dst, b, dims, &num_dims));
+    ASSERT_EQ(num_dims, 3);
+    ASSERT_EQ(dims[0], 8);
+    ASSERT_EQ(dims[2], 2);
+    const rtml_tensor_id_t r {rtml_isolate_create_tensor(dst, RTML_DTYPE_F32, 8, 4, 2, 1, 3, 0, 0)};
+    ASSERT_TRUE(rtml_tensor_op(dst, RTML_OP_ADD, r, b, b));
+    ASSERT_FLOAT_EQ(static_cast<const float*>(rtml_tensor_data(dst, r))[63], 6.0f);
+    ASSERT_TRUE(rtml_isolate_destroy(dst)); // Calls the deleter, which releases the source isolate
+}
+
+TEST(capi, dlpack_import_rejects) {
+    const rtml_isolate_id_t iso {rtml_isolate_create("capi_dlpack", RTML_DEVICE_CPU, 0x1000<<4)};
+    static bool s_deleted {};
+    alignas(64) std::array<double, 4> data {};
+    std::int64_t shape[] {4};
+    DLManagedTensor managed {
+        .dl_tensor={
+            .data=data.data(),
+            .device={.device_type=kDLCPU, .device_id=0},
+            .ndim=1,
+            .dtype={.code=kDLFloat, .bits=64, .lanes=1},
+            .shape=shape,
+            .strides=nullptr,
+            .byte_offset=0
+        },
+        .manager_ctx=nullptr,
+        .deleter=[](DLManagedTensor*) { s_deleted = true; }
+    };
+    ASSERT_EQ(rtml_isolate_from_dlpack(iso, &managed), RTML_INVALID_HANDLE); // f64
+    managed.dl_tensor.dtype.bits = 32;
+    managed.dl_tensor.device.device_type = kDLCUDA;
+    ASSERT_EQ(rtml_isolate_from_dlpack(iso, &managed), RTML_INVALID_HANDLE);
+    managed.dl_tensor.device.device_type = kDLCPU;
+    std::int64_t strides[] {2};
+    managed.dl_tensor.strides = strides;
+    const rtml_tensor_id_t t {rtml_isolate_from_dlpack(iso, &managed)};
+    ASSERT_NE(t, RTML_INVALID_HANDLE);
+    std::int64_t byte_strides[RTML_MAX_DIMS] {};
+    ASSERT_TRUE(rtml_tensor_strides(iso, t, byte_strides));
+    ASSERT_EQ(byte_strides[0], 8);
+    ASSERT_FALSE(s_deleted); // Failed imports do not take ownership
+    ASSERT_TRUE(rtml_isolate_destroy(iso));
+    ASSERT_TRUE(s_deleted);
+}
+
+TEST(capi, async_jobs) {
+    const rtml_isolate_id_t iso {rtml_isolate_create("capi_async", RTML_DEVICE_CPU, 0x1000<<6)};
+    const rtml_tensor_id_t x {rtml_isolate_create_tensor(iso, RTML_DTYPE_F32, 64, 64, 1, 1, 2, 0, 0)};
+    rtml_tensor_fill(iso, x, 1.0f);
+    rtml_graph_node_t nodes[] {
+        {.opcode=RTML_OP_MATMUL, .r=0, .x=x, .y=x, .params={}},
+        {.opcode=RTML_OP_ADD, .r=0, .x=RTML_NODE_RESULT(0), .y=x, .params={}},
+    };
+    const rtml_graph_id_t g {rtml_graph_build(iso, nodes, 2)};
+    ASSERT_NE(g, RTML_INVALID_HANDLE);
+    std::array<rtml_job_id_t, 8> jobs {};
+    for (rtml_job_id_t& job : jobs) {
+        job = rtml_graph_submit(iso, g);
+        ASSERT_NE(job, RTML_INVALID_HANDLE);
+    }
+    ASSERT_TRUE(rtml_job_wait(iso, jobs.back(), -1));
+    for (const rtml_job_id_t job : jobs) // Jobs complete in submission order
+        ASSERT_EQ(rtml_job_poll(iso, job), 1);
+    ASSERT_FLOAT_EQ(static_cast<const float*>(rtml_tensor_data(iso, nodes[1].r))[0], 65.0f);
+#ifdef __linux__
+    ASSERT_GE(rtml_job_eventfd(iso, jobs[0]), 0);
+#endif
+    for (const rtml_job_id_t job : jobs)
+        ASSERT_TRUE(rtml_job_release(iso, job));
+    ASSERT_EQ(rtml_job_poll(iso, jobs[0]), -1); // Released handles are invalid
+    const rtml_job_id_t reused {rtml_graph_submit(iso, g)}; // Reuses a released slot with a new generation
+    ASSERT_NE(reused, jobs.back());
+    ASSERT_EQ(reused & 0xffffffff, jobs.back() & 0xffffffff);
+    ASSERT_TRUE(rtml_graph_execute(iso, g)); // Waits for the pending job first
+    ASSERT_EQ(rtml_job_poll(iso, reused), 1);
+    const rtml_job_id_t pending {rtml_graph_submit(iso, g)};
+    ASSERT_NE(rtml_tensor_data(iso, nodes[1].r), nullptr); // Data access waits for the pending job first
+    ASSERT_EQ(rtml_job_poll(iso, pending), 1);
+    const rtml_job_id_t exported {rtml_graph_submit(iso, g)};
+    DLManagedTensor* const managed {rtml_tensor_to_dlpack(iso, nodes[1].r)}; // Exporting waits as well
+    ASSERT_NE(managed, nullptr);
+    ASSERT_EQ(rtml_job_poll(iso, exported), 1);
+    managed->deleter(managed);
+    ASSERT_NE(rtml_graph_submit(iso, g), RTML_INVALID_HANDLE);
+    ASSERT_TRUE(rtml_isolate_destroy(iso)); // Completes the pending job
+}
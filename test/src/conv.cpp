@@ -0,0 +1,226 @@
+// Copyright Mario "Neo" Sieg 2024. All rights reserved. mario.sieg.64@gmail.com
+
+#include <gtest/gtest.h>
+
+#include <random>
+
+#include <conv.hpp>
+#include <executor.hpp>
+#include <graph.hpp>
+#include <isolate.hpp>
+#include <tensor.hpp>
+#include <thread_pool.hpp>
+
+#include "test_util.hpp"
+
+using namespace rtml;
+
+// Direct evaluation of the convolution sum in double precision, conv1d is a conv2d with H = KH = 1
+static auto reference_conv(const dim spatial_dims, const tensor<>& x, const tensor<>& w, const blas::conv_params& p, const std::array<dim, 4>& shape) -> std::vector<double> {
+    const bool is_2d {spatial_dims == 2};
+    const dim w_in {x.dims()[1]}, h_in {is_2d ? x.dims()[2] : 1}, batch {is_2d ? x.dims()[3] : x.dims()[2]};
+    const dim c_out {w.dims()[0]}, cin_g {w.dims()[1]}, kw {w.dims()[2]}, kh {is_2d ? w.dims()[3] : 1};
+    const dim w_out {shape[1]}, h_out {is_2d ? shape[2] : 1};
+    const dim cout_g {c_out / p.groups};
+    const auto in {[&](const dim c, const dim ix, const dim iy, const dim b) -> double {
+        if (ix < 0 || iy < 0 || ix >= w_in || iy >= h_in) return 0.0;
+        return is_2d ? x({c, ix, iy, b}) : x({c, ix, b, 0});
+    }};
+    std::vector<double> r {};
+    for (dim b {}; b < batch; ++b)
+        for (dim oy {}; oy < h_out; ++oy)
+            for (dim ox {}; ox < w_out; ++ox)
+                for (dim co {}; co < c_out; ++co) {
+                    const dim g {co / cout_g};
+                    double sum {};
+                    for (dim ky {}; ky < kh; ++ky)
+                        for (dim kx {}; kx < kw; ++kx)
+                            for (dim ci {}; ci < cin_g; ++ci) {
+                                const double v {in(g*cin_g + ci, ox*p.stride[0] - p.padding[0] + kx*p.dilation[0], oy*p.stride[1] - p.padding[1] + ky*p.dilation[1], b)};
+                                sum += v * (is_2d ? w({co, ci, kx, ky}) : w({co, ci, kx, 0}));
+                            }
+                    r.emplace_back(sum);
+                }
+    return r;
+}
+
+static auto check_conv(
+    const dim spatial_dims,
+    const std::array<dim, 4>& x_shape,
+    const std::array<dim, 4>& w_shape,
+    const blas::conv_params& p,
+    const dim threads
+) -> void {
+    auto ctx {isolate::create("conv_test", isolate::compute_device::cpu, 0x1000<<10)};
+    tensor<>* const x {ctx->new_tensor<float>(x_shape)};
+    tensor<>* const w {ctx->new_tensor<float>(w_shape)};
+    std::mt19937 prng {static_cast<std::mt19937::result_type>(x_shape[0]*w_shape[0])};
+    std::uniform_real_distribution<float> dist {-1.0f, 1.0f};
+    for (tensor<>* const t : {x, w})
+        for (float& v : t->data()) v = dist(prng);
+    const std::array<dim, 4> shape {blas::conv_output_shape(spatial_dims, *x, *w, p)};
+    tensor<>* const r {ctx->new_tensor<float>(shape)};
+    ASSERT_EQ(blas::validate_conv(spatial_dims, *r, *x, *w, p), nullptr);
+    const std::vector<double> expected {reference_conv(spatial_dims, *x, *w, p, shape)};
+    thread_pool pool {threads};
+    for (const blas::conv_algorithm algo : {blas::conv_algorithm::direct, blas::conv_algorithm::gemm}) {
+        r->splat(-1.0f);
+        pool.parallel_for([&](const blas::compute_ctx& cctx) { blas::conv(cctx, spatial_dims, *r, *x, *w, p, algo); });
+        for (dim i {}; i < r->elem_count(); ++i)
+            ASSERT_NEAR((*r)(i), expected[i], 1e-4) << "algorithm " << static_cast<int>(algo) << " i " << i;
+    }
+}
+
+TEST(conv, conv2d_dense) {
+    check_conv(2, {16, 9, 7, 2}, {32, 16, 3, 3}, {.padding={1, 1}}, 3);
+}
+
+TEST(conv, conv2d_stride_dilation) {
+    check_conv(2, {8, 15, 12, 1}, {24, 8, 3, 2}, {.stride={2, 3}, .padding={2, 1}, .dilation={2, 1}}, 2);
+}
+
+TEST(conv, conv2d_groups) {
+    check_conv(2, {12, 6, 6, 1}, {20, 3, 3, 3}, {.padding={1, 1}, .groups=4}, 2);
+}
+
+TEST(conv, conv2d_depthwise) {
+    check_conv(2, {40, 10, 8, 2}, {40, 1, 3, 3}, {.stride={2, 2}, .padding={1, 1}, .groups=40}, 3);
+}
+
+TEST(conv, conv2d_large_reduction) { // K = 9 * 64 spans multiple KC blocks of the packed SGEMM
+    check_conv(2, {64, 8, 8, 1}, {48, 64, 3, 3}, {.padding={1, 1}}, 2);
+}
+
+TEST(conv, conv1d) {
+    check_conv(1, {16, 50, 2, 1}, {32, 16, 5, 1}, {.stride={2, 1}, .padding={2, 0}, .dilation={3, 1}}, 2);
+    check_conv(1, {64, 40, 1, 1}, {64, 1, 31, 1}, {.padding={15, 0}, .groups=64}, 2); // Conformer depthwise conv
+}
+
+TEST(conv, heuristic) {
+    auto ctx {isolate::create("conv_test", isolate::compute_device::cpu, 0x1000<<10)};
+    tensor<>* const x {ctx->new_tensor<float>({64, 28, 28})};
+    tensor<>* const w {ctx->new_tensor<float>({64, 64, 3, 3})};
+    tensor<>* const dw {ctx->new_tensor<float>({64, 1, 3, 3})};
+    ASSERT_EQ(blas::conv_select_algorithm(2, *x, *w, {.padding={1, 1}}), blas::conv_algorithm::gemm);
+    ASSERT_EQ(blas::conv_select_algorithm(2, *x, *dw, {.padding={1, 1}, .groups=64}), blas::conv_algorithm::direct);
+}
+
+TEST(conv, graph_node) {
+    auto ctx {isolate::create("conv_test", isolate::compute_device::cpu, 0x1000<<10)};
+    tensor<>* const x {ctx->new_tensor<float>({4, 10, 2})};
+    tensor<>* const w {ctx->new_tensor<float>({8, 4, 3})};
+    tensor<>* const r {ctx->new_tensor<float>({8, 5, 2})};
+    x->splat(1.0f);
+    w->splat(0.5f);
+    graph::node n {.op=graph::opcode::conv1d, .r=r, .x=x, .y=w, .params=blas::to_op_params({.stride={2, 1}, .padding={1, 0}})};
+    ASSERT_EQ(graph::validate(n), nullptr);
+    thread_pool pool {2};
+    pool.parallel_for([&](const blas::compute_ctx& cctx) { blas::eval(cctx, n.op, *n.r, *n.x, n.y, n.params); });
+    ASSERT_FLOAT_EQ((*r)({0, 0, 0, 0}), 4.0f); // First output sees one padded tap
+    ASSERT_FLOAT_EQ((*r)({0, 1, 0, 0}), 6.0f);
+    n.params = {};
+    ASSERT_NE(graph::validate(n), nullptr); // Stride 1 does not produce 5 outputs
+}
+
+// Feeds the signal in chunks of varying size (shorter and longer than the context) and compares the concatenated
+// outputs to the offline conv1d of the signal with (K - 1) * dilation zero frames prepended
+static auto check_conv1d_stream(const std::array<dim, 4>& w_shape, const dim channels, const dim batch, const blas::conv_params& p, const dim threads) -> void {
+    static constexpr dim k_frames {96};
+    static constexpr std::array<dim, 6> k_chunks {1, 7, 2, 30, 5, 51};
+    auto ctx {isolate::create("conv_test", isolate::compute_device::cpu, 0x1000<<10)};
+    tensor<>* const w {ctx->new_tensor<float>(w_shape)};
+    tensor<>* const signal {ctx->new_tensor<float>({channels, k_frames, batch})};
+    std::mt19937 prng {static_cast<std::mt19937::result_type>(channels*w_shape[0])};
+    std::uniform_real_distribution<float> dist {-1.0f, 1.0f};
+    for (tensor<>* const t : {w, signal})
+        for (float& v : t->data()) v = dist(prng);
+    blas::conv1d_stream stream {*ctx, *w, channels, batch, p};
+    ASSERT_EQ(stream.context(), (w_shape[2]-1)*p.dilation[0]);
+    const dim context {stream.context()};
+    tensor<>* const padded {ctx->new_tensor<float>({channels, context + k_frames, batch})};
+    padded->splat(0.0f);
+    for (dim b {}; b < batch; ++b)
+        for (dim t {}; t < k_frames; ++t)
+            for (dim c {}; c < channels; ++c)
+                (*padded)({c, context + t, b, 0}) = (*signal)({c, t, b, 0});
+    tensor<>* const expected {ctx->new_tensor<float>(blas::conv_output_shape(1, *padded, *w, {.dilation=p.dilation, .groups=p.groups}))};
+    ASSERT_EQ(expected->dims()[1], k_frames);
+    thread_pool pool {threads};
+    pool.parallel_for([&](const blas::compute_ctx& cctx) {
+        blas::conv(cctx, 1, *expected, *padded, *w, {.dilation=p.dilation, .groups=p.groups}, blas::conv_algorithm::direct);
+    });
+    for (int pass {}; pass < 2; ++pass) { // Second pass after reset must restart from zero context
+        dim t0 {};
+        for (std::size_t i {}; t0 < k_frames; ++i) {
+            const dim n {std::min(k_chunks[i % k_chunks.size()], k_frames - t0)};
+            tensor<>* const x {ctx->new_tensor<float>({channels, n, batch})};
+            tensor<>* const r {ctx->new_tensor<float>({w_shape[0], n, batch})};
+            for (dim b {}; b < batch; ++b)
+                for (dim t {}; t < n; ++t)
+                    for (dim c {}; c < channels; ++c)
+                        (*x)({c, t, b, 0}) = (*signal)({c, t0 + t, b, 0});
+            ASSERT_EQ(stream.validate(*r, *x), nullptr);
+            pool.parallel_for([&](const blas::compute_ctx& cctx) { stream.process(cctx, *r, *x); });
+            for (dim b {}; b < batch; ++b)
+                for (dim t {}; t < n; ++t)
+                    for (dim c {}; c < w_shape[0]; ++c)
+                        ASSERT_NEAR((*r)({c, t, b, 0}), (*expected)({c, t0 + t, b, 0}), 1e-4) << "frame " << t0 + t;
+            t0 += n;
+        }
+        ASSERT_EQ(stream.frames(), k_frames);
+        stream.reset();
+    }
+}
+
+TEST(conv, conv1d_stream_depthwise) { // Conformer depthwise conv, causal
+    check_conv1d_stream({32, 1, 31, 1}, 32, 1, {.groups=32}, 2);
+}
+
+TEST(conv, conv1d_stream_dense) { // Dense conv with dilation, large chunks take the GEMM path
+    check_conv1d_stream({32, 16, 3, 1}, 16, 2, {.dilation={2, 1}}, 3);
+    check_conv1d_stream({8, 8, 1, 1}, 8, 1, {}, 1); // Pointwise conv has no context
+}
+
+TEST(conv, conv1d_stream_multiple_per_dispatch) { // Two chunks of a stream and a split reduction in one dispatch
+    auto ctx {isolate::create("conv_test", isolate::compute_device::cpu, 0x1000<<10)};
+    tensor<>* const w {ctx->new_tensor<float>({16, 1, 9})};
+    tensor<>* const x0 {ctx->new_tensor<float>({16, 40, 1})};
+    tensor<>* const x1 {ctx->new_tensor<float>({16, 24, 1})};
+    tensor<>* const x2 {ctx->new_tensor<float>({1<<16})};
+    test::fill_random(*w, 1);
+    test::fill_random(*x0, 2);
+    test::fill_random(*x1, 3);
+    test::fill_random(*x2, 4);
+    thread_pool pool {4};
+    blas::conv1d_stream reference {*ctx, *w, 16, 1, {.groups=16}};
+    tensor<>* const expected0 {ctx->new_tensor<float>({16, 40, 1})};
+    tensor<>* const expected1 {ctx->new_tensor<float>({16, 24, 1})};
+    pool.parallel_for([&](const blas::compute_ctx& cctx) { reference.process(cctx, *expected0, *x0); });
+    pool.parallel_for([&](const blas::compute_ctx& cctx) { reference.process(cctx, *expected1, *x1); });
+    tensor<>* const r0 {ctx->new_tensor<float>({16, 40, 1})};
+    tensor<>* const r1 {ctx->new_tensor<float>({16, 24, 1})};
+    tensor<>* const sum {ctx->new_tensor<float>({1})};
+    for (int run {}; run < 32; ++run) {
+        blas::conv1d_stream stream {*ctx, *w, 16, 1, {.groups=16}};
+        pool.parallel_for([&](const blas::compute_ctx& cctx) {
+            stream.process(cctx, *r0, *x0);
+            blas::sum(cctx, *sum, *x2);
+            stream.process(cctx, *r1, *x1);
+        });
+        ASSERT_EQ(stream.frames(), 64);
+        for (dim i {}; i < r0->elem_count(); ++i)
+            ASSERT_FLOAT_EQ((*r0)(i), (*expected0)(i)) << "run " << run << " i " << i;
+        for (dim i {}; i < r1->elem_count(); ++i)
+            ASSERT_FLOAT_EQ((*r1)(i), (*expected1)(i)) << "run " << run << " i " << i;
+    }
+}
+
+TEST(conv, conv1d_stream_validate) {
+    auto ctx {isolate::create("conv_test", isolate::compute_device::cpu, 0x1000<<10)};
+    tensor<>* const w {ctx->new_tensor<float>({8, 4, 3})};
+    blas::conv1d_stream stream {*ctx, *w, 4, 1, {}};
+    tensor<>* const x {ctx->new_tensor<float>({4, 10, 1})};
+    ASSERT_EQ(stream.validate(*ctx->new_tensor<float>({8, 10, 1}), *x), nullptr);
+    ASSERT_NE(stream.validate(*ctx->new_tensor<float>({8, 8, 1}), *x), nullptr); // Stream outputs one frame per input frame
+    ASSERT_NE(stream.validate(*ctx->new_tensor<float>({8, 10, 2}), *ctx->new_tensor<float>({4, 10, 2})), nullptr);
+}
@@ -0,0 +1,62 @@
+// Copyright Mario "Neo" Sieg 2024. All rights reserved. mario.sieg.64@gmail.com
+
+#include <gtest/gtest.h>
+
+#include <job_queue.hpp>
+
+#ifdef __linux__
+#include <poll.h>
+#endif
+
+using namespace rtml;
+
+TEST(job_queue, runs_in_submission_order) {
+    std::vector<int> order {};
+    std::vector<std::shared_ptr<completion>> done {};
+    {
+        job_queue queue {};
+        for (int i {}; i < 32; ++i)
+            done.emplace_back(queue.submit([&order, i] { order.emplace_back(i); }));
+        done.back()->wait();
+        ASSERT_EQ(order.size(), 32);
+    }
+    for (int i {}; i < 32; ++i) {
+        ASSERT_EQ(order[i], i);
+        ASSERT_TRUE(done[i]->is_done());
+    }
+}
+
+TEST(job_queue, wait_for_and_drain) {
+    job_queue queue {};
+    std::atomic_bool release {};
+    auto blocked {queue.submit([&release] { release.wait(false); })};
+    auto next {queue.submit([] {})};
+    ASSERT_FALSE(blocked->wait_for(std::chrono::microseconds{1000}));
+    ASSERT_FALSE(next->is_done());
+    ASSERT_EQ(queue.pending(), 2);
+    release.store(true);
+    release.notify_all();
+    queue.drain();
+    ASSERT_EQ(queue.pending(), 0);
+    ASSERT_TRUE(next->wait_for(std::chrono::microseconds{0}));
+}
+
+#ifdef __linux__
+TEST(job_queue, eventfd_signals_completion) {
+    job_queue queue {};
+    std::atomic_bool release {};
+    auto pending {queue.submit([&release] { release.wait(false); })};
+    pollfd pfd {.fd=pending->event_fd(), .events=POLLIN};
+    ASSERT_GE(pfd.fd, 0);
+    ASSERT_EQ(poll(&pfd, 1, 0), 0);
+    release.store(true);
+    release.notify_all();
+    ASSERT_EQ(poll(&pfd, 1, 5000), 1);
+    ASSERT_TRUE(pending->is_done());
+
+    auto completed {queue.submit([] {})}; // fd requested after completion is readable immediately
+    completed->wait();
+    pfd = {.fd=completed->event_fd(), .events=POLLIN};
+    ASSERT_EQ(poll(&pfd, 1, 0), 1);
+}
+#endif
@@ -0,0 +1,154 @@
+// Copyright Mario "Neo" Sieg 2024. All rights reserved. mario.sieg.64@gmail.com
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include <isolate.hpp>
+#include <kv_cache.hpp>
+#include <tensor.hpp>
+#include <thread_pool.hpp>
+
+using namespace rtml;
+
+static constexpr dim k_heads {2};
+static constexpr dim k_head_dim {8};
+
+static auto token(std::mt19937& prng) -> std::vector<float> {
+    std::uniform_real_distribution<float> dist {-1.0f, 1.0f};
+    std::vector<float> x(k_heads*k_head_dim);
+    for (float& v : x) v = dist(prng);
+    return x;
+}
+
+// Reference attention over contiguous keys and values of one head
+static auto reference(const std::vector<std::vector<float>>& keys, const std::vector<std::vector<float>>& values, const dim head, const float* q, const float scale) -> std::vector<float> {
+    std::vector<float> s(keys.size());
+    float max {-INFINITY};
+    for (std::size_t t {}; t < keys.size(); ++t) {
+        float dot {};
+        for (dim j {}; j < k_head_dim; ++j) dot += q[j]*keys[t][head*k_head_dim+j];
+        s[t] = dot*scale;
+        max = std::max(max, s[t]);
+    }
+    float sum {};
+    for (float& x : s) sum += x = std::exp(x - max);
+    std::vector<float> o(k_head_dim);
+    for (std::size_t t {}; t < keys.size(); ++t)
+        for (dim j {}; j < k_head_dim; ++j)
+            o[j] += s[t]/sum*values[t][head*k_head_dim+j];
+    return o;
+}
+
+TEST(kv_cache, append_and_block_table) {
+    auto ctx {isolate::create("kv_test", isolate::compute_device::cpu, 0x1000<<8)};
+    kv_cache cache {*ctx, {.num_heads=k_heads, .head_dim=k_head_dim, .page_size=4, .num_pages=8}};
+    std::mt19937 prng {1};
+    const kv_cache::seq_id seq {cache.create_sequence()};
+    std::vector<std::vector<float>> keys {};
+    for (dim i {}; i < 10; ++i) {
+        keys.emplace_back(token(prng));
+        ASSERT_TRUE(cache.append(seq, keys.back(), keys.back()));
+    }
+    ASSERT_EQ(cache.length(seq), 10);
+    ASSERT_EQ(cache.block_table(seq).size(), 3);
+    ASSERT_EQ(cache.free_pages(), 5);
+    for (dim i {}; i < 10; ++i)
+        for (dim h {}; h < k_heads; ++h)
+            for (dim j {}; j < k_head_dim; ++j) {
+                ASSERT_EQ(cache.key(seq, i, h)[j], keys[i][h*k_head_dim+j]);
+                ASSERT_EQ(cache.value(seq, i, h)[j], keys[i][h*k_head_dim+j]);
+            }
+}
+
+TEST(kv_cache, out_of_pages_and_reuse) {
+    auto ctx {isolate::create("kv_test", isolate::compute_device::cpu, 0x1000<<8)};
+    kv_cache cache {*ctx, {.num_heads=k_heads, .head_dim=k_head_dim, .page_size=4, .num_pages=4}};
+    std::mt19937 prng {2};
+    const std::vector<float> x {token(prng)};
+    std::vector<kv_cache::seq_id> seqs {};
+    for (int i {}; i < 4; ++i) {
+        seqs.emplace_back(cache.create_sequence());
+        ASSERT_TRUE(cache.append(seqs.back(), x, x));
+    }
+    ASSERT_EQ(cache.free_pages(), 0);
+    const kv_cache::seq_id extra {cache.create_sequence()};
+    ASSERT_FALSE(cache.append(extra, x, x));
+    ASSERT_EQ(cache.length(extra), 0);
+    cache.free_sequence(seqs[1]);
+    cache.free_sequence(seqs[3]);
+    ASSERT_EQ(cache.free_pages(), 2);
+    for (int i {}; i < 8; ++i) // Non adjacent pages are reused by a single sequence
+        ASSERT_TRUE(cache.append(extra, x, x));
+    ASSERT_FALSE(cache.append(extra, x, x));
+    ASSERT_EQ(cache.length(extra), 8);
+    const kv_cache::seq_id reused {cache.create_sequence()}; // Sequence slots are reused
+    ASSERT_TRUE(reused == seqs[1] || reused == seqs[3]);
+}
+
+TEST(kv_cache, fork_copy_on_write) {
+    auto ctx {isolate::create("kv_test", isolate::compute_device::cpu, 0x1000<<8)};
+    kv_cache cache {*ctx, {.num_heads=k_heads, .head_dim=k_head_dim, .page_size=4, .num_pages=8}};
+    std::mt19937 prng {3};
+    const kv_cache::seq_id parent {cache.create_sequence()};
+    std::vector<std::vector<float>> prefix {};
+    for (int i {}; i < 6; ++i) {
+        prefix.emplace_back(token(prng));
+        ASSERT_TRUE(cache.append(parent, prefix.back(), prefix.back()));
+    }
+    const kv_cache::seq_id child {cache.fork(parent)};
+    ASSERT_EQ(cache.free_pages(), 6);
+    ASSERT_EQ(cache.ref_count(cache.block_table(parent)[0]), 2);
+    const std::vector<float> a {token(prng)};
+    const std::vector<float> b {token(prng)};
+    ASSERT_TRUE(cache.append(child, a, a)); // Copies the shared, partially filled last page
+    ASSERT_TRUE(cache.append(parent, b, b)); // Last page is exclusive again
+    ASSERT_EQ(cache.free_pages(), 5);
+    ASSERT_EQ(cache.block_table(parent)[0], cache.block_table(child)[0]);
+    ASSERT_NE(cache.block_table(parent)[1], cache.block_table(child)[1]);
+    for (dim j {}; j < k_head_dim; ++j) {
+        ASSERT_EQ(cache.key(child, 5, 1)[j], prefix[5][k_head_dim+j]);
+        ASSERT_EQ(cache.key(child, 6, 0)[j], a[j]);
+        ASSERT_EQ(cache.key(parent, 6, 0)[j], b[j]);
+    }
+    cache.free_sequence(parent);
+    ASSERT_EQ(cache.ref_count(cache.block_table(child)[0]), 1);
+    cache.free_sequence(child);
+    ASSERT_EQ(cache.free_pages(), 8);
+}
+
+TEST(kv_cache, paged_attention) {
+    auto ctx {isolate::create("kv_test", isolate::compute_device::cpu, 0x1000<<8)};
+    kv_cache cache {*ctx, {.num_heads=k_heads, .head_dim=k_head_dim, .page_size=4, .num_pages=64}};
+    std::mt19937 prng {4};
+    static constexpr dim k_q_heads {k_heads*2}; // Grouped query attention
+    static constexpr std::array<dim, 3> k_lens {1, 7, 150};
+    std::vector<kv_cache::seq_id> seqs {};
+    std::vector<std::vector<std::vector<float>>> keys(k_lens.size()), values(k_lens.size());
+    for (std::size_t s {}; s < k_lens.size(); ++s) {
+        seqs.emplace_back(cache.create_sequence());
+        for (dim i {}; i < k_lens[s]; ++i) {
+            keys[s].emplace_back(token(prng));
+            values[s].emplace_back(token(prng));
+            ASSERT_TRUE(cache.append(seqs.back(), keys[s].back(), values[s].back()));
+        }
+    }
+    tensor<>* const q {ctx->new_tensor<float>({k_head_dim, k_q_heads, static_cast<dim>(seqs.size())})};
+    tensor<>* const r {ctx->new_tensor<float>({k_head_dim, k_q_heads, static_cast<dim>(seqs.size())})};
+    std::uniform_real_distribution<float> dist {-1.0f, 1.0f};
+    for (float& x : q->data()) x = dist(prng);
+    const float scale {1.0f / std::sqrt(static_cast<float>(k_head_dim))};
+    thread_pool pool {3};
+    pool.parallel_for([&](const blas::compute_ctx& cctx) { paged_attention(cctx, cache, seqs, *q, *r, scale); });
+    const auto* const qd {reinterpret_cast<const float*>(q->ptr())};
+    const auto* const rd {reinterpret_cast<const float*>(r->ptr())};
+    for (std::size_t s {}; s < seqs.size(); ++s)
+        for (dim h {}; h < k_q_heads; ++h) {
+            const dim off {(static_cast<dim>(s)*k_q_heads + h)*k_head_dim};
+            const std::vector<float> o {reference(keys[s], values[s], h / 2, qd + off, scale)};
+            for (dim j {}; j < k_head_dim; ++j)
+                ASSERT_NEAR(rd[off+j], o[j], 1e-4f);
+        }
+}
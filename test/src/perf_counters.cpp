@@ -0,0 +1,50 @@
+// Copyright Mario "Neo" Sieg 2024. All rights reserved. mario.sieg.64@gmail.com
+
+#include <gtest/gtest.h>
+
+#include <thread>
+
+#include <perf_counters.hpp>
+
+using namespace rtml;
+
+static auto busy_work(const std::size_t n) -> float {
+    volatile float acc {};
+    for (std::size_t i {}; i < n; ++i)
+        acc = acc + static_cast<float>(i);
+    return acc;
+}
+
+TEST(perf_counters, counts_are_monotonic) {
+    const perf::counter_group& counters {perf::thread_counters()};
+    if (!counters.is_valid()) GTEST_SKIP() << "Hardware performance counters are not available";
+    const perf::counter_values begin {counters.read()};
+    busy_work(1<<20);
+    const perf::counter_values end {counters.read()};
+    for (std::size_t i {}; i < perf::k_num_counters; ++i) {
+        if (!counters.is_available(static_cast<perf::counter>(i))) continue;
+        ASSERT_GE(end[i], begin[i]);
+    }
+    if (counters.is_available(perf::counter::instructions)) {
+        ASSERT_GE(end[static_cast<std::size_t>(perf::counter::instructions)] - begin[static_cast<std::size_t>(perf::counter::instructions)], 1<<20);
+    }
+}
+
+TEST(perf_counters, inherit_counts_child_threads) {
+    const perf::counter_group counters {true};
+    if (!counters.is_available(perf::counter::instructions)) GTEST_SKIP() << "Hardware performance counters are not available";
+    const perf::counter_values begin {counters.read()};
+    std::thread worker {[] { busy_work(1<<22); }};
+    worker.join();
+    const perf::counter_values end {counters.read()};
+    ASSERT_GE(end[static_cast<std::size_t>(perf::counter::instructions)] - begin[static_cast<std::size_t>(perf::counter::instructions)], 1<<22);
+}
+
+TEST(perf_counters, unavailable_counters_read_zero) {
+    const perf::counter_group& counters {perf::thread_counters()};
+    const perf::counter_values values {counters.read()};
+    for (std::size_t i {}; i < perf::k_num_counters; ++i) {
+        if (counters.is_available(static_cast<perf::counter>(i))) continue;
+        ASSERT_EQ(values[i], 0);
+    }
+}
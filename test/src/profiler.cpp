@@ -0,0 +1,133 @@
+// Copyright Mario "Neo" Sieg 2024. All rights reserved. mario.sieg.64@gmail.com
+
+#include <gtest/gtest.h>
+
+#include <thread>
+
+#include <blas.hpp>
+#include <graph.hpp>
+#include <isolate.hpp>
+#include <profiler.hpp>
+#include <tensor.hpp>
+
+using namespace rtml;
+
+TEST(profiler, disabled_records_nothing) {
+    profiler::disable();
+    profiler::reset();
+    auto ctx = isolate::create("test", isolate::compute_device::cpu, 0x1000<<3);
+    tensor<float>* a = ctx->new_tensor<float>({4, 4});
+    tensor<float>* b = ctx->new_tensor<float>({4, 4});
+    tensor<float>* c = ctx->new_tensor<float>({4, 4});
+    blas::compute_ctx cctx {};
+    blas::add(cctx, *c, *a, *b);
+    ASSERT_TRUE(profiler::collect().empty());
+}
+
+TEST(profiler, records_ops) {
+    profiler::reset();
+    profiler::enable();
+    auto ctx = isolate::create("test", isolate::compute_device::cpu, 0x1000<<3);
+    tensor<float>* a = ctx->new_tensor<float>({4, 8, 2});
+    tensor<float>* b = ctx->new_tensor<float>({4, 8, 2});
+    tensor<float>* c = ctx->new_tensor<float>({4, 8, 2});
+    a->splat_one();
+    b->splat_one();
+    c->set_name("result");
+    blas::compute_ctx cctx {};
+    blas::add(cctx, *c, *a, *b);
+    blas::mul(cctx, *c, *a, *b);
+    profiler::disable();
+    const std::vector<profiler::event> events {profiler::collect()};
+    ASSERT_EQ(events.size(), 2);
+    ASSERT_EQ(events[0].op, graph::opcode::add);
+    ASSERT_EQ(events[1].op, graph::opcode::mul);
+    for (const profiler::event& e : events) {
+        ASSERT_LE(e.start_ns, e.end_ns);
+        ASSERT_STREQ(e.name.data(), "result");
+        ASSERT_EQ(e.flops, 4*8*2);
+        ASSERT_EQ(e.bytes, 3*4*8*2*sizeof(float));
+        ASSERT_EQ(e.num_tensors, 3);
+        ASSERT_EQ(e.shapes[0][0], 4);
+        ASSERT_EQ(e.shapes[0][1], 8);
+        ASSERT_EQ(e.shapes[0][2], 2);
+        ASSERT_EQ(e.shapes[0][3], 1);
+    }
+    const std::string trace {profiler::chrome_trace()};
+    ASSERT_NE(trace.find("\"traceEvents\""), std::string::npos);
+    ASSERT_NE(trace.find("\"name\":\"+\""), std::string::npos);
+    ASSERT_NE(trace.find("\"tensor\":\"result\""), std::string::npos);
+    const std::string table {profiler::summary_table()};
+    ASSERT_NE(table.find("GFLOP/s"), std::string::npos);
+    profiler::reset();
+    ASSERT_TRUE(profiler::collect().empty());
+}
+
+TEST(profiler, ring_buffer_drops_when_full) {
+    profiler::ring_buffer ring {0};
+    const profiler::event e {};
+    for (std::size_t i {}; i < profiler::ring_buffer::k_capacity; ++i)
+        ASSERT_TRUE(ring.push(e));
+    ASSERT_FALSE(ring.push(e));
+    ASSERT_EQ(ring.dropped(), 1);
+    ASSERT_EQ(ring.drain([](const profiler::event&) {}), profiler::ring_buffer::k_capacity);
+    ASSERT_TRUE(ring.push(e));
+}
+
+TEST(profiler, reuses_rings_of_exited_threads) {
+    profiler::reset();
+    profiler::enable();
+    auto ctx = isolate::create("test", isolate::compute_device::cpu, 0x1000<<3);
+    tensor<float>* a = ctx->new_tensor<float>({4, 4});
+    tensor<float>* b = ctx->new_tensor<float>({4, 4});
+    tensor<float>* c = ctx->new_tensor<float>({4, 4});
+    const auto record {[&] {
+        blas::compute_ctx cctx {};
+        blas::add(cctx, *c, *a, *b);
+    }};
+    std::thread{record}.join();
+    std::thread{record}.join();
+    profiler::disable();
+    const std::vector<profiler::event> events {profiler::collect()};
+    ASSERT_EQ(events.size(), 2);
+    ASSERT_EQ(events[0].tid, events[1].tid); // The second thread got the ring of the first one
+    profiler::reset();
+}
+
+TEST(profiler, counters_enabled_during_scope) { // A scope which began without counters records none
+    profiler::reset();
+    profiler::enable();
+    auto ctx = isolate::create("test", isolate::compute_device::cpu, 0x1000<<3);
+    tensor<float>* a = ctx->new_tensor<float>({4, 4});
+    tensor<float>* c = ctx->new_tensor<float>({4, 4});
+    {
+        const profiler::scope scope {graph::opcode::relu, 0, *c, *a};
+        profiler::enable(true);
+    }
+    profiler::disable();
+    const std::vector<profiler::event> events {profiler::collect()};
+    ASSERT_EQ(events.size(), 1);
+    ASSERT_EQ(events[0].counter_mask, 0);
+    profiler::reset();
+}
+
+TEST(profiler, records_counters) {
+    if (!perf::thread_counters().is_valid()) GTEST_SKIP() << "Hardware performance counters are not available";
+    profiler::reset();
+    profiler::enable(true);
+    auto ctx = isolate::create("test", isolate::compute_device::cpu, 0x1000<<5);
+    tensor<float>* a = ctx->new_tensor<float>({64, 64});
+    tensor<float>* b = ctx->new_tensor<float>({64, 64});
+    tensor<float>* c = ctx->new_tensor<float>({64, 64});
+    blas::compute_ctx cctx {};
+    blas::matmul(cctx, *c, *a, *b);
+    profiler::disable();
+    const std::vector<profiler::event> events {profiler::collect()};
+    ASSERT_EQ(events.size(), 1);
+    ASSERT_EQ(events[0].counter_mask, perf::thread_counters().mask());
+    if (perf::thread_counters().is_available(perf::counter::instructions)) {
+        ASSERT_GT(events[0].counters[static_cast<std::size_t>(perf::counter::instructions)], 64*64*64);
+    }
+    ASSERT_NE(profiler::summary_table().find("IPC"), std::string::npos);
+    profiler::reset();
+}
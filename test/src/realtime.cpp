@@ -0,0 +1,103 @@
+// Copyright Mario "Neo" Sieg 2024. All rights reserved. mario.sieg.64@gmail.com
+
+#include <gtest/gtest.h>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#include <executor.hpp>
+#include <graph.hpp>
+#include <isolate.hpp>
+#include <realtime.hpp>
+#include <tensor.hpp>
+
+using namespace rtml;
+using namespace std::chrono_literals;
+
+// r = relu(x) + x
+static auto build_graph(isolate& ctx, graph::executor& g) -> tensor<>* {
+    tensor<>* const x {ctx.new_tensor<float>({64, 32})};
+    tensor<>* const a {ctx.new_tensor<float>({64, 32})};
+    tensor<>* const r {ctx.new_tensor<float>({64, 32})};
+    x->splat(-2.0f);
+    EXPECT_EQ(g.push({.op=graph::opcode::relu, .r=a, .x=x}), nullptr);
+    EXPECT_EQ(g.push({.op=graph::opcode::add, .r=r, .x=a, .y=x}), nullptr);
+    return r;
+}
+
+TEST(realtime, deadline_and_stats) {
+    auto ctx {isolate::create("rt_test", isolate::compute_device::cpu, 0x1000<<10)};
+    graph::executor g {};
+    tensor<>* const r {build_graph(*ctx, g)};
+    realtime_executor rt {{.deadline=1s, .num_threads=2, .cores={0}, .latency_log=8}};
+    ASSERT_EQ(rt.pool().num_threads(), 2);
+    for (int i {}; i < 20; ++i) {
+        const run_result res {rt.run(g)};
+        ASSERT_FALSE(res.missed);
+        ASSERT_FALSE(res.aborted);
+        ASSERT_EQ(res.nodes_run, 2);
+        ASSERT_GT(res.latency.count(), 0);
+    }
+    ASSERT_FLOAT_EQ((*r)(0), -2.0f);
+    const realtime_stats& s {rt.stats()};
+    ASSERT_EQ(s.runs, 20);
+    ASSERT_EQ(s.misses, 0);
+    ASSERT_LE(s.min_latency, s.max_latency);
+    ASSERT_LE(rt.latency_percentile(0.5), rt.latency_percentile(1.0));
+    ASSERT_LE(rt.latency_percentile(1.0), s.max_latency);
+    rt.reset_stats();
+    ASSERT_EQ(rt.stats().runs, 0);
+}
+
+TEST(realtime, deadline_miss) {
+    auto ctx {isolate::create("rt_test", isolate::compute_device::cpu, 0x1000<<10)};
+    graph::executor g {};
+    (void)build_graph(*ctx, g);
+    realtime_executor rt {{.deadline=1ns, .num_threads=1}};
+    ASSERT_TRUE(rt.run(g).missed);
+    ASSERT_EQ(rt.stats().misses, 1);
+}
+
+TEST(realtime, scheduling_fallback) { // SCHED_FIFO if permitted, otherwise the fallback is reported, execution works either way
+    auto ctx {isolate::create("rt_test", isolate::compute_device::cpu, 0x1000<<10)};
+    graph::executor g {};
+    (void)build_graph(*ctx, g);
+#ifdef __linux__
+    const int policy {sched_getscheduler(0)};
+#endif
+    {
+        realtime_executor rt {{.deadline=1s, .num_threads=2, .fifo_priority=10}};
+        const thread_priority p {rt.scheduling()};
+        ASSERT_TRUE(p == thread_priority::realtime || p == thread_priority::elevated || p == thread_priority::normal);
+#ifdef __linux__
+        if (p == thread_priority::realtime) {
+            ASSERT_EQ(sched_getscheduler(0), SCHED_FIFO); // Calling thread is thread 0
+        }
+#endif
+        ASSERT_EQ(rt.run(g).nodes_run, 2);
+    }
+#ifdef __linux__
+    ASSERT_EQ(sched_getscheduler(0), policy); // Restored on destruction
+#endif
+}
+
+TEST(realtime, preemption) {
+    auto ctx {isolate::create("rt_test", isolate::compute_device::cpu, 0x1000<<10)};
+    graph::executor g {};
+    (void)build_graph(*ctx, g);
+    realtime_executor low {{.deadline=1s, .num_threads=1, .priority=1, .abortable=true}};
+    realtime_executor pinned {{.deadline=1s, .num_threads=1, .priority=1}};
+    {
+        const realtime_executor::core_claim high {2}; // E.g. a run of a priority 2 executor on another thread
+        ASSERT_TRUE(realtime_executor::is_preempted(1));
+        ASSERT_FALSE(realtime_executor::is_preempted(2));
+        const run_result res {low.run(g)};
+        ASSERT_TRUE(res.aborted);
+        ASSERT_EQ(res.nodes_run, 0);
+        ASSERT_EQ(pinned.run(g).nodes_run, 2); // Not abortable
+    }
+    ASSERT_FALSE(realtime_executor::is_preempted(1));
+    ASSERT_EQ(low.run(g).nodes_run, 2);
+    ASSERT_EQ(low.stats().aborts, 1);
+}
@@ -0,0 +1,94 @@
+// Copyright Mario "Neo" Sieg 2024. All rights reserved. mario.sieg.64@gmail.com
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include <blas.hpp>
+#include <isolate.hpp>
+#include <ring_tensor.hpp>
+#include <tensor.hpp>
+#include <thread_pool.hpp>
+
+using namespace rtml;
+
+// Frame t has the elements t * 100 + feature, frames before the stream start are zero
+static auto check_window(const ring_tensor& ring) -> void {
+    const tensor<>& w {ring.latest()};
+    ASSERT_EQ(w.dims()[0], ring.features());
+    ASSERT_EQ(w.dims()[1], ring.window());
+    ASSERT_TRUE(w.is_dense());
+    for (dim i {}; i < ring.window(); ++i) {
+        const dim t {ring.frames() - ring.window() + i};
+        for (dim f {}; f < ring.features(); ++f)
+            ASSERT_FLOAT_EQ(w({f, i, 0, 0}), t < 0 ? 0.0f : static_cast<float>(t*100 + f)) << "frame " << t;
+    }
+}
+
+TEST(ring_tensor, push_frames) {
+    auto ctx {isolate::create("ring_test", isolate::compute_device::cpu, 0x1000<<10)};
+    ring_tensor ring {*ctx, 3, 10};
+    ASSERT_GE(ring.capacity(), ring.window());
+    const tensor<>* const view {&ring.latest()};
+    check_window(ring);
+    for (dim t {}; t < 4*ring.capacity() + 7; ++t) { // Wraps around the ring several times
+        ring.push(std::vector<float>{static_cast<float>(t*100), static_cast<float>(t*100 + 1), static_cast<float>(t*100 + 2)});
+        ASSERT_EQ(&ring.latest(), view); // Same tensor, only the data pointer moves
+        check_window(ring);
+    }
+}
+
+TEST(ring_tensor, push_chunks) {
+    auto ctx {isolate::create("ring_test", isolate::compute_device::cpu, 0x1000<<10)};
+    ring_tensor ring {*ctx, 4, 37};
+    std::vector<float> chunk {};
+    for (const dim n : {5, 1, 36, 13, 600, 2, 64, 64, 9}) { // 600 is larger than the capacity
+        const dim n_frames {std::min(n, 3*ring.capacity())};
+        chunk.clear();
+        for (dim t {ring.frames()}; t < ring.frames() + n_frames; ++t)
+            for (dim f {}; f < 4; ++f)
+                chunk.emplace_back(static_cast<float>(t*100 + f));
+        ring.push(chunk);
+        check_window(ring);
+    }
+}
+
+TEST(ring_tensor, acquire_commit) {
+    auto ctx {isolate::create("ring_test", isolate::compute_device::cpu, 0x1000<<10)};
+    ring_tensor ring {*ctx, 2, 8};
+    for (int i {}; i < 50; ++i) {
+        const dim n {i % 5 + 1};
+        const std::span<float> slots {ring.acquire(n)};
+        ASSERT_EQ(slots.size(), n*2);
+        for (dim j {}; j < n; ++j)
+            for (dim f {}; f < 2; ++f)
+                slots[j*2 + f] = static_cast<float>((ring.frames() + j)*100 + f);
+        ring.commit(n);
+        check_window(ring);
+    }
+}
+
+TEST(ring_tensor, double_mapping) {
+    auto ctx {isolate::create("ring_test", isolate::compute_device::cpu, 0x1000<<10)};
+    ring_tensor ring {*ctx, 16, 100};
+    if (!ring.is_double_mapped()) GTEST_SKIP() << "Double mapping is not available (memfd or mmap blocked)";
+    const std::span<float> a {ring.acquire(1)};
+    a[0] = 42.0f;
+    const float* const mirror {a.data() + ring.capacity()*ring.features()};
+    ASSERT_FLOAT_EQ(*mirror, 42.0f); // Same page mapped twice
+}
+
+TEST(ring_tensor, window_as_operand) { // The window feeds dense kernels directly, also when it wraps around
+    auto ctx {isolate::create("ring_test", isolate::compute_device::cpu, 0x1000<<10)};
+    ring_tensor ring {*ctx, 8, 16};
+    tensor<>* const r {ctx->new_tensor<float>({8, 16})};
+    thread_pool pool {2};
+    std::vector<float> frame(8);
+    for (dim t {}; t < ring.capacity() + 9; ++t) {
+        std::ranges::fill(frame, static_cast<float>(t));
+        ring.push(frame);
+    }
+    pool.parallel_for([&](const blas::compute_ctx& cctx) { blas::add(cctx, *r, ring.latest(), ring.latest()); });
+    for (dim i {}; i < 16; ++i)
+        ASSERT_FLOAT_EQ((*r)({0, i, 0, 0}), 2.0f*static_cast<float>(ring.frames() - 16 + i));
+}
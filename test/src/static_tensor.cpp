@@ -0,0 +1,114 @@
+// Copyright Mario "Neo" Sieg 2024. All rights reserved. mario.sieg.64@gmail.com
+
+#include <gtest/gtest.h>
+
+#include <blas.hpp>
+#include <isolate.hpp>
+#include <static_tensor.hpp>
+#include <tensor.hpp>
+
+#include "test_util.hpp"
+
+using namespace rtml;
+using test::fill_random;
+
+// Static kernel on views of pool tensors vs. the dynamic kernel on the same tensors
+template <typename R, typename Y>
+static auto check_binary(isolate& ctx) -> void {
+    tensor<>* const x {R::new_tensor(ctx)};
+    tensor<>* const y {Y::new_tensor(ctx)};
+    tensor<>* const r {R::new_tensor(ctx)};
+    tensor<>* const expected {R::new_tensor(ctx)};
+    fill_random(*x, 1);
+    fill_random(*y, 2);
+    for (float& v : y->data()) v += 3.0f; // Keeps divisors away from zero
+    const R sr {*r}, sx {*x};
+    const Y sy {*y};
+    const auto check {[&](const char* const name) {
+        for (dim i {}; i < R::k_elems; ++i)
+            ASSERT_FLOAT_EQ(sr(i), (*expected)(i)) << name << " i " << i;
+    }};
+    blas::add(blas::compute_ctx{}, *expected, *x, *y);
+    blas::add(sr, sx, sy);
+    check("add");
+    blas::sub(blas::compute_ctx{}, *expected, *x, *y);
+    blas::sub(sr, sx, sy);
+    check("sub");
+    blas::mul(blas::compute_ctx{}, *expected, *x, *y);
+    blas::mul(sr, sx, sy);
+    check("mul");
+    blas::div(blas::compute_ctx{}, *expected, *x, *y);
+    blas::div(sr, sx, sy);
+    check("div");
+}
+
+TEST(static_tensor, shape_and_view) {
+    using t = static_tensor<float, 16, 8, 3>;
+    static_assert(t::k_elems == 16*8*3 && t::k_rows == 8*3 && t::k_rank == 3);
+    static_assert(t::k_strides[1] == 16 && t::k_strides[2] == 16*8 && t::k_strides[3] == 16*8*3);
+    static_assert(static_tensor<float, 5>::k_rank == 1 && static_tensor<float, 5, 1, 1, 2>::k_rank == 4);
+    auto ctx {isolate::create("static_test", isolate::compute_device::cpu, 0x1000<<4)};
+    tensor<>* const x {t::new_tensor(*ctx)};
+    ASSERT_EQ(x->dim_count(), 3);
+    ASSERT_TRUE(t::matches(*x));
+    ASSERT_FALSE((static_tensor<float, 16, 8>::matches(*x)));
+    ASSERT_FALSE(t::matches(*x->transposed_clone())); // Same elements, but not dense
+    fill_random(*x, 3);
+    const t v {*x};
+    ASSERT_EQ(v.ptr(), reinterpret_cast<float*>(x->ptr())); // Views the pool storage, no copy
+    for (const std::array<dim, 4> idx : {std::array<dim, 4>{0, 0, 0, 0}, {15, 7, 2, 0}, {3, 5, 1, 0}})
+        ASSERT_EQ(&v(idx), &(*x)(idx));
+}
+
+TEST(static_tensor, binary_broadcast) {
+    auto ctx {isolate::create("static_test", isolate::compute_device::cpu, 0x1000<<6)};
+    check_binary<static_tensor<float, 37>, static_tensor<float, 37>>(*ctx);
+    check_binary<static_tensor<float, 16, 16>, static_tensor<float, 16, 16>>(*ctx);
+    check_binary<static_tensor<float, 16, 16>, static_tensor<float, 16>>(*ctx);          // Bias row
+    check_binary<static_tensor<float, 8, 8, 4>, static_tensor<float, 1, 8>>(*ctx);      // Scalar per row
+    check_binary<static_tensor<float, 8, 6, 4, 2>, static_tensor<float, 8, 1, 4>>(*ctx);
+    check_binary<static_tensor<float, 5, 3, 2>, static_tensor<float, 1>>(*ctx);         // Scalar
+    static_assert(!static_broadcastable<static_tensor<float, 16, 16>, static_tensor<float, 8>>);
+    static_assert(!static_broadcastable<static_tensor<float, 16>, static_tensor<float, 16, 2>>);
+}
+
+TEST(static_tensor, unary) {
+    using t = static_tensor<float, 24, 5>;
+    auto ctx {isolate::create("static_test", isolate::compute_device::cpu, 0x1000<<4)};
+    tensor<>* const x {t::new_tensor(*ctx)};
+    tensor<>* const r {t::new_tensor(*ctx)};
+    tensor<>* const expected {t::new_tensor(*ctx)};
+    fill_random(*x, 4);
+    const t sr {*r}, sx {*x};
+    using dynamic_op = auto (const blas::compute_ctx&, tensor<>&, const tensor<>&) noexcept -> void;
+    using static_op = auto (const t&, const t&) noexcept -> void;
+    const std::array<std::pair<dynamic_op*, static_op*>, 6> ops {{
+        {&blas::softmax, &blas::softmax<t>},
+        {&blas::sigmoid, &blas::sigmoid<t>},
+        {&blas::tanh, &blas::tanh<t>},
+        {&blas::relu, &blas::relu<t>},
+        {&blas::gelu, &blas::gelu<t>},
+        {&blas::silu, &blas::silu<t>},
+    }};
+    for (std::size_t op {}; op < ops.size(); ++op) {
+        (*ops[op].first)(blas::compute_ctx{}, *expected, *x);
+        (*ops[op].second)(sr, sx);
+        for (dim i {}; i < t::k_elems; ++i)
+            ASSERT_NEAR(sr(i), (*expected)(i), 1e-5f) << "op " << op << " i " << i;
+    }
+}
+
+TEST(static_tensor, matmul) {
+    static constexpr dim M {6}, N {16}, K {9};
+    auto ctx {isolate::create("static_test", isolate::compute_device::cpu, 0x1000<<4)};
+    tensor<>* const x {static_tensor<float, K, M>::new_tensor(*ctx)};
+    tensor<>* const y {static_tensor<float, N, K>::new_tensor(*ctx)};
+    tensor<>* const r {static_tensor<float, N, M>::new_tensor(*ctx)};
+    tensor<>* const expected {static_tensor<float, N, M>::new_tensor(*ctx)};
+    fill_random(*x, 5);
+    fill_random(*y, 6);
+    blas::matmul(blas::compute_ctx{}, *expected, *x, *y);
+    blas::matmul(static_tensor<float, N, M>{*r}, static_tensor<float, K, M>{*x}, static_tensor<float, N, K>{*y});
+    for (dim i {}; i < M*N; ++i)
+        ASSERT_NEAR((*r)(i), (*expected)(i), 1e-4f) << "i " << i;
+}
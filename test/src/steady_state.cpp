@@ -0,0 +1,207 @@
+// Copyright Mario "Neo" Sieg 2024. All rights reserved. mario.sieg.64@gmail.com
+// Allocation-free steady state: malloc and friends are interposed for the whole test binary (glibc), while a heap_guard
+// is armed every heap call of any thread is counted, the tests warm up, lock the runtime and require zero heap calls
+
+#include <gtest/gtest.h>
+
+#include <array>
+#include <atomic>
+#include <cstdlib>
+#include <thread>
+
+#include <conv.hpp>
+#include <executor.hpp>
+#include <graph.hpp>
+#include <isolate.hpp>
+#include <realtime.hpp>
+#include <ring_tensor.hpp>
+#include <tensor.hpp>
+#include <tensor_queue.hpp>
+#include <thread_pool.hpp>
+
+#if defined(__linux__) && defined(__GLIBC__)
+#define RTML_HEAP_INTERPOSE 1
+
+static constinit std::atomic_bool g_heap_armed {};
+static constinit std::atomic_size_t g_heap_calls {};
+
+static auto count_heap_call() noexcept -> void {
+    if (g_heap_armed.load(std::memory_order_relaxed)) [[unlikely]]
+        g_heap_calls.fetch_add(1, std::memory_order_relaxed);
+}
+
+extern "C" {
+    auto __libc_malloc(std::size_t size) -> void*;
+    auto __libc_calloc(std::size_t n, std::size_t size) -> void*;
+    auto __libc_realloc(void* p, std::size_t size) -> void*;
+    auto __libc_memalign(std::size_t align, std::size_t size) -> void*;
+    auto __libc_free(void* p) -> void;
+
+    auto malloc(const std::size_t size) -> void* { count_heap_call(); return __libc_malloc(size); }
+    auto calloc(const std::size_t n, const std::size_t size) -> void* { count_heap_call(); return __libc_calloc(n, size); }
+    auto realloc(void* const p, const std::size_t size) -> void* { count_heap_call(); return __libc_realloc(p, size); }
+    auto memalign(const std::size_t align, const std::size_t size) -> void* { count_heap_call(); return __libc_memalign(align, size); }
+    auto aligned_alloc(const std::size_t align, const std::size_t size) -> void* { count_heap_call(); return __libc_memalign(align, size); }
+    auto posix_memalign(void** const p, const std::size_t align, const std::size_t size) -> int {
+        count_heap_call();
+        *p = __libc_memalign(align, size);
+        return *p ? 0 : ENOMEM;
+    }
+    auto free(void* const p) -> void {
+        if (p) count_heap_call();
+        __libc_free(p);
+    }
+}
+#else
+#define RTML_HEAP_INTERPOSE 0
+#endif
+
+using namespace rtml;
+
+// Locks the runtime and counts heap calls of all threads for its lifetime
+class heap_guard final {
+public:
+    heap_guard() noexcept {
+        lock_runtime();
+        g_heap_calls.store(0, std::memory_order_relaxed);
+        g_heap_armed.store(true, std::memory_order_seq_cst);
+    }
+    heap_guard(const heap_guard&) = delete;
+    heap_guard(heap_guard&&) = delete;
+    auto operator=(const heap_guard&) -> heap_guard& = delete;
+    auto operator=(heap_guard&&) -> heap_guard& = delete;
+    ~heap_guard() {
+        disarm();
+        unlock_runtime();
+    }
+    auto disarm() noexcept -> std::size_t { // Returns the heap calls since construction
+        g_heap_armed.store(false, std::memory_order_seq_cst);
+        return g_heap_calls.load(std::memory_order_relaxed);
+    }
+};
+
+#define RTML_REQUIRE_INTERPOSE() if (!RTML_HEAP_INTERPOSE) GTEST_SKIP() << "malloc interposition requires glibc"
+
+TEST(steady_state, harness_detects_allocations) {
+    RTML_REQUIRE_INTERPOSE();
+    heap_guard guard {};
+    void* volatile p {std::malloc(64)};
+    std::free(p);
+    auto* volatile v {new std::array<int, 4>{}};
+    delete v;
+    ASSERT_EQ(guard.disarm(), 4);
+}
+
+// Graph with one node of most op families: packed GEMM, elementwise, softmax, norms, reductions and convolution
+TEST(steady_state, graph_execution) {
+    RTML_REQUIRE_INTERPOSE();
+    auto ctx {isolate::create("steady_test", isolate::compute_device::cpu, 0x1000<<12)};
+    tensor<>* const x {ctx->new_tensor<float>({64, 32})};
+    tensor<>* const w {ctx->new_tensor<float>({64, 64})};
+    tensor<>* const h {ctx->new_tensor<float>({64, 32})};
+    tensor<>* const a {ctx->new_tensor<float>({64, 32})};
+    tensor<>* const s {ctx->new_tensor<float>({64, 32})};
+    tensor<>* const p {ctx->new_tensor<float>({64, 32})};
+    tensor<>* const gamma {ctx->new_tensor<float>({64})};
+    tensor<>* const n {ctx->new_tensor<float>({64, 32})};
+    tensor<>* const m {ctx->new_tensor<float>({1, 32})};
+    tensor<>* const cw {ctx->new_tensor<float>({16, 64, 3})};
+    tensor<>* const c {ctx->new_tensor<float>({16, 30})};
+    x->splat(0.5f);
+    w->splat(0.01f);
+    gamma->splat(1.0f);
+    cw->splat(0.1f);
+    graph::executor g {};
+    ASSERT_EQ(g.push({.op=graph::opcode::matmul, .r=h, .x=x, .y=w}), nullptr);
+    ASSERT_EQ(g.push({.op=graph::opcode::gelu, .r=a, .x=h}), nullptr);
+    ASSERT_EQ(g.push({.op=graph::opcode::add, .r=s, .x=a, .y=x}), nullptr);
+    ASSERT_EQ(g.push({.op=graph::opcode::softmax, .r=p, .x=s}), nullptr);
+    ASSERT_EQ(g.push({.op=graph::opcode::rmsnorm, .r=n, .x=p, .y=gamma}), nullptr);
+    ASSERT_EQ(g.push({.op=graph::opcode::mean, .r=m, .x=n}), nullptr);
+    ASSERT_EQ(g.push({.op=graph::opcode::conv1d, .r=c, .x=n, .y=cw}), nullptr);
+    thread_pool pool {3};
+    g.run(pool); // Warm up: per thread GEMM workspaces
+    heap_guard guard {};
+    for (int i {}; i < 16; ++i)
+        g.run(pool);
+    ASSERT_EQ(guard.disarm(), 0);
+}
+
+TEST(steady_state, locked_executor_push) {
+    RTML_REQUIRE_INTERPOSE();
+    auto ctx {isolate::create("steady_test", isolate::compute_device::cpu, 0x1000<<4)};
+    tensor<>* const x {ctx->new_tensor<float>({8})};
+    tensor<>* const r {ctx->new_tensor<float>({8})};
+    graph::executor g {};
+    g.reserve(1);
+    heap_guard guard {};
+    const char* const reserved {g.push({.op=graph::opcode::relu, .r=r, .x=x})};
+    const char* const full {g.push({.op=graph::opcode::relu, .r=r, .x=x})};
+    ASSERT_EQ(guard.disarm(), 0);
+    ASSERT_EQ(reserved, nullptr);
+    ASSERT_NE(full, nullptr); // Would grow the node vector
+}
+
+TEST(steady_state, tensor_views_and_names) { // Views come from the pool, names are formatted in place
+    RTML_REQUIRE_INTERPOSE();
+    auto ctx {isolate::create("steady_test", isolate::compute_device::cpu, 0x1000<<4)};
+    tensor<>* const x {ctx->new_tensor<float>({8, 4})};
+    x->set_name("x");
+    std::array<char, 512> buf {};
+    heap_guard guard {};
+    tensor<>* const t {x->transposed_clone()};
+    tensor<>* const c {x->clone()};
+    *x->format_to(buf.begin(), 4) = '\0';
+    ASSERT_EQ(guard.disarm(), 0);
+    ASSERT_STREQ(t->name(), "x (transposed)");
+    ASSERT_STREQ(c->name(), "x (clone)");
+    ASSERT_EQ(std::string_view{buf.data()}.substr(0, 10), "Tensor x: ");
+}
+
+TEST(steady_state, streaming_input) { // Capture thread -> tensor_queue -> ring_tensor window -> streaming conv on a realtime executor
+    RTML_REQUIRE_INTERPOSE();
+    auto ctx {isolate::create("steady_test", isolate::compute_device::cpu, 0x1000<<10)};
+    tensor_queue q {*ctx, std::array<dim, 2>{8, 4}, 4, tensor_queue::producers::single};
+    ring_tensor ring {*ctx, 8, 32};
+    tensor<>* const w {ctx->new_tensor<float>({8, 1, 5})};
+    tensor<>* const r {ctx->new_tensor<float>({8, 4})};
+    tensor<>* const wr {ctx->new_tensor<float>({8, 32})};
+    w->splat(0.2f);
+    blas::conv1d_stream stream {*ctx, *w, 8, 1, {.groups=8}};
+    graph::executor g {};
+    ASSERT_EQ(g.push({.op=graph::opcode::tanh, .r=wr, .x=&ring.latest()}), nullptr);
+    realtime_executor rt {{.deadline=std::chrono::seconds{1}, .num_threads=2}};
+    const auto step {[&] {
+        tensor_queue::slot* const s {q.pop()};
+        ring.push(s->input->data());
+        rt.pool().parallel_for([&](const blas::compute_ctx& cctx) { stream.process(cctx, *r, *s->input); });
+        (void)rt.run(g);
+        q.recycle(s);
+    }};
+    tensor_queue::slot* const first {q.acquire()};
+    first->input->splat(1.0f);
+    q.publish(first);
+    step(); // Warm up
+    std::atomic_bool done {};
+    std::thread producer {[&q, &done] { // Started before arming and kept alive until disarmed, thread creation and exit allocate
+        for (int i {}; i < 64; ++i) {
+            tensor_queue::slot* const s {q.acquire()};
+            s->input->splat(static_cast<float>(i));
+            q.publish(s);
+        }
+        while (!done.load(std::memory_order_acquire))
+            std::this_thread::yield();
+    }};
+    std::size_t heap_calls;
+    {
+        heap_guard guard {};
+        for (int i {}; i < 64; ++i)
+            step();
+        heap_calls = guard.disarm();
+    }
+    done.store(true, std::memory_order_release);
+    producer.join();
+    ASSERT_EQ(heap_calls, 0);
+    ASSERT_EQ(rt.stats().runs, 65);
+    ASSERT_EQ(ring.frames(), 65*4);
+}
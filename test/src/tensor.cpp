@@ -70,3 +70,18 @@ TEST(tensor, create_4d) {
     ASSERT_EQ(tensor->strides()[2], 4*4*sizeof(float));
     ASSERT_EQ(tensor->strides()[3], 4*4*8*sizeof(float));
 }
+
+TEST(tensor, linear_index_of_strided_view) { // Linear indices of non dense views are unrolled in dim order, dim 1 != dim 2
+    auto ctx = isolate::create("test", isolate::compute_device::cpu, 0x1000<<2);
+    tensor<float>* base = ctx->new_tensor<float>({4, 3, 5, 2});
+    for (dim i {}; i < base->elem_count(); ++i) (*base)(i) = static_cast<float>(i);
+    tensor<float>* view = base->transposed_clone(); // [3, 4, 5, 2], not dense
+    ASSERT_FALSE(view->is_dense());
+    ASSERT_EQ(view->unroll_index(1*1 + 2*3 + 4*3*4 + 1*3*4*5), (std::array<dim, 4>{1, 2, 4, 1}));
+    dim i {};
+    for (dim i3 {}; i3 < 2; ++i3)
+        for (dim i2 {}; i2 < 5; ++i2)
+            for (dim i1 {}; i1 < 4; ++i1)
+                for (dim i0 {}; i0 < 3; ++i0, ++i)
+                    ASSERT_EQ((*view)(i), (*base)({i1, i0, i2, i3})) << "i " << i;
+}
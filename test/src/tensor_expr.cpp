@@ -0,0 +1,92 @@
+// Copyright Mario "Neo" Sieg 2024. All rights reserved. mario.sieg.64@gmail.com
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include <blas.hpp>
+#include <isolate.hpp>
+#include <tensor.hpp>
+#include <tensor_expr.hpp>
+#include <thread_pool.hpp>
+
+#include "test_util.hpp"
+
+using namespace rtml;
+using test::fill_random;
+
+// r = gelu(a * b + c) fused vs. the three blas ops with temporaries, c is broadcasted with the given shape
+static auto check_fused(const std::array<dim, 4>& shape, const std::array<dim, 4>& c_shape, const dim threads) -> void {
+    auto ctx {isolate::create("expr_test", isolate::compute_device::cpu, 0x1000<<10)};
+    tensor<>* const a {ctx->new_tensor<float>(shape)};
+    tensor<>* const b {ctx->new_tensor<float>(shape)};
+    tensor<>* const c {ctx->new_tensor<float>(c_shape)};
+    tensor<>* const r {ctx->new_tensor<float>(shape)};
+    tensor<>* const expected {ctx->new_tensor<float>(shape)};
+    tensor<>* const tmp {ctx->new_tensor<float>(shape)};
+    fill_random(*a, 1);
+    fill_random(*b, 2);
+    fill_random(*c, 3);
+    blas::mul(blas::compute_ctx{}, *tmp, *a, *b);
+    blas::add(blas::compute_ctx{}, *tmp, *tmp, *c);
+    blas::gelu(blas::compute_ctx{}, *expected, *tmp);
+    thread_pool pool {threads};
+    const std::size_t allocated {ctx->pool().bytes_allocated()};
+    {
+        const test::small_op_limit_guard generic {0}; // Always dispatch to the pool
+        const expr::pool_scope scope {pool};
+        ASSERT_EQ(expr::validate(*r, gelu(*a * *b + *c)), nullptr);
+        *r = gelu(*a * *b + *c);
+    }
+    ASSERT_EQ(ctx->pool().bytes_allocated(), allocated); // No intermediate tensors
+    for (dim i {}; i < r->elem_count(); ++i)
+        ASSERT_NEAR((*r)(i), (*expected)(i), 1e-5f) << "i " << i;
+}
+
+TEST(tensor_expr, fused_same_shape) {
+    check_fused({37, 5, 3, 1}, {37, 5, 3, 1}, 1);
+    check_fused({37, 5, 3, 1}, {37, 5, 3, 1}, 3);
+}
+
+TEST(tensor_expr, fused_broadcast) {
+    check_fused({19, 8, 2, 1}, {19, 1, 1, 1}, 2);   // Bias row
+    check_fused({19, 8, 2, 1}, {1, 8, 1, 1}, 2);    // Scalar per row, splatted
+    check_fused({16, 6, 4, 2}, {16, 3, 2, 1}, 3);   // Repeated (tiled) dims 1-3
+}
+
+TEST(tensor_expr, long_rows) { // Rows longer than a block and fewer rows than threads, blocks are split across threads
+    check_fused({3*expr::k_block + 17, 1, 1, 1}, {3*expr::k_block + 17, 1, 1, 1}, 4);
+    check_fused({expr::k_block + 5, 2, 1, 1}, {1, 2, 1, 1}, 3);
+}
+
+TEST(tensor_expr, scalars_and_activations) {
+    auto ctx {isolate::create("expr_test", isolate::compute_device::cpu, 0x1000<<4)};
+    tensor<>* const x {ctx->new_tensor<float>({24, 5})};
+    tensor<>* const y {ctx->new_tensor<float>({24, 5})};
+    tensor<>* const r {ctx->new_tensor<float>({24, 5})};
+    fill_random(*x, 4);
+    fill_random(*y, 5);
+    *r = -(*x * 0.5f) + 2.0f / (1.0f + relu(*y)) - sigmoid(*x) * tanh(*y) + silu(*x - 1.0f);
+    for (dim i {}; i < r->elem_count(); ++i) {
+        const float xv {(*x)(i)}, yv {(*y)(i)};
+        const float expected {-(xv*0.5f) + 2.0f / (1.0f + std::max(yv, 0.0f)) - 1.0f / (1.0f + std::exp(-xv)) * std::tanh(yv) + (xv - 1.0f) / (1.0f + std::exp(1.0f - xv))};
+        ASSERT_NEAR((*r)(i), expected, 1e-5f) << "i " << i;
+    }
+    const std::vector<float> prev {r->data().begin(), r->data().end()};
+    *r = *r * *r; // In place, same shape operands
+    for (dim i {}; i < r->elem_count(); ++i)
+        ASSERT_FLOAT_EQ((*r)(i), prev[i]*prev[i]) << "i " << i;
+}
+
+TEST(tensor_expr, validate) {
+    auto ctx {isolate::create("expr_test", isolate::compute_device::cpu, 0x1000<<4)};
+    tensor<>* const x {ctx->new_tensor<float>({8, 6})};
+    tensor<>* const r {ctx->new_tensor<float>({8, 6})};
+    ASSERT_EQ(expr::validate(*r, *x + *ctx->new_tensor<float>({1, 3})), nullptr);
+    ASSERT_NE(expr::validate(*r, *x + *ctx->new_tensor<float>({4, 6})), nullptr);  // Dim 0 is not repeated
+    ASSERT_NE(expr::validate(*r, *x + *ctx->new_tensor<float>({8, 4})), nullptr);  // 4 does not divide 6
+    tensor<>* const strided {ctx->new_tensor<float>({6, 8})->transposed_clone()}; // [8, 6] view, not dense in dim 0
+    ASSERT_NE(expr::validate(*r, *x + *strided), nullptr);
+    ASSERT_NE(expr::validate(*strided, gelu(*x)), nullptr);
+    ASSERT_DEATH(*r = *x + *ctx->new_tensor<float>({4, 6}), "invalid tensor expression"); // Assignment checks as well
+}
@@ -0,0 +1,109 @@
+// Copyright Mario "Neo" Sieg 2024. All rights reserved. mario.sieg.64@gmail.com
+
+#include <gtest/gtest.h>
+
+#include <array>
+#include <thread>
+#include <vector>
+
+#include <executor.hpp>
+#include <graph.hpp>
+#include <isolate.hpp>
+#include <tensor.hpp>
+#include <tensor_queue.hpp>
+#include <thread_pool.hpp>
+
+using namespace rtml;
+
+static constexpr std::array<dim, 2> k_shape {16, 4};
+
+TEST(tensor_queue, fifo_and_capacity) {
+    auto ctx {isolate::create("queue_test", isolate::compute_device::cpu, 0x1000<<10)};
+    tensor_queue q {*ctx, k_shape, 3, tensor_queue::producers::single};
+    ASSERT_EQ(q.slots().size(), 3);
+    ASSERT_EQ(q.try_pop(), nullptr);
+    std::vector<tensor_queue::slot*> taken {};
+    while (tensor_queue::slot* const s {q.try_acquire()})
+        taken.emplace_back(s);
+    ASSERT_EQ(taken.size(), 3); // All slots in flight
+    for (std::size_t i {}; i < taken.size(); ++i) {
+        taken[i]->tag = i;
+        ASSERT_TRUE(taken[i]->input->is_shape_eq(q.slots()[0].input));
+        q.publish(taken[i]);
+    }
+    for (std::uint64_t i {}; i < 3; ++i) {
+        tensor_queue::slot* const s {q.try_pop()};
+        ASSERT_NE(s, nullptr);
+        ASSERT_EQ(s->tag, i);
+        q.recycle(s);
+    }
+    ASSERT_EQ(q.try_pop(), nullptr);
+    ASSERT_NE(q.try_acquire(), nullptr); // Recycled slots are free again
+}
+
+// Producers write their id and a running counter into the slot tensor, the consumer checks the tensor against the tag
+// and that every producer's slots arrive in order
+static auto stress(const tensor_queue::producers mode, const std::uint32_t num_producers) -> void {
+    static constexpr std::uint64_t k_per_producer {20000};
+    auto ctx {isolate::create("queue_test", isolate::compute_device::cpu, 0x1000<<10)};
+    tensor_queue q {*ctx, k_shape, 8, mode};
+    std::vector<std::thread> producers {};
+    for (std::uint32_t p {}; p < num_producers; ++p) {
+        producers.emplace_back([&q, p] {
+            for (std::uint64_t i {}; i < k_per_producer; ++i) {
+                tensor_queue::slot* const s {q.acquire()};
+                s->tag = (static_cast<std::uint64_t>(p) << 32) | i;
+                s->input->splat(static_cast<float>(p*k_per_producer + i));
+                q.publish(s);
+            }
+        });
+    }
+    std::vector<std::uint64_t> next (num_producers);
+    for (std::uint64_t n {}; n < num_producers*k_per_producer; ++n) {
+        tensor_queue::slot* const s {q.pop()};
+        const auto p {static_cast<std::uint32_t>(s->tag >> 32)};
+        const std::uint64_t i {s->tag & 0xffffffff};
+        ASSERT_LT(p, num_producers);
+        ASSERT_EQ(i, next[p]++);
+        for (const float v : s->input->data())
+            ASSERT_EQ(v, static_cast<float>(p*k_per_producer + i));
+        q.recycle(s);
+    }
+    for (std::thread& t : producers)
+        t.join();
+    ASSERT_EQ(q.try_pop(), nullptr);
+}
+
+TEST(tensor_queue, spsc) {
+    stress(tensor_queue::producers::single, 1);
+}
+
+TEST(tensor_queue, mpsc) {
+    stress(tensor_queue::producers::multi, 4);
+}
+
+TEST(tensor_queue, execute_graph_per_slot) { // One graph per slot, built once, the consumer runs the graph of the popped slot
+    auto ctx {isolate::create("queue_test", isolate::compute_device::cpu, 0x1000<<10)};
+    tensor_queue q {*ctx, k_shape, 4, tensor_queue::producers::single};
+    tensor<>* const r {ctx->new_tensor<float>(k_shape)};
+    std::vector<graph::executor> graphs (q.slots().size());
+    for (const tensor_queue::slot& s : q.slots())
+        ASSERT_EQ(graphs[s.index].push({.op=graph::opcode::relu, .r=r, .x=s.input}), nullptr);
+    thread_pool pool {2};
+    std::thread producer {[&q] {
+        for (int i {}; i < 100; ++i) {
+            tensor_queue::slot* const s {q.acquire()};
+            s->input->splat(i % 2 ? static_cast<float>(i) : -1.0f);
+            s->tag = i;
+            q.publish(s);
+        }
+    }};
+    for (int i {}; i < 100; ++i) {
+        tensor_queue::slot* const s {q.pop()};
+        graphs[s->index].run(pool);
+        ASSERT_EQ(s->tag, i);
+        ASSERT_FLOAT_EQ((*r)(0), i % 2 ? static_cast<float>(i) : 0.0f);
+        q.recycle(s);
+    }
+    producer.join();
+}
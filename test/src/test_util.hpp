@@ -0,0 +1,36 @@
+// Copyright Mario "Neo" Sieg 2024. All rights reserved. mario.sieg.64@gmail.com
+// Helpers shared by the test suites
+
+#pragma once
+
+#include <cstdint>
+#include <random>
+
+#include <blas.hpp>
+#include <tensor.hpp>
+
+namespace rtml::test {
+    // Fills t with deterministic uniform values in [-2, 2)
+    inline auto fill_random(const tensor<>& t, const std::uint32_t seed) -> void {
+        std::mt19937 prng {seed};
+        std::uniform_real_distribution<float> dist {-2.0f, 2.0f};
+        for (float& v : t.data()) v = dist(prng);
+    }
+
+    // Sets the small op limit (blas::set_small_op_limit) for its lifetime, the previous limit is restored even if a
+    // failed assertion returns early, so later tests do not run with a modified global limit
+    class small_op_limit_guard final {
+    public:
+        explicit small_op_limit_guard(const dim limit) noexcept : m_prev{blas::small_op_limit()} {
+            blas::set_small_op_limit(limit);
+        }
+        small_op_limit_guard(const small_op_limit_guard&) = delete;
+        small_op_limit_guard(small_op_limit_guard&&) = delete;
+        auto operator=(const small_op_limit_guard&) -> small_op_limit_guard& = delete;
+        auto operator=(small_op_limit_guard&&) -> small_op_limit_guard& = delete;
+        ~small_op_limit_guard() { blas::set_small_op_limit(m_prev); }
+
+    private:
+        const dim m_prev;
+    };
+}
@@ -0,0 +1,145 @@
+// Copyright Mario "Neo" Sieg 2024. All rights reserved. mario.sieg.64@gmail.com
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+
+#include <blas.hpp>
+#include <isolate.hpp>
+#include <tensor.hpp>
+#include <thread_pool.hpp>
+
+#include "test_util.hpp"
+
+using namespace rtml;
+
+TEST(thread_pool, runs_each_thread_index_once) {
+    thread_pool pool {4};
+    ASSERT_EQ(pool.num_threads(), 4);
+    for (int rep {}; rep < 64; ++rep) {
+        std::array<std::atomic_int, 4> hits {};
+        pool.parallel_for([&hits](const blas::compute_ctx& ctx) {
+            ASSERT_EQ(ctx.num_threads, 4);
+            hits[ctx.thread_idx].fetch_add(1, std::memory_order_relaxed);
+        });
+        for (const auto& h : hits)
+            ASSERT_EQ(h.load(), 1);
+    }
+}
+
+TEST(thread_pool, tensor_add_partitioned) {
+    auto ctx = isolate::create("test", isolate::compute_device::cpu, 0x1000<<4);
+    tensor<float>* a = ctx->new_tensor<float>({16, 7, 3});
+    tensor<float>* b = ctx->new_tensor<float>({16, 7, 3});
+    tensor<float>* c = ctx->new_tensor<float>({16, 7, 3});
+    a->splat(1.5f);
+    b->splat(2.0f);
+    c->splat_zero();
+    thread_pool pool {3};
+    pool.parallel_for([&](const blas::compute_ctx& cctx) {
+        blas::add(cctx, *c, *a, *b);
+    });
+    for (const float v : c->data())
+        ASSERT_FLOAT_EQ(v, 3.5f);
+}
+
+TEST(thread_pool, tensor_add_strided) {
+    auto ctx = isolate::create("test", isolate::compute_device::cpu, 0x1000<<4);
+    tensor<float>* a = ctx->new_tensor<float>({8, 8});
+    tensor<float>* b = ctx->new_tensor<float>({8, 8});
+    tensor<float>* c = ctx->new_tensor<float>({8, 8});
+    for (dim i {}; i < 64; ++i) (*b)(i) = static_cast<float>(i);
+    a->splat_zero();
+    tensor<float>* bt = b->transposed_clone();
+    ASSERT_TRUE(bt->is_transposed());
+    thread_pool pool {2};
+    pool.parallel_for([&](const blas::compute_ctx& cctx) {
+        blas::add(cctx, *c, *a, *bt);
+    });
+    for (dim i {}; i < 8; ++i)
+        for (dim j {}; j < 8; ++j)
+            ASSERT_FLOAT_EQ((*c)({i, j, 0, 0}), (*b)({j, i, 0, 0}));
+}
+
+TEST(thread_pool, row_schedules) { // Every schedule must cover every row exactly once, for dense, broadcast and strided operands
+    auto ctx = isolate::create("test", isolate::compute_device::cpu, 0x1000<<8);
+    tensor<float>* a = ctx->new_tensor<float>({24, 37, 5});
+    tensor<float>* b = ctx->new_tensor<float>({24, 37, 5});
+    tensor<float>* row = ctx->new_tensor<float>({24});
+    tensor<float>* sq = ctx->new_tensor<float>({24, 24});
+    tensor<float>* sqt = sq->transposed_clone();
+    tensor<float>* c = ctx->new_tensor<float>({24, 37, 5});
+    tensor<float>* cs = ctx->new_tensor<float>({24, 24});
+    for (dim i {}; i < a->elem_count(); ++i) {
+        (*a)(i) = static_cast<float>(i % 97) - 48.0f;
+        (*b)(i) = static_cast<float>(i % 13);
+    }
+    for (dim i {}; i < row->elem_count(); ++i) (*row)(i) = static_cast<float>(i);
+    for (dim i {}; i < sq->elem_count(); ++i) (*sq)(i) = static_cast<float>(i);
+    const test::small_op_limit_guard generic {0}; // Small ops would run on thread 0 only
+    for (const blas::row_schedule schedule : {blas::row_schedule::static_even, blas::row_schedule::guided, blas::row_schedule::adaptive}) {
+        for (const dim threads : {2, 5}) {
+            thread_pool pool {threads};
+            pool.set_schedule(schedule);
+            ASSERT_EQ(pool.schedule(), schedule);
+            for (int rep {}; rep < 4; ++rep) { // The row counter is reset for every dispatch
+                c->splat(-1.0f);
+                pool.parallel_for([&](const blas::compute_ctx& cctx) {
+                    if (cctx.thread_idx == 1) std::this_thread::sleep_for(std::chrono::microseconds{200}); // Late thread
+                    blas::add(cctx, *c, *a, *b);
+                });
+                for (dim i {}; i < c->elem_count(); ++i)
+                    ASSERT_FLOAT_EQ((*c)(i), (*a)(i) + (*b)(i));
+                pool.parallel_for([&](const blas::compute_ctx& cctx) { blas::mul(cctx, *c, *a, *row); });
+                for (dim i {}; i < c->elem_count(); ++i)
+                    ASSERT_FLOAT_EQ((*c)(i), (*a)(i) * static_cast<float>(i % 24));
+                pool.parallel_for([&](const blas::compute_ctx& cctx) { blas::relu(cctx, *c, *a); });
+                for (dim i {}; i < c->elem_count(); ++i)
+                    ASSERT_FLOAT_EQ((*c)(i), std::max((*a)(i), 0.0f));
+                pool.parallel_for([&](const blas::compute_ctx& cctx) { blas::sub(cctx, *cs, *sq, *sqt); });
+                for (dim i {}; i < 24; ++i)
+                    for (dim j {}; j < 24; ++j)
+                        ASSERT_FLOAT_EQ((*cs)({i, j, 0, 0}), (*sq)({i, j, 0, 0}) - (*sq)({j, i, 0, 0}));
+            }
+        }
+    }
+}
+
+TEST(thread_pool, row_schedules_multiple_ops_per_dispatch) { // Every row partitioned op of a dispatch claims its own rows
+    auto ctx = isolate::create("test", isolate::compute_device::cpu, 0x1000<<9);
+    tensor<float>* a = ctx->new_tensor<float>({24, 37, 5});
+    tensor<float>* b = ctx->new_tensor<float>({24, 37, 5});
+    tensor<float>* c = ctx->new_tensor<float>({24, 37, 5});
+    tensor<float>* d = ctx->new_tensor<float>({24, 37, 5});
+    tensor<float>* x = ctx->new_tensor<float>({8, 2000});
+    tensor<float>* e = ctx->new_tensor<float>({8, 2000});
+    for (dim i {}; i < a->elem_count(); ++i) {
+        (*a)(i) = static_cast<float>(i % 97) - 48.0f;
+        (*b)(i) = static_cast<float>(i % 13);
+    }
+    for (dim i {}; i < x->elem_count(); ++i) (*x)(i) = static_cast<float>(i % 31) - 15.0f;
+    const test::small_op_limit_guard generic {0};
+    for (const blas::row_schedule schedule : {blas::row_schedule::static_even, blas::row_schedule::guided, blas::row_schedule::adaptive}) {
+        for (const dim threads : {2, 5}) {
+            thread_pool pool {threads};
+            pool.set_schedule(schedule);
+            for (int rep {}; rep < 4; ++rep) {
+                c->splat(-1.0f);
+                d->splat(-1.0f);
+                e->splat(-1.0f);
+                pool.parallel_for([&](const blas::compute_ctx& cctx) { // Independent outputs, no barrier between the ops
+                    blas::add(cctx, *c, *a, *b);
+                    if (cctx.thread_idx == 1) std::this_thread::sleep_for(std::chrono::microseconds{200}); // Late thread
+                    blas::relu(cctx, *e, *x);
+                    blas::mul(cctx, *d, *a, *b);
+                });
+                for (dim i {}; i < c->elem_count(); ++i) {
+                    ASSERT_FLOAT_EQ((*c)(i), (*a)(i) + (*b)(i));
+                    ASSERT_FLOAT_EQ((*d)(i), (*a)(i) * (*b)(i));
+                }
+                for (dim i {}; i < e->elem_count(); ++i)
+                    ASSERT_FLOAT_EQ((*e)(i), std::max((*x)(i), 0.0f));
+            }
+        }
+    }
+}
@@ -0,0 +1,167 @@
+// Copyright Mario "Neo" Sieg 2024. All rights reserved. mario.sieg.64@gmail.com
+
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+#include <random>
+
+#include <blas.hpp>
+#include <isolate.hpp>
+#include <tensor.hpp>
+#include <thread_pool.hpp>
+#include <topology.hpp>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+using namespace rtml;
+
+// Fake sysfs of 2 packages x 2 cores x 2 SMT threads, numbered like Linux: CPUs 0-3 are the first threads of all cores,
+// 4-7 their siblings, every core has its own L2 and every package one L3
+class fake_sysfs final {
+public:
+    fake_sysfs() : m_root{std::filesystem::temp_directory_path() / ("rtml_sysfs_" + std::to_string(std::random_device{}()))} {
+        write("online", "0-7");
+        for (int cpu {}; cpu < 8; ++cpu) {
+            const int package {(cpu % 4) / 2};
+            const int core {cpu % 2};
+            const int first {cpu % 4};
+            const std::string dir {"cpu" + std::to_string(cpu)};
+            write(dir + "/topology/physical_package_id", std::to_string(package));
+            write(dir + "/topology/core_id", std::to_string(core));
+            write_cache(dir, 0, 1, "Data", fmt::format("{},{}", first, first + 4));
+            write_cache(dir, 1, 1, "Instruction", fmt::format("{},{}", first, first + 4));
+            write_cache(dir, 2, 2, "Unified", fmt::format("{},{}", first, first + 4));
+            write_cache(dir, 3, 3, "Unified", fmt::format("{}-{},{}-{}", package*2, package*2 + 1, package*2 + 4, package*2 + 5));
+        }
+    }
+    fake_sysfs(const fake_sysfs&) = delete;
+    fake_sysfs(fake_sysfs&&) = delete;
+    auto operator=(const fake_sysfs&) -> fake_sysfs& = delete;
+    auto operator=(fake_sysfs&&) -> fake_sysfs& = delete;
+    ~fake_sysfs() { std::filesystem::remove_all(m_root); }
+
+    [[nodiscard]] auto root() const noexcept -> const std::filesystem::path& { return m_root; }
+
+private:
+    auto write(const std::string& path, const std::string& content) const -> void {
+        std::filesystem::create_directories((m_root / path).parent_path());
+        std::ofstream {m_root / path} << content << '\n';
+    }
+    auto write_cache(const std::string& cpu, const int index, const int level, const char* type, const std::string& shared) const -> void {
+        const std::string dir {cpu + "/cache/index" + std::to_string(index)};
+        write(dir + "/level", std::to_string(level));
+        write(dir + "/type", type);
+        write(dir + "/shared_cpu_list", shared);
+    }
+
+    std::filesystem::path m_root;
+};
+
+TEST(topology, discover_sysfs) {
+    const fake_sysfs sysfs {};
+    const cpu_topology topo {cpu_topology::discover(sysfs.root())};
+    ASSERT_EQ(topo.cpus().size(), 8);
+    ASSERT_EQ(topo.num_packages(), 2);
+    ASSERT_EQ(topo.num_cores(), 4);
+    ASSERT_EQ(topo.num_l2_domains(), 4);
+    ASSERT_EQ(topo.num_l3_domains(), 2);
+    const cpu_info* const c5 {topo.find(5)};
+    ASSERT_NE(c5, nullptr);
+    ASSERT_EQ(c5->package, 0);
+    ASSERT_EQ(c5->smt, 1);
+    ASSERT_EQ(c5->core, topo.find(1)->core); // SMT sibling of CPU 1
+    ASSERT_EQ(c5->l3, topo.find(0)->l3);
+    ASSERT_NE(c5->l3, topo.find(2)->l3);
+    ASSERT_EQ(topo.find(8), nullptr);
+}
+
+TEST(topology, fallback) {
+    const cpu_topology topo {cpu_topology::discover("/nonexistent/rtml/sysfs")};
+    ASSERT_GE(topo.cpus().size(), 1);
+    ASSERT_EQ(topo.num_l3_domains(), 1);
+    ASSERT_GE(cpu_topology::system().cpus().size(), 1);
+}
+
+TEST(topology, placement_policies) {
+    const fake_sysfs sysfs {};
+    const cpu_topology topo {cpu_topology::discover(sysfs.root())};
+    ASSERT_EQ(topo.placement(pin_policy::compact, 8), (std::vector<int>{0, 4, 1, 5, 2, 6, 3, 7}));
+    ASSERT_EQ(topo.placement(pin_policy::scatter, 8), (std::vector<int>{0, 2, 1, 3, 4, 6, 5, 7}));
+    ASSERT_EQ(topo.placement(pin_policy::physical, 6), (std::vector<int>{0, 1, 2, 3, 0, 1})); // Wraps around
+    ASSERT_TRUE(topo.placement(pin_policy::none, 4).empty());
+}
+
+TEST(topology, pool_cache_domains) {
+    const fake_sysfs sysfs {};
+    const cpu_topology topo {cpu_topology::discover(sysfs.root())};
+    thread_pool pool {4};
+    ASSERT_EQ(pool.domain(3).count, 1); // Not pinned: one domain
+    const bool pinned {pool.pin(pin_policy::scatter, topo)}; // CPUs of the fake topology may not exist here
+    std::array<blas::cache_domain, 4> seen {};
+    pool.parallel_for([&](const blas::compute_ctx& ctx) { seen[ctx.thread_idx] = ctx.domain; });
+    // Scatter places threads 0, 2 on package 0 and 1, 3 on package 1
+    for (dim i {}; i < 4; ++i) {
+        if (!pinned) { // Threads which are not pinned are not grouped into domains
+            ASSERT_EQ(seen[i].count, 1);
+            ASSERT_EQ(seen[i].rank, i);
+            continue;
+        }
+        ASSERT_EQ(seen[i].count, 2);
+        ASSERT_EQ(seen[i].idx, i % 2);
+        ASSERT_EQ(seen[i].num_threads, 2);
+        ASSERT_EQ(seen[i].thread_idx, i / 2);
+        ASSERT_EQ(seen[i].rank, (i % 2)*2 + i/2);
+    }
+    pool.unpin();
+    ASSERT_EQ(pool.domain(3).count, 1);
+}
+
+TEST(topology, unpin_restores_affinity) {
+#ifdef __linux__
+    const fake_sysfs sysfs {};
+    const cpu_topology topo {cpu_topology::discover(sysfs.root())};
+    cpu_set_t before {};
+    ASSERT_EQ(sched_getaffinity(0, sizeof(before), &before), 0);
+    thread_pool pool {2};
+    (void)pool.pin(pin_policy::compact, topo);
+    (void)pool.pin(pin_policy::scatter, topo); // Repinning keeps the affinity saved by the first pin
+    (void)pool.pin(pin_policy::none, topo);
+    cpu_set_t after {};
+    ASSERT_EQ(sched_getaffinity(0, sizeof(after), &after), 0);
+    ASSERT_TRUE(CPU_EQUAL(&before, &after));
+#else
+    GTEST_SKIP() << "Thread affinity is only supported on Linux";
+#endif
+}
+
+TEST(topology, matmul_shared_b_per_domain) { // Packed GEMM with B panels packed by the threads of each domain together
+    const fake_sysfs sysfs {};
+    const cpu_topology topo {cpu_topology::discover(sysfs.root())};
+    auto ctx {isolate::create("topology_test", isolate::compute_device::cpu, 0x1000<<12)};
+    static constexpr dim m {70}, n {1100}, k {300}; // Several NC and KC blocks, partial MR and NR tiles
+    tensor<>* const x {ctx->new_tensor<float>({k, m})};
+    tensor<>* const y {ctx->new_tensor<float>({n, k})};
+    tensor<>* const r {ctx->new_tensor<float>({n, m})};
+    std::mt19937 prng {7};
+    std::uniform_real_distribution<float> dist {-1.0f, 1.0f};
+    for (tensor<>* const t : {x, y})
+        for (float& v : t->data()) v = dist(prng);
+    for (const pin_policy policy : {pin_policy::none, pin_policy::compact, pin_policy::scatter}) {
+        thread_pool pool {5};
+        (void)pool.pin(policy, topo);
+        r->splat(0.0f);
+        pool.parallel_for([&](const blas::compute_ctx& cctx) { blas::matmul(cctx, *r, *x, *y); });
+        for (dim i {}; i < m; i += 7) {
+            for (dim j {}; j < n; j += 13) {
+                double sum {};
+                for (dim p {}; p < k; ++p)
+                    sum += static_cast<double>((*x)({p, i, 0, 0})) * (*y)({j, p, 0, 0});
+                ASSERT_NEAR((*r)({j, i, 0, 0}), sum, 1e-3) << "policy " << static_cast<int>(policy);
+            }
+        }
+        pool.unpin();
+    }
+}
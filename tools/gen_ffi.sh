@@ -1,2 +1,2 @@
 pip3 install ctypesgen
-ctypesgen ../runtime/capi.h -o ../python/rtml_runtime.py -l rtml_runtime
\ No newline at end of file
+ctypesgen ../runtime/rtml_capi.h -o ../python/rtml_runtime.py -l rtml_runtime
\ No newline at end of file